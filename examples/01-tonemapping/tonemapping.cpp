@@ -3,6 +3,10 @@
 #include "imgui/imgui.h"
 #include <bx/rng.h>
 
+#include "bae/HandlePool.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
+
 namespace
 {
 
@@ -124,6 +128,7 @@ namespace
             init.resolution.width = m_width;
             init.resolution.height = m_height;
             init.resolution.reset = m_reset;
+            init.allocator = bae::getTrackingAllocator();
             bgfx::init(init);
 
             // Enable m_debug text.
@@ -153,18 +158,17 @@ namespace
             u_tonemap = bgfx::createUniform("u_tonemap", bgfx::UniformType::Vec4);
             u_histogramParams = bgfx::createUniform("u_params", bgfx::UniformType::Vec4);
 
-            m_skyProgram = loadProgram("vs_tonemapping_skybox", "fs_tonemapping_skybox");
-            m_meshProgram = loadProgram("vs_tonemapping_mesh", "fs_tonemapping_mesh");
-            m_histogramProgram = loadProgram("cs_lum_hist", NULL);
-            m_averagingProgram = loadProgram("cs_lum_avg", NULL);
-            m_tonemapPrograms[0] = loadProgram("vs_tonemapping_tonemap", "fs_reinhard");
-            m_tonemapPrograms[1] = loadProgram("vs_tonemapping_tonemap", "fs_lottes");
-            m_tonemapPrograms[2] = loadProgram("vs_tonemapping_tonemap", "fs_uchimura");
-            m_tonemapPrograms[3] = loadProgram("vs_tonemapping_tonemap", "fs_unreal");
+            m_skyProgram = m_programs.add(loadProgram("vs_tonemapping_skybox", "fs_tonemapping_skybox"), "Skybox");
+            m_meshProgram = m_programs.add(loadProgram("vs_tonemapping_mesh", "fs_tonemapping_mesh"), "Mesh");
+            m_histogramProgram = m_programs.add(loadProgram("cs_lum_hist", NULL), "Luminance Histogram");
+            m_averagingProgram = m_programs.add(loadProgram("cs_lum_avg", NULL), "Luminance Average");
+            m_tonemapPrograms[0] = m_programs.add(loadProgram("vs_tonemapping_tonemap", "fs_reinhard"), s_operatorNames[0]);
+            m_tonemapPrograms[1] = m_programs.add(loadProgram("vs_tonemapping_tonemap", "fs_lottes"), s_operatorNames[1]);
+            m_tonemapPrograms[2] = m_programs.add(loadProgram("vs_tonemapping_tonemap", "fs_uchimura"), s_operatorNames[2]);
+            m_tonemapPrograms[3] = m_programs.add(loadProgram("vs_tonemapping_tonemap", "fs_unreal"), s_operatorNames[3]);
 
             m_mesh = meshLoad("meshes/bunny.bin");
 
-            m_fbh.idx = bgfx::kInvalidHandle;
 
             m_histogramBuffer = bgfx::createDynamicIndexBuffer(256, BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
 
@@ -196,18 +200,8 @@ namespace
 
             meshUnload(m_mesh);
 
-            if (bgfx::isValid(m_fbh))
-            {
-                bgfx::destroy(m_fbh);
-            }
-
-            bgfx::destroy(m_meshProgram);
-            bgfx::destroy(m_skyProgram);
-            for (size_t i = 0; i < BX_COUNTOF(m_tonemapPrograms); ++i) {
-                bgfx::destroy(m_tonemapPrograms[i]);
-            }
-            bgfx::destroy(m_histogramProgram);
-            bgfx::destroy(m_averagingProgram);
+            m_frameBuffers.destroy();
+            m_programs.destroy();
 
             bgfx::destroy(m_envTexture);
 
@@ -236,7 +230,7 @@ namespace
                     return false;
                 }
 
-                if (!bgfx::isValid(m_fbh)
+                if (!m_frameBuffers.isValid(m_fbh)
                     || m_oldWidth != m_width
                     || m_oldHeight != m_height
                     || m_oldReset != m_reset)
@@ -248,10 +242,9 @@ namespace
 
                     uint32_t msaa = (m_reset & BGFX_RESET_MSAA_MASK) >> BGFX_RESET_MSAA_SHIFT;
 
-                    if (bgfx::isValid(m_fbh))
-                    {
-                        bgfx::destroy(m_fbh);
-                    }
+                    // Frames that are still in flight may be rendering into the old one, so it's only destroyed once
+                    // they're done
+                    m_frameBuffers.release(m_fbh, m_frame);
 
                     m_fbtextures[0] = bgfx::createTexture2D(
                         uint16_t(m_width)
@@ -279,7 +272,7 @@ namespace
                         , textureFlags
                     );
 
-                    m_fbh = bgfx::createFrameBuffer(BX_COUNTOF(m_fbtextures), m_fbtextures, true);
+                    m_fbh = m_frameBuffers.add(bgfx::createFrameBuffer(BX_COUNTOF(m_fbtextures), m_fbtextures, true), "HDR");
 
                     uint64_t lumAvgFlags = BGFX_TEXTURE_COMPUTE_WRITE | SAMPLER_POINT_CLAMP;
                     m_lumAvgTarget = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::R16F, lumAvgFlags);
@@ -347,12 +340,12 @@ namespace
                 bgfx::setViewName(hdrSkybox, "Skybox");
                 bgfx::setViewClear(hdrSkybox, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x303030ff, 1.0f, 0);
                 bgfx::setViewRect(hdrSkybox, 0, 0, bgfx::BackbufferRatio::Equal);
-                bgfx::setViewFrameBuffer(hdrSkybox, m_fbh);
+                bgfx::setViewFrameBuffer(hdrSkybox, m_frameBuffers.get(m_fbh));
 
                 bgfx::setViewName(hdrMesh, "Mesh");
                 bgfx::setViewClear(hdrMesh, BGFX_CLEAR_DISCARD_DEPTH | BGFX_CLEAR_DISCARD_STENCIL);
                 bgfx::setViewRect(hdrMesh, 0, 0, bgfx::BackbufferRatio::Equal);
-                bgfx::setViewFrameBuffer(hdrMesh, m_fbh);
+                bgfx::setViewFrameBuffer(hdrMesh, m_frameBuffers.get(m_fbh));
 
                 bgfx::setViewName(histogramPass, "Luminence Histogram");
 
@@ -393,13 +386,13 @@ namespace
                 bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
                 bgfx::setUniform(u_mtx, mtx);
                 screenSpaceQuad((float)m_width, (float)m_height, true);
-                bgfx::submit(hdrSkybox, m_skyProgram);
+                bgfx::submit(hdrSkybox, m_programs.get(m_skyProgram));
 
                 // Set view and projection matrix for view hdrMesh.
                 bgfx::setViewTransform(hdrMesh, view, proj);
                 // Render m_mesh into view hdrMesh.
                 bgfx::setTexture(0, s_texCube, m_envTexture);
-                meshSubmit(m_mesh, hdrMesh, m_meshProgram, NULL);
+                meshSubmit(m_mesh, hdrMesh, m_programs.get(m_meshProgram), NULL);
 
 
                 float minLogLum = -8.0f;
@@ -415,7 +408,7 @@ namespace
                 bgfx::setImage(0, m_fbtextures[0], 0, bgfx::Access::Read, bgfx::TextureFormat::RGBA16F);
                 bgfx::setBuffer(1, m_histogramBuffer, bgfx::Access::Write);
                 bgfx::setUniform(u_histogramParams, histogramParams);
-                bgfx::dispatch(histogramPass, m_histogramProgram, groupsX, groupsY, 1);
+                bgfx::dispatch(histogramPass, m_programs.get(m_histogramProgram), groupsX, groupsY, 1);
 
                 float tau = 1.1f;
                 float timeCoeff = bx::clamp<float>(1.0f - bx::exp(-frameTime * tau), 0.0, 1.0);
@@ -428,7 +421,7 @@ namespace
                 bgfx::setImage(0, m_lumAvgTarget, 0, bgfx::Access::ReadWrite, bgfx::TextureFormat::R16F);
                 bgfx::setBuffer(1, m_histogramBuffer, bgfx::Access::ReadWrite);
                 bgfx::setUniform(u_histogramParams, avgParams);
-                bgfx::dispatch(averagingPass, m_averagingProgram, 1, 1, 1);
+                bgfx::dispatch(averagingPass, m_programs.get(m_averagingProgram), 1, 1, 1);
 
                 float tonemap[4] = { bx::square(m_white), 0.0f, m_threshold, m_time };
                 bgfx::setTexture(0, s_texColor, m_fbtextures[0]);
@@ -436,9 +429,12 @@ namespace
                 bgfx::setUniform(u_tonemap, tonemap);
                 bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
                 screenSpaceQuad((float)m_width, (float)m_height, m_caps->originBottomLeft);
-                bgfx::submit(toneMapPass, m_tonemapPrograms[m_currentOperator]);
+                bgfx::submit(toneMapPass, m_programs.get(m_tonemapPrograms[m_currentOperator]));
 
-                bgfx::frame();
+                m_frame = bgfx::frame();
+                bae::getTrackingAllocator()->endFrame();
+                bae::getFrameArena().endFrame();
+                m_frameBuffers.update(m_frame);
 
                 m_firstFrame = false;
 
@@ -450,11 +446,12 @@ namespace
 
         entry::MouseState m_mouseState;
 
-        bgfx::ProgramHandle m_skyProgram;
-        bgfx::ProgramHandle m_meshProgram;
-        bgfx::ProgramHandle m_tonemapPrograms[4];
-        bgfx::ProgramHandle m_histogramProgram;
-        bgfx::ProgramHandle m_averagingProgram;
+        bae::HandlePool<bgfx::ProgramHandle> m_programs;
+        bae::PoolHandle m_skyProgram;
+        bae::PoolHandle m_meshProgram;
+        bae::PoolHandle m_tonemapPrograms[4];
+        bae::PoolHandle m_histogramProgram;
+        bae::PoolHandle m_averagingProgram;
 
         bgfx::TextureHandle m_envTexture;
         bgfx::UniformHandle s_texCube;
@@ -470,7 +467,9 @@ namespace
 
         bgfx::TextureHandle m_fbtextures[2];
         bgfx::TextureHandle m_lumAvgTarget;
-        bgfx::FrameBufferHandle m_fbh;
+        bae::HandlePool<bgfx::FrameBufferHandle> m_frameBuffers;
+        bae::PoolHandle m_fbh;
+        uint32_t m_frame = 0;
 
         bx::RngMwc m_rng;
 
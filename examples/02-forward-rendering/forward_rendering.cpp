@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <array>
 #include <bx/rng.h>
 #include "bgfx_utils.h"
@@ -11,9 +12,17 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "camera.h"
+#include "bae/GpuCulling.h"
+#include "bae/OcclusionQueries.h"
 #include "bae/PhysicallyBasedScene.h"
+#include "bae/PointShadows.h"
+#include "bae/StaticBatching.h"
+#include "bae/TextureArrays.h"
+#include "bae/TextureCache.h"
 #include "bae/Tonemapping.h"
 #include "bae/gltf_model_loading.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
 
 namespace example
 {
@@ -31,6 +40,16 @@ static std::vector<glm::vec3> LIGHT_COLORS = {
     {0.1f, 1.0f, 1.0f},
 };
 
+// Has to match MAX_SHADOWED_LIGHTS in fs_pbr.sc
+static constexpr uint32_t MAX_SHADOWED_LIGHTS = 8;
+// One view for each face we can redraw in a frame
+static constexpr uint32_t MAX_POINT_SHADOW_FACE_UPDATES = 48;
+static constexpr uint16_t POINT_SHADOW_ATLAS_SIZE = 4096;
+static const uint16_t POINT_SHADOW_FACE_SIZES[] = {128, 256, 512, 1024};
+static const char *POINT_SHADOW_FACE_SIZE_NAMES[] = {"128", "256", "512", "1024"};
+
+static const char *OCCLUSION_MODE_NAMES[] = {"Disabled", "Skip Occluded", "Conditional Rendering"};
+
 std::vector<glm::vec3> sampleUnitCylinderUniformly(size_t N)
 {
     std::default_random_engine generator(10);
@@ -57,7 +76,14 @@ public:
     std::vector<glm::vec4> positionRadiusData;
     std::vector<glm::vec4> colorIntensityData;
 
-    // params is bacasically just used to store params.x = lightCount
+    // What we actually upload, with the shadowed lights moved to the front so that
+    // they line up with the point shadow uniforms
+    uint16_t numShadowedLights = 0;
+    std::vector<glm::vec4> orderedPositionRadiusData;
+    std::vector<glm::vec4> orderedColorIntensityData;
+    std::vector<uint8_t> isShadowed;
+
+    // params is bacasically just used to store params.x = lightCount and params.y = shadowed light count
     bgfx::UniformHandle u_params = BGFX_INVALID_HANDLE;
     bgfx::UniformHandle u_positionRadius = BGFX_INVALID_HANDLE;
     bgfx::UniformHandle u_colorIntensity = BGFX_INVALID_HANDLE;
@@ -74,14 +100,42 @@ public:
         initialPositions = sampleUnitCylinderUniformly(maxNumLights);
         positionRadiusData.resize(maxNumLights);
         colorIntensityData.resize(maxNumLights);
+        orderedPositionRadiusData.resize(maxNumLights);
+        orderedColorIntensityData.resize(maxNumLights);
+        isShadowed.resize(maxNumLights);
+    }
+
+    void orderShadowedFirst(const uint32_t *shadowedLights, const uint16_t shadowedCount)
+    {
+        std::fill(isShadowed.begin(), isShadowed.end(), uint8_t(0));
+        numShadowedLights = shadowedCount;
+
+        uint16_t orderedIdx = 0;
+        for (uint16_t i = 0; i < shadowedCount; ++i)
+        {
+            const uint32_t lightIdx = shadowedLights[i];
+            isShadowed[lightIdx] = 1;
+            orderedPositionRadiusData[orderedIdx] = positionRadiusData[lightIdx];
+            orderedColorIntensityData[orderedIdx] = colorIntensityData[lightIdx];
+            ++orderedIdx;
+        }
+        for (uint16_t i = 0; i < numActiveLights; ++i)
+        {
+            if (!isShadowed[i])
+            {
+                orderedPositionRadiusData[orderedIdx] = positionRadiusData[i];
+                orderedColorIntensityData[orderedIdx] = colorIntensityData[i];
+                ++orderedIdx;
+            }
+        }
     }
 
     void setUniforms() const
     {
-        uint32_t paramsArr[4]{uint32_t(numActiveLights), 0, 0, 0};
+        uint32_t paramsArr[4]{uint32_t(numActiveLights), uint32_t(numShadowedLights), 0, 0};
         bgfx::setUniform(u_params, paramsArr);
-        bgfx::setUniform(u_positionRadius, positionRadiusData.data(), maxNumLights);
-        bgfx::setUniform(u_colorIntensity, colorIntensityData.data(), maxNumLights);
+        bgfx::setUniform(u_positionRadius, orderedPositionRadiusData.data(), maxNumLights);
+        bgfx::setUniform(u_colorIntensity, orderedColorIntensityData.data(), maxNumLights);
     };
 
     void destroy()
@@ -102,6 +156,7 @@ struct PBRShaderUniforms
     bgfx::UniformHandle u_factors = BGFX_INVALID_HANDLE;
     bgfx::UniformHandle u_cameraPos = BGFX_INVALID_HANDLE;
     bgfx::UniformHandle u_normalTransform = BGFX_INVALID_HANDLE;
+    bgfx::UniformHandle u_textureLayers = BGFX_INVALID_HANDLE;
 };
 
 void init(PBRShaderUniforms &uniforms)
@@ -116,6 +171,8 @@ void init(PBRShaderUniforms &uniforms)
     uniforms.u_factors = bgfx::createUniform("u_factors", bgfx::UniformType::Vec4, 3);
     uniforms.u_cameraPos = bgfx::createUniform("u_cameraPos", bgfx::UniformType::Vec4);
     uniforms.u_normalTransform = bgfx::createUniform("u_normalTransform", bgfx::UniformType::Mat4);
+    // Layer of each material texture, only used when they're packed into texture arrays
+    uniforms.u_textureLayers = bgfx::createUniform("u_textureLayers", bgfx::UniformType::Vec4, 2);
 }
 
 void destroy(PBRShaderUniforms &uniforms)
@@ -128,18 +185,20 @@ void destroy(PBRShaderUniforms &uniforms)
     bgfx::destroy(uniforms.u_factors);
     bgfx::destroy(uniforms.u_cameraPos);
     bgfx::destroy(uniforms.u_normalTransform);
+    bgfx::destroy(uniforms.u_textureLayers);
 }
 
+// Textures are bound separately, see bindMaterialTextures
 void bindMaterialUniforms(const PBRShaderUniforms &uniforms, const bae::PBRMaterial &material, const glm::mat4 &transform)
 {
-    bgfx::setTexture(0, uniforms.s_baseColor, material.baseColorTexture);
-    bgfx::setTexture(1, uniforms.s_normal, material.normalTexture);
-    bgfx::setTexture(2, uniforms.s_metallicRoughness, material.metallicRoughnessTexture);
-    bgfx::setTexture(3, uniforms.s_emissive, material.emissiveTexture);
-    bgfx::setTexture(4, uniforms.s_occlusion, material.occlusionTexture);
     // We are going to pack our baseColorFactor, emissiveFactor, roughnessFactor
     // and metallicFactor into this uniform
     bgfx::setUniform(uniforms.u_factors, &material.baseColorFactor, 3);
+    const glm::vec4 textureLayers[] = {
+        {float(material.baseColorLayer), float(material.normalLayer), float(material.metallicRoughnessLayer), float(material.emissiveLayer)},
+        {float(material.occlusionLayer), 0.0f, 0.0f, 0.0f},
+    };
+    bgfx::setUniform(uniforms.u_textureLayers, textureLayers, 2);
 
     // Transforms
     bgfx::setTransform(glm::value_ptr(transform));
@@ -152,6 +211,80 @@ void bindSceneUniforms(const PBRShaderUniforms &uniforms, const bx::Vec3 cameraP
     bgfx::setUniform(uniforms.u_cameraPos, &cameraPos);
 }
 
+// Sponza along with its static batches, with either a texture per material slot or textures packed into arrays
+struct SceneVariant
+{
+    bae::Model model;
+    bae::StaticBatches opaqueBatches;
+    bae::StaticBatches maskedBatches;
+};
+
+void init(SceneVariant &scene, bae::TextureArrays *textureArrays)
+{
+    // Lets load all the meshes, keeping their vertices around until we've batched them
+    scene.model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf", true, nullptr, textureArrays);
+
+    // Nothing in Sponza moves, so every mesh can be merged with the others that share its material. Transparent
+    // meshes are left alone, since merging them would change the order they're blended in.
+    scene.opaqueBatches = bae::buildStaticBatches(scene.model.opaqueMeshes);
+    scene.maskedBatches = bae::buildStaticBatches(scene.model.maskedMeshes);
+    scene.model.opaqueMeshes.meshData.clear();
+    scene.model.maskedMeshes.meshData.clear();
+    scene.model.transparentMeshes.meshData.clear();
+}
+
+void destroy(SceneVariant &scene)
+{
+    bae::destroy(scene.opaqueBatches);
+    bae::destroy(scene.maskedBatches);
+    bae::destroy(scene.model);
+}
+
+struct PointShadowUniforms
+{
+    // x: relative depth bias, yz: texel size of the atlas
+    bgfx::UniformHandle u_params = BGFX_INVALID_HANDLE;
+    // xyz: where the light was when its faces were drawn
+    bgfx::UniformHandle u_origins = BGFX_INVALID_HANDLE;
+    // x: proj[10], y: proj[14] of the light's face projection, for linearizing the depth we sample
+    bgfx::UniformHandle u_depthParams = BGFX_INVALID_HANDLE;
+    // UV scale and offset of each light's faces in the atlas
+    bgfx::UniformHandle u_regions = BGFX_INVALID_HANDLE;
+    bgfx::UniformHandle s_atlas = BGFX_INVALID_HANDLE;
+
+    glm::vec4 params = {0.02f, 0.0f, 0.0f, 0.0f};
+    glm::vec4 origins[MAX_SHADOWED_LIGHTS];
+    glm::vec4 depthParams[MAX_SHADOWED_LIGHTS];
+    glm::vec4 regions[bae::POINT_SHADOW_FACES * MAX_SHADOWED_LIGHTS];
+};
+
+void init(PointShadowUniforms &uniforms)
+{
+    uniforms.u_params = bgfx::createUniform("pointShadow_params", bgfx::UniformType::Vec4);
+    uniforms.u_origins = bgfx::createUniform("pointShadow_origins", bgfx::UniformType::Vec4, MAX_SHADOWED_LIGHTS);
+    uniforms.u_depthParams = bgfx::createUniform("pointShadow_depthParams", bgfx::UniformType::Vec4, MAX_SHADOWED_LIGHTS);
+    uniforms.u_regions = bgfx::createUniform("pointShadow_regions", bgfx::UniformType::Vec4, bae::POINT_SHADOW_FACES * MAX_SHADOWED_LIGHTS);
+    uniforms.s_atlas = bgfx::createUniform("s_pointShadowAtlas", bgfx::UniformType::Sampler);
+}
+
+void destroy(PointShadowUniforms &uniforms)
+{
+    bgfx::destroy(uniforms.u_params);
+    bgfx::destroy(uniforms.u_origins);
+    bgfx::destroy(uniforms.u_depthParams);
+    bgfx::destroy(uniforms.u_regions);
+    bgfx::destroy(uniforms.s_atlas);
+}
+
+void bindPointShadowUniforms(const PointShadowUniforms &uniforms, const bgfx::TextureHandle atlas)
+{
+    bgfx::setUniform(uniforms.u_params, &uniforms.params);
+    bgfx::setUniform(uniforms.u_origins, uniforms.origins, MAX_SHADOWED_LIGHTS);
+    bgfx::setUniform(uniforms.u_depthParams, uniforms.depthParams, MAX_SHADOWED_LIGHTS);
+    bgfx::setUniform(uniforms.u_regions, uniforms.regions, bae::POINT_SHADOW_FACES * MAX_SHADOWED_LIGHTS);
+    bgfx::setTexture(5, uniforms.s_atlas, atlas, SAMPLER_POINT_CLAMP);
+}
+
 class ExampleForward : public entry::AppI
 {
 public:
@@ -172,6 +305,7 @@ public:
         initInfo.resolution.width = m_width;
         initInfo.resolution.height = m_height;
         initInfo.resolution.reset = m_reset;
+        initInfo.allocator = bae::getTrackingAllocator();
         bgfx::init(initInfo);
 
         // Enable m_debug text.
@@ -188,11 +322,50 @@ public:
         m_prepassProgram = loadProgram("vs_z_prepass", "fs_z_prepass");
         m_pbrShader = loadProgram("vs_pbr", "fs_pbr");
         m_pbrShaderWithMasking = loadProgram("vs_pbr", "fs_pbr_masked");
+        m_textureArraysSupported = bae::TextureArrays::isSupported();
+        if (m_textureArraysSupported)
+        {
+            m_pbrShaderTextureArrays = loadProgram("vs_pbr", "fs_pbr_texture_arrays");
+            m_pbrShaderWithMaskingTextureArrays = loadProgram("vs_pbr", "fs_pbr_masked_texture_arrays");
+        }
 
-        // Lets load all the meshes
-        m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf");
+        // Both variants are loaded up front, so switching between them doesn't stall a frame on reloading Sponza
+        example::init(m_scenes[0], nullptr);
+        if (m_textureArraysSupported)
+        {
+            example::init(m_scenes[1], &m_textureArrays);
+        }
 
         example::init(m_uniforms);
+        example::init(m_pointShadowUniforms);
+
+        // Our meshes never move, but the shadows only need to know where they are. The loader
+        // transforms the corners of each box, which can leave min and max swapped.
+        for (const bae::AABB &box : getScene().model.opaqueMeshes.boundingBoxes)
+        {
+            m_shadowCasterBounds.push_back({glm::min(box.min, box.max), glm::max(box.min, box.max)});
+        }
+
+        bgfx::Attachment attachment;
+        m_pointShadowAtlasTexture = bgfx::createTexture2D(POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE, false, 1, bgfx::TextureFormat::D32);
+        bgfx::setName(m_pointShadowAtlasTexture, "Point Shadow Atlas");
+        attachment.init(m_pointShadowAtlasTexture, bgfx::Access::Write);
+        m_pointShadowFramebuffer = bgfx::createFrameBuffer(1, &attachment, true);
+        m_pointShadowUniforms.params.y = 1.0f / float(POINT_SHADOW_ATLAS_SIZE);
+        m_pointShadowUniforms.params.z = 1.0f / float(POINT_SHADOW_ATLAS_SIZE);
+        m_pointShadows.init(POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE, m_pointShadowParams, m_caps->homogeneousDepth);
+        m_oldPointShadowParams = m_pointShadowParams;
+
+        m_occlusionQueriesSupported = !!(m_caps->supported & BGFX_CAPS_OCCLUSION_QUERY);
+        if (m_occlusionQueriesSupported)
+        {
+            const bae::MeshGroup &occluders = getScene().model.opaqueMeshes;
+            m_occlusionQueries.init(occluders.boundingBoxes.data(), occluders.boundingBoxes.size(), bae::OcclusionQueryParams{});
+        }
+        else
+        {
+            m_occlusionMode = bae::OcclusionMode::DISABLED;
+        }
 
         m_lightSet.init("pointLight");
         m_totalBrightness = 100.0f;
@@ -241,12 +414,26 @@ public:
         m_toneMapPass.destroy();
 
         // Cleanup.
+        bgfx::destroy(m_pointShadowFramebuffer);
+        m_occlusionQueries.destroy();
+        example::destroy(m_scenes[0]);
+        if (m_textureArraysSupported)
+        {
+            example::destroy(m_scenes[1]);
+        }
+        m_textureArrays.destroy();
+        bae::getTextureCache().destroy();
         m_lightSet.destroy();
         example::destroy(m_uniforms);
-        bae::destroy(m_model);
+        example::destroy(m_pointShadowUniforms);
         bgfx::destroy(m_prepassProgram);
         bgfx::destroy(m_pbrShader);
         bgfx::destroy(m_pbrShaderWithMasking);
+        if (m_textureArraysSupported)
+        {
+            bgfx::destroy(m_pbrShaderTextureArrays);
+            bgfx::destroy(m_pbrShaderWithMaskingTextureArrays);
+        }
 
         cameraDestroy();
 
@@ -257,30 +444,199 @@ public:
         return 0;
     }
 
+    // Geometry is the same in both variants, so anything that only depends on the meshes can use either one
+    const SceneVariant &getScene() const
+    {
+        return m_scenes[m_useTextureArrays ? 1 : 0];
+    }
+
+    // Only sets the material textures that differ from the previous draw's. Without texture arrays that's still
+    // every texture on every draw, since bgfx forgets bindings after each submit, but the GPU only sees the ones
+    // that changed. With them, most draws keep the same arrays and only change the layers in u_textureLayers,
+    // so arrays are bound once per view and draws are submitted with preserveState to hang on to them.
+    void bindMaterialTextures(const bae::PBRMaterial &material, const bool preserveBindings)
+    {
+        const bgfx::TextureHandle textures[] = {
+            material.baseColorTexture,
+            material.normalTexture,
+            material.metallicRoughnessTexture,
+            material.emissiveTexture,
+            material.occlusionTexture,
+        };
+        const bgfx::UniformHandle samplers[] = {
+            m_uniforms.s_baseColor,
+            m_uniforms.s_normal,
+            m_uniforms.s_metallicRoughness,
+            m_uniforms.s_emissive,
+            m_uniforms.s_occlusion,
+        };
+        for (uint8_t i = 0; i < BX_COUNTOF(textures); ++i)
+        {
+            const bool changed = textures[i].idx != m_boundTextures[i].idx;
+            if (changed)
+            {
+                ++m_textureChangeCount;
+                m_boundTextures[i] = textures[i];
+            }
+            if (changed || !preserveBindings)
+            {
+                bgfx::setTexture(i, samplers[i], textures[i]);
+                ++m_setTextureCount;
+            }
+        }
+    }
+
+    // Forgets what's bound, at the start of each view
+    void resetMaterialTextures()
+    {
+        for (bgfx::TextureHandle &texture : m_boundTextures)
+        {
+            texture = BGFX_INVALID_HANDLE;
+        }
+    }
+
     void renderMeshes(
         const bae::MeshGroup &meshes,
         const bx::Vec3 &cameraPos,
         const uint64_t state,
         const bgfx::ProgramHandle program,
-        const bgfx::ViewId viewId)
+        const bgfx::ViewId viewId,
+        const bae::OcclusionQueries *occlusion = nullptr,
+        const bool conditional = false)
     {
+        // Preserved state would also keep an occlusion condition around for the draws after it
+        const bool preserveBindings = m_useTextureArrays && !(conditional && occlusion != nullptr);
+        resetMaterialTextures();
+
         // Render all our opaque meshes
         for (size_t i = 0; i < meshes.meshes.size(); ++i)
         {
+            if (occlusion != nullptr && !occlusion->prepareDraw(i, conditional))
+            {
+                continue;
+            }
+
             const auto &mesh = meshes.meshes[i];
             const auto &transform = meshes.transforms[i];
             const auto &material = meshes.materials[i];
 
             bgfx::setState(state);
+            bindMaterialTextures(material, preserveBindings);
             bindMaterialUniforms(m_uniforms, material, transform);
             bindSceneUniforms(m_uniforms, cameraPos);
+            bindPointShadowUniforms(m_pointShadowUniforms, m_pointShadowAtlasTexture);
             m_lightSet.setUniforms();
             mesh.setBuffers();
 
-            bgfx::submit(viewId, program);
+            bgfx::submit(viewId, program, 0, preserveBindings);
+            ++m_meshDrawCount;
+        }
+        if (preserveBindings)
+        {
+            bgfx::discard();
         }
     }
 
+    // Each batch is culled one source mesh at a time, and whatever is left over is drawn with as few submits as
+    // the visible ranges allow
+    void renderStaticBatches(
+        const bae::StaticBatches &batches,
+        const glm::vec4 frustumPlanes[6],
+        const bx::Vec3 &cameraPos,
+        const uint64_t state,
+        const bgfx::ProgramHandle program,
+        const bgfx::ViewId viewId)
+    {
+        const bool preserveBindings = m_useTextureArrays;
+        resetMaterialTextures();
+
+        for (size_t i = 0; i < batches.group.meshes.size(); ++i)
+        {
+            m_batchDraws.clear();
+            bae::cullStaticBatch(batches, i, frustumPlanes, m_batchDraws);
+
+            const auto &mesh = batches.group.meshes[i];
+            const auto &transform = batches.group.transforms[i];
+            const auto &material = batches.group.materials[i];
+
+            for (const bae::StaticBatchDraw &draw : m_batchDraws)
+            {
+                bgfx::setState(state);
+                bindMaterialTextures(material, preserveBindings);
+                bindMaterialUniforms(m_uniforms, material, transform);
+                bindSceneUniforms(m_uniforms, cameraPos);
+                bindPointShadowUniforms(m_pointShadowUniforms, m_pointShadowAtlasTexture);
+                m_lightSet.setUniforms();
+                for (uint8_t j = 0; j < mesh.numVertexHandles; ++j)
+                {
+                    bgfx::setVertexBuffer(j, mesh.vertexHandles[j]);
+                }
+                bgfx::setIndexBuffer(mesh.indexHandle, draw.firstIndex, draw.indexCount);
+
+                bgfx::submit(viewId, program, 0, preserveBindings);
+                ++m_meshDrawCount;
+            }
+        }
+        if (preserveBindings)
+        {
+            bgfx::discard();
+        }
+    }
+
+    // Redraws the faces the point shadow atlas asked for, one view per face, and fills in the uniforms
+    // for every light that has shadows this frame
+    void renderPointShadows(const bgfx::ViewId firstView)
+    {
+        const uint64_t stateShadow = 0 | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_CULL_CCW;
+        const bae::MeshGroup &casters = getScene().model.opaqueMeshes;
+        const std::vector<bae::PointShadowLight> &slots = m_pointShadows.getSlots();
+        const std::vector<uint32_t> &faceCasters = m_pointShadows.getFaceCasters();
+        const std::vector<bae::PointShadowFaceUpdate> &faceUpdates = m_pointShadows.getFaceUpdates();
+
+        for (size_t i = 0; i < faceUpdates.size(); ++i)
+        {
+            const bae::PointShadowFaceUpdate &faceUpdate = faceUpdates[i];
+            const bae::ShadowAtlasRegion &region = slots[faceUpdate.slot].faces[faceUpdate.face].region;
+            const glm::mat4 faceView = m_pointShadows.getFaceView(faceUpdate.slot, faceUpdate.face);
+            const glm::mat4 faceProj = m_pointShadows.getFaceProjection(faceUpdate.slot);
+
+            const bgfx::ViewId view = bgfx::ViewId(firstView + i);
+            bgfx::setViewName(view, "Point Shadow Face");
+            bgfx::setViewFrameBuffer(view, m_pointShadowFramebuffer);
+            bgfx::setViewRect(view, region.x, region.y, region.size, region.size);
+            bgfx::setViewClear(view, BGFX_CLEAR_DEPTH, 0, 1.0f, 0);
+            bgfx::setViewTransform(view, glm::value_ptr(faceView), glm::value_ptr(faceProj));
+            bgfx::touch(view);
+
+            for (uint32_t j = 0; j < faceUpdate.casterCount; ++j)
+            {
+                const uint32_t casterIdx = faceCasters[faceUpdate.casterBegin + j];
+                bgfx::setState(stateShadow);
+                bgfx::setTransform(glm::value_ptr(casters.transforms[casterIdx]));
+                casters.meshes[casterIdx].setBuffers();
+                bgfx::submit(view, m_prepassProgram);
+            }
+        }
+
+        const std::vector<uint32_t> &shadowedSlots = m_pointShadows.getShadowedSlots();
+        const uint32_t shadowedCount = std::min<uint32_t>(uint32_t(shadowedSlots.size()), MAX_SHADOWED_LIGHTS);
+        uint32_t shadowedLights[MAX_SHADOWED_LIGHTS];
+        for (uint32_t i = 0; i < shadowedCount; ++i)
+        {
+            const bae::PointShadowLight &slot = slots[shadowedSlots[i]];
+            const glm::mat4 faceProj = m_pointShadows.getFaceProjection(shadowedSlots[i]);
+            shadowedLights[i] = slot.lightIdx;
+            m_pointShadowUniforms.origins[i] = slot.positionRadius;
+            m_pointShadowUniforms.depthParams[i] = glm::vec4{faceProj[2][2], faceProj[3][2], 0.0f, 0.0f};
+            for (uint32_t face = 0; face < bae::POINT_SHADOW_FACES; ++face)
+            {
+                m_pointShadowUniforms.regions[bae::POINT_SHADOW_FACES * i + face] = m_pointShadows.getAtlas().getUVScaleOffset(
+                    slot.faces[face].region, m_caps->originBottomLeft);
+            }
+        }
+        m_lightSet.orderShadowedFirst(shadowedLights, uint16_t(shadowedCount));
+    }
+
     bool update() override
     {
         if (entry::processEvents(m_width, m_height, m_debug, m_reset, &m_mouseState))
@@ -301,6 +657,9 @@ public:
             m_oldHeight = m_height;
             m_oldReset = m_reset;
 
+            // The shadow atlas might not survive a reset, so draw every face again
+            m_pointShadows.reset();
+
             uint32_t msaa = (m_reset & BGFX_RESET_MSAA_MASK) >> BGFX_RESET_MSAA_SHIFT;
 
             if (bgfx::isValid(m_pbrFramebuffer))
@@ -348,24 +707,126 @@ public:
         ImGui::SliderInt("Num lights", &lightCount, 1, m_lightSet.maxNumLights);
         ImGui::DragFloat("Total Brightness", &m_totalBrightness, 0.5f, 0.0f, 250.0f);
         ImGui::Checkbox("Z-Prepass Enabled", &m_zPrepassEnabled);
+        ImGui::Checkbox("Animate Lights", &m_animateLights);
+
+        ImGui::Separator();
+        const SceneVariant &scene = getScene();
+        ImGui::Checkbox("Static Batching", &m_staticBatching);
+        ImGui::Text("Opaque: %u meshes into %u batches", scene.opaqueBatches.stats.sourceMeshes, scene.opaqueBatches.stats.batches);
+        ImGui::Text("Masked: %u meshes into %u batches", scene.maskedBatches.stats.sourceMeshes, scene.maskedBatches.stats.batches);
+        ImGui::Text("Batching took %.2f ms at load", scene.opaqueBatches.stats.buildMs + scene.maskedBatches.stats.buildMs);
+        ImGui::Text("Mesh Draws: %u", m_meshDrawCount);
+
+        ImGui::Separator();
+        if (m_textureArraysSupported)
+        {
+            ImGui::Checkbox("Texture Arrays", &m_useTextureArrays);
+            if (m_useTextureArrays)
+            {
+                const bae::TextureArraysStats &arrayStats = m_textureArrays.getStats();
+                ImGui::Text("%u textures in %u arrays (up to %u layers)", arrayStats.textures, arrayStats.arrays, arrayStats.largestArray);
+                ImGui::Text("%u adds shared an existing layer", arrayStats.hits);
+            }
+        }
+        else
+        {
+            ImGui::Text("Texture arrays not supported.");
+        }
+        ImGui::Text("Texture Changes: %u of %u binds", m_textureChangeCount, 5 * m_meshDrawCount);
+        ImGui::Text("setTexture Calls: %u", m_setTextureCount);
+        const bae::TextureCacheStats &cacheStats = bae::getTextureCache().getStats();
+        ImGui::Text("Texture Cache: %u textures, %u references", cacheStats.textures, cacheStats.references);
+
+        ImGui::Separator();
+        if (m_staticBatching)
+        {
+            // Queries are per source mesh, which no longer have draws of their own
+            ImGui::Text("Occlusion queries need unbatched meshes.");
+        }
+        else if (m_occlusionQueriesSupported)
+        {
+            int occlusionMode = int(m_occlusionMode);
+            ImGui::Combo("Occlusion Queries", &occlusionMode, OCCLUSION_MODE_NAMES, BX_COUNTOF(OCCLUSION_MODE_NAMES));
+            m_occlusionMode = bae::OcclusionMode(occlusionMode);
+            if (m_occlusionMode != bae::OcclusionMode::DISABLED)
+            {
+                const bae::OcclusionQueryStats &stats = m_occlusionQueries.getStats();
+                ImGui::Text("Queries: %u of %u meshes (%u pending)", stats.queries, stats.testedMeshes, stats.pendingResults);
+                ImGui::Text("Occluded: %u", stats.occludedMeshes);
+                ImGui::Text("Draws Skipped: %u, Conditional: %u", stats.skippedDraws, stats.conditionalDraws);
+                ImGui::Text("Popping Errors: %u", stats.poppingErrors);
+            }
+        }
+        else
+        {
+            ImGui::Text("Occlusion queries not supported.");
+        }
+
+        ImGui::Separator();
+        ImGui::Checkbox("Point Shadows", &m_pointShadowsEnabled);
+        if (m_pointShadowsEnabled)
+        {
+            int maxShadowedLights = int(m_pointShadowParams.maxShadowedLights);
+            ImGui::SliderInt("Shadowed Lights", &maxShadowedLights, 1, MAX_SHADOWED_LIGHTS);
+            m_pointShadowParams.maxShadowedLights = uint32_t(maxShadowedLights);
+
+            int maxFaceSize = 0;
+            while (maxFaceSize + 1 < int(BX_COUNTOF(POINT_SHADOW_FACE_SIZES)) && POINT_SHADOW_FACE_SIZES[maxFaceSize] < m_pointShadowParams.maxFaceSize)
+            {
+                ++maxFaceSize;
+            }
+            ImGui::Combo("Max Face Size", &maxFaceSize, POINT_SHADOW_FACE_SIZE_NAMES, BX_COUNTOF(POINT_SHADOW_FACE_SIZE_NAMES));
+            m_pointShadowParams.maxFaceSize = POINT_SHADOW_FACE_SIZES[maxFaceSize];
+
+            int maxFaceUpdates = int(m_pointShadowParams.maxFaceUpdates);
+            ImGui::SliderInt("Face Updates / Frame", &maxFaceUpdates, int(bae::POINT_SHADOW_FACES), MAX_POINT_SHADOW_FACE_UPDATES);
+            m_pointShadowParams.maxFaceUpdates = uint32_t(maxFaceUpdates);
+
+            ImGui::SliderFloat("Shadow Bias", &m_pointShadowUniforms.params.x, 0.0f, 0.1f);
+
+            const bae::PointShadowStats &stats = m_pointShadows.getStats();
+            ImGui::Text("Shadowed Lights: %u (%u skipped)", stats.shadowedLights, stats.skippedLights);
+            ImGui::Text("Faces: %u drawn, %u cached, %u deferred", stats.renderedFaces, stats.cachedFaces, stats.deferredFaces);
+            ImGui::Text("Caster Draws: %u", stats.casterDraws);
+            ImGui::Text("Atlas: %.1f%% used", 100.0f * float(m_pointShadows.getAtlas().getAllocatedTexels()) / float(uint32_t(POINT_SHADOW_ATLAS_SIZE) * POINT_SHADOW_ATLAS_SIZE));
+        }
+
+        if (m_pointShadowParams.maxShadowedLights != m_oldPointShadowParams.maxShadowedLights || m_pointShadowParams.maxFaceSize != m_oldPointShadowParams.maxFaceSize || m_pointShadowParams.maxFaceUpdates != m_oldPointShadowParams.maxFaceUpdates)
+        {
+            m_pointShadows.init(POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE, m_pointShadowParams, m_caps->homogeneousDepth);
+            m_oldPointShadowParams = m_pointShadowParams;
+        }
 
         ImGui::End();
 
         imguiEndFrame();
 
-        bgfx::ViewId zPrepass = 0;
+        const bae::OcclusionMode occlusionMode = m_staticBatching ? bae::OcclusionMode::DISABLED : m_occlusionMode;
+        // Proxies are tested against the prepass, so we can't have one without the other
+        const bool zPrepassEnabled = m_zPrepassEnabled || occlusionMode != bae::OcclusionMode::DISABLED;
+
+        // Shadow faces get drawn first, into the atlas
+        bgfx::ViewId firstPointShadowView = 0;
+
+        bgfx::ViewId zPrepass = bgfx::ViewId(firstPointShadowView + MAX_POINT_SHADOW_FACE_UPDATES);
         bgfx::setViewFrameBuffer(zPrepass, m_pbrFramebuffer);
         bgfx::setViewName(zPrepass, "Z Prepass");
         bgfx::setViewRect(zPrepass, 0, 0, uint16_t(m_width), uint16_t(m_height));
 
-        bgfx::ViewId meshPass = 1;
+        // Bounding box proxies for our occlusion queries, against the prepass' depth
+        bgfx::ViewId occlusionPass = bgfx::ViewId(zPrepass + 1);
+        bgfx::setViewFrameBuffer(occlusionPass, m_pbrFramebuffer);
+        bgfx::setViewName(occlusionPass, "Occlusion Queries");
+        bgfx::setViewRect(occlusionPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+
+        bgfx::ViewId meshPass = bgfx::ViewId(occlusionPass + 1);
         bgfx::setViewFrameBuffer(meshPass, m_pbrFramebuffer);
         bgfx::setViewName(meshPass, "Draw Meshes");
         bgfx::setViewRect(meshPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
 
         // This dummy draw call is here to make sure that view 0 is cleared
         // if no other draw calls are submitted to view 0.
-        if (m_zPrepassEnabled)
+        if (zPrepassEnabled)
         {
             bgfx::setViewClear(zPrepass, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x030303ff, 1.0f, 0);
             bgfx::setViewClear(meshPass, 0);
@@ -383,7 +844,11 @@ public:
         last = now;
         const double freq = double(bx::getHPFrequency());
         const float deltaTime = (float)(frameTime / freq);
-        m_time += deltaTime;
+        // Leaving the lights still lets every point shadow stay cached
+        if (m_animateLights)
+        {
+            m_time += deltaTime;
+        }
 
         float proj[16];
         bx::mtxProj(proj, 60.0f, float(m_width) / float(m_height), 0.1f, 100.0f, bgfx::getCaps()->homogeneousDepth);
@@ -395,6 +860,7 @@ public:
         cameraGetViewMtx(view);
         // Set view and projection matrix
         bgfx::setViewTransform(zPrepass, view, proj);
+        bgfx::setViewTransform(occlusionPass, view, proj);
         bgfx::setViewTransform(meshPass, view, proj);
 
         // Not scaling or translating our scene
@@ -433,9 +899,33 @@ public:
             }
         }
 
+        if (m_pointShadowsEnabled)
+        {
+            glm::mat4 viewMtx = glm::make_mat4(view);
+            bae::LightLODView lodView{};
+            lodView.cameraPos = glm::vec3{cameraPos.x, cameraPos.y, cameraPos.z};
+            lodView.cameraForward = glm::vec3{viewMtx[0][2], viewMtx[1][2], viewMtx[2][2]};
+            lodView.projScale = proj[5];
+            lodView.viewportWidth = float(m_width);
+            lodView.viewportHeight = float(m_height);
+
+            m_pointShadows.update(
+                m_lightSet.positionRadiusData.data(),
+                m_lightSet.colorIntensityData.data(),
+                m_lightSet.numActiveLights,
+                lodView,
+                m_shadowCasterBounds.data(),
+                uint32_t(m_shadowCasterBounds.size()));
+            renderPointShadows(firstPointShadowView);
+        }
+        else
+        {
+            m_lightSet.orderShadowedFirst(nullptr, 0);
+        }
+
         uint64_t stateOpaque = 0 | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_CULL_CCW | BGFX_STATE_MSAA;
 
-        if (m_zPrepassEnabled)
+        if (zPrepassEnabled)
         {
             stateOpaque |= BGFX_STATE_DEPTH_TEST_LEQUAL;
         }
@@ -446,26 +936,61 @@ public:
 
         uint64_t stateTransparent = 0 | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_CULL_CCW | BGFX_STATE_MSAA | BGFX_STATE_BLEND_ALPHA;
 
-        if (m_zPrepassEnabled)
+        // Uses whichever query results have made it back so far, without waiting for this frame's
+        m_occlusionQueries.update(occlusionMode, glm::vec3{cameraPos.x, cameraPos.y, cameraPos.z});
+        const bae::OcclusionQueries *occlusion = occlusionMode != bae::OcclusionMode::DISABLED ? &m_occlusionQueries : nullptr;
+
+        glm::vec4 frustumPlanes[6];
+        bae::extractFrustumPlanes(glm::make_mat4(proj) * glm::make_mat4(view), m_caps->homogeneousDepth, frustumPlanes);
+        m_meshDrawCount = 0;
+        m_textureChangeCount = 0;
+        m_setTextureCount = 0;
+        const SceneVariant &scene = getScene();
+        const bgfx::ProgramHandle pbrShader = m_useTextureArrays ? m_pbrShaderTextureArrays : m_pbrShader;
+        const bgfx::ProgramHandle pbrShaderWithMasking = m_useTextureArrays ? m_pbrShaderWithMaskingTextureArrays : m_pbrShaderWithMasking;
+
+        if (zPrepassEnabled)
         {
             uint64_t statePrepass = 0 | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_CULL_CCW | BGFX_STATE_MSAA;
 
             // Render all our opaque meshes
-            renderMeshes(m_model.opaqueMeshes, cameraPos, statePrepass, m_pbrShader, zPrepass);
+            if (m_staticBatching)
+            {
+                renderStaticBatches(scene.opaqueBatches, frustumPlanes, cameraPos, statePrepass, pbrShader, zPrepass);
+            }
+            else
+            {
+                renderMeshes(scene.model.opaqueMeshes, cameraPos, statePrepass, pbrShader, zPrepass, occlusion);
+            }
         }
 
-        // Render all our opaque meshes
-        renderMeshes(m_model.opaqueMeshes, cameraPos, stateOpaque, m_pbrShader, meshPass);
+        if (occlusion != nullptr)
+        {
+            m_occlusionQueries.submitProxies(occlusionPass, m_prepassProgram);
+        }
+
+        if (m_staticBatching)
+        {
+            renderStaticBatches(scene.opaqueBatches, frustumPlanes, cameraPos, stateOpaque, pbrShader, meshPass);
+            renderStaticBatches(scene.maskedBatches, frustumPlanes, cameraPos, stateOpaque & ~BGFX_STATE_WRITE_Z, pbrShaderWithMasking, meshPass);
+        }
+        else
+        {
+            // Render all our opaque meshes, letting the GPU skip the ones whose proxies are still hidden
+            renderMeshes(scene.model.opaqueMeshes, cameraPos, stateOpaque, pbrShader, meshPass, occlusion, true);
 
-        // Render all our masked meshes
-        renderMeshes(m_model.maskedMeshes, cameraPos, stateOpaque & ~BGFX_STATE_WRITE_Z, m_pbrShaderWithMasking, meshPass);
+            // Render all our masked meshes
+            renderMeshes(scene.model.maskedMeshes, cameraPos, stateOpaque & ~BGFX_STATE_WRITE_Z, pbrShaderWithMasking, meshPass);
+        }
 
         // Render all our transparent meshes
-        renderMeshes(m_model.transparentMeshes, cameraPos, stateTransparent, m_pbrShader, meshPass);
+        renderMeshes(scene.model.transparentMeshes, cameraPos, stateTransparent, pbrShader, meshPass);
 
         m_toneMapPass.render(m_pbrFbTextures[0], m_toneMapParams, deltaTime, meshPass + 1);
 
         bgfx::frame();
+        bae::getTrackingAllocator()->endFrame();
+        bae::getFrameArena().endFrame();
 
         return true;
     }
@@ -489,10 +1014,13 @@ public:
     bgfx::ProgramHandle m_prepassProgram;
     bgfx::ProgramHandle m_pbrShader;
     bgfx::ProgramHandle m_pbrShaderWithMasking;
+    bgfx::ProgramHandle m_pbrShaderTextureArrays = BGFX_INVALID_HANDLE;
+    bgfx::ProgramHandle m_pbrShaderWithMaskingTextureArrays = BGFX_INVALID_HANDLE;
 
     PBRShaderUniforms m_uniforms;
 
-    bae::Model m_model;
+    // Without and with texture arrays
+    SceneVariant m_scenes[2];
     LightSet m_lightSet;
 
     bgfx::TextureHandle m_pbrFbTextures[2];
@@ -505,6 +1033,33 @@ public:
 
     bool m_computeSupported = true;
     bool m_zPrepassEnabled = false;
+    bool m_animateLights = true;
+
+    bae::OcclusionQueries m_occlusionQueries;
+    bae::OcclusionMode m_occlusionMode = bae::OcclusionMode::DISABLED;
+    bool m_occlusionQueriesSupported = false;
+
+    std::vector<bae::StaticBatchDraw> m_batchDraws;
+    bool m_staticBatching = false;
+    uint32_t m_meshDrawCount = 0;
+
+    bae::TextureArrays m_textureArrays;
+    bool m_textureArraysSupported = false;
+    bool m_useTextureArrays = false;
+    // Material textures of the last draw in the current view, for counting how many each draw changes
+    bgfx::TextureHandle m_boundTextures[5];
+    uint32_t m_textureChangeCount = 0;
+    uint32_t m_setTextureCount = 0;
+
+    // Only our opaque meshes cast point light shadows
+    std::vector<bae::AABB> m_shadowCasterBounds;
+    bae::PointShadowAtlas m_pointShadows;
+    bae::PointShadowParams m_pointShadowParams;
+    bae::PointShadowParams m_oldPointShadowParams;
+    PointShadowUniforms m_pointShadowUniforms;
+    bgfx::TextureHandle m_pointShadowAtlasTexture = BGFX_INVALID_HANDLE;
+    bgfx::FrameBufferHandle m_pointShadowFramebuffer = BGFX_INVALID_HANDLE;
+    bool m_pointShadowsEnabled = true;
 };
 
 } // namespace example
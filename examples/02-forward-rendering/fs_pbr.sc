@@ -4,6 +4,7 @@ $input v_position, v_normal, v_tangent, v_bitangent, v_texcoord
 #include "../common/pbr_helpers.sh"
 
 #define MAX_LIGHT_COUNT 255u
+#define MAX_SHADOWED_LIGHTS 8u
 
 // Scene
 uniform vec4 u_cameraPos;
@@ -11,13 +12,38 @@ uniform vec4 pointLight_params;
 uniform vec4 pointLight_colorIntensity[MAX_LIGHT_COUNT];
 uniform vec4 pointLight_pos[MAX_LIGHT_COUNT];
 
+// Point light shadows, for the first pointLight_params.y lights
+uniform vec4 pointShadow_params;
+#define u_pointShadowBias pointShadow_params.x
+#define u_pointShadowTexelSize pointShadow_params.yz
+uniform vec4 pointShadow_origins[MAX_SHADOWED_LIGHTS];
+uniform vec4 pointShadow_depthParams[MAX_SHADOWED_LIGHTS];
+uniform vec4 pointShadow_regions[6u * MAX_SHADOWED_LIGHTS];
+SAMPLER2D(s_pointShadowAtlas, 5);
 
 // Material
+#ifdef TEXTURE_ARRAYS
+// Each texture is one layer of an array that's shared with every other texture of the same size and format
+SAMPLER2DARRAY(s_baseColor, 0);
+SAMPLER2DARRAY(s_normal, 1);
+SAMPLER2DARRAY(s_metallicRoughness, 2);
+SAMPLER2DARRAY(s_emissive, 3);
+SAMPLER2DARRAY(s_occlusion, 4);
+uniform vec4 u_textureLayers[2];
+#define sampleMaterial(_sampler, _layer) texture2DArray(_sampler, vec3(v_texcoord, _layer))
+#else
 SAMPLER2D(s_baseColor, 0);
 SAMPLER2D(s_normal, 1);
 SAMPLER2D(s_metallicRoughness, 2);
 SAMPLER2D(s_emissive, 3);
 SAMPLER2D(s_occlusion, 4);
+#define sampleMaterial(_sampler, _layer) texture2D(_sampler, v_texcoord)
+#endif // TEXTURE_ARRAYS
+#define u_baseColorLayer u_textureLayers[0].x
+#define u_normalLayer u_textureLayers[0].y
+#define u_metallicRoughnessLayer u_textureLayers[0].z
+#define u_emissiveLayer u_textureLayers[0].w
+#define u_occlusionLayer u_textureLayers[1].x
 uniform vec4 u_factors[3];
 #define u_baseColorFactor u_factors[0]
 #define u_emissiveFactor u_factors[1]
@@ -45,9 +71,48 @@ float karisFalloff(float dist, float lightRadius) {
     return pow(clamp(1.0 - pow(dist/lightRadius, 4), 0.0, 1.0), 2) / (dist * dist + 1);
 }
 
+// Picks the cube face that a direction from the light falls in, and returns the direction in that
+// face's view space. Has to match PointShadowAtlas::getFaceBasis.
+vec3 getPointShadowFaceCoords(vec3 dir, out uint face) {
+    vec3 absDir = abs(dir);
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z) {
+        face = dir.x > 0.0 ? 0u : 1u;
+        return dir.x > 0.0 ? vec3(-dir.z, dir.y, dir.x) : vec3(dir.z, dir.y, -dir.x);
+    }
+    if (absDir.y >= absDir.z) {
+        face = dir.y > 0.0 ? 2u : 3u;
+        return dir.y > 0.0 ? vec3(dir.x, -dir.z, dir.y) : vec3(dir.x, dir.z, -dir.y);
+    }
+    face = dir.z > 0.0 ? 4u : 5u;
+    return dir.z > 0.0 ? dir : vec3(-dir.x, dir.y, -dir.z);
+}
+
+float samplePointShadow(uint shadowIdx, vec3 position) {
+    uint face;
+    vec3 faceCoords = getPointShadowFaceCoords(position - pointShadow_origins[shadowIdx].xyz, face);
+    vec2 uv = 0.5 * faceCoords.xy / faceCoords.z + 0.5;
+#if !BGFX_SHADER_LANGUAGE_GLSL
+    uv.y = 1.0 - uv.y;
+#endif
+
+    // Move into the face's region of the atlas, without filtering across into its neighbours
+    vec4 scaleOffset = pointShadow_regions[6u * shadowIdx + face];
+    vec2 halfTexel = 0.5 * u_pointShadowTexelSize;
+    vec2 atlasUV = clamp(uv * scaleOffset.xy + scaleOffset.zw, scaleOffset.zw + halfTexel, scaleOffset.zw + scaleOffset.xy - halfTexel);
+    float sampledDepth = texture2DLod(s_pointShadowAtlas, atlasUV, 0.0).r;
+#if BGFX_SHADER_LANGUAGE_GLSL
+    sampledDepth = 2.0 * sampledDepth - 1.0;
+#endif
+
+    // Compare distances along the face's axis, scaling the bias with distance to match the depth precision
+    vec2 depthParams = pointShadow_depthParams[shadowIdx].xy;
+    float occluderDepth = depthParams.y / (sampledDepth - depthParams.x);
+    return step(faceCoords.z * (1.0 - u_pointShadowBias), occluderDepth);
+}
+
 void main()
 {
-    vec4 baseColor = toLinear(texture2D(s_baseColor, v_texcoord)) * u_baseColorFactor;
+    vec4 baseColor = toLinear(sampleMaterial(s_baseColor, u_baseColorLayer)) * u_baseColorFactor;
 #ifdef MASKING_ENABLED
     if (baseColor.w < u_alphaCutoff) {
         discard;
@@ -55,20 +120,21 @@ void main()
     }
 #endif // MASKING_ENABLED
 
-    vec3 normal = texture2D(s_normal, v_texcoord).xyz * 2.0 - 1.0;
+    vec3 normal = sampleMaterial(s_normal, u_normalLayer).xyz * 2.0 - 1.0;
     // From the MikkTSpace docs! (check mikktspace.h)
     normal = normalize(normal.x * v_tangent + normal.y * v_bitangent + normal.z * v_normal);
 
     vec3 viewDir = normalize(u_cameraPos.xyz - v_position);
 
-    vec2 roughnessMetal = texture2D(s_metallicRoughness, v_texcoord).yz;
+    vec2 roughnessMetal = sampleMaterial(s_metallicRoughness, u_metallicRoughnessLayer).yz;
     float roughness = max(roughnessMetal.x * u_roughnessFactor, MIN_ROUGHNESS);
     float metallic = roughnessMetal.y * u_metallicFactor;
-    float occlusion = texture2D(s_occlusion, v_texcoord).x;
-    vec3 emissive = toLinear(texture2D(s_emissive, v_texcoord)).xyz * u_emissiveFactor;
+    float occlusion = sampleMaterial(s_occlusion, u_occlusionLayer).x;
+    vec3 emissive = toLinear(sampleMaterial(s_emissive, u_emissiveLayer)).xyz * u_emissiveFactor;
 
     vec3 color = vec3(0.0, 0.0, 0.0);
     uint numLights = min(floatBitsToUint(pointLight_params.x), MAX_LIGHT_COUNT);
+    uint numShadowedLights = min(floatBitsToUint(pointLight_params.y), MAX_SHADOWED_LIGHTS);
     for (uint i = 0; i < numLights; i++) {
         vec3 lightPos = pointLight_pos[i].xyz;
         float lightRadius = pointLight_pos[i].w;
@@ -82,6 +148,13 @@ void main()
             continue;
         }
 
+        if (i < numShadowedLights) {
+            attenuation *= samplePointShadow(i, v_position);
+            if (attenuation == 0.0) {
+                continue;
+            }
+        }
+
         vec3 light = attenuation * colorIntensity.xyz * clampDot(normal, lightDir);
 
         color += (
@@ -0,0 +1,4 @@
+#define MASKING_ENABLED 1
+#define TEXTURE_ARRAYS 1
+
+#include "./fs_pbr.sc"
@@ -0,0 +1,3 @@
+#define TEXTURE_ARRAYS 1
+
+#include "./fs_pbr.sc"
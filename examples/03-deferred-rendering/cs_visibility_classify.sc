@@ -0,0 +1,54 @@
+#include "bgfx_compute.sh"
+#include "./visibility.sh"
+
+#define THREADS_X VISIBILITY_TILE_SIZE
+#define THREADS_Y VISIBILITY_TILE_SIZE
+#define GROUP_SIZE 64
+
+// One group per tile, adding the tile to the list of every bin it has pixels in. See visibility.sh.
+
+IMAGE2D_RO(s_visibility, rgba8, 0);
+BUFFER_RO(b_draws, vec4, 1);
+// Tiles listed so far per bin. cs_visibility_dispatch_args turns these into dispatches and clears them.
+BUFFER_RW(b_tileCounts, uint, 2);
+BUFFER_WR(b_tileLists, uint, 3);
+
+uniform vec4 u_classifyParams;
+#define u_binCount u_classifyParams.x
+#define u_targetSize u_classifyParams.zw
+
+SHARED uint binUsed[VISIBILITY_MAX_BINS];
+
+NUM_THREADS(THREADS_X, THREADS_Y, 1)
+void main()
+{
+    uint binCount = uint(u_binCount);
+    for (uint i = gl_LocalInvocationIndex; i < binCount; i += uint(GROUP_SIZE)) {
+        binUsed[i] = 0u;
+    }
+    groupMemoryBarrier();
+
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    if (coord.x < int(u_targetSize.x) && coord.y < int(u_targetSize.y)) {
+        uint packedId = unpackVisibilityId(imageLoad(s_visibility, coord));
+        // Empty pixels go in the last bin
+        uint bin = binCount - 1u;
+        if (packedId != 0u) {
+            uint drawId = (packedId >> VISIBILITY_TRIANGLE_BITS) - 1u;
+            bin = uint(b_draws[drawId].z);
+        }
+        // Every thread that writes here writes the same value
+        binUsed[bin] = 1u;
+    }
+    groupMemoryBarrier();
+
+    uint tileCapacity = getVisibilityTileCapacity(u_targetSize);
+    uint packedTile = packVisibilityTile(gl_WorkGroupID.xy);
+    for (uint bin = gl_LocalInvocationIndex; bin < binCount; bin += uint(GROUP_SIZE)) {
+        if (binUsed[bin] != 0u) {
+            uint slot;
+            atomicFetchAndAdd(b_tileCounts[bin], 1u, slot);
+            b_tileLists[bin * tileCapacity + slot] = packedTile;
+        }
+    }
+}
@@ -0,0 +1,22 @@
+#include "bgfx_compute.sh"
+
+// One thread per bin, turning the number of tiles cs_visibility_classify listed for it into the arguments of
+// its resolve dispatch. Clears the count afterwards, so it's ready for the next frame without a separate pass.
+
+BUFFER_RW(b_tileCounts, uint, 0);
+BUFFER_WR(b_dispatchArgs, uvec4, 1);
+
+uniform vec4 u_classifyParams;
+#define u_binCount u_classifyParams.x
+
+NUM_THREADS(64, 1, 1)
+void main()
+{
+    uint bin = gl_GlobalInvocationID.x;
+    if (bin >= uint(u_binCount)) {
+        return;
+    }
+
+    dispatchIndirect(b_dispatchArgs, bin, b_tileCounts[bin], 1u, 1u);
+    b_tileCounts[bin] = 0u;
+}
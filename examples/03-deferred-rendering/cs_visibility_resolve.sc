@@ -0,0 +1,158 @@
+#include "bgfx_compute.sh"
+#include "../common/shaderlib.sh"
+#include "./visibility.sh"
+
+#define THREADS_X VISIBILITY_TILE_SIZE
+#define THREADS_Y VISIBILITY_TILE_SIZE
+
+// Dispatched indirectly once per bin, with one group for each tile cs_visibility_classify listed under that
+// bin, so only tiles with pixels of this bin's material get looked at and each pixel gets shaded once
+
+// Material, bound to the same slots as in our G-buffer pass
+SAMPLER2D(s_baseColor, 0);
+SAMPLER2D(s_normal, 1);
+SAMPLER2D(s_metallicRoughness, 2);
+SAMPLER2D(s_emissive, 3);
+SAMPLER2D(s_occlusion, 4);
+uniform vec4 u_factors[3];
+#define u_baseColorFactor u_factors[0]
+#define u_emissiveFactor u_factors[1]
+#define u_metallicFactor u_factors[2].y
+#define u_roughnessFactor u_factors[2].z
+
+IMAGE2D_RO(s_visibility, rgba8, 5);
+
+// Scene geometry, see bae::VisibilityScene for the layout
+BUFFER_RO(b_positions, vec4, 6);
+BUFFER_RO(b_normals, vec4, 7);
+BUFFER_RO(b_tangents, vec4, 8);
+BUFFER_RO(b_triangles, vec4, 9);
+BUFFER_RO(b_draws, vec4, 10);
+
+// Same layout as what fs_deferred_pbr writes out
+IMAGE2D_WR(s_baseColorRoughness, rgba8, 11);
+IMAGE2D_WR(s_normalMetallic, rgba16f, 12);
+IMAGE2D_WR(s_emissiveOcclusion, rgba8, 13);
+IMAGE2D_WR(s_depth, r32f, 14);
+
+BUFFER_RO(b_tileLists, uint, 15);
+
+uniform vec4 u_cameraPos;
+uniform vec4 u_resolveParams;
+#define u_binIdx u_resolveParams.x
+// Set for the last bin, which clears the pixels no draw covered
+#define u_clearBackground u_resolveParams.y
+#define u_targetSize u_resolveParams.zw
+
+vec3 getRayDirection(vec2 pixel)
+{
+    vec2 texcoord = pixel / u_targetSize;
+#if BGFX_SHADER_LANGUAGE_GLSL
+    vec4 clip = vec4(texcoord * 2.0 - 1.0, 1.0, 1.0);
+#else
+    vec4 clip = vec4(vec2(texcoord.x, 1.0 - texcoord.y) * 2.0 - 1.0, 1.0, 1.0);
+#endif
+    vec4 world = mul(u_invViewProj, clip);
+    return normalize(world.xyz / world.w - u_cameraPos.xyz);
+}
+
+// Same as bae::computeBarycentrics, hits outside of the triangle are still valid
+vec3 computeBarycentrics(vec3 rayOrigin, vec3 rayDirection, vec3 p0, vec3 p1, vec3 p2)
+{
+    vec3 edge1 = p1 - p0;
+    vec3 edge2 = p2 - p0;
+    vec3 pvec = cross(rayDirection, edge2);
+    float invDet = 1.0 / dot(edge1, pvec);
+    vec3 tvec = rayOrigin - p0;
+    float u = dot(tvec, pvec) * invDet;
+    vec3 qvec = cross(tvec, edge1);
+    float v = dot(rayDirection, qvec) * invDet;
+    return vec3(1.0 - u - v, u, v);
+}
+
+NUM_THREADS(THREADS_X, THREADS_Y, 1)
+void main()
+{
+    uint binIdx = uint(u_binIdx);
+    uint packedTile = b_tileLists[binIdx * getVisibilityTileCapacity(u_targetSize) + gl_WorkGroupID.x];
+    ivec2 coord = ivec2(unpackVisibilityTile(packedTile) * uint(VISIBILITY_TILE_SIZE) + gl_LocalInvocationID.xy);
+    if (coord.x >= int(u_targetSize.x) || coord.y >= int(u_targetSize.y)) {
+        return;
+    }
+
+    uint packedId = unpackVisibilityId(imageLoad(s_visibility, coord));
+    if (packedId == 0u) {
+        if (u_clearBackground > 0.0) {
+            imageStore(s_baseColorRoughness, coord, vec4_splat(0.0));
+            imageStore(s_normalMetallic, coord, vec4_splat(0.0));
+            imageStore(s_emissiveOcclusion, coord, vec4_splat(0.0));
+            imageStore(s_depth, coord, vec4_splat(1.0));
+        }
+        return;
+    }
+
+    uint drawId = (packedId >> VISIBILITY_TRIANGLE_BITS) - 1u;
+    uint triangleId = packedId & VISIBILITY_TRIANGLE_MASK;
+    vec4 draw = b_draws[drawId];
+    // Tiles on the edge of a material also have pixels of other materials, which their own bins take care of
+    if (uint(draw.z) != binIdx) {
+        return;
+    }
+
+    vec4 triangle = b_triangles[uint(draw.x) + triangleId];
+    uint i0 = uint(triangle.x);
+    uint i1 = uint(triangle.y);
+    uint i2 = uint(triangle.z);
+    vec4 position0 = b_positions[i0];
+    vec4 position1 = b_positions[i1];
+    vec4 position2 = b_positions[i2];
+    vec4 normal0 = b_normals[i0];
+    vec4 normal1 = b_normals[i1];
+    vec4 normal2 = b_normals[i2];
+    vec4 tangent0 = b_tangents[i0];
+    vec4 tangent1 = b_tangents[i1];
+    vec4 tangent2 = b_tangents[i2];
+
+    // Barycentrics of this pixel and its neighbours, the latter give us our texture derivatives
+    vec2 pixel = vec2(coord) + 0.5;
+    vec3 rayOrigin = u_cameraPos.xyz;
+    vec3 bary = computeBarycentrics(rayOrigin, getRayDirection(pixel), position0.xyz, position1.xyz, position2.xyz);
+    vec3 baryX = computeBarycentrics(rayOrigin, getRayDirection(pixel + vec2(1.0, 0.0)), position0.xyz, position1.xyz, position2.xyz);
+    vec3 baryY = computeBarycentrics(rayOrigin, getRayDirection(pixel + vec2(0.0, 1.0)), position0.xyz, position1.xyz, position2.xyz);
+
+    vec2 uv0 = vec2(position0.w, normal0.w);
+    vec2 uv1 = vec2(position1.w, normal1.w);
+    vec2 uv2 = vec2(position2.w, normal2.w);
+    vec2 texcoord = uv0 * bary.x + uv1 * bary.y + uv2 * bary.z;
+    vec2 texcoordDx = uv0 * baryX.x + uv1 * baryX.y + uv2 * baryX.z - texcoord;
+    vec2 texcoordDy = uv0 * baryY.x + uv1 * baryY.y + uv2 * baryY.z - texcoord;
+
+    vec3 position = position0.xyz * bary.x + position1.xyz * bary.y + position2.xyz * bary.z;
+    vec3 vertexNormal = normalize(normal0.xyz * bary.x + normal1.xyz * bary.y + normal2.xyz * bary.z);
+    vec3 vertexTangent = normalize(tangent0.xyz * bary.x + tangent1.xyz * bary.y + tangent2.xyz * bary.z);
+    vec3 vertexBitangent = normalize(cross(vertexNormal, vertexTangent)) * tangent0.w;
+
+    // From here on out, this is the same material evaluation as fs_deferred_pbr
+    vec4 baseColor = toLinear(texture2DGrad(s_baseColor, texcoord, texcoordDx, texcoordDy)) * u_baseColorFactor;
+
+    vec3 normal = texture2DGrad(s_normal, texcoord, texcoordDx, texcoordDy).xyz * 2.0 - 1.0;
+    normal = normalize(normal.x * vertexTangent + normal.y * vertexBitangent + normal.z * vertexNormal);
+
+    vec2 roughnessMetal = texture2DGrad(s_metallicRoughness, texcoord, texcoordDx, texcoordDy).yz;
+    float roughness = roughnessMetal.x * u_roughnessFactor;
+    float metallic = roughnessMetal.y * u_metallicFactor;
+    float occlusion = texture2DGrad(s_occlusion, texcoord, texcoordDx, texcoordDy).x;
+    vec3 emissive = toLinear(texture2DGrad(s_emissive, texcoord, texcoordDx, texcoordDy)).xyz * u_emissiveFactor.xyz;
+
+    vec4 clip = mul(u_viewProj, vec4(position, 1.0));
+    float depth = clip.z / clip.w;
+#if BGFX_SHADER_LANGUAGE_GLSL
+    // Match gl_FragCoord.z
+    depth = depth * 0.5 + 0.5;
+#endif
+
+    imageStore(s_baseColorRoughness, coord, vec4(baseColor.xyz, roughness));
+    imageStore(s_normalMetallic, coord, vec4(normal, metallic));
+    imageStore(s_emissiveOcclusion, coord, vec4(emissive, occlusion));
+    imageStore(s_depth, coord, vec4(depth, 0.0, 0.0, 0.0));
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <array>
 #include <random>
 #include <bx/rng.h>
@@ -16,6 +17,15 @@
 #include "bae/Tonemapping.h"
 #include "bae/Offscreen.h"
 #include "bae/IcosahedronFactory.h"
+#include "bae/LightTree.h"
+#include "bae/VisibilityBuffer.h"
+#include "bae/DepthAwareUpsample.h"
+#include "bae/GpuCulling.h"
+#include "bae/TextureStreaming.h"
+#include "bae/TextureCache.h"
+#include "bae/JobSystem.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
 
 namespace example
 {
@@ -23,6 +33,158 @@ namespace example
 
     static float s_texelHalf = 0.0f;
 
+    // Light radius is chosen so that the falloff drops to this value at the edge of the volume
+    constexpr float LIGHT_FALLOFF_EPSILON = 0.01f;
+
+    constexpr float CAMERA_NEAR = 0.1f;
+    constexpr float CAMERA_FAR = 1000.0f;
+
+    enum struct GBufferLayout
+    {
+        // RGBA8 base color, RGBA16F normals, RGBA8 emissive and an R32F depth copy
+        FULL,
+        // RGBA8 base color and RGBA16 octahedral normals, position comes from the hardware depth
+        COMPACT_16,
+        // Same as above, but with the normals squeezed into RGBA8
+        COMPACT_8,
+    };
+
+    static const char* GBUFFER_LAYOUT_NAMES[] = {
+        "Full",
+        "Compact (16-bit normals)",
+        "Compact (8-bit normals)",
+    };
+
+    // Counts every full resolution target we render to, including our final radiance and depth-stencil.
+    // Full is 32 bytes, COMPACT_16 is 24 and COMPACT_8 is 20: the radiance and depth targets every layout needs
+    // take 12 of those. COMPACT_8 more than halves the rest (20 down to 8), COMPACT_16 only saves 25% overall.
+    uint32_t getGBufferBytesPerPixel(const GBufferLayout layout)
+    {
+        switch (layout) {
+        case GBufferLayout::COMPACT_16:
+            return 4 + 8 + 8 + 4;
+        case GBufferLayout::COMPACT_8:
+            return 4 + 4 + 8 + 4;
+        default:
+            return 4 + 8 + 4 + 4 + 8 + 4;
+        }
+    }
+
+    enum struct LightResolution
+    {
+        FULL,
+        HALF,
+        QUARTER,
+    };
+
+    static const char* LIGHT_RESOLUTION_NAMES[] = {
+        "Full",
+        "Half",
+        "Quarter",
+    };
+
+    uint32_t getLightResolutionFactor(const LightResolution resolution)
+    {
+        switch (resolution) {
+        case LightResolution::HALF:
+            return 2;
+        case LightResolution::QUARTER:
+            return 4;
+        default:
+            return 1;
+        }
+    }
+
+    enum struct RenderMode
+    {
+        // Full material evaluation for every fragment we rasterize
+        GBUFFER,
+        // Rasterize draw and triangle IDs only, then evaluate materials once per pixel in a compute pass
+        VISIBILITY_BUFFER,
+    };
+
+    static const char* RENDER_MODE_NAMES[] = {
+        "G-Buffer",
+        "Visibility Buffer",
+    };
+
+    enum struct DrawOrder
+    {
+        UNSORTED,
+        FRONT_TO_BACK,
+        // Worst case for overdraw, since every fragment we draw passes the depth test
+        BACK_TO_FRONT,
+    };
+
+    static const char* DRAW_ORDER_NAMES[] = {
+        "Unsorted",
+        "Front to Back",
+        "Back to Front",
+    };
+
+    // Matches VISIBILITY_TILE_SIZE in visibility.sh
+    constexpr uint32_t VISIBILITY_TILE_SIZE = 8;
+    constexpr uint32_t VISIBILITY_CLASSIFY_THREADS = 64;
+
+    // Fills drawOrder with the indices of the group's meshes, sorted by the distance to their bounding boxes
+    void sortDraws(const bae::MeshGroup& meshGroup, const DrawOrder order, const glm::vec3& cameraPos, std::vector<uint32_t>& drawOrder)
+    {
+        drawOrder.resize(meshGroup.meshes.size());
+        for (uint32_t i = 0; i < uint32_t(drawOrder.size()); ++i) {
+            drawOrder[i] = i;
+        }
+        if (order == DrawOrder::UNSORTED) {
+            return;
+        }
+
+        auto distanceSq = [&](const uint32_t idx) {
+            const bae::AABB& boundingBox = meshGroup.boundingBoxes[idx];
+            glm::vec3 toCenter = 0.5f * (boundingBox.min + boundingBox.max) - cameraPos;
+            return glm::dot(toCenter, toCenter);
+        };
+        std::sort(drawOrder.begin(), drawOrder.end(), [&](const uint32_t a, const uint32_t b) {
+            return order == DrawOrder::FRONT_TO_BACK
+                ? distanceSq(a) < distanceSq(b)
+                : distanceSq(a) > distanceSq(b);
+        });
+    }
+
+    // Asks the streamer for the mips each mesh inside the frustum needs
+    void requestStreamedTextures(
+        bae::TextureStreamer& streamer,
+        const bae::MeshGroup& meshGroup,
+        const std::vector<float>& uvDensities,
+        const glm::vec4 frustumPlanes[6],
+        const glm::vec3& cameraPos,
+        const float projScale,
+        const uint32_t frame)
+    {
+        for (size_t i = 0; i < meshGroup.meshes.size(); ++i) {
+            const bae::AABB& boundingBox = meshGroup.boundingBoxes[i];
+            if (bae::isBoxOutsideFrustum(frustumPlanes, boundingBox.min, boundingBox.max)) {
+                continue;
+            }
+            streamer.requestForMesh(meshGroup.materials[i], boundingBox, uvDensities[i], cameraPos, projScale, frame);
+        }
+    }
+
+    struct PassTimings
+    {
+        float geometryMs = 0.0f;
+        float resolveMs = 0.0f;
+        float lightingMs = 0.0f;
+    };
+
+    // A snapshot of our pass timings, so we can compare modes across resolutions and draw orders
+    struct TimingRecord
+    {
+        RenderMode renderMode;
+        DrawOrder drawOrder;
+        uint32_t width;
+        uint32_t height;
+        PassTimings timings;
+    };
+
     std::vector<glm::vec3> LIGHT_COLORS = {
         { 1.0f, 1.0f, 1.0f },
         { 1.0f, 0.1f, 0.1f },
@@ -56,6 +218,11 @@ namespace example
         std::vector<glm::vec4> positionRadiusData;
         std::vector<glm::vec4> colorIntensityData;
 
+        // Light LOD, which merges and drops lights before they reach the GPU
+        bae::LightTree lightTree;
+        std::vector<glm::vec4> lodPositionRadiusData;
+        std::vector<glm::vec4> lodColorIntensityData;
+
         void init()
         {
             bae::IcosahedronFactory factory{ 2 };
@@ -109,7 +276,7 @@ namespace example
         bgfx::destroy(uniforms.u_normalTransform);
     }
 
-    void bindUniforms(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material, const glm::mat4& transform) {
+    void bindMaterial(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material) {
         bgfx::setTexture(0, uniforms.s_baseColor, material.baseColorTexture);
         bgfx::setTexture(1, uniforms.s_normal, material.normalTexture);
         bgfx::setTexture(2, uniforms.s_metallicRoughness, material.metallicRoughnessTexture);
@@ -118,6 +285,10 @@ namespace example
         // We are going to pack our baseColorFactor, emissiveFactor, roughnessFactor
         // and metallicFactor into this uniform
         bgfx::setUniform(uniforms.u_factors, &material.baseColorFactor, 3);
+    }
+
+    void bindUniforms(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material, const glm::mat4& transform) {
+        bindMaterial(uniforms, material);
 
         // Transforms
         bgfx::setTransform(glm::value_ptr(transform));
@@ -125,11 +296,22 @@ namespace example
         bgfx::setUniform(uniforms.u_normalTransform, glm::value_ptr(normalTransform));
     }
 
+    // Our visibility pass only writes IDs, so the only part of the material it needs is what masking reads
+    void bindVisibilityUniforms(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material, const glm::mat4& transform, const bool masked) {
+        if (masked) {
+            bgfx::setTexture(0, uniforms.s_baseColor, material.baseColorTexture);
+            bgfx::setUniform(uniforms.u_factors, &material.baseColorFactor, 3);
+        }
+        bgfx::setTransform(glm::value_ptr(transform));
+    }
+
     struct DeferredSceneUniforms {
         bgfx::UniformHandle s_baseColorRoughness = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle s_normalMetallic = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle s_emissiveOcclusion = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle s_depth = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_baseColorOcclusion = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_normalRoughnessMetallic = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle u_cameraPos = BGFX_INVALID_HANDLE;
     };
 
@@ -138,6 +320,8 @@ namespace example
         uniforms.s_normalMetallic = bgfx::createUniform("s_normalMetallic", bgfx::UniformType::Sampler);
         uniforms.s_emissiveOcclusion = bgfx::createUniform("s_emissiveOcclusion", bgfx::UniformType::Sampler);
         uniforms.s_depth = bgfx::createUniform("s_depth", bgfx::UniformType::Sampler);
+        uniforms.s_baseColorOcclusion = bgfx::createUniform("s_baseColorOcclusion", bgfx::UniformType::Sampler);
+        uniforms.s_normalRoughnessMetallic = bgfx::createUniform("s_normalRoughnessMetallic", bgfx::UniformType::Sampler);
         uniforms.u_cameraPos = bgfx::createUniform("u_cameraPos", bgfx::UniformType::Vec4);
     }
 
@@ -146,6 +330,8 @@ namespace example
         bgfx::destroy(uniforms.s_normalMetallic);
         bgfx::destroy(uniforms.s_emissiveOcclusion);
         bgfx::destroy(uniforms.s_depth);
+        bgfx::destroy(uniforms.s_baseColorOcclusion);
+        bgfx::destroy(uniforms.s_normalRoughnessMetallic);
         bgfx::destroy(uniforms.u_cameraPos);
     }
 
@@ -164,6 +350,117 @@ namespace example
         bgfx::destroy(uniforms.u_lightPosRadius);
     }
 
+    // GPU copy of our bae::VisibilityScene, read by the visibility buffer resolve
+    struct VisibilitySceneBuffers {
+        bgfx::VertexBufferHandle positions = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle normals = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle tangents = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle triangles = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle draws = BGFX_INVALID_HANDLE;
+    };
+
+    bgfx::VertexBufferHandle createComputeBuffer(const std::vector<glm::vec4>& data)
+    {
+        bgfx::VertexDecl decl;
+        decl.begin().add(bgfx::Attrib::TexCoord0, 4, bgfx::AttribType::Float).end();
+        const bgfx::Memory* memory = bgfx::copy(data.data(), uint32_t(data.size() * sizeof(glm::vec4)));
+        return bgfx::createVertexBuffer(memory, decl, BGFX_BUFFER_COMPUTE_READ);
+    }
+
+    void init(VisibilitySceneBuffers& buffers, const bae::VisibilityScene& scene)
+    {
+        buffers.positions = createComputeBuffer(scene.positions);
+        buffers.normals = createComputeBuffer(scene.normals);
+        buffers.tangents = createComputeBuffer(scene.tangents);
+        buffers.triangles = createComputeBuffer(scene.triangles);
+        buffers.draws = createComputeBuffer(scene.draws);
+    }
+
+    void destroy(VisibilitySceneBuffers& buffers)
+    {
+        bgfx::destroy(buffers.positions);
+        bgfx::destroy(buffers.normals);
+        bgfx::destroy(buffers.tangents);
+        bgfx::destroy(buffers.triangles);
+        bgfx::destroy(buffers.draws);
+    }
+
+    // Per material lists of the tiles our resolve shades, filled in on the GPU every frame. There's one bin per
+    // material plus one for empty pixels, and each bin's list has room for every tile on screen.
+    struct VisibilityTiles {
+        bgfx::DynamicIndexBufferHandle tileCounts = BGFX_INVALID_HANDLE;
+        bgfx::DynamicIndexBufferHandle tileLists = BGFX_INVALID_HANDLE;
+        bgfx::IndirectBufferHandle dispatchArgs = BGFX_INVALID_HANDLE;
+        uint32_t binCount = 0;
+        uint32_t tileCount = 0;
+    };
+
+    void init(VisibilityTiles& tiles, const uint32_t materialCount) {
+        tiles.binCount = materialCount + 1;
+        // The counts have to start out cleared, after that our dispatch args pass clears them as it goes
+        std::vector<uint32_t> zeroes(tiles.binCount, 0);
+        tiles.tileCounts = bgfx::createDynamicIndexBuffer(
+            bgfx::copy(zeroes.data(), uint32_t(zeroes.size() * sizeof(uint32_t))), BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
+        tiles.dispatchArgs = bgfx::createIndirectBuffer(tiles.binCount);
+    }
+
+    void resize(VisibilityTiles& tiles, const uint32_t width, const uint32_t height) {
+        if (bgfx::isValid(tiles.tileLists)) {
+            bgfx::destroy(tiles.tileLists);
+        }
+        const uint32_t tilesX = (width + VISIBILITY_TILE_SIZE - 1) / VISIBILITY_TILE_SIZE;
+        const uint32_t tilesY = (height + VISIBILITY_TILE_SIZE - 1) / VISIBILITY_TILE_SIZE;
+        tiles.tileCount = tilesX * tilesY;
+        tiles.tileLists = bgfx::createDynamicIndexBuffer(tiles.binCount * tiles.tileCount, BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
+    }
+
+    void destroy(VisibilityTiles& tiles) {
+        bgfx::destroy(tiles.tileCounts);
+        bgfx::destroy(tiles.dispatchArgs);
+        if (bgfx::isValid(tiles.tileLists)) {
+            bgfx::destroy(tiles.tileLists);
+        }
+    }
+
+    struct VisibilityUniforms {
+        bgfx::UniformHandle u_drawParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_classifyParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_resolveParams = BGFX_INVALID_HANDLE;
+    };
+
+    void init(VisibilityUniforms& uniforms) {
+        uniforms.u_drawParams = bgfx::createUniform("u_drawParams", bgfx::UniformType::Vec4);
+        uniforms.u_classifyParams = bgfx::createUniform("u_classifyParams", bgfx::UniformType::Vec4);
+        uniforms.u_resolveParams = bgfx::createUniform("u_resolveParams", bgfx::UniformType::Vec4);
+    }
+
+    void destroy(VisibilityUniforms& uniforms) {
+        bgfx::destroy(uniforms.u_drawParams);
+        bgfx::destroy(uniforms.u_classifyParams);
+        bgfx::destroy(uniforms.u_resolveParams);
+    }
+
+    struct ReducedResolutionUniforms {
+        bgfx::UniformHandle s_lowResLight = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_lowResDepth = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_downsampleParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_upsampleParams = BGFX_INVALID_HANDLE;
+    };
+
+    void init(ReducedResolutionUniforms& uniforms) {
+        uniforms.s_lowResLight = bgfx::createUniform("s_lowResLight", bgfx::UniformType::Sampler);
+        uniforms.s_lowResDepth = bgfx::createUniform("s_lowResDepth", bgfx::UniformType::Sampler);
+        uniforms.u_downsampleParams = bgfx::createUniform("u_downsampleParams", bgfx::UniformType::Vec4);
+        uniforms.u_upsampleParams = bgfx::createUniform("u_upsampleParams", bgfx::UniformType::Vec4, 2);
+    }
+
+    void destroy(ReducedResolutionUniforms& uniforms) {
+        bgfx::destroy(uniforms.s_lowResLight);
+        bgfx::destroy(uniforms.s_lowResDepth);
+        bgfx::destroy(uniforms.u_downsampleParams);
+        bgfx::destroy(uniforms.u_upsampleParams);
+    }
+
     class ExampleDeferred : public entry::AppI
     {
     public:
@@ -175,7 +472,8 @@ namespace example
 
             m_width = _width;
             m_height = _height;
-            m_debug = BGFX_DEBUG_TEXT;
+            // The profiler gives us GPU timings per view, which we use to compare our render modes
+            m_debug = BGFX_DEBUG_TEXT | BGFX_DEBUG_PROFILER;
             m_reset = BGFX_RESET_VSYNC | BGFX_RESET_MAXANISOTROPY;
 
             bgfx::Init initInfo;
@@ -184,6 +482,7 @@ namespace example
             initInfo.resolution.width = m_width;
             initInfo.resolution.height = m_height;
             initInfo.resolution.reset = m_reset;
+            initInfo.allocator = bae::getTrackingAllocator();
             bgfx::init(initInfo);
 
             // Enable m_debug text.
@@ -199,6 +498,10 @@ namespace example
 
             m_caps = bgfx::getCaps();
             m_computeSupported = !!(m_caps->supported & BGFX_CAPS_COMPUTE);
+            m_readbackSupported = !!(m_caps->supported & BGFX_CAPS_TEXTURE_BLIT)
+                && !!(m_caps->supported & BGFX_CAPS_TEXTURE_READ_BACK);
+            // Our visibility buffer resolve dispatches each material over the tiles the GPU found it in
+            m_dispatchIndirectSupported = !!(m_caps->supported & BGFX_CAPS_DRAW_INDIRECT);
 
             if (!m_computeSupported) {
                 return;
@@ -207,19 +510,71 @@ namespace example
             m_writeToRTProgram = loadProgram("vs_deferred_pbr", "fs_deferred_pbr");
             m_lightStencilProgram = loadProgram("vs_light_stencil", "fs_light_stencil");
             m_pointLightVolumeProgram = loadProgram("vs_point_light_volume", "fs_point_light_volume");
+            m_writeToCompactRTProgram = loadProgram("vs_deferred_pbr", "fs_deferred_pbr_compact");
+            m_compactPointLightVolumeProgram = loadProgram("vs_point_light_volume", "fs_point_light_volume_compact");
             m_emissivePassProgram = loadProgram("vs_emissive_pass", "fs_emissive_pass");
+            m_visibilityProgram = loadProgram("vs_visibility", "fs_visibility");
+            m_visibilityMaskedProgram = loadProgram("vs_visibility", "fs_visibility_masked");
+            m_visibilityClassifyProgram = loadProgram("cs_visibility_classify", nullptr);
+            m_visibilityDispatchArgsProgram = loadProgram("cs_visibility_dispatch_args", nullptr);
+            m_visibilityResolveProgram = loadProgram("cs_visibility_resolve", nullptr);
+            // Both of these are full screen passes, same as our emissive pass
+            m_downsampleGBufferProgram = loadProgram("vs_emissive_pass", "fs_downsample_gbuffer");
+            m_bilateralUpsampleProgram = loadProgram("vs_emissive_pass", "fs_bilateral_upsample");
 
             example::init(m_pbrUniforms);
             example::init(m_deferredSceneUniforms);
             example::init(m_pointLightUniforms);
+            example::init(m_visibilityUniforms);
+            example::init(m_reducedResolutionUniforms);
+
+            // Lets load all the meshes, with CPU copies for our visibility buffer and texture streaming that we
+            // let go of once they're set up. Textures start out with only their smallest mips, the rest get
+            // streamed in as we get close enough to need them.
+            m_textureStreamer.init(m_textureStreamingParams);
+            m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf", true, nullptr, nullptr, &m_textureStreamer);
+            for (size_t i = 0; i < m_model.opaqueMeshes.meshes.size(); ++i) {
+                m_opaqueUvDensities.push_back(bae::computeUvDensity(m_model.opaqueMeshes.meshData[i], m_model.opaqueMeshes.transforms[i]));
+            }
+            for (size_t i = 0; i < m_model.maskedMeshes.meshes.size(); ++i) {
+                m_maskedUvDensities.push_back(bae::computeUvDensity(m_model.maskedMeshes.meshData[i], m_model.maskedMeshes.transforms[i]));
+            }
 
-            // Lets load all the meshes
-            m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf");
+            // Opaque meshes get the first draw IDs, followed by the masked ones
+            m_opaqueFirstDrawId = bae::appendMeshGroup(m_visibilityScene, m_model.opaqueMeshes);
+            m_maskedFirstDrawId = bae::appendMeshGroup(m_visibilityScene, m_model.maskedMeshes);
+            example::init(m_visibilitySceneBuffers, m_visibilityScene);
+            example::init(m_visibilityTiles, uint32_t(m_visibilityScene.materials.size()));
+
+            // Everything that needed the CPU copies of our geometry is done with them, the GPU has its own
+            bae::releaseGeometry(m_visibilityScene);
+            m_model.opaqueMeshes.meshData.clear();
+            m_model.maskedMeshes.meshData.clear();
+            m_model.transparentMeshes.meshData.clear();
+
+            m_jobSystem.init(bae::JobSystemParams{});
 
             m_lightSet.init();
             m_lightSet.numActiveLights = 256;
             m_totalBrightness = 100.0f;
 
+            // Points used to compare the LOD light set against the full one, spread over the scene
+            constexpr size_t samplesPerAxis[3] = { 8, 4, 8 };
+            const glm::vec3 sceneSize = m_model.boundingBox.max - m_model.boundingBox.min;
+            m_lightLODSamplePoints.reserve(samplesPerAxis[0] * samplesPerAxis[1] * samplesPerAxis[2]);
+            for (size_t x = 0; x < samplesPerAxis[0]; ++x) {
+                for (size_t y = 0; y < samplesPerAxis[1]; ++y) {
+                    for (size_t z = 0; z < samplesPerAxis[2]; ++z) {
+                        glm::vec3 t{
+                            (float(x) + 0.5f) / float(samplesPerAxis[0]),
+                            (float(y) + 0.5f) / float(samplesPerAxis[1]),
+                            (float(z) + 0.5f) / float(samplesPerAxis[2]),
+                        };
+                        m_lightLODSamplePoints.push_back(m_model.boundingBox.min + t * sceneSize);
+                    }
+                }
+            }
+
 
             m_toneMapParams.width = m_width;
             m_toneMapParams.width = m_height;
@@ -261,18 +616,50 @@ namespace example
                     bgfx::destroy(m_lightGBuffer);
                 }
 
+                if (bgfx::isValid(m_visibilityFrameBuffer)) {
+                    bgfx::destroy(m_visibilityFrameBuffer);
+                    bgfx::destroy(m_visibilityTex);
+                }
+
+                if (bgfx::isValid(m_lowResGBuffer)) {
+                    bgfx::destroy(m_lowResGBuffer);
+                    bgfx::destroy(m_lowResLightBuffer);
+                    bgfx::destroy(m_lowResLightTex);
+                }
+
+                if (bgfx::isValid(m_readbackDepthTex)) {
+                    bgfx::destroy(m_readbackDepthTex);
+                    bgfx::destroy(m_readbackRadianceTex);
+                }
+
                 m_toneMapPass.destroy();
 
                 // Cleanup.
                 destroy(m_pbrUniforms);
                 destroy(m_deferredSceneUniforms);
                 destroy(m_pointLightUniforms);
+                destroy(m_visibilityUniforms);
+                destroy(m_reducedResolutionUniforms);
+                destroy(m_visibilitySceneBuffers);
+                destroy(m_visibilityTiles);
                 bgfx::destroy(m_writeToRTProgram);
                 bgfx::destroy(m_lightStencilProgram);
                 bgfx::destroy(m_pointLightVolumeProgram);
+                bgfx::destroy(m_writeToCompactRTProgram);
+                bgfx::destroy(m_compactPointLightVolumeProgram);
                 bgfx::destroy(m_emissivePassProgram);
+                bgfx::destroy(m_visibilityProgram);
+                bgfx::destroy(m_visibilityMaskedProgram);
+                bgfx::destroy(m_visibilityClassifyProgram);
+                bgfx::destroy(m_visibilityDispatchArgsProgram);
+                bgfx::destroy(m_visibilityResolveProgram);
+                bgfx::destroy(m_downsampleGBufferProgram);
+                bgfx::destroy(m_bilateralUpsampleProgram);
                 destroy(m_model);
+                m_textureStreamer.destroy();
+                bae::getTextureCache().destroy();
                 m_lightSet.destroy();
+                m_jobSystem.destroy();
 
                 cameraDestroy();
 
@@ -290,6 +677,8 @@ namespace example
             m_oldWidth = m_width;
             m_oldHeight = m_height;
             m_oldReset = m_reset;
+            m_oldGBufferLayout = m_gbufferLayout;
+            m_oldLightResolution = m_lightResolution;
 
             uint32_t msaa = (m_reset & BGFX_RESET_MSAA_MASK) >> BGFX_RESET_MSAA_SHIFT;
 
@@ -311,6 +700,34 @@ namespace example
                 m_gbufferTex[5].idx = bgfx::kInvalidHandle;
             }
 
+            if (bgfx::isValid(m_visibilityFrameBuffer))
+            {
+                bgfx::destroy(m_visibilityFrameBuffer);
+                bgfx::destroy(m_visibilityTex);
+                m_visibilityFrameBuffer.idx = bgfx::kInvalidHandle;
+                m_visibilityTex.idx = bgfx::kInvalidHandle;
+            }
+
+            if (bgfx::isValid(m_lowResGBuffer))
+            {
+                bgfx::destroy(m_lowResGBuffer);
+                bgfx::destroy(m_lowResLightBuffer);
+                bgfx::destroy(m_lowResLightTex);
+                m_lowResGBuffer.idx = bgfx::kInvalidHandle;
+                m_lowResLightBuffer.idx = bgfx::kInvalidHandle;
+                m_lowResLightTex.idx = bgfx::kInvalidHandle;
+            }
+
+            // Our readback targets need to match our G-buffer size, so they get recreated the next time we measure
+            if (bgfx::isValid(m_readbackDepthTex))
+            {
+                bgfx::destroy(m_readbackDepthTex);
+                bgfx::destroy(m_readbackRadianceTex);
+                m_readbackDepthTex.idx = bgfx::kInvalidHandle;
+                m_readbackRadianceTex.idx = bgfx::kInvalidHandle;
+                m_upsampleReadbackPending = false;
+            }
+
             const uint64_t tsFlags = 0
                 | BGFX_SAMPLER_MIN_POINT
                 | BGFX_SAMPLER_MAG_POINT
@@ -319,31 +736,95 @@ namespace example
                 | BGFX_SAMPLER_V_CLAMP
                 ;
 
-            bgfx::Attachment gbufferAt[6] = {};
-
-            // The gBuffers store the following, in order:
-            // - RGB - Base Color, A -Roughness
-            // - RGB16 - Normal, A - Metalness
-            // - RGB - Emissive, A - Occlusion
-            // - R32F - Depth
-            // - RGBA16F - Final Radiance
-            m_gbufferTex[0] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
-            m_gbufferTex[1] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
-            m_gbufferTex[2] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
-            m_gbufferTex[3] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::R32F, BGFX_TEXTURE_RT | tsFlags);
-            m_gbufferTex[4] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
-
-            gbufferAt[0].init(m_gbufferTex[0]);
-            gbufferAt[1].init(m_gbufferTex[1]);
-            gbufferAt[2].init(m_gbufferTex[2]);
-            gbufferAt[3].init(m_gbufferTex[3]);
-            gbufferAt[4].init(m_gbufferTex[4]);
-
-            m_gbufferTex[5] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT | tsFlags);
-            gbufferAt[5].init(m_gbufferTex[5]);
-
-            m_gBuffer = bgfx::createFrameBuffer(BX_COUNTOF(gbufferAt), gbufferAt, true);
-            m_lightGBuffer = bgfx::createFrameBuffer(2, &gbufferAt[4], false);
+            if (m_gbufferLayout == GBufferLayout::FULL) {
+                bgfx::Attachment gbufferAt[6] = {};
+
+                // The gBuffers store the following, in order:
+                // - RGB - Base Color, A -Roughness
+                // - RGB16 - Normal, A - Metalness
+                // - RGB - Emissive, A - Occlusion
+                // - R32F - Depth
+                // - RGBA16F - Final Radiance
+                // The first four can also be written to by our visibility buffer resolve
+                const uint64_t gbufferFlags = BGFX_TEXTURE_RT | BGFX_TEXTURE_COMPUTE_WRITE | tsFlags;
+                m_gbufferTex[0] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, gbufferFlags);
+                m_gbufferTex[1] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, gbufferFlags);
+                m_gbufferTex[2] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, gbufferFlags);
+                m_gbufferTex[3] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::R32F, gbufferFlags);
+                m_gbufferTex[4] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
+
+                gbufferAt[0].init(m_gbufferTex[0]);
+                gbufferAt[1].init(m_gbufferTex[1]);
+                gbufferAt[2].init(m_gbufferTex[2]);
+                gbufferAt[3].init(m_gbufferTex[3]);
+                gbufferAt[4].init(m_gbufferTex[4]);
+
+                m_gbufferTex[5] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT | tsFlags);
+                gbufferAt[5].init(m_gbufferTex[5]);
+
+                m_gBuffer = bgfx::createFrameBuffer(BX_COUNTOF(gbufferAt), gbufferAt, true);
+                m_lightGBuffer = bgfx::createFrameBuffer(2, &gbufferAt[4], false);
+
+                // Draw and triangle IDs, packed into RGBA8. We share the G-buffer's depth stencil
+                // so that our light volumes can still use it after the resolve.
+                m_visibilityTex = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
+                bgfx::Attachment visibilityAt[2] = {};
+                visibilityAt[0].init(m_visibilityTex);
+                visibilityAt[1].init(m_gbufferTex[5]);
+                m_visibilityFrameBuffer = bgfx::createFrameBuffer(BX_COUNTOF(visibilityAt), visibilityAt, false);
+                resize(m_visibilityTiles, m_width, m_height);
+
+                const uint32_t lightFactor = getLightResolutionFactor(m_lightResolution);
+                if (lightFactor > 1) {
+                    // Same layout as our full resolution G-buffer, so the light volumes can use it as is. The depth
+                    // stencil gets written by our downsample pass, for the light volumes' stencil test.
+                    const uint16_t lowResWidth = uint16_t((m_width + lightFactor - 1) / lightFactor);
+                    const uint16_t lowResHeight = uint16_t((m_height + lightFactor - 1) / lightFactor);
+                    m_lowResGBufferTex[0] = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
+                    m_lowResGBufferTex[1] = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
+                    m_lowResGBufferTex[2] = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
+                    m_lowResGBufferTex[3] = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::R32F, BGFX_TEXTURE_RT | tsFlags);
+                    m_lowResGBufferTex[4] = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT | tsFlags);
+                    m_lowResLightTex = bgfx::createTexture2D(lowResWidth, lowResHeight, false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
+
+                    bgfx::Attachment lowResAt[6] = {};
+                    for (size_t i = 0; i < BX_COUNTOF(m_lowResGBufferTex); ++i) {
+                        lowResAt[i].init(m_lowResGBufferTex[i]);
+                    }
+                    lowResAt[5].init(m_lowResLightTex);
+                    m_lowResGBuffer = bgfx::createFrameBuffer(BX_COUNTOF(m_lowResGBufferTex), lowResAt, true);
+
+                    bgfx::Attachment lowResLightAt[2] = { lowResAt[5], lowResAt[4] };
+                    m_lowResLightBuffer = bgfx::createFrameBuffer(BX_COUNTOF(lowResLightAt), lowResLightAt, false);
+                }
+            }
+            else {
+                bgfx::Attachment gbufferAt[4] = {};
+
+                // The compact gBuffers store the following, in order:
+                // - RGB - Base Color, A - Occlusion
+                // - RG - Octahedral Normal, B - Roughness, A - Metalness
+                // - RGBA16F - Final Radiance, which emissive gets written to directly
+                // - D24S8 - Depth, which we also sample to reconstruct position
+                // Slots 2 and 3 are left empty so the rest of the code can keep indexing the same way
+                bgfx::TextureFormat::Enum normalFormat = m_gbufferLayout == GBufferLayout::COMPACT_16
+                    ? bgfx::TextureFormat::RGBA16
+                    : bgfx::TextureFormat::RGBA8;
+                m_gbufferTex[0] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | tsFlags);
+                m_gbufferTex[1] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, normalFormat, BGFX_TEXTURE_RT | tsFlags);
+                m_gbufferTex[4] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT | tsFlags);
+                m_gbufferTex[5] = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT | tsFlags);
+
+                gbufferAt[0].init(m_gbufferTex[0]);
+                gbufferAt[1].init(m_gbufferTex[1]);
+                gbufferAt[2].init(m_gbufferTex[4]);
+                gbufferAt[3].init(m_gbufferTex[5]);
+
+                m_gBuffer = bgfx::createFrameBuffer(BX_COUNTOF(gbufferAt), gbufferAt, true);
+                // We sample the depth buffer during the lighting pass, so it can't be attached here.
+                // That also means no stencil pass, so the light volumes rely on the shader to reject pixels.
+                m_lightGBuffer = bgfx::createFrameBuffer(1, &gbufferAt[2], false);
+            }
 
             m_toneMapParams.width = m_width;
             m_toneMapParams.height = m_height;
@@ -395,7 +876,9 @@ namespace example
             if (!bgfx::isValid(m_hdrFrameBuffer)
                 || m_oldWidth != m_width
                 || m_oldHeight != m_height
-                || m_oldReset != m_reset) {
+                || m_oldReset != m_reset
+                || m_oldGBufferLayout != m_gbufferLayout
+                || m_oldLightResolution != m_lightResolution) {
                 initializeFrameBuffers();
             }
 
@@ -428,23 +911,193 @@ namespace example
             ImGui::SliderInt("Num lights", &numActiveLights, 1, int(m_lightSet.maxNumLights));
             ImGui::DragFloat("Total Brightness", &m_totalBrightness, 0.5f, 0.0f, 250.0f);
 
+            if (m_dispatchIndirectSupported) {
+                int renderMode = int(m_renderMode);
+                ImGui::Combo("Render Mode", &renderMode, RENDER_MODE_NAMES, BX_COUNTOF(RENDER_MODE_NAMES));
+                m_renderMode = RenderMode(renderMode);
+            }
+            else {
+                ImGui::Text("Indirect dispatch isn't supported, so no visibility buffer.");
+            }
+
+            if (m_renderMode == RenderMode::GBUFFER) {
+                int gbufferLayout = int(m_gbufferLayout);
+                ImGui::Combo("G-Buffer Layout", &gbufferLayout, GBUFFER_LAYOUT_NAMES, BX_COUNTOF(GBUFFER_LAYOUT_NAMES));
+                m_gbufferLayout = GBufferLayout(gbufferLayout);
+            }
+            else {
+                // Our resolve writes out the full G-buffer, so that the lighting passes stay the same
+                m_gbufferLayout = GBufferLayout::FULL;
+                ImGui::Text("Draws: %u, Materials: %u"
+                    , uint32_t(m_visibilityScene.draws.size())
+                    , uint32_t(m_visibilityScene.materials.size()));
+            }
+            ImGui::Text("G-Buffer: %u bytes per pixel", getGBufferBytesPerPixel(m_gbufferLayout));
+
+            int drawOrder = int(m_drawOrder);
+            ImGui::Combo("Draw Order", &drawOrder, DRAW_ORDER_NAMES, BX_COUNTOF(DRAW_ORDER_NAMES));
+            m_drawOrder = DrawOrder(drawOrder);
+
+            ImGui::Text("Geometry: %.2f ms", m_passTimings.geometryMs);
+            ImGui::Text("Resolve: %.2f ms", m_passTimings.resolveMs);
+            ImGui::Text("Lighting: %.2f ms", m_passTimings.lightingMs);
+            if (ImGui::Button("Record Timings")) {
+                m_timingRecords.push_back({ m_renderMode, m_drawOrder, m_width, m_height, m_passTimings });
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Timings")) {
+                m_timingRecords.clear();
+            }
+            if (!m_timingRecords.empty()) {
+                ImGui::Columns(6, "timings");
+                ImGui::Text("Mode");
+                ImGui::NextColumn();
+                ImGui::Text("Resolution");
+                ImGui::NextColumn();
+                ImGui::Text("Order");
+                ImGui::NextColumn();
+                ImGui::Text("Geometry");
+                ImGui::NextColumn();
+                ImGui::Text("Resolve");
+                ImGui::NextColumn();
+                ImGui::Text("Lighting");
+                ImGui::NextColumn();
+                ImGui::Separator();
+                for (const TimingRecord& record : m_timingRecords) {
+                    ImGui::Text("%s", RENDER_MODE_NAMES[int(record.renderMode)]);
+                    ImGui::NextColumn();
+                    ImGui::Text("%ux%u", record.width, record.height);
+                    ImGui::NextColumn();
+                    ImGui::Text("%s", DRAW_ORDER_NAMES[int(record.drawOrder)]);
+                    ImGui::NextColumn();
+                    ImGui::Text("%.2f ms", record.timings.geometryMs);
+                    ImGui::NextColumn();
+                    ImGui::Text("%.2f ms", record.timings.resolveMs);
+                    ImGui::NextColumn();
+                    ImGui::Text("%.2f ms", record.timings.lightingMs);
+                    ImGui::NextColumn();
+                }
+                ImGui::Columns(1);
+            }
+
+            if (m_gbufferLayout == GBufferLayout::FULL) {
+                int lightResolution = int(m_lightResolution);
+                ImGui::Combo("Light Resolution", &lightResolution, LIGHT_RESOLUTION_NAMES, BX_COUNTOF(LIGHT_RESOLUTION_NAMES));
+                m_lightResolution = LightResolution(lightResolution);
+                ImGui::SliderFloat("Upsample Depth Sigma", &m_upsampleDepthSigma, 0.001f, 0.5f);
+                // Renders a full resolution frame, and runs the CPU version of our downsample and upsample on it
+                if (ImGui::Button("Measure Upsample Error") && m_readbackSupported) {
+                    m_upsampleErrorRequested = true;
+                }
+                ImGui::Text("Upsample Error: RMS %.4f, Max %.4f", m_upsampleError.rmsRelative, m_upsampleError.maxRelative);
+            }
+            else {
+                // The compact G-buffer doesn't use the stencil pass that our reduced resolution lighting relies on
+                m_lightResolution = LightResolution::FULL;
+            }
+
+            ImGui::Separator();
+            int budgetMb = int(m_textureStreamingParams.budgetBytes >> 20);
+            ImGui::SliderInt("Texture Budget (MB)", &budgetMb, 16, 1024);
+            m_textureStreamingParams.budgetBytes = uint64_t(budgetMb) << 20;
+            m_textureStreamer.setParams(m_textureStreamingParams);
+            const bae::TextureStreamingStats& streamingStats = m_textureStreamer.getStats();
+            ImGui::Text("Textures: %.1f / %.1f MB resident"
+                , double(streamingStats.residentBytes) / (1024.0 * 1024.0)
+                , double(streamingStats.fullBytes) / (1024.0 * 1024.0));
+            ImGui::Text("Streamed: %u in, %u out, %u pending (%u loading)"
+                , streamingStats.streamedIn
+                , streamingStats.streamedOut
+                , streamingStats.pending
+                , streamingStats.loading);
+            ImGui::Checkbox("Show Texture Residency", &m_showTextureResidency);
+            if (m_showTextureResidency) {
+                for (size_t i = 0; i < m_textureStreamer.getTextureCount(); ++i) {
+                    const bae::StreamedTextureInfo& info = m_textureStreamer.getInfo(i);
+                    ImGui::Text("%s: mip %u of %u, wants %u"
+                        , info.path.c_str()
+                        , info.residentMip
+                        , info.mipCount
+                        , info.requestedMip);
+                }
+            }
+            ImGui::Separator();
+
+            ImGui::Checkbox("Light LOD", &m_lightLODEnabled);
+            if (m_lightLODEnabled) {
+                int lightBudget = int(m_lightLODParams.lightBudget);
+                ImGui::SliderInt("Light Budget", &lightBudget, 1, int(m_lightSet.maxNumLights));
+                m_lightLODParams.lightBudget = uint32_t(lightBudget);
+                ImGui::SliderFloat("Min Coverage (px)", &m_lightLODParams.minScreenCoverage, 0.0f, 256.0f);
+                ImGui::SliderFloat("Merge Threshold (px)", &m_lightLODParams.mergeThreshold, 0.0f, 128.0f);
+                ImGui::Text("Lights: %u in, %u out", m_lightLODStats.inputLights, m_lightLODStats.outputLights);
+                ImGui::Text("Merged: %u, Dropped: %u", m_lightLODStats.mergedLights, m_lightLODStats.droppedLights);
+                ImGui::Checkbox("Measure LOD Error", &m_measureLightLODError);
+                if (m_measureLightLODError) {
+                    ImGui::Text("RMS Error: %.3f", m_lightLODError.rmsRelative);
+                    ImGui::Text("Max Error: %.3f", m_lightLODError.maxRelative);
+                    ImGui::Text("Measured on %u threads", m_jobSystem.getThreadCount());
+                }
+            }
+
             ImGui::End();
 
             imguiEndFrame();
 
+            // Our framebuffers only match the render mode once they've been re-initialized
+            const bool visibilityBuffer = m_renderMode == RenderMode::VISIBILITY_BUFFER && bgfx::isValid(m_visibilityFrameBuffer);
+
             bgfx::ViewId meshPass = 0;
             bgfx::setViewRect(meshPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
-            bgfx::setViewFrameBuffer(meshPass, m_gBuffer);
+            bgfx::setViewFrameBuffer(meshPass, visibilityBuffer ? m_visibilityFrameBuffer : m_gBuffer);
+            // Our visibility buffer uses zero to mark pixels that nothing was drawn to
+            bgfx::setViewClear(meshPass
+                , BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH | BGFX_CLEAR_STENCIL
+                , visibilityBuffer ? 0x00000000 : 0x000000ff
+                , 1.0f
+                , 0
+            );
             bgfx::setViewName(meshPass, "Draw Meshes");
 
-            bgfx::ViewId lightingPass = 1;
-            bgfx::setViewFrameBuffer(lightingPass, m_lightGBuffer);
-            bgfx::setViewRect(lightingPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+            bgfx::ViewId resolvePass = 1;
+            bgfx::setViewRect(resolvePass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+            // Classifying tiles, writing the dispatch arguments and resolving have to happen in that order
+            bgfx::setViewMode(resolvePass, bgfx::ViewMode::Sequential);
+            bgfx::setViewName(resolvePass, "Visibility Resolve");
+
+            // Measuring our upsample error needs a full resolution reference to compare against
+            const bool measureUpsampleError = m_upsampleErrorRequested
+                && !m_upsampleReadbackPending
+                && m_gbufferLayout == GBufferLayout::FULL;
+            const uint32_t lightFactor = getLightResolutionFactor(m_lightResolution);
+            const bool reducedResolution = lightFactor > 1 && bgfx::isValid(m_lowResGBuffer) && !measureUpsampleError;
+            const uint16_t lightWidth = uint16_t(reducedResolution ? (m_width + lightFactor - 1) / lightFactor : m_width);
+            const uint16_t lightHeight = uint16_t(reducedResolution ? (m_height + lightFactor - 1) / lightFactor : m_height);
+
+            bgfx::ViewId downsamplePass = 2;
+            bgfx::setViewFrameBuffer(downsamplePass, m_lowResGBuffer);
+            bgfx::setViewRect(downsamplePass, 0, 0, lightWidth, lightHeight);
+            bgfx::setViewClear(downsamplePass, BGFX_CLEAR_DEPTH | BGFX_CLEAR_STENCIL, 0x00000000, 1.0f, 0);
+            bgfx::setViewName(downsamplePass, "Downsample G-Buffer");
+
+            bgfx::ViewId lightingPass = 3;
+            bgfx::setViewFrameBuffer(lightingPass, reducedResolution ? m_lowResLightBuffer : m_lightGBuffer);
+            bgfx::setViewRect(lightingPass, 0, 0, lightWidth, lightHeight);
+            // Our final radiance target usually gets cleared along with the G-buffer, which we skip rasterizing
+            // when using the visibility buffer. Our low resolution target always needs a clear.
+            bgfx::setViewClear(lightingPass, visibilityBuffer || reducedResolution ? BGFX_CLEAR_COLOR : BGFX_CLEAR_NONE, 0x00000000, 1.0f, 0);
             // We want our draw calls to execute in order
             bgfx::setViewMode(lightingPass, bgfx::ViewMode::Sequential);
             bgfx::setViewName(lightingPass, "Lighting Pass");
 
-            bgfx::ViewId emissivePass = 2;
+            bgfx::ViewId upsamplePass = 4;
+            bgfx::setViewFrameBuffer(upsamplePass, m_lightGBuffer);
+            bgfx::setViewRect(upsamplePass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+            // With both the visibility buffer and reduced resolution lighting, this is the first pass to touch our final radiance
+            bgfx::setViewClear(upsamplePass, visibilityBuffer && reducedResolution ? BGFX_CLEAR_COLOR : BGFX_CLEAR_NONE, 0x00000000, 1.0f, 0);
+            bgfx::setViewName(upsamplePass, "Upsample Lighting");
+
+            bgfx::ViewId emissivePass = 5;
             bgfx::setViewFrameBuffer(emissivePass, m_lightGBuffer);
             bgfx::setViewRect(emissivePass, 0, 0, uint16_t(m_width), uint16_t(m_height));
             bgfx::setViewName(emissivePass, "Emissive Pass");
@@ -463,7 +1116,7 @@ namespace example
             m_time += deltaTime;
 
             float proj[16];
-            bx::mtxProj(proj, 60.0f, float(m_width) / float(m_height), 0.1f, 1000.0f, bgfx::getCaps()->homogeneousDepth);
+            bx::mtxProj(proj, 60.0f, float(m_width) / float(m_height), CAMERA_NEAR, CAMERA_FAR, bgfx::getCaps()->homogeneousDepth);
 
             // Update camera
             float view[16];
@@ -487,30 +1140,116 @@ namespace example
             bx::Vec3 cameraPos = cameraGetPosition();
             bgfx::setUniform(m_deferredSceneUniforms.u_cameraPos, &cameraPos.x);
 
+            const bgfx::ProgramHandle gbufferProgram = m_gbufferLayout == GBufferLayout::FULL
+                ? m_writeToRTProgram
+                : m_writeToCompactRTProgram;
+            const bgfx::ProgramHandle opaqueProgram = visibilityBuffer ? m_visibilityProgram : gbufferProgram;
+            const bgfx::ProgramHandle maskedProgram = visibilityBuffer ? m_visibilityMaskedProgram : gbufferProgram;
+
+            const glm::vec3 eyePos{ cameraPos.x, cameraPos.y, cameraPos.z };
+
+            // Stream texture mips in and out before anything binds them, since swapped handles get destroyed. Every
+            // copy of the materials has to follow the swaps, including the visibility buffer's.
+            {
+                glm::vec4 frustumPlanes[6];
+                bae::extractFrustumPlanes(glm::make_mat4(proj) * glm::make_mat4(view), bgfx::getCaps()->homogeneousDepth, frustumPlanes);
+                const float projScale = 0.5f * float(m_height) * proj[5];
+                requestStreamedTextures(m_textureStreamer, m_model.opaqueMeshes, m_opaqueUvDensities, frustumPlanes, eyePos, projScale, m_currentFrame);
+                requestStreamedTextures(m_textureStreamer, m_model.maskedMeshes, m_maskedUvDensities, frustumPlanes, eyePos, projScale, m_currentFrame);
+
+                m_textureSwaps.clear();
+                m_textureStreamer.update(m_currentFrame, meshPass, m_textureSwaps);
+                bae::applyTextureSwaps(m_textureSwaps, m_model.opaqueMeshes.materials);
+                bae::applyTextureSwaps(m_textureSwaps, m_model.maskedMeshes.materials);
+                bae::applyTextureSwaps(m_textureSwaps, m_visibilityScene.materials);
+            }
+
             // Render all our opaque meshes
             const bae::MeshGroup& meshes = m_model.opaqueMeshes;
-            for (size_t i = 0; i < meshes.meshes.size(); ++i) {
+            sortDraws(meshes, m_drawOrder, eyePos, m_opaqueDrawOrder);
+            for (const uint32_t i : m_opaqueDrawOrder) {
                 const auto& mesh = meshes.meshes[i];
                 const auto& transform = meshes.transforms[i];
                 const auto& material = meshes.materials[i];
 
                 bgfx::setState(stateOpaque);
-                bindUniforms(m_pbrUniforms, material, transform);
+                if (visibilityBuffer) {
+                    glm::vec4 drawParams{ float(m_opaqueFirstDrawId + i), 0.0f, 0.0f, 0.0f };
+                    bgfx::setUniform(m_visibilityUniforms.u_drawParams, glm::value_ptr(drawParams));
+                    bindVisibilityUniforms(m_pbrUniforms, material, transform, false);
+                }
+                else {
+                    bindUniforms(m_pbrUniforms, material, transform);
+                }
                 mesh.setBuffers();
-                bgfx::submit(meshPass, m_writeToRTProgram);
+                bgfx::submit(meshPass, opaqueProgram);
             }
 
             // Render all our masked meshes
             const bae::MeshGroup& maskedMeshes = m_model.maskedMeshes;
-            for (size_t i = 0; i < maskedMeshes.meshes.size(); ++i) {
+            sortDraws(maskedMeshes, m_drawOrder, eyePos, m_maskedDrawOrder);
+            for (const uint32_t i : m_maskedDrawOrder) {
                 const auto& mesh = maskedMeshes.meshes[i];
                 const auto& transform = maskedMeshes.transforms[i];
                 const auto& material = maskedMeshes.materials[i];
 
                 bgfx::setState(stateOpaque);
-                bindUniforms(m_pbrUniforms, material, transform);
+                if (visibilityBuffer) {
+                    glm::vec4 drawParams{ float(m_maskedFirstDrawId + i), 0.0f, 0.0f, 0.0f };
+                    bgfx::setUniform(m_visibilityUniforms.u_drawParams, glm::value_ptr(drawParams));
+                    bindVisibilityUniforms(m_pbrUniforms, material, transform, true);
+                }
+                else {
+                    bindUniforms(m_pbrUniforms, material, transform);
+                }
                 mesh.setBuffers();
-                bgfx::submit(meshPass, m_writeToRTProgram);
+                bgfx::submit(meshPass, maskedProgram);
+            }
+
+            if (visibilityBuffer) {
+                // Resolve our visibility buffer into the same G-buffer the raster path writes. Without bindless
+                // textures we still need a dispatch per material, so we first list the tiles each material
+                // covers and then dispatch each one over its own tiles only. Every pixel gets read by the
+                // classification once and shaded once, plus the odd pixel in tiles shared by materials.
+                bgfx::setViewTransform(resolvePass, view, proj);
+                const uint16_t groupsX = uint16_t((m_width + VISIBILITY_TILE_SIZE - 1) / VISIBILITY_TILE_SIZE);
+                const uint16_t groupsY = uint16_t((m_height + VISIBILITY_TILE_SIZE - 1) / VISIBILITY_TILE_SIZE);
+                const uint32_t binCount = m_visibilityTiles.binCount;
+                glm::vec4 classifyParams{ float(binCount), 0.0f, float(m_width), float(m_height) };
+
+                bgfx::setUniform(m_visibilityUniforms.u_classifyParams, glm::value_ptr(classifyParams));
+                bgfx::setImage(0, m_visibilityTex, 0, bgfx::Access::Read, bgfx::TextureFormat::RGBA8);
+                bgfx::setBuffer(1, m_visibilitySceneBuffers.draws, bgfx::Access::Read);
+                bgfx::setBuffer(2, m_visibilityTiles.tileCounts, bgfx::Access::ReadWrite);
+                bgfx::setBuffer(3, m_visibilityTiles.tileLists, bgfx::Access::Write);
+                bgfx::dispatch(resolvePass, m_visibilityClassifyProgram, groupsX, groupsY, 1);
+
+                bgfx::setUniform(m_visibilityUniforms.u_classifyParams, glm::value_ptr(classifyParams));
+                bgfx::setBuffer(0, m_visibilityTiles.tileCounts, bgfx::Access::ReadWrite);
+                bgfx::setBuffer(1, m_visibilityTiles.dispatchArgs, bgfx::Access::Write);
+                bgfx::dispatch(resolvePass, m_visibilityDispatchArgsProgram, uint16_t((binCount + VISIBILITY_CLASSIFY_THREADS - 1) / VISIBILITY_CLASSIFY_THREADS), 1, 1);
+
+                for (uint32_t i = 0; i < binCount; ++i) {
+                    // The last bin has no material, it clears the pixels that no draw covered
+                    const bool backgroundBin = i == binCount - 1;
+                    glm::vec4 resolveParams{ float(i), backgroundBin ? 1.0f : 0.0f, float(m_width), float(m_height) };
+                    bgfx::setUniform(m_visibilityUniforms.u_resolveParams, glm::value_ptr(resolveParams));
+                    if (!backgroundBin) {
+                        bindMaterial(m_pbrUniforms, m_visibilityScene.materials[i]);
+                    }
+                    bgfx::setImage(5, m_visibilityTex, 0, bgfx::Access::Read, bgfx::TextureFormat::RGBA8);
+                    bgfx::setBuffer(6, m_visibilitySceneBuffers.positions, bgfx::Access::Read);
+                    bgfx::setBuffer(7, m_visibilitySceneBuffers.normals, bgfx::Access::Read);
+                    bgfx::setBuffer(8, m_visibilitySceneBuffers.tangents, bgfx::Access::Read);
+                    bgfx::setBuffer(9, m_visibilitySceneBuffers.triangles, bgfx::Access::Read);
+                    bgfx::setBuffer(10, m_visibilitySceneBuffers.draws, bgfx::Access::Read);
+                    bgfx::setImage(11, m_gbufferTex[0], 0, bgfx::Access::Write, bgfx::TextureFormat::RGBA8);
+                    bgfx::setImage(12, m_gbufferTex[1], 0, bgfx::Access::Write, bgfx::TextureFormat::RGBA16F);
+                    bgfx::setImage(13, m_gbufferTex[2], 0, bgfx::Access::Write, bgfx::TextureFormat::RGBA8);
+                    bgfx::setImage(14, m_gbufferTex[3], 0, bgfx::Access::Write, bgfx::TextureFormat::R32F);
+                    bgfx::setBuffer(15, m_visibilityTiles.tileLists, bgfx::Access::Read);
+                    bgfx::dispatch(resolvePass, m_visibilityResolveProgram, m_visibilityTiles.dispatchArgs, uint16_t(i), 1);
+                }
             }
 
             {
@@ -524,8 +1263,7 @@ namespace example
 
                 float N = float(m_lightSet.numActiveLights);
                 float intensity = m_totalBrightness / N;
-                constexpr float EPSILON = 0.01f;
-                float radius = bx::sqrt(intensity / EPSILON);
+                float radius = bx::sqrt(intensity / LIGHT_FALLOFF_EPSILON);
 
                 for (size_t i = 0; i < m_lightSet.numActiveLights; ++i) {
                     glm::vec3& initial = m_lightSet.initialPositions[i];
@@ -542,12 +1280,104 @@ namespace example
                 }
             }
 
+            const glm::vec4* lightPositionRadius = m_lightSet.positionRadiusData.data();
+            const glm::vec4* lightColorIntensity = m_lightSet.colorIntensityData.data();
+            size_t lightCount = m_lightSet.numActiveLights;
+            if (m_lightLODEnabled) {
+                glm::mat4 viewMtx = glm::make_mat4(view);
+                bae::LightLODView lodView{};
+                lodView.cameraPos = glm::vec3{ cameraPos.x, cameraPos.y, cameraPos.z };
+                lodView.cameraForward = glm::vec3{ viewMtx[0][2], viewMtx[1][2], viewMtx[2][2] };
+                lodView.projScale = proj[5];
+                lodView.viewportWidth = float(m_width);
+                lodView.viewportHeight = float(m_height);
+                m_lightLODParams.falloffEpsilon = LIGHT_FALLOFF_EPSILON;
+
+                m_lightSet.lightTree.build(lightPositionRadius, lightColorIntensity, lightCount);
+                m_lightSet.lightTree.selectLights(
+                    lodView,
+                    m_lightLODParams,
+                    m_lightSet.lodPositionRadiusData,
+                    m_lightSet.lodColorIntensityData,
+                    &m_lightLODStats);
+
+                if (m_measureLightLODError) {
+                    m_lightLODError = bae::computeLightingError(
+                        lightPositionRadius,
+                        lightColorIntensity,
+                        lightCount,
+                        m_lightSet.lodPositionRadiusData.data(),
+                        m_lightSet.lodColorIntensityData.data(),
+                        m_lightSet.lodPositionRadiusData.size(),
+                        m_lightLODSamplePoints,
+                        &m_jobSystem);
+                }
+
+                lightPositionRadius = m_lightSet.lodPositionRadiusData.data();
+                lightColorIntensity = m_lightSet.lodColorIntensityData.data();
+                lightCount = m_lightSet.lodPositionRadiusData.size();
+            }
+
+            float orthoProjection[16];
+            bx::mtxOrtho(orthoProjection, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 2.0f, 0.0f, m_caps->homogeneousDepth);
+
+            // Our light volumes read from this G-buffer, which is either our full resolution one or a downsampled copy
+            const bgfx::TextureHandle* lightGBufferTex = m_gbufferTex;
+            if (reducedResolution) {
+                uint64_t downsampleState = 0
+                    | BGFX_STATE_WRITE_RGB
+                    | BGFX_STATE_WRITE_A
+                    | BGFX_STATE_WRITE_Z
+                    | BGFX_STATE_DEPTH_TEST_ALWAYS;
+                glm::vec4 downsampleParams{ float(lightFactor), 0.0f, float(m_width), float(m_height) };
+                bgfx::setState(downsampleState);
+                bae::setScreenSpaceQuad(float(lightWidth), float(lightHeight), m_caps->originBottomLeft);
+                bgfx::setViewTransform(downsamplePass, nullptr, orthoProjection);
+                bgfx::setUniform(m_reducedResolutionUniforms.u_downsampleParams, glm::value_ptr(downsampleParams));
+                bgfx::setTexture(0, m_deferredSceneUniforms.s_baseColorRoughness, m_gbufferTex[0], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(1, m_deferredSceneUniforms.s_normalMetallic, m_gbufferTex[1], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(2, m_deferredSceneUniforms.s_emissiveOcclusion, m_gbufferTex[2], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(3, m_deferredSceneUniforms.s_depth, m_gbufferTex[3], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::submit(downsamplePass, m_downsampleGBufferProgram);
+                lightGBufferTex = m_lowResGBufferTex;
+            }
+
             bgfx::setViewTransform(lightingPass, view, proj);
+            bgfx::touch(lightingPass);
+            const bool compactGBuffer = m_gbufferLayout != GBufferLayout::FULL;
             // We need to set up the stencil state for rendering our lights
             uint64_t stencilState = 0
                 | BGFX_STATE_DEPTH_TEST_LESS;
             // Lets render our light volumes
-            for (size_t i = 0; i < m_lightSet.numActiveLights; ++i) {
+            for (size_t i = 0; i < lightCount; ++i) {
+                glm::mat4 modelTransform = glm::identity<glm::mat4>();
+                glm::vec3 position{ lightPositionRadius[i].x, lightPositionRadius[i].y, lightPositionRadius[i].z };
+                glm::vec3 scale{ lightPositionRadius[i].w };
+                modelTransform = glm::scale(
+                    glm::translate(modelTransform, position),
+                    scale
+                );
+
+                if (compactGBuffer) {
+                    // No stencil pass here, since our depth buffer is bound as a texture instead. We draw
+                    // the back faces so that the volume still gets shaded when the camera is inside it.
+                    uint64_t lightVolumeState = 0
+                        | BGFX_STATE_WRITE_RGB
+                        | BGFX_STATE_CULL_CW
+                        | BGFX_STATE_BLEND_ADD;
+
+                    bgfx::setTransform(glm::value_ptr(modelTransform));
+                    bgfx::setState(lightVolumeState);
+                    m_lightSet.volumeMesh.setBuffers();
+                    bgfx::setTexture(0, m_deferredSceneUniforms.s_baseColorOcclusion, m_gbufferTex[0], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                    bgfx::setTexture(1, m_deferredSceneUniforms.s_normalRoughnessMetallic, m_gbufferTex[1], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                    bgfx::setTexture(3, m_deferredSceneUniforms.s_depth, m_gbufferTex[5], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                    bgfx::setUniform(m_pointLightUniforms.u_lightPosRadius, glm::value_ptr(lightPositionRadius[i]));
+                    bgfx::setUniform(m_pointLightUniforms.u_lightColorIntensity, glm::value_ptr(lightColorIntensity[i]));
+                    bgfx::submit(lightingPass, m_compactPointLightVolumeProgram);
+                    continue;
+                }
+
                 // First, we render our light volumes purely to determine stencil state
                 // We determine whether a light volume should be rendered by the following algo:
                 //   1) The front faces must be IN FRONT of scene geometry
@@ -568,14 +1398,6 @@ namespace example
                     | BGFX_STENCIL_OP_FAIL_Z_KEEP
                     | BGFX_STENCIL_OP_PASS_Z_INCR;
 
-                glm::mat4 modelTransform = glm::identity<glm::mat4>();
-                glm::vec3 position{ m_lightSet.positionRadiusData[i].x, m_lightSet.positionRadiusData[i].y, m_lightSet.positionRadiusData[i].z };
-                glm::vec3 scale{ m_lightSet.positionRadiusData[i].w };
-                modelTransform = glm::scale(
-                    glm::translate(modelTransform, position),
-                    scale
-                );
-
                 bgfx::setTransform(glm::value_ptr(modelTransform));
                 bgfx::setState(stencilState);
                 bgfx::setStencil(frontStencilFunc, backStencilFunc);
@@ -602,30 +1424,109 @@ namespace example
                 bgfx::setState(lightVolumeState);
                 bgfx::setStencil(frontStencilFunc, backStencilFunc);
                 m_lightSet.volumeMesh.setBuffers();
-                bgfx::setTexture(0, m_deferredSceneUniforms.s_baseColorRoughness, m_gbufferTex[0], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
-                bgfx::setTexture(1, m_deferredSceneUniforms.s_normalMetallic, m_gbufferTex[1], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
-                bgfx::setTexture(2, m_deferredSceneUniforms.s_emissiveOcclusion, m_gbufferTex[2], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
-                bgfx::setTexture(3, m_deferredSceneUniforms.s_depth, m_gbufferTex[3], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
-                bgfx::setUniform(m_pointLightUniforms.u_lightPosRadius, glm::value_ptr(m_lightSet.positionRadiusData[i]));
-                bgfx::setUniform(m_pointLightUniforms.u_lightColorIntensity, glm::value_ptr(m_lightSet.colorIntensityData[i]));
+                bgfx::setTexture(0, m_deferredSceneUniforms.s_baseColorRoughness, lightGBufferTex[0], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(1, m_deferredSceneUniforms.s_normalMetallic, lightGBufferTex[1], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(2, m_deferredSceneUniforms.s_emissiveOcclusion, lightGBufferTex[2], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(3, m_deferredSceneUniforms.s_depth, lightGBufferTex[3], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setUniform(m_pointLightUniforms.u_lightPosRadius, glm::value_ptr(lightPositionRadius[i]));
+                bgfx::setUniform(m_pointLightUniforms.u_lightColorIntensity, glm::value_ptr(lightColorIntensity[i]));
                 bgfx::submit(lightingPass, m_pointLightVolumeProgram);
             }
 
+            if (reducedResolution) {
+                // Add our low resolution lighting into the full resolution target, only blending between low
+                // resolution samples that are at a similar depth to the pixel we're filling in
+                uint64_t upsampleState = 0
+                    | BGFX_STATE_WRITE_RGB
+                    | BGFX_STATE_BLEND_ADD;
+                glm::vec4 upsampleParams[2] = {
+                    { float(lightFactor), m_upsampleDepthSigma, CAMERA_NEAR, CAMERA_FAR },
+                    { float(lightWidth), float(lightHeight), 0.0f, 0.0f },
+                };
+                bgfx::setState(upsampleState);
+                bae::setScreenSpaceQuad(float(m_width), float(m_height), m_caps->originBottomLeft);
+                bgfx::setViewTransform(upsamplePass, nullptr, orthoProjection);
+                bgfx::setUniform(m_reducedResolutionUniforms.u_upsampleParams, upsampleParams, 2);
+                bgfx::setTexture(0, m_reducedResolutionUniforms.s_lowResLight, m_lowResLightTex, BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(1, m_reducedResolutionUniforms.s_lowResDepth, m_lowResGBufferTex[3], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::setTexture(2, m_deferredSceneUniforms.s_depth, m_gbufferTex[3], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::submit(upsamplePass, m_bilateralUpsampleProgram);
+            }
+
+            if (measureUpsampleError) {
+                // Blits happen before any of the view's draws, so our radiance doesn't include emissive yet
+                if (!bgfx::isValid(m_readbackDepthTex)) {
+                    m_readbackDepthTex = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::R32F, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+                    m_readbackRadianceTex = bgfx::createTexture2D(uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+                }
+                m_readbackDepth.resize(size_t(m_width) * m_height);
+                m_readbackRadiance.resize(size_t(m_width) * m_height * 4);
+                bgfx::blit(emissivePass, m_readbackDepthTex, 0, 0, m_gbufferTex[3]);
+                bgfx::blit(emissivePass, m_readbackRadianceTex, 0, 0, m_gbufferTex[4]);
+                bgfx::readTexture(m_readbackDepthTex, m_readbackDepth.data());
+                m_upsampleReadbackFrame = bgfx::readTexture(m_readbackRadianceTex, m_readbackRadiance.data());
+                m_upsampleReadbackPending = true;
+                m_upsampleErrorRequested = false;
+            }
+
             // Here we are simply drawing a full screen quad to add emissive radiance from our gbuffers into our final buffer
-            float orthoProjection[16];
-            bx::mtxOrtho(orthoProjection, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 2.0f, 0.0f, m_caps->homogeneousDepth);
-            uint64_t emissivePassState = 0
-                | BGFX_STATE_WRITE_RGB
-                | BGFX_STATE_BLEND_ADD;
-            bgfx::setState(emissivePassState);
-            bae::setScreenSpaceQuad(float(m_width), float(m_height), m_caps->originBottomLeft);
-            bgfx::setViewTransform(emissivePass, nullptr, orthoProjection);
-            bgfx::setTexture(0, m_deferredSceneUniforms.s_emissiveOcclusion, m_gbufferTex[2], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
-            bgfx::submit(emissivePass, m_emissivePassProgram);
+            // The compact G-buffer has already written emissive into the final buffer during the mesh pass
+            if (!compactGBuffer) {
+                uint64_t emissivePassState = 0
+                    | BGFX_STATE_WRITE_RGB
+                    | BGFX_STATE_BLEND_ADD;
+                bgfx::setState(emissivePassState);
+                bae::setScreenSpaceQuad(float(m_width), float(m_height), m_caps->originBottomLeft);
+                bgfx::setViewTransform(emissivePass, nullptr, orthoProjection);
+                bgfx::setTexture(0, m_deferredSceneUniforms.s_emissiveOcclusion, m_gbufferTex[2], BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+                bgfx::submit(emissivePass, m_emissivePassProgram);
+            }
 
             m_toneMapPass.render(m_gbufferTex[4], m_toneMapParams, deltaTime, emissivePass + 1);
 
-            bgfx::frame();
+            // These are from a previous frame, but that's good enough for comparing our modes
+            const bgfx::Stats* stats = bgfx::getStats();
+            PassTimings frameTimings{};
+            for (uint16_t i = 0; i < stats->numViews; ++i) {
+                const bgfx::ViewStats& viewStats = stats->viewStats[i];
+                const float gpuMs = float(1000.0 * double(viewStats.gpuTimeElapsed) / double(stats->gpuTimerFreq));
+                if (viewStats.view == meshPass) {
+                    frameTimings.geometryMs = gpuMs;
+                }
+                else if (viewStats.view == resolvePass) {
+                    frameTimings.resolveMs = gpuMs;
+                }
+                else if (viewStats.view >= downsamplePass && viewStats.view <= emissivePass) {
+                    frameTimings.lightingMs += gpuMs;
+                }
+            }
+            // Smooth them out a bit so they're readable
+            constexpr float timingSmoothing = 0.05f;
+            m_passTimings.geometryMs = bx::lerp(m_passTimings.geometryMs, frameTimings.geometryMs, timingSmoothing);
+            m_passTimings.resolveMs = bx::lerp(m_passTimings.resolveMs, frameTimings.resolveMs, timingSmoothing);
+            m_passTimings.lightingMs = bx::lerp(m_passTimings.lightingMs, frameTimings.lightingMs, timingSmoothing);
+
+            m_currentFrame = bgfx::frame();
+            bae::getTrackingAllocator()->endFrame();
+            bae::getFrameArena().endFrame();
+
+            if (m_upsampleReadbackPending && m_currentFrame >= m_upsampleReadbackFrame) {
+                std::vector<glm::vec3> radiance(m_readbackDepth.size());
+                for (size_t i = 0; i < radiance.size(); ++i) {
+                    radiance[i] = glm::vec3{
+                        bx::halfToFloat(m_readbackRadiance[4 * i + 0]),
+                        bx::halfToFloat(m_readbackRadiance[4 * i + 1]),
+                        bx::halfToFloat(m_readbackRadiance[4 * i + 2]),
+                    };
+                }
+                bae::BilateralUpsampleParams upsampleParams{};
+                upsampleParams.factor = bx::max(getLightResolutionFactor(m_lightResolution), 2u);
+                upsampleParams.nearZ = CAMERA_NEAR;
+                upsampleParams.farZ = CAMERA_FAR;
+                upsampleParams.depthSigma = m_upsampleDepthSigma;
+                m_upsampleError = bae::measureUpsampleError(m_readbackDepth.data(), radiance.data(), m_width, m_height, upsampleParams);
+                m_upsampleReadbackPending = false;
+            }
 
             return true;
         }
@@ -647,19 +1548,85 @@ namespace example
         bgfx::ProgramHandle m_lightStencilProgram;
         bgfx::ProgramHandle m_pointLightVolumeProgram;
         bgfx::ProgramHandle m_emissivePassProgram;
+        bgfx::ProgramHandle m_writeToCompactRTProgram;
+        bgfx::ProgramHandle m_compactPointLightVolumeProgram;
+        bgfx::ProgramHandle m_visibilityProgram;
+        bgfx::ProgramHandle m_visibilityMaskedProgram;
+        bgfx::ProgramHandle m_visibilityClassifyProgram;
+        bgfx::ProgramHandle m_visibilityDispatchArgsProgram;
+        bgfx::ProgramHandle m_visibilityResolveProgram;
+        bgfx::ProgramHandle m_downsampleGBufferProgram;
+        bgfx::ProgramHandle m_bilateralUpsampleProgram;
 
         bae::Model m_model;
         PBRShaderUniforms m_pbrUniforms;
+
+        // Mip streaming for the model's textures
+        bae::TextureStreamingParams m_textureStreamingParams;
+        bae::TextureStreamer m_textureStreamer;
+        std::vector<bae::TextureSwap> m_textureSwaps;
+        std::vector<float> m_opaqueUvDensities;
+        std::vector<float> m_maskedUvDensities;
+        bool m_showTextureResidency = false;
         DeferredSceneUniforms m_deferredSceneUniforms;
         PointLightUniforms m_pointLightUniforms;
+        VisibilityUniforms m_visibilityUniforms;
+        ReducedResolutionUniforms m_reducedResolutionUniforms;
+
+        RenderMode m_renderMode = RenderMode::GBUFFER;
+        DrawOrder m_drawOrder = DrawOrder::UNSORTED;
+        std::vector<uint32_t> m_opaqueDrawOrder;
+        std::vector<uint32_t> m_maskedDrawOrder;
+        PassTimings m_passTimings;
+        std::vector<TimingRecord> m_timingRecords;
+
+        // Visibility buffer
+        bae::VisibilityScene m_visibilityScene;
+        VisibilitySceneBuffers m_visibilitySceneBuffers;
+        VisibilityTiles m_visibilityTiles;
+        uint32_t m_opaqueFirstDrawId = 0;
+        uint32_t m_maskedFirstDrawId = 0;
+        bgfx::TextureHandle m_visibilityTex = BGFX_INVALID_HANDLE;
+        bgfx::FrameBufferHandle m_visibilityFrameBuffer = BGFX_INVALID_HANDLE;
 
         LightSet m_lightSet;
 
+        bool m_lightLODEnabled = false;
+        bool m_measureLightLODError = false;
+        bae::LightLODParams m_lightLODParams;
+        bae::LightLODStats m_lightLODStats;
+        bae::LightingError m_lightLODError;
+        std::vector<glm::vec3> m_lightLODSamplePoints;
+        bae::JobSystem m_jobSystem;
+
         float m_totalBrightness = 1.0f;
         // Deferred passes
         bgfx::FrameBufferHandle m_gBuffer = BGFX_INVALID_HANDLE;
         bgfx::FrameBufferHandle m_lightGBuffer = BGFX_INVALID_HANDLE;
         bgfx::TextureHandle m_gbufferTex[6];
+        GBufferLayout m_gbufferLayout = GBufferLayout::FULL;
+        GBufferLayout m_oldGBufferLayout = GBufferLayout::FULL;
+
+        // Reduced resolution lighting
+        LightResolution m_lightResolution = LightResolution::FULL;
+        LightResolution m_oldLightResolution = LightResolution::FULL;
+        float m_upsampleDepthSigma = 0.05f;
+        bgfx::FrameBufferHandle m_lowResGBuffer = BGFX_INVALID_HANDLE;
+        bgfx::FrameBufferHandle m_lowResLightBuffer = BGFX_INVALID_HANDLE;
+        bgfx::TextureHandle m_lowResGBufferTex[5];
+        bgfx::TextureHandle m_lowResLightTex = BGFX_INVALID_HANDLE;
+
+        // CPU copies of a full resolution frame, to measure our upsample error against
+        bool m_readbackSupported = false;
+        bool m_upsampleErrorRequested = false;
+        bool m_upsampleReadbackPending = false;
+        uint32_t m_upsampleReadbackFrame = 0;
+        uint32_t m_currentFrame = 0;
+        bgfx::TextureHandle m_readbackDepthTex = BGFX_INVALID_HANDLE;
+        bgfx::TextureHandle m_readbackRadianceTex = BGFX_INVALID_HANDLE;
+        std::vector<float> m_readbackDepth;
+        std::vector<uint16_t> m_readbackRadiance;
+        bae::UpsampleError m_upsampleError;
 
         // Buffer to put final outputs into
         bgfx::TextureHandle m_hdrFbTextures[2];
@@ -672,6 +1639,7 @@ namespace example
         float m_time;
 
         bool m_computeSupported = true;
+        bool m_dispatchIndirectSupported = true;
     };
 
 }  // namespace example
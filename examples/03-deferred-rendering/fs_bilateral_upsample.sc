@@ -0,0 +1,68 @@
+$input v_texcoord
+
+#include "../common/common.sh"
+
+SAMPLER2D(s_lowResLight, 0);
+SAMPLER2D(s_lowResDepth, 1);
+SAMPLER2D(s_depth, 2);
+
+uniform vec4 u_upsampleParams[2];
+#define u_factor u_upsampleParams[0].x
+#define u_depthSigma u_upsampleParams[0].y
+#define u_nearZ u_upsampleParams[0].z
+#define u_farZ u_upsampleParams[0].w
+#define u_lowResSize u_upsampleParams[1].xy
+
+// Our G-buffer depth is in window space, which is [0, 1] for both GL and D3D
+float linearizeDepth(float depth)
+{
+    return u_nearZ * u_farZ / (u_farZ - depth * (u_farZ - u_nearZ));
+}
+
+void accumulateSample(
+    vec2 samplePos,
+    float bilinear,
+    float depth,
+    inout vec3 color,
+    inout float totalWeight,
+    inout vec3 closestColor,
+    inout float closestDiff)
+{
+    vec2 texcoord = (clamp(samplePos, vec2_splat(0.0), u_lowResSize - 1.0) + 0.5) / u_lowResSize;
+    vec3 sampleColor = texture2D(s_lowResLight, texcoord).rgb;
+    float sampleDepth = linearizeDepth(texture2D(s_lowResDepth, texcoord).x);
+
+    float relativeDiff = abs(sampleDepth - depth) / (depth * u_depthSigma);
+    float weight = bilinear * exp(-relativeDiff * relativeDiff);
+    color += weight * sampleColor;
+    totalWeight += weight;
+    if (relativeDiff < closestDiff) {
+        closestDiff = relativeDiff;
+        closestColor = sampleColor;
+    }
+}
+
+// Same as bae::bilateralUpsample
+void main()
+{
+    vec2 texcoord = gl_FragCoord.xy / u_viewRect.zw;
+    float depth = linearizeDepth(texture2D(s_depth, texcoord).x);
+
+    // gl_FragCoord is at our pixel center, find it relative to the low resolution pixel centers
+    vec2 lowResPos = gl_FragCoord.xy / u_factor - 0.5;
+    vec2 base = floor(lowResPos);
+    vec2 f = lowResPos - base;
+
+    vec3 color = vec3_splat(0.0);
+    float totalWeight = 0.0;
+    vec3 closestColor = vec3_splat(0.0);
+    float closestDiff = 1e30;
+    accumulateSample(base, (1.0 - f.x) * (1.0 - f.y), depth, color, totalWeight, closestColor, closestDiff);
+    accumulateSample(base + vec2(1.0, 0.0), f.x * (1.0 - f.y), depth, color, totalWeight, closestColor, closestDiff);
+    accumulateSample(base + vec2(0.0, 1.0), (1.0 - f.x) * f.y, depth, color, totalWeight, closestColor, closestDiff);
+    accumulateSample(base + vec2(1.0, 1.0), f.x * f.y, depth, color, totalWeight, closestColor, closestDiff);
+
+    // None of our samples are on the same surface, so just take the closest one
+    vec3 radiance = totalWeight > 1e-4 ? color / totalWeight : closestColor;
+    gl_FragColor = vec4(radiance, 1.0);
+}
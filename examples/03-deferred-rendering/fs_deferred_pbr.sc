@@ -33,9 +33,16 @@ void main()
     float occlusion = texture2D(s_occlusion, v_texcoord).x;
     vec3 emissive = toLinear(texture2D(s_emissive, v_texcoord)).xyz * u_emissiveFactor;
 
+#ifdef COMPACT_GBUFFER
+    // Position gets reconstructed from the hardware depth buffer, and emissive goes straight into
+    // our light accumulation buffer
+    gl_FragData[0] = vec4(baseColor.xyz, occlusion);
+    gl_FragData[1] = vec4(encodeNormalOctahedron(normal), roughness, metallic);
+    gl_FragData[2] = vec4(emissive, 1.0);
+#else
     gl_FragData[0] = vec4(baseColor.xyz, roughness);
     gl_FragData[1] = vec4(normal, metallic);
     gl_FragData[2] = vec4(emissive, occlusion);
     gl_FragData[3] = gl_FragCoord.z;
-
+#endif // COMPACT_GBUFFER
 }
@@ -0,0 +1,49 @@
+$input v_texcoord
+
+#include "../common/common.sh"
+
+// Full resolution G-buffer
+SAMPLER2D(s_baseColorRoughness, 0);
+SAMPLER2D(s_normalMetallic, 1);
+SAMPLER2D(s_emissiveOcclusion, 2);
+SAMPLER2D(s_depth, 3);
+
+uniform vec4 u_downsampleParams;
+#define u_factor u_downsampleParams.x
+#define u_fullResSize u_downsampleParams.zw
+
+// We support downsampling by up to 4x in each direction
+#define MAX_FACTOR 4
+
+// Same as bae::downsampleMinMaxDepth. Rather than averaging, we pick a single pixel out of each block so that
+// the G-buffer values stay consistent with each other, alternating between the closest and furthest one.
+void main()
+{
+    vec2 lowResPixel = floor(gl_FragCoord.xy);
+    bool takeMax = mod(lowResPixel.x + lowResPixel.y, 2.0) > 0.5;
+    vec2 blockOrigin = lowResPixel * u_factor;
+
+    vec2 bestTexcoord = (blockOrigin + 0.5) / u_fullResSize;
+    float bestDepth = texture2D(s_depth, bestTexcoord).x;
+    for (int j = 0; j < MAX_FACTOR; ++j) {
+        for (int i = 0; i < MAX_FACTOR; ++i) {
+            if (float(i) < u_factor && float(j) < u_factor) {
+                vec2 pixel = min(blockOrigin + vec2(float(i), float(j)), u_fullResSize - 1.0);
+                vec2 texcoord = (pixel + 0.5) / u_fullResSize;
+                float depth = texture2D(s_depth, texcoord).x;
+                bool better = takeMax ? depth > bestDepth : depth < bestDepth;
+                if (better) {
+                    bestDepth = depth;
+                    bestTexcoord = texcoord;
+                }
+            }
+        }
+    }
+
+    gl_FragData[0] = texture2D(s_baseColorRoughness, bestTexcoord);
+    gl_FragData[1] = texture2D(s_normalMetallic, bestTexcoord);
+    gl_FragData[2] = texture2D(s_emissiveOcclusion, bestTexcoord);
+    gl_FragData[3] = vec4_splat(bestDepth);
+    // Also goes into our low resolution depth stencil, so the light volumes can do their stencil test
+    gl_FragDepth = bestDepth;
+}
@@ -3,9 +3,15 @@ $input v_screenPos
 #include "../common/common.sh"
 #include "../common/pbr_helpers.sh"
 
+#ifdef COMPACT_GBUFFER
+SAMPLER2D(s_baseColorOcclusion, 0);
+SAMPLER2D(s_normalRoughnessMetallic, 1);
+#else
 SAMPLER2D(s_baseColorRoughness, 0);
 SAMPLER2D(s_normalMetallic, 1);
 SAMPLER2D(s_emissiveOcclusion, 2);
+#endif // COMPACT_GBUFFER
+// For the compact G-buffer, this is the hardware depth buffer
 SAMPLER2D(s_depth, 3);
 
 uniform vec4 u_cameraPos;
@@ -51,6 +57,26 @@ void main()
     view = view / view.w;
     vec3 position = view.xyz;
 
+    vec3 lightDir = u_lightPos - position.xyz;
+    float dist = length(lightDir);
+#ifdef COMPACT_GBUFFER
+    // Without the stencil pass we shade every pixel our volume covers, so skip the ones out of reach
+    if (dist > u_lightRadius) {
+        discard;
+    }
+#endif // COMPACT_GBUFFER
+    lightDir = lightDir / dist;
+
+#ifdef COMPACT_GBUFFER
+    vec4 baseColorOcclusion = texture2D(s_baseColorOcclusion, texcoord);
+    vec4 normalRoughnessMetallic = texture2D(s_normalRoughnessMetallic, texcoord);
+
+    vec3 baseColor = baseColorOcclusion.rgb;
+    vec3 normal = decodeNormalOctahedron(normalRoughnessMetallic.xy);
+    float roughness = max(normalRoughnessMetallic.z, MIN_ROUGHNESS);
+    float metallic = normalRoughnessMetallic.w;
+    float occlusion = baseColorOcclusion.a;
+#else
     vec4 baseColorRoughness = texture2D(s_baseColorRoughness, texcoord);
     vec4 normalMetallic = texture2D(s_normalMetallic, texcoord);
 
@@ -59,13 +85,10 @@ void main()
     float roughness = max(baseColorRoughness.a, MIN_ROUGHNESS);
     float metallic = normalMetallic.a;
     float occlusion = texture2D(s_emissiveOcclusion, texcoord).a;
+#endif // COMPACT_GBUFFER
 
     vec3 viewDir = normalize(u_cameraPos.xyz - position);
 
-    vec3 lightDir = u_lightPos - position.xyz;
-    float dist = length(lightDir);
-    lightDir = lightDir / dist;
-
     float attenuation = u_lightIntensity * karisFalloff(dist, u_lightRadius);
     vec3 light = attenuation * u_lightColor * clampDot(normal, lightDir);
 
@@ -0,0 +1,3 @@
+#define COMPACT_GBUFFER 1
+
+#include "./fs_point_light_volume.sc"
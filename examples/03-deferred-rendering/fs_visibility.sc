@@ -0,0 +1,27 @@
+$input v_texcoord
+
+#include "../common/common.sh"
+#include "./visibility.sh"
+
+#ifdef MASKING_ENABLED
+SAMPLER2D(s_baseColor, 0);
+uniform vec4 u_factors[3];
+#define u_baseColorFactor u_factors[0]
+#define u_alphaCutoff u_factors[2].x
+#endif // MASKING_ENABLED
+
+uniform vec4 u_drawParams;
+#define u_drawId u_drawParams.x
+
+void main()
+{
+#ifdef MASKING_ENABLED
+    // Masking is the only part of the material we need to evaluate up front
+    float alpha = texture2D(s_baseColor, v_texcoord).w * u_baseColorFactor.w;
+    if (alpha < u_alphaCutoff) {
+        discard;
+    }
+#endif // MASKING_ENABLED
+
+    gl_FragColor = packVisibilityId(uint(u_drawId), uint(gl_PrimitiveID));
+}
@@ -0,0 +1,3 @@
+#define MASKING_ENABLED 1
+
+#include "./fs_visibility.sc"
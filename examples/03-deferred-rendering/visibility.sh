@@ -0,0 +1,44 @@
+// Needs to be kept in sync with bae/VisibilityBuffer.h
+// Each texel stores (drawId + 1) in the top 12 bits and the triangle ID in the bottom 20,
+// split across the four channels of an RGBA8 target. Zero means nothing was drawn.
+#define VISIBILITY_TRIANGLE_BITS 20u
+#define VISIBILITY_TRIANGLE_MASK 0xfffffu
+
+vec4 packVisibilityId(uint drawId, uint triangleId)
+{
+    uint id = ((drawId + 1u) << VISIBILITY_TRIANGLE_BITS) | (triangleId & VISIBILITY_TRIANGLE_MASK);
+    uvec4 bytes = uvec4(id >> 24u, id >> 16u, id >> 8u, id) & uvec4(255u, 255u, 255u, 255u);
+    return vec4(bytes) / 255.0;
+}
+
+uint unpackVisibilityId(vec4 texel)
+{
+    uvec4 bytes = uvec4(texel * 255.0 + 0.5);
+    return (bytes.x << 24u) | (bytes.y << 16u) | (bytes.z << 8u) | bytes.w;
+}
+
+// The resolve works on tiles of VISIBILITY_TILE_SIZE^2 pixels. cs_visibility_classify lists every tile under
+// each material found in it, plus a last bin for tiles with empty pixels, and the resolve then runs one
+// indirect dispatch per bin over only the tiles in its list.
+// VISIBILITY_MAX_BINS needs to be kept in sync with bae::VISIBILITY_MAX_MATERIALS.
+#define VISIBILITY_TILE_SIZE 8
+#define VISIBILITY_MAX_BINS 256
+
+// Every bin's list has room for every tile
+uint getVisibilityTileCapacity(vec2 targetSize)
+{
+    uint tileSize = uint(VISIBILITY_TILE_SIZE);
+    uint tilesX = (uint(targetSize.x) + tileSize - 1u) / tileSize;
+    uint tilesY = (uint(targetSize.y) + tileSize - 1u) / tileSize;
+    return tilesX * tilesY;
+}
+
+uint packVisibilityTile(uvec2 tile)
+{
+    return (tile.y << 16u) | tile.x;
+}
+
+uvec2 unpackVisibilityTile(uint packedTile)
+{
+    return uvec2(packedTile & 0xffffu, packedTile >> 16u);
+}
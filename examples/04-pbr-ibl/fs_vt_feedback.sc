@@ -0,0 +1,16 @@
+$input v_position, v_texcoord
+
+#include "../common/common.sh"
+
+SAMPLER2D(s_vtIndirection, 0);
+SAMPLER2D(s_vtCache, 1);
+
+#include "../common/virtual_texture.sh"
+
+// x: mip bias for the feedback target being smaller than the screen
+uniform vec4 u_vtFeedbackParams;
+
+void main()
+{
+    gl_FragColor = vtFeedback(v_texcoord, u_vtFeedbackParams.x);
+}
@@ -0,0 +1,18 @@
+$input v_position, v_texcoord
+
+#include "../common/common.sh"
+
+SAMPLER2D(s_vtIndirection, 0);
+SAMPLER2D(s_vtCache, 1);
+SAMPLERCUBE(s_irradiance, 7);
+
+#include "../common/virtual_texture.sh"
+
+void main()
+{
+    // The cache holds the sRGB texels of the source images as they are
+    vec3 baseColor = toLinear(vtSample(v_texcoord).rgb);
+    // Only lit by the environment, from straight above
+    vec3 irradiance = textureCube(s_irradiance, vec3(0.0, 1.0, 0.0)).rgb;
+    gl_FragColor = vec4(baseColor * irradiance, 1.0);
+}
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <array>
+#include <bimg/bimg.h>
 #include "bgfx_utils.h"
 #include "common.h"
 #include "imgui/imgui.h"
@@ -6,12 +8,21 @@
 #include <glm/glm.hpp>
 #include <glm/matrix.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "camera.h"
 #include "bae/Offscreen.h"
 #include "bae/Tonemapping.h"
 #include "bae/PhysicallyBasedScene.h"
+#include "bae/DrawInstancing.h"
 #include "bae/gltf_model_loading.h"
+#include "bae/AsyncModelLoading.h"
+#include "bae/TextureCache.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
+#include "bae/AsyncReadback.h"
+#include "bae/VirtualPageTable.h"
+#include "bae/VirtualTexture.h"
 
 namespace example
 {
@@ -19,6 +30,12 @@ namespace example
 
     static float s_texelHalf = 0.0f;
 
+    // The stress test draws a grid of up to this many helmets on each side
+    static constexpr int MAX_HELMET_GRID_SIZE = 64;
+
+    // Size of the floor's virtual texture, the helmet's four base color textures side by side
+    static constexpr uint32_t FLOOR_TEXTURE_SIZE = 4096;
+
     class BrdfLutCreator
     {
     public:
@@ -220,7 +237,7 @@ namespace example
         bgfx::destroy(uniforms.u_normalTransform);
     }
 
-    void bindUniforms(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material, const glm::mat4& transform) {
+    void bindMaterial(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material) {
         bgfx::setTexture(0, uniforms.s_baseColor, material.baseColorTexture);
         bgfx::setTexture(1, uniforms.s_normal, material.normalTexture);
         bgfx::setTexture(2, uniforms.s_metallicRoughness, material.metallicRoughnessTexture);
@@ -229,6 +246,10 @@ namespace example
         // We are going to pack our baseColorFactor, emissiveFactor, roughnessFactor
         // and metallicFactor into this uniform
         bgfx::setUniform(uniforms.u_factors, &material.baseColorFactor, 3);
+    }
+
+    void bindUniforms(const PBRShaderUniforms& uniforms, const bae::PBRMaterial& material, const glm::mat4& transform) {
+        bindMaterial(uniforms, material);
 
         // Transforms
         bgfx::setTransform(glm::value_ptr(transform));
@@ -236,6 +257,256 @@ namespace example
         bgfx::setUniform(uniforms.u_normalTransform, glm::value_ptr(normalTransform));
     }
 
+    struct FloorVertex
+    {
+        float x;
+        float y;
+        float z;
+        float u;
+        float v;
+
+        static void init()
+        {
+            ms_decl
+                .begin()
+                .add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+                .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+                .end();
+        }
+
+        static bgfx::VertexDecl ms_decl;
+    };
+
+    bgfx::VertexDecl FloorVertex::ms_decl;
+
+    // A floor under the helmets, textured with the helmet's four base color textures tiled into a single 4096x4096
+    // virtual texture. Only the pages the floor actually samples are resident: a small feedback pass writes the
+    // page every pixel wants, it's read back a few frames later, and the page table picks what to upload.
+    class VirtualTexturedFloor
+    {
+    public:
+        void init(const uint16_t _feedbackWidth, const uint16_t _feedbackHeight)
+        {
+            FloorVertex::init();
+            const FloorVertex vertices[] = {
+                { -0.5f, 0.0f, -0.5f, 0.0f, 1.0f },
+                { 0.5f, 0.0f, -0.5f, 1.0f, 1.0f },
+                { 0.5f, 0.0f, 0.5f, 1.0f, 0.0f },
+                { -0.5f, 0.0f, 0.5f, 0.0f, 0.0f },
+            };
+            const uint16_t indices[] = { 0, 2, 1, 0, 3, 2 };
+            vertexBuffer = bgfx::createVertexBuffer(bgfx::copy(vertices, sizeof(vertices)), FloorVertex::ms_decl);
+            indexBuffer = bgfx::createIndexBuffer(bgfx::copy(indices, sizeof(indices)));
+
+            floorProgram = loadProgram("vs_vt_floor", "fs_vt_floor");
+            feedbackProgram = loadProgram("vs_vt_floor", "fs_vt_feedback");
+            s_vtIndirection = bgfx::createUniform("s_vtIndirection", bgfx::UniformType::Sampler);
+            s_vtCache = bgfx::createUniform("s_vtCache", bgfx::UniformType::Sampler);
+            u_vtParams = bgfx::createUniform("u_vtParams", bgfx::UniformType::Vec4);
+            u_vtInfo = bgfx::createUniform("u_vtInfo", bgfx::UniformType::Vec4);
+            u_vtFeedbackParams = bgfx::createUniform("u_vtFeedbackParams", bgfx::UniformType::Vec4);
+
+            loadSourceMips();
+
+            bae::VirtualPageTableParams params;
+            params.cacheWidth = 16;
+            params.cacheHeight = 16;
+            table.init(params);
+            textureId = table.addTexture(FLOOR_TEXTURE_SIZE, FLOOR_TEXTURE_SIZE);
+            texture.init(table);
+            pageTexels.resize(size_t(params.pageSize + 2 * params.pageBorder) * (params.pageSize + 2 * params.pageBorder));
+
+            // The feedback target stays the size it was created at, since resizing it would free readback memory
+            // that bgfx may still be writing into. Its mip bias follows the window instead.
+            feedbackWidth = _feedbackWidth;
+            feedbackHeight = _feedbackHeight;
+            feedbackTextures[0] = bgfx::createTexture2D(feedbackWidth, feedbackHeight, false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_RT | BGFX_SAMPLER_POINT);
+            const bgfx::TextureFormat::Enum depthFormat = bgfx::isTextureValid(0, false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT_WRITE_ONLY)
+                ? bgfx::TextureFormat::D24S8
+                : bgfx::TextureFormat::D32;
+            feedbackTextures[1] = bgfx::createTexture2D(feedbackWidth, feedbackHeight, false, 1, depthFormat, BGFX_TEXTURE_RT_WRITE_ONLY);
+            bgfx::setName(feedbackTextures[0], "Virtual Texture Feedback");
+            feedbackFrameBuffer = bgfx::createFrameBuffer(BX_COUNTOF(feedbackTextures), feedbackTextures, true);
+            feedbackReadback.init(feedbackWidth, feedbackHeight, bgfx::TextureFormat::RGBA8, 3, "Virtual Texture Feedback Readback");
+        }
+
+        void destroy()
+        {
+            feedbackReadback.destroy();
+            bgfx::destroy(feedbackFrameBuffer);
+            texture.destroy();
+            bgfx::destroy(vertexBuffer);
+            bgfx::destroy(indexBuffer);
+            bgfx::destroy(floorProgram);
+            bgfx::destroy(feedbackProgram);
+            bgfx::destroy(s_vtIndirection);
+            bgfx::destroy(s_vtCache);
+            bgfx::destroy(u_vtParams);
+            bgfx::destroy(u_vtInfo);
+            bgfx::destroy(u_vtFeedbackParams);
+        }
+
+        // Requests the pages of the latest feedback to have come back, then uploads whatever the table picked
+        void updatePages(const uint32_t currentFrame)
+        {
+            if (feedbackReadback.update(currentFrame)) {
+                const uint32_t* feedback = static_cast<const uint32_t*>(feedbackReadback.getData());
+                table.request(feedback, size_t(feedbackWidth) * feedbackHeight);
+            }
+
+            uploads.clear();
+            table.update(currentFrame, uploads);
+            const bae::VirtualPageTableParams& params = table.getParams();
+            for (const bae::PageUpload& upload : uploads) {
+                const SourceMip& mip = sourceMips[upload.page.mip];
+                bae::extractPage(mip.texels.data(), mip.size, mip.size, upload.page.x, upload.page.y, params.pageSize, params.pageBorder, pageTexels.data());
+                texture.uploadPage(upload, bgfx::copy(pageTexels.data(), uint32_t(pageTexels.size() * sizeof(uint32_t))));
+            }
+            texture.updateIndirection(table);
+        }
+
+        // Draws the floor into the feedback target, cleared to "no texture", and queues its readback in readbackView,
+        // which has to come after feedbackView
+        void renderFeedback(
+            const bgfx::ViewId feedbackView,
+            const bgfx::ViewId readbackView,
+            const float* view,
+            const float* proj,
+            const glm::mat4& transform,
+            const uint32_t screenHeight)
+        {
+            bgfx::setViewName(feedbackView, "Virtual Texture Feedback");
+            bgfx::setViewClear(feedbackView, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0xffffffff, 1.0f, 0);
+            bgfx::setViewRect(feedbackView, 0, 0, feedbackWidth, feedbackHeight);
+            bgfx::setViewFrameBuffer(feedbackView, feedbackFrameBuffer);
+            bgfx::setViewTransform(feedbackView, view, proj);
+
+            // Derivatives are larger by the downscale, which takes the mips back to what the screen samples
+            const float feedbackParams[] = { bx::log2(float(feedbackHeight) / float(screenHeight)), 0.0f, 0.0f, 0.0f };
+            bgfx::setUniform(u_vtFeedbackParams, feedbackParams);
+            bindTextures();
+            bgfx::setTransform(glm::value_ptr(transform));
+            bgfx::setVertexBuffer(0, vertexBuffer);
+            bgfx::setIndexBuffer(indexBuffer);
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS);
+            bgfx::submit(feedbackView, feedbackProgram);
+
+            feedbackReadback.request(readbackView, feedbackTextures[0]);
+        }
+
+        void render(const bgfx::ViewId viewId, const glm::mat4& transform, const bgfx::TextureHandle irradianceMap, const bgfx::UniformHandle s_irradiance)
+        {
+            bindTextures();
+            bgfx::setTexture(7, s_irradiance, irradianceMap);
+            bgfx::setTransform(glm::value_ptr(transform));
+            bgfx::setVertexBuffer(0, vertexBuffer);
+            bgfx::setIndexBuffer(indexBuffer);
+            bgfx::setState(BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_MSAA);
+            bgfx::submit(viewId, floorProgram);
+        }
+
+        const bae::VirtualPageTable& getTable() const { return table; }
+        const bae::AsyncReadback& getReadback() const { return feedbackReadback; }
+
+    private:
+        struct SourceMip
+        {
+            uint32_t size;
+            std::vector<uint32_t> texels;
+        };
+
+        void bindTextures()
+        {
+            const glm::vec4 params = texture.getParams(textureId);
+            const glm::vec4 info = texture.getInfo(textureId);
+            bgfx::setTexture(0, s_vtIndirection, texture.getIndirection(textureId));
+            bgfx::setTexture(1, s_vtCache, texture.getCache());
+            bgfx::setUniform(u_vtParams, glm::value_ptr(params));
+            bgfx::setUniform(u_vtInfo, glm::value_ptr(info));
+        }
+
+        // Stands in for the offline step of cutting a texture into pages: keeps every mip of the virtual texture in
+        // memory and cuts pages out of it as they're asked for
+        void loadSourceMips()
+        {
+            const char* files[] = {
+                "meshes/FlightHelmet/FlightHelmet_baseColor.png",
+                "meshes/FlightHelmet/FlightHelmet_baseColor2.png",
+                "meshes/FlightHelmet/FlightHelmet_baseColor3.png",
+                "meshes/FlightHelmet/FlightHelmet_baseColor4.png",
+            };
+            const uint32_t tileSize = FLOOR_TEXTURE_SIZE / 2;
+
+            sourceMips.clear();
+            sourceMips.push_back(SourceMip{ FLOOR_TEXTURE_SIZE, std::vector<uint32_t>(size_t(FLOOR_TEXTURE_SIZE) * FLOOR_TEXTURE_SIZE, 0xff808080) });
+            std::vector<uint32_t>& texels = sourceMips[0].texels;
+            for (uint32_t tile = 0; tile < BX_COUNTOF(files); ++tile) {
+                bimg::ImageContainer* image = imageLoad(files[tile], bgfx::TextureFormat::RGBA8);
+                if (image == nullptr) {
+                    continue;
+                }
+                // Nearest neighbour, in case an image isn't exactly the size of its tile
+                const uint32_t* imageTexels = static_cast<const uint32_t*>(image->m_data);
+                const uint32_t originX = (tile % 2) * tileSize;
+                const uint32_t originY = (tile / 2) * tileSize;
+                for (uint32_t y = 0; y < tileSize; ++y) {
+                    const uint32_t srcY = y * image->m_height / tileSize;
+                    for (uint32_t x = 0; x < tileSize; ++x) {
+                        const uint32_t srcX = x * image->m_width / tileSize;
+                        texels[size_t(originY + y) * FLOOR_TEXTURE_SIZE + originX + x] = imageTexels[srcY * image->m_width + srcX];
+                    }
+                }
+                bimg::imageFree(image);
+            }
+
+            // Box filtered down to a single page, one mip per page table mip
+            const uint32_t pageSize = bae::VirtualPageTableParams{}.pageSize;
+            while (sourceMips.back().size > pageSize) {
+                const SourceMip& parent = sourceMips.back();
+                SourceMip mip;
+                mip.size = parent.size / 2;
+                mip.texels.resize(size_t(mip.size) * mip.size);
+                for (uint32_t y = 0; y < mip.size; ++y) {
+                    for (uint32_t x = 0; x < mip.size; ++x) {
+                        const uint32_t* row0 = &parent.texels[size_t(2 * y) * parent.size + 2 * x];
+                        const uint32_t* row1 = row0 + parent.size;
+                        uint32_t texel = 0;
+                        for (uint32_t channel = 0; channel < 32; channel += 8) {
+                            const uint32_t sum = ((row0[0] >> channel) & 0xff) + ((row0[1] >> channel) & 0xff)
+                                + ((row1[0] >> channel) & 0xff) + ((row1[1] >> channel) & 0xff);
+                            texel |= ((sum + 2) / 4) << channel;
+                        }
+                        mip.texels[size_t(y) * mip.size + x] = texel;
+                    }
+                }
+                sourceMips.push_back(std::move(mip));
+            }
+        }
+
+        bae::VirtualPageTable table;
+        bae::VirtualTexture texture;
+        uint8_t textureId = 0;
+        std::vector<SourceMip> sourceMips;
+        std::vector<bae::PageUpload> uploads;
+        std::vector<uint32_t> pageTexels;
+
+        uint16_t feedbackWidth = 0;
+        uint16_t feedbackHeight = 0;
+        bgfx::TextureHandle feedbackTextures[2];
+        bgfx::FrameBufferHandle feedbackFrameBuffer = BGFX_INVALID_HANDLE;
+        bae::AsyncReadback feedbackReadback;
+
+        bgfx::VertexBufferHandle vertexBuffer = BGFX_INVALID_HANDLE;
+        bgfx::IndexBufferHandle indexBuffer = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle floorProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle feedbackProgram = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_vtIndirection = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_vtCache = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_vtParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_vtInfo = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_vtFeedbackParams = BGFX_INVALID_HANDLE;
+    };
+
     class ExampleIbl : public entry::AppI
     {
     public:
@@ -256,6 +527,7 @@ namespace example
             initInfo.resolution.width = m_width;
             initInfo.resolution.height = m_height;
             initInfo.resolution.reset = m_reset;
+            initInfo.allocator = bae::getTrackingAllocator();
             bgfx::init(initInfo);
 
             // Enable m_debug text.
@@ -279,12 +551,18 @@ namespace example
             m_skyboxProgram = loadProgram("vs_skybox", "fs_skybox");
             m_pbrIblProgram = loadProgram("vs_pbr_ibl", "fs_pbr_ibl");
             m_pbrIblProgramWithMasking = loadProgram("vs_pbr_ibl", "fs_pbr_ibl_with_masking");
+            m_pbrIblInstancedProgram = loadProgram("vs_pbr_ibl_instanced", "fs_pbr_ibl");
+            m_pbrIblInstancedProgramWithMasking = loadProgram("vs_pbr_ibl_instanced", "fs_pbr_ibl_with_masking");
+            m_instancingSupported = !!(m_caps->supported & BGFX_CAPS_INSTANCING);
+            m_drawInstancer.setEnabled(m_instancingSupported);
 
             example::init(m_pbrUniforms);
             example::init(m_sceneUniforms);
             example::init(m_skyboxUniforms);
 
-            m_model = bae::loadGltfModel("meshes/FlightHelmet/", "FlightHelmet.gltf");
+            // The helmet streams in over the first frames instead of stalling startup
+            m_modelLoader.init(bae::AsyncLoadingParams{});
+            m_modelHandle = m_modelLoader.load("meshes/FlightHelmet/", "FlightHelmet.gltf");
 
             m_toneMapParams.width = m_width;
             m_toneMapParams.width = m_height;
@@ -292,6 +570,7 @@ namespace example
             m_toneMapPass.init(m_caps);
 
             m_brdfLutCreator.init();
+            m_floor.init(uint16_t(bx::max(m_width / 8, 1u)), uint16_t(bx::max(m_height / 8, 1u)));
 
             m_envMap = loadTexture("textures/pisa_with_mips.ktx");
             m_prefilteredEnvMapCreator.sourceCubeMap = m_envMap;
@@ -326,8 +605,10 @@ namespace example
                 m_toneMapPass.destroy();
                 m_prefilteredEnvMapCreator.destroy();
                 m_brdfLutCreator.destroy();
+                m_floor.destroy();
 
-                destroy(m_model);
+                m_modelLoader.destroy();
+                bae::getTextureCache().destroy();
 
                 destroy(m_pbrUniforms);
                 destroy(m_sceneUniforms);
@@ -336,6 +617,8 @@ namespace example
                 bgfx::destroy(m_skyboxProgram);
                 bgfx::destroy(m_pbrIblProgram);
                 bgfx::destroy(m_pbrIblProgramWithMasking);
+                bgfx::destroy(m_pbrIblInstancedProgram);
+                bgfx::destroy(m_pbrIblInstancedProgramWithMasking);
 
                 cameraDestroy();
                 imguiDestroy();
@@ -400,28 +683,54 @@ namespace example
             m_hdrFrameBuffer = bgfx::createFrameBuffer(BX_COUNTOF(m_hdrFbTextures), m_hdrFbTextures, true);
         }
 
-        void renderMeshes(
+        void addMeshes(
             const bae::MeshGroup& meshes,
+            const uint32_t groupIdx,
             const uint64_t state,
-            const bgfx::ProgramHandle program,
-            const bgfx::ViewId viewId
+            const glm::mat4& helmetTransform
         )
         {
-            // Render all our opaque meshes
             for (size_t i = 0; i < meshes.meshes.size(); ++i) {
-                const auto& mesh = meshes.meshes[i];
-                const auto& transform = meshes.transforms[i];
-                const auto& material = meshes.materials[i];
+                // Every mesh has its own material, so the mesh's index doubles as its material's index
+                const uint32_t material = (groupIdx << 16) | uint32_t(i);
+                m_drawInstancer.add(meshes.meshes[i], material, state, helmetTransform * meshes.transforms[i]);
+            }
+        }
+
+        void renderMeshes(const bgfx::ViewId viewId)
+        {
+            const bae::Model& model = m_modelLoader.getModel(m_modelHandle);
+            const bae::MeshGroup* groups[] = { &model.opaqueMeshes, &model.maskedMeshes, &model.transparentMeshes };
+            const bgfx::ProgramHandle programs[] = { m_pbrIblProgram, m_pbrIblProgramWithMasking, m_pbrIblProgram };
+            const bgfx::ProgramHandle instancedPrograms[] = { m_pbrIblInstancedProgram, m_pbrIblInstancedProgramWithMasking, m_pbrIblInstancedProgram };
+
+            for (size_t i = 0; i < m_drawInstancer.getBatchCount(); ++i) {
+                const bae::InstanceBatch& batch = m_drawInstancer.getBatch(i);
+                const uint32_t groupIdx = batch.material >> 16;
+                const bae::PBRMaterial& material = groups[groupIdx]->materials[batch.material & 0xffff];
+
+                if (m_drawInstancer.setInstanceData(i)) {
+                    bgfx::setState(batch.state);
+                    bindMaterial(m_pbrUniforms, material);
+                    bgfx::setTexture(5, m_sceneUniforms.s_brdfLUT, m_brdfLutCreator.getLUT());
+                    bgfx::setTexture(6, m_sceneUniforms.s_prefilteredEnv, m_prefilteredEnvMapCreator.getPrefilteredMap());
+                    bgfx::setTexture(7, m_sceneUniforms.s_irradiance, m_prefilteredEnvMapCreator.getIrradianceMap());
+                    batch.mesh->setBuffers();
+                    bgfx::submit(viewId, instancedPrograms[groupIdx]);
+                    continue;
+                }
 
-                bgfx::setState(state);
-                bindUniforms(m_pbrUniforms, material, transform);
-                bgfx::setTexture(5, m_sceneUniforms.s_brdfLUT, m_brdfLutCreator.getLUT());
-                bgfx::setTexture(6, m_sceneUniforms.s_prefilteredEnv, m_prefilteredEnvMapCreator.getPrefilteredMap());
-                bgfx::setTexture(7, m_sceneUniforms.s_irradiance, m_prefilteredEnvMapCreator.getIrradianceMap());
+                for (uint32_t j = 0; j < batch.count; ++j) {
+                    bgfx::setState(batch.state);
+                    bindUniforms(m_pbrUniforms, material, m_drawInstancer.getTransform(batch.firstDraw + j));
+                    bgfx::setTexture(5, m_sceneUniforms.s_brdfLUT, m_brdfLutCreator.getLUT());
+                    bgfx::setTexture(6, m_sceneUniforms.s_prefilteredEnv, m_prefilteredEnvMapCreator.getPrefilteredMap());
+                    bgfx::setTexture(7, m_sceneUniforms.s_irradiance, m_prefilteredEnvMapCreator.getIrradianceMap());
 
-                mesh.setBuffers();
+                    batch.mesh->setBuffers();
 
-                bgfx::submit(viewId, program);
+                    bgfx::submit(viewId, programs[groupIdx]);
+                }
             }
         }
 
@@ -456,6 +765,8 @@ namespace example
                 initializeFrameBuffers();
             }
 
+            m_modelLoader.update();
+
             imguiBeginFrame(m_mouseState.m_mx
                 , m_mouseState.m_my
                 , (m_mouseState.m_buttons[entry::MouseButton::Left] ? IMGUI_MBUT_LEFT : 0)
@@ -486,12 +797,90 @@ namespace example
             ImGui::RadioButton("Multi-scattering, standard Fresnel", &m_iblMode, 1);
             ImGui::RadioButton("Multiscattering, roughness depedent", &m_iblMode, 2);
 
+            ImGui::Separator();
+            ImGui::Text("Instancing Stress Test");
+            ImGui::SliderInt("Helmet Grid", &m_helmetGridSize, 1, MAX_HELMET_GRID_SIZE);
+            if (m_instancingSupported) {
+                bool instancingEnabled = m_drawInstancer.isEnabled();
+                if (ImGui::Checkbox("Automatic Instancing", &instancingEnabled)) {
+                    m_drawInstancer.setEnabled(instancingEnabled);
+                }
+            }
+            else {
+                ImGui::Text("Instancing not supported.");
+            }
+            const bae::DrawInstancingStats& instancingStats = m_drawInstancer.getStats();
+            ImGui::Text("Draws: %u in %u batches", instancingStats.draws, instancingStats.batches);
+            ImGui::Text("Submits: %u (%u instanced)", instancingStats.draws - instancingStats.drawsSaved, instancingStats.instancedBatches);
+            ImGui::Text("Draws Saved: %u", instancingStats.drawsSaved);
+            ImGui::Text("Submit CPU Time: %.3f ms", m_submitMs);
+
+            ImGui::Separator();
+            ImGui::Text("Virtual Texturing");
+            ImGui::Checkbox("Virtual Textured Floor", &m_showFloor);
+            const bae::VirtualPageTableStats& pageStats = m_floor.getTable().getStats();
+            const bae::VirtualPageTableParams& pageParams = m_floor.getTable().getParams();
+            ImGui::Text("Resident Pages: %u / %u", pageStats.residentPages, uint32_t(pageParams.cacheWidth) * pageParams.cacheHeight);
+            ImGui::Text("Requested: %u pages, %u hits", pageStats.uniquePages, pageStats.hits);
+            ImGui::Text("Uploads: %u, Evictions: %u, Deferred: %u", pageStats.uploads, pageStats.evictions, pageStats.deferred);
+            ImGui::Text("Feedback Latency: %u frames", m_floor.getReadback().getStats().lastLatency);
+
+            ImGui::Separator();
+            ImGui::Text("Async Model Loading");
+            const bae::ModelLoadState loadState = m_modelLoader.getState(m_modelHandle);
+            if (loadState == bae::ModelLoadState::FAILED) {
+                ImGui::Text("Failed: %s", m_modelLoader.getError(m_modelHandle).c_str());
+            }
+            else {
+                ImGui::ProgressBar(m_modelLoader.getProgress(m_modelHandle), ImVec2(-1.0f, 0.0f), loadState == bae::ModelLoadState::READY ? "Ready" : "Loading");
+            }
+            bae::AsyncLoadingParams loadingParams = m_modelLoader.getParams();
+            if (ImGui::SliderFloat("Upload Budget (ms)", &loadingParams.uploadBudgetMs, 0.1f, 16.0f)) {
+                m_modelLoader.setParams(loadingParams);
+            }
+            const bae::AsyncLoadingStats& loadingStats = m_modelLoader.getStats();
+            ImGui::Text("Uploaded: %u meshes, %u textures", loadingStats.meshesUploaded, loadingStats.texturesUploaded);
+            ImGui::Text("Upload: %.2f MB in %.3f ms", float(loadingStats.bytesUploaded) / float(1 << 20), loadingStats.uploadMs);
+            ImGui::Text("Pending Uploads: %u", loadingStats.pendingUploads);
+
+            ImGui::Separator();
+            ImGui::Text("Allocations");
+            const bae::TrackingAllocator* allocator = bae::getTrackingAllocator();
+            const bae::TrackingAllocatorStats allocatorStats = allocator->getStats();
+            const bae::AllocationFrameStats lastFrame = allocator->getLastFrame();
+            for (uint32_t tag = 0; tag < bae::ALLOCATION_TAG_COUNT; ++tag) {
+                ImGui::Text("%s: %u this frame, %.2f MB live"
+                    , bae::getAllocationTagName(bae::AllocationTag(tag))
+                    , lastFrame.allocations[tag]
+                    , float(allocatorStats.tags[tag].bytes) / float(1 << 20)
+                );
+            }
+            ImGui::Text("Pooled: %u, Heap: %u", lastFrame.pooledAllocations, lastFrame.heapAllocations);
+            ImGui::Text("Frames Without Allocations: %u", allocatorStats.quietFrames);
+            float allocationHistory[bae::ALLOCATION_FRAME_HISTORY];
+            allocator->getFrameHistory(allocationHistory);
+            ImGui::PlotLines("Per Frame", allocationHistory, bae::ALLOCATION_FRAME_HISTORY);
+            float sizeHistogram[bae::ALLOCATION_HISTOGRAM_BUCKETS] = {};
+            for (uint32_t tag = 0; tag < bae::ALLOCATION_TAG_COUNT; ++tag) {
+                for (uint32_t bucket = 0; bucket < bae::ALLOCATION_HISTOGRAM_BUCKETS; ++bucket) {
+                    sizeHistogram[bucket] += float(lastFrame.histogram[tag][bucket]);
+                }
+            }
+            ImGui::PlotHistogram("Sizes (log2)", sizeHistogram, bae::ALLOCATION_HISTOGRAM_BUCKETS);
+            const bae::FrameArenaStats& arenaStats = bae::getFrameArena().getStats();
+            ImGui::Text("Frame Arena: %.1f / %.1f KB, %u overflows"
+                , float(arenaStats.bytesAllocated) / 1024.0f
+                , float(arenaStats.capacity) / 1024.0f
+                , arenaStats.overflowBlocks
+            );
+
             ImGui::End();
 
             imguiEndFrame();
 
 
             // Set views.
+            bgfx::ViewId feedbackPass = viewId++;
             bgfx::ViewId skyboxPass = viewId++;
             bgfx::setViewName(skyboxPass, "Skybox");
             bgfx::setViewClear(skyboxPass, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x303030ff, 1.0f, 0);
@@ -566,13 +955,55 @@ namespace example
             bgfx::setUniform(m_sceneUniforms.u_envParams, envParams);
             bgfx::setUniform(m_sceneUniforms.u_cameraPos, &cameraPos.x);
 
-            renderMeshes(m_model.opaqueMeshes, stateOpaque, m_pbrIblProgram, meshPass);
-            renderMeshes(m_model.maskedMeshes, stateOpaque, m_pbrIblProgramWithMasking, meshPass);
-            renderMeshes(m_model.transparentMeshes, stateTransparent, m_pbrIblProgram, meshPass);
+            const bae::Model& model = m_modelLoader.getModel(m_modelHandle);
+            const glm::vec3 helmetSize = model.boundingBox.max - model.boundingBox.min;
+            const float spacing = 1.2f * bx::max(helmetSize.x, helmetSize.z);
+
+            // The floor covers the grid, at the bottom of the helmets
+            if (m_showFloor && m_modelLoader.getState(m_modelHandle) == bae::ModelLoadState::READY) {
+                const float floorSize = spacing * float(m_helmetGridSize + 1);
+                const glm::mat4 floorTransform = glm::scale(
+                    glm::translate(glm::mat4{ 1.0f }, glm::vec3{ 0.0f, model.boundingBox.min.y, 0.0f }),
+                    glm::vec3{ floorSize, 1.0f, floorSize });
+                m_floor.updatePages(m_currentFrame);
+                m_floor.renderFeedback(feedbackPass, meshPass, view, proj, floorTransform, m_height);
+                m_floor.render(meshPass, floorTransform, m_prefilteredEnvMapCreator.getIrradianceMap(), m_sceneUniforms.s_irradiance);
+            }
+
+            // Every helmet of the grid gets a copy of every mesh, opaque ones first
+            const int64_t submitStart = bx::getHPCounter();
+            const float gridOffset = 0.5f * float(m_helmetGridSize - 1);
+            const uint64_t groupStates[] = { stateOpaque, stateOpaque, stateTransparent };
+            const bae::MeshGroup* groups[] = { &model.opaqueMeshes, &model.maskedMeshes, &model.transparentMeshes };
+
+            // Transparent meshes blend, so their helmets are added back to front
+            m_helmetOffsets.clear();
+            for (int z = 0; z < m_helmetGridSize; ++z) {
+                for (int x = 0; x < m_helmetGridSize; ++x) {
+                    m_helmetOffsets.push_back(spacing * glm::vec3{ float(x) - gridOffset, 0.0f, float(z) - gridOffset });
+                }
+            }
+            const glm::vec3 eye{ cameraPos.x, cameraPos.y, cameraPos.z };
+            std::sort(m_helmetOffsets.begin(), m_helmetOffsets.end(), [&eye](const glm::vec3& a, const glm::vec3& b) {
+                return glm::dot(a - eye, a - eye) > glm::dot(b - eye, b - eye);
+            });
+
+            m_drawInstancer.begin();
+            for (uint32_t groupIdx = 0; groupIdx < BX_COUNTOF(groups); ++groupIdx) {
+                for (const glm::vec3& offset : m_helmetOffsets) {
+                    const glm::mat4 helmetTransform = glm::translate(glm::mat4{ 1.0f }, offset);
+                    addMeshes(*groups[groupIdx], groupIdx, groupStates[groupIdx], helmetTransform);
+                }
+            }
+            m_drawInstancer.end();
+            renderMeshes(meshPass);
+            m_submitMs = float(double(bx::getHPCounter() - submitStart) * 1000.0 / freq);
 
             m_toneMapPass.render(m_hdrFbTextures[0], m_toneMapParams, deltaTime, viewId);
 
-            bgfx::frame();
+            m_currentFrame = bgfx::frame();
+            bae::getTrackingAllocator()->endFrame();
+            bae::getFrameArena().endFrame();
 
             return true;
         }
@@ -591,6 +1022,8 @@ namespace example
         bgfx::ProgramHandle m_skyboxProgram = BGFX_INVALID_HANDLE;
         bgfx::ProgramHandle m_pbrIblProgram = BGFX_INVALID_HANDLE;
         bgfx::ProgramHandle m_pbrIblProgramWithMasking = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_pbrIblInstancedProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_pbrIblInstancedProgramWithMasking = BGFX_INVALID_HANDLE;
 
         // PBR IRB Textures and LUT
         bgfx::TextureHandle m_envMap = BGFX_INVALID_HANDLE;
@@ -604,7 +1037,11 @@ namespace example
         BrdfLutCreator m_brdfLutCreator;
         CubeMapFilterer m_prefilteredEnvMapCreator;
 
-        bae::Model m_model;
+        bae::AsyncModelLoader m_modelLoader;
+        bae::ModelHandle m_modelHandle;
+        bae::DrawInstancer m_drawInstancer;
+        std::vector<glm::vec3> m_helmetOffsets;
+        VirtualTexturedFloor m_floor;
         PBRShaderUniforms m_pbrUniforms;
         SceneUniforms m_sceneUniforms;
         SkyboxUniforms m_skyboxUniforms;
@@ -614,6 +1051,12 @@ namespace example
 
         bool m_computeSupported = true;
         int m_iblMode = 0;
+
+        bool m_instancingSupported = false;
+        int m_helmetGridSize = 1;
+        float m_submitMs = 0.0f;
+        bool m_showFloor = true;
+        uint32_t m_currentFrame = 0;
     };
 
 }  // namespace example
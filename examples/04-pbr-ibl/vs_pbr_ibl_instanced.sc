@@ -0,0 +1,26 @@
+$input a_position, a_normal, a_texcoord0, a_tangent, i_data0, i_data1, i_data2, i_data3
+$output v_position, v_texcoord, v_normal, v_tangent, v_bitangent
+
+
+#include "../common/common.sh"
+
+void main()
+{
+    // Same as vs_pbr_ibl, but with the model matrix coming from the instance data
+    mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+    v_position = mul(model, vec4(a_position, 1.0)).xyz;
+
+    // Instance transforms include the glTF node's, which can scale non-uniformly. The cofactor matrix is the
+    // inverse transpose up to a factor of the determinant, whose sign keeps mirrored nodes' normals pointing out.
+    vec3 cofactor0 = cross(i_data1.xyz, i_data2.xyz);
+    vec3 cofactor1 = cross(i_data2.xyz, i_data0.xyz);
+    vec3 cofactor2 = cross(i_data0.xyz, i_data1.xyz);
+    float determinantSign = dot(i_data0.xyz, cofactor0) < 0.0 ? -1.0 : 1.0;
+    v_normal    = normalize(determinantSign * (a_normal.x * cofactor0 + a_normal.y * cofactor1 + a_normal.z * cofactor2));
+    v_tangent   = normalize(mul(model, vec4(a_tangent.xyz, 0.0)).xyz);
+    v_bitangent = normalize(cross(v_normal, v_tangent)) * a_tangent.w;
+
+    v_texcoord = a_texcoord0;
+
+    gl_Position = mul(u_viewProj, vec4(v_position, 1.0));
+}
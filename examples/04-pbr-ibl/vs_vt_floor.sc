@@ -0,0 +1,11 @@
+$input a_position, a_texcoord0
+$output v_position, v_texcoord
+
+#include "../common/common.sh"
+
+void main()
+{
+    v_position = mul(u_model[0], vec4(a_position, 1.0)).xyz;
+    v_texcoord = a_texcoord0;
+    gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
+}
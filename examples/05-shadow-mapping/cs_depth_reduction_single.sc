@@ -0,0 +1,106 @@
+#include "bgfx_compute.sh"
+
+#define GROUP_SIZE 64
+#define THREADS_X 8
+#define THREADS_Y 8
+// Every thread reduces a block of pixels before the group reduces its threads, so we need fewer groups
+#define PIXELS_PER_THREAD 2
+#define PIXELS_PER_GROUP 16
+// floatBitsToUint(1.0). Our depths are never negative, so their bits sort the same way the floats do.
+#define DEPTH_ONE_BITS 1065353216u
+
+// Uniforms:
+uniform vec4 u_params;
+#define nearZ u_params.z
+#define farZ u_params.w
+uniform mat4 u_projection;
+
+SAMPLER2D(s_inputDepthMap, 0);
+// Min and max depth so far, as uints, then the number of groups that have finished. The last group to finish
+// resets it, so it's ready for the next frame without a clear.
+BUFFER_RW(b_depthMinMax, uint, 1);
+IMAGE2D_WR(s_output, rg16f, 2);
+
+// Shared
+SHARED vec2 depthShared[GROUP_SIZE];
+
+float toLinearDepth(float sampledDepth) {
+  // Transform to linear depth, taken from MJP
+#if BGFX_SHADER_LANGUAGE_GLSL
+  // GL's depth buffer holds 0.5 * ndc + 0.5
+  sampledDepth = 2.0 * sampledDepth - 1.0;
+  sampledDepth = u_projection[3][2] / (sampledDepth - u_projection[2][2]);
+#else
+  sampledDepth = u_projection[2][3] / (sampledDepth - u_projection[2][2]);
+#endif
+  return saturate((sampledDepth - nearZ) / (farZ - nearZ));
+}
+
+NUM_THREADS(THREADS_X, THREADS_Y, 1)
+void main() {
+  ivec2 imageDim = ivec2(u_params.xy);
+  ivec2 blockStart = ivec2(gl_GlobalInvocationID.xy) * PIXELS_PER_THREAD;
+
+  // Background pixels are left out, a block of nothing but background gives (1, 0)
+  vec2 minMax = vec2(1.0, 0.0);
+  UNROLL
+  for (int y = 0; y < PIXELS_PER_THREAD; ++y) {
+    UNROLL
+    for (int x = 0; x < PIXELS_PER_THREAD; ++x) {
+      ivec2 coord = blockStart + ivec2(x, y);
+      if (coord.x < imageDim.x && coord.y < imageDim.y) {
+        // NOTE: This doesn't support multisampled depth maps.
+        float sampledDepth = texelFetch(s_inputDepthMap, coord, 0).r;
+        if (sampledDepth < 1.0) {
+          float linearDepth = toLinearDepth(sampledDepth);
+          minMax = vec2(min(minMax.x, linearDepth), max(minMax.y, linearDepth));
+        }
+      }
+    }
+  }
+  depthShared[gl_LocalInvocationIndex] = minMax;
+
+  groupMemoryBarrier();
+
+  UNROLL
+  for (uint binIndex = (GROUP_SIZE >> 1); binIndex > 0; binIndex >>= 1) {
+    if (uint(gl_LocalInvocationIndex) < binIndex) {
+      depthShared[gl_LocalInvocationIndex].x = min(
+        depthShared[gl_LocalInvocationIndex].x,
+        depthShared[gl_LocalInvocationIndex + binIndex].x
+      );
+      depthShared[gl_LocalInvocationIndex].y = max(
+        depthShared[gl_LocalInvocationIndex].y,
+        depthShared[gl_LocalInvocationIndex + binIndex].y
+      );
+    }
+
+    groupMemoryBarrier();
+  }
+
+  if (gl_LocalInvocationIndex == 0) {
+    atomicMin(b_depthMinMax[0], floatBitsToUint(depthShared[0].x));
+    atomicMax(b_depthMinMax[1], floatBitsToUint(depthShared[0].y));
+  }
+
+  // Our min and max have to be visible to the other groups before we count ourselves as finished
+  memoryBarrierBuffer();
+
+  if (gl_LocalInvocationIndex == 0) {
+    uint groupCountX = uint(imageDim.x + PIXELS_PER_GROUP - 1) / PIXELS_PER_GROUP;
+    uint groupCountY = uint(imageDim.y + PIXELS_PER_GROUP - 1) / PIXELS_PER_GROUP;
+    uint finishedGroups;
+    atomicFetchAndAdd(b_depthMinMax[2], 1u, finishedGroups);
+
+    // Every other group has already added its min and max, so we're the one to write out the result
+    if (finishedGroups == groupCountX * groupCountY - 1u) {
+      uint minBits;
+      uint maxBits;
+      uint unused;
+      atomicFetchAndExchange(b_depthMinMax[0], DEPTH_ONE_BITS, minBits);
+      atomicFetchAndExchange(b_depthMinMax[1], 0u, maxBits);
+      atomicFetchAndExchange(b_depthMinMax[2], 0u, unused);
+      imageStore(s_output, ivec2(0, 0), vec4(uintBitsToFloat(minBits), uintBitsToFloat(maxBits), 0.0, 0.0));
+    }
+  }
+}
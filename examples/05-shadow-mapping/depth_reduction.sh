@@ -37,6 +37,8 @@ void main() {
   if (sampledDepth < 1.0) {
     // Transform to linear depth, taken from MJP
 #if BGFX_SHADER_LANGUAGE_GLSL
+    // GL's depth buffer holds 0.5 * ndc + 0.5
+    sampledDepth = 2.0 * sampledDepth - 1.0;
     sampledDepth = u_projection[3][2] / (sampledDepth - u_projection[2][2]);
 #else
     sampledDepth = u_projection[2][3] / (sampledDepth - u_projection[2][2]);
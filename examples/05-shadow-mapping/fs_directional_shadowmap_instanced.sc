@@ -0,0 +1,11 @@
+$input v_cascadeClip
+
+#include "../common/common.sh"
+
+void main()
+{
+    // Rasterization is only clipped against the whole atlas, so we have to keep out of the neighbouring cascades
+    if (any(greaterThan(abs(v_cascadeClip), vec2_splat(1.0)))) {
+        discard;
+    }
+}
@@ -0,0 +1,19 @@
+$input v_position, v_normal
+
+#include "../common/common.sh"
+#include "../common/pbr_helpers.sh"
+
+uniform vec4 u_directionalLightParams[2];
+#define u_lightColor u_directionalLightParams[0].xyz
+#define u_lightIntesity u_directionalLightParams[0].w
+#define u_lightDir u_directionalLightParams[1].xyz
+
+void main()
+{
+    // Plain diffuse, these only exist to cast moving shadows onto the scene
+    vec3 baseColor = vec3(0.8, 0.2, 0.1);
+    float NoL = clampDot(normalize(v_normal), -u_lightDir);
+    vec3 color = 0.1 * baseColor + baseColor * u_lightIntesity * u_lightColor * NoL;
+
+    gl_FragColor = vec4(color, 1.0);
+}
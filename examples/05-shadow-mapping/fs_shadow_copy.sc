@@ -0,0 +1,14 @@
+$input v_texcoord
+
+#include "../common/common.sh"
+
+// uv scale and offset of the region we're copying, same layout in both atlases
+uniform vec4 u_copyRegion;
+
+SAMPLER2D(s_staticShadowAtlas, 0);
+
+void main()
+{
+    vec2 uv = v_texcoord * u_copyRegion.xy + u_copyRegion.zw;
+    gl_FragDepth = texture2D(s_staticShadowAtlas, uv).r;
+}
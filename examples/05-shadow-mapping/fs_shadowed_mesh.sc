@@ -4,7 +4,11 @@ $input v_position, v_normal, v_tangent, v_bitangent, v_texcoord
 #include "../common/pbr_helpers.sh"
 
 #define MAX_SLOPE_OFFSET 2.0
-#define NUM_CASCADES 4
+#define MAX_CASCADES 8
+// Variants define this as 1 (a single hard sample) or 8, we default to the full 16 tap Poisson disk
+#ifndef SHADOW_FILTER_TAPS
+#define SHADOW_FILTER_TAPS 16
+#endif // SHADOW_FILTER_TAPS
 
 // Scene
 uniform vec4 u_shadowMapParams;
@@ -19,14 +23,13 @@ uniform vec4 u_directionalLightParams[2];
 #define u_lightIntesity u_directionalLightParams[0].w
 #define u_lightDir u_directionalLightParams[1].xyz
 uniform vec4 u_samplingDisk[8];
-uniform vec4 u_cascadeBounds[NUM_CASCADES];
+uniform vec4 u_cascadeBounds[MAX_CASCADES];
 #define u_diskSize u_cascadeBounds[0].w
-uniform mat4 u_lightViewProj[NUM_CASCADES];
+uniform mat4 u_lightViewProj[MAX_CASCADES];
+// Per cascade: uv scale and offset into the atlas, then the min and max uvs of its region
+uniform vec4 u_shadowAtlasRegions[2 * MAX_CASCADES];
 
-SAMPLER2D(s_shadowMap_1, 5);
-SAMPLER2D(s_shadowMap_2, 6);
-SAMPLER2D(s_shadowMap_3, 7);
-SAMPLER2D(s_shadowMap_4, 8);
+SAMPLER2D(s_shadowAtlas, 5);
 SAMPLER2D(s_randomTexture, 9);
 
 
@@ -71,12 +74,12 @@ vec2 get_shadow_offsets(vec3 normal, vec3 lightDir) {
 
 uint getShadowCascadeIdx(float fragDepth) {
     UNROLL
-    for (uint i = 0; i < NUM_CASCADES; ++i) {
+    for (uint i = 0; i < MAX_CASCADES; ++i) {
         if (fragDepth < u_cascadeBounds[i].z) {
             return i;
         }
     }
-    return NUM_CASCADES - 1;
+    return MAX_CASCADES - 1;
 }
 
 
@@ -93,16 +96,11 @@ float sampleLightDepth(
     );
     // vec2 diskOffset = (u_samplingDisk[i][j], u_samplingDisk[i][j+1]);
     vec2 uv = texCoords + u_diskSize * diskOffset / u_cascadeBounds[cascadeIdx].xy;
-    float sampledLightDepth;
-    if (cascadeIdx == 0) {
-        sampledLightDepth = texture2D(s_shadowMap_1, uv).r;
-    } else if (cascadeIdx == 1) {
-        sampledLightDepth = texture2D(s_shadowMap_2, uv).r;
-    } else if (cascadeIdx == 2) {
-        sampledLightDepth = texture2D(s_shadowMap_3, uv).r;
-    } else {
-        sampledLightDepth = texture2D(s_shadowMap_4, uv).r;
-    }
+    // Move into the cascade's region of the atlas, without letting the disk reach into its neighbours
+    vec4 scaleOffset = u_shadowAtlasRegions[2u * cascadeIdx];
+    vec4 bounds = u_shadowAtlasRegions[2u * cascadeIdx + 1u];
+    vec2 atlasUV = clamp(uv * scaleOffset.xy + scaleOffset.zw, bounds.xy, bounds.zw);
+    float sampledLightDepth = texture2D(s_shadowAtlas, atlasUV).r;
     return step(lightDepth, sampledLightDepth);
 }
 
@@ -144,12 +142,17 @@ void main()
         // Red is cos theta, green is sin theta
         vec2 diskRotation = texture2D(s_randomTexture, 0.5 * gl_FragCoord.xy + 0.5).rg;
 
+    #if SHADOW_FILTER_TAPS == 1
+        // The first point of our disk is its centre
+        shadowVisibility = sampleLightDepth(cascadeIdx, lightUVDepth.xy, diskRotation, lightDepth, 0, 0);
+    #else
         UNROLL
-        for (uint i = 0; i < 8; i++) {
+        for (uint i = 0; i < SHADOW_FILTER_TAPS / 2; i++) {
             shadowVisibility += sampleLightDepth(cascadeIdx, lightUVDepth.xy, diskRotation, lightDepth, i, 0);
             shadowVisibility += sampleLightDepth(cascadeIdx, lightUVDepth.xy, diskRotation, lightDepth, i, 2);
         }
-        shadowVisibility /= 16.0;
+        shadowVisibility /= float(SHADOW_FILTER_TAPS);
+    #endif // SHADOW_FILTER_TAPS == 1
     }
 
 
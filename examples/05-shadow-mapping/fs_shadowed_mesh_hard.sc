@@ -0,0 +1,3 @@
+#define SHADOW_FILTER_TAPS 1
+
+#include "./fs_shadowed_mesh.sc"
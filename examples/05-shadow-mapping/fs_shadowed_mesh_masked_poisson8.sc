@@ -0,0 +1,4 @@
+#define MASKING_ENABLED 1
+#define SHADOW_FILTER_TAPS 8
+
+#include "./fs_shadowed_mesh.sc"
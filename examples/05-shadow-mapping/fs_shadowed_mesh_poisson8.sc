@@ -0,0 +1,3 @@
+#define SHADOW_FILTER_TAPS 8
+
+#include "./fs_shadowed_mesh.sc"
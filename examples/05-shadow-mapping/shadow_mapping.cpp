@@ -10,12 +10,24 @@
 #include <glm/glm.hpp>
 #include <glm/matrix.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "camera.h"
 #include "bae/PhysicallyBasedScene.h"
 #include "bae/Tonemapping.h"
 #include "bae/Offscreen.h"
+#include "bae/ShadowAtlas.h"
+#include "bae/AsyncReadback.h"
+#include "bae/IcosahedronFactory.h"
+#include "bae/ShadowCasterCulling.h"
+#include "bae/ShadowCascades.h"
+#include "bae/DepthReduction.h"
+#include "bae/OcclusionQueries.h"
+#include "bae/GeometryPool.h"
 #include "bae/gltf_model_loading.h"
+#include "bae/TextureCache.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
 
 namespace example
 {
@@ -26,8 +38,186 @@ namespace example
     constexpr uint16_t THREAD_COUNT_PER_DIM = 8u;
     constexpr float NEAR_PLANE = 0.2f;
     constexpr float FAR_PLANE = 1000.f;
-    constexpr size_t NUM_CASCADES = 4;
-    constexpr uint16_t numDepthUniforms = NUM_CASCADES / 4u + (NUM_CASCADES % 4u > 0u ? 1u : 0u);
+    // Uniform arrays are sized for the most cascades we support, the ones actually in use are picked at runtime
+    constexpr uint32_t MAX_CASCADES = bae::MAX_SHADOW_CASCADES;
+    constexpr uint16_t MIN_CASCADE_SIZE = 256u;
+
+    enum struct CascadeSizing
+    {
+        // Every cascade gets the same, user chosen resolution
+        FIXED,
+        // Each cascade asks for enough texels to match the screen resolution at its near plane
+        SCREEN_COVERAGE,
+    };
+
+    static const char* CASCADE_SIZING_NAMES[] = {
+        "Fixed Budget",
+        "Screen Coverage",
+    };
+
+    static const uint16_t SHADOW_ATLAS_SIZES[][2] = {
+        { 2048u, 2048u },
+        { 4096u, 2048u },
+        { 4096u, 4096u },
+    };
+
+    static const char* SHADOW_ATLAS_SIZE_NAMES[] = {
+        "2048x2048",
+        "4096x2048",
+        "4096x4096",
+    };
+
+    static const uint16_t CASCADE_SIZES[] = { 256u, 512u, 1024u, 2048u };
+
+    static const char* CASCADE_SIZE_NAMES[] = {
+        "256",
+        "512",
+        "1024",
+        "2048",
+    };
+
+    static const char* CASCADE_SPLIT_SCHEME_NAMES[] = {
+        "Logarithmic",
+        "Uniform",
+        "Practical (PSSM)",
+    };
+
+    // Each filter is a precompiled variant of the shaded mesh shaders, see fs_shadowed_mesh.sc
+    enum struct ShadowFilter
+    {
+        HARD,
+        POISSON_8,
+        POISSON_16,
+        COUNT,
+    };
+
+    static const char* SHADOW_FILTER_NAMES[] = {
+        "Hard (1 tap)",
+        "Poisson (8 taps)",
+        "Poisson (16 taps)",
+    };
+
+    static const char* SHADOW_FILTER_SHADERS[][2] = {
+        { "fs_shadowed_mesh_hard", "fs_shadowed_mesh_masked_hard" },
+        { "fs_shadowed_mesh_poisson8", "fs_shadowed_mesh_masked_poisson8" },
+        { "fs_shadowed_mesh", "fs_shadowed_mesh_masked" },
+    };
+
+    enum struct ShadowQuality
+    {
+        LOW,
+        MEDIUM,
+        HIGH,
+    };
+
+    static const char* SHADOW_QUALITY_NAMES[] = {
+        "Low",
+        "Medium",
+        "High",
+    };
+
+    // Starting points for each platform, everything can still be tweaked individually afterwards
+    struct ShadowSettings
+    {
+        int numCascades;
+        // Indices into SHADOW_ATLAS_SIZES and CASCADE_SIZES
+        int shadowAtlasSize;
+        int fixedCascadeSize;
+        CascadeSizing cascadeSizing;
+        bae::CascadeSplitScheme splitScheme;
+        float splitLambda;
+        ShadowFilter filter;
+    };
+
+    static const ShadowSettings SHADOW_QUALITY_SETTINGS[] = {
+        { 2, 0, 2, CascadeSizing::FIXED, bae::CascadeSplitScheme::PRACTICAL, 0.5f, ShadowFilter::HARD },
+        { 3, 0, 2, CascadeSizing::SCREEN_COVERAGE, bae::CascadeSplitScheme::PRACTICAL, 0.75f, ShadowFilter::POISSON_8 },
+        { 4, 1, 2, CascadeSizing::SCREEN_COVERAGE, bae::CascadeSplitScheme::LOGARITHMIC, 0.75f, ShadowFilter::POISSON_16 },
+    };
+
+    static ShadowQuality getDefaultShadowQuality(const bgfx::Caps* caps)
+    {
+        // Mobile GPUs, or anything that can't fit our larger atlases, get the cheapest settings
+        if (caps->rendererType == bgfx::RendererType::OpenGLES || caps->limits.maxTextureSize < 4096) {
+            return ShadowQuality::LOW;
+        }
+        // Without instancing every cascade costs us another draw per caster
+        if (!(caps->supported & BGFX_CAPS_INSTANCING)) {
+            return ShadowQuality::MEDIUM;
+        }
+        return ShadowQuality::HIGH;
+    }
+
+    enum struct DepthReductionMode
+    {
+        // A dispatch per 8x8 reduction, each into a smaller texture
+        MULTI_PASS,
+        // A single dispatch, with groups combining their results through atomics in a tiny buffer
+        SINGLE_PASS,
+    };
+
+    static const char* DEPTH_REDUCTION_MODE_NAMES[] = {
+        "Multi Pass",
+        "Single Pass",
+    };
+
+    enum struct DepthReductionValidation
+    {
+        NOT_RUN,
+        PENDING,
+        PASSED,
+        FAILED,
+    };
+
+    static const char* DEPTH_REDUCTION_VALIDATION_NAMES[] = {
+        "Not Run",
+        "Pending",
+        "Passed",
+        "Failed",
+    };
+
+    static const char* OCCLUSION_MODE_NAMES[] = {
+        "Disabled",
+        "Skip Occluded",
+        "Conditional Rendering",
+    };
+
+    // floatBitsToUint(1.0), what the single pass reduction's min starts at
+    constexpr uint32_t DEPTH_ONE_BITS = 0x3f800000u;
+    constexpr uint16_t PIXELS_PER_REDUCTION_GROUP = 16u;
+
+    enum struct CascadeStatus
+    {
+        // Static casters were redrawn this frame
+        RENDERED,
+        // Nothing about the cascade changed, so its static casters were reused
+        CACHED,
+        // The cascade changed, but is far enough away that we've put off redrawing it
+        DEFERRED,
+        // Didn't get a region in the atlas
+        SKIPPED,
+    };
+
+    static const char* CASCADE_STATUS_NAMES[] = {
+        "Rendered",
+        "Cached",
+        "Deferred",
+        "Skipped",
+    };
+
+    // What a cascade's static casters were last drawn with
+    struct CascadeCache
+    {
+        glm::mat4 lightView = glm::mat4{ 1.0f };
+        glm::mat4 projection = glm::mat4{ 1.0f };
+        glm::mat4 viewProj = glm::mat4{ 1.0f };
+        glm::vec2 extent = glm::vec2{ 1.0f };
+        bae::ShadowAtlasRegion region = {};
+        uint32_t lastUpdateFrame = 0;
+        bool valid = false;
+        // Whether the shadow atlas region has dynamic casters in it that we need to get rid of
+        bool hasDynamicCasters = false;
+    };
 
     static glm::vec2 poissonPattern[16]{
         { 0.0f, 0.0f },
@@ -54,14 +244,17 @@ namespace example
         float m_intensity = 10.0f;
         glm::vec4 m_direction = glm::normalize(glm::vec4{ 1.0, -3.0f, 1.0f, 0.0 });
 
-        glm::mat4 m_cascadeTransforms[NUM_CASCADES];
-        glm::vec4 m_cascadeBounds[NUM_CASCADES];
+        glm::mat4 m_cascadeTransforms[MAX_CASCADES];
+        glm::vec4 m_cascadeBounds[MAX_CASCADES];
+        // For each cascade, the uv scale and offset of its atlas region followed by its uv bounds
+        glm::vec4 m_atlasRegions[2 * MAX_CASCADES];
 
         bgfx::UniformHandle u_directionalLightParams = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle u_lightViewProj = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle u_samplingDisk = BGFX_INVALID_HANDLE;
         bgfx::UniformHandle u_cascadeBounds = BGFX_INVALID_HANDLE;
-        bgfx::UniformHandle s_shadowMaps[NUM_CASCADES] = { BGFX_INVALID_HANDLE };
+        bgfx::UniformHandle u_shadowAtlasRegions = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_shadowAtlas = BGFX_INVALID_HANDLE;
     };
 
     void init(DirectionalLight& light)
@@ -70,17 +263,12 @@ namespace example
         light.m_cascadeBounds[0].w = 0.035;
 
         light.u_directionalLightParams = bgfx::createUniform("u_directionalLightParams", bgfx::UniformType::Vec4, 2);
-        light.u_lightViewProj = bgfx::createUniform("u_lightViewProj", bgfx::UniformType::Mat4, NUM_CASCADES);
+        light.u_lightViewProj = bgfx::createUniform("u_lightViewProj", bgfx::UniformType::Mat4, MAX_CASCADES);
         light.u_samplingDisk = bgfx::createUniform("u_samplingDisk", bgfx::UniformType::Vec4, 4u);
-        // Uniform will be vec4, but we're storing a min and max for each cascade
-        light.u_cascadeBounds = bgfx::createUniform("u_cascadeBounds", bgfx::UniformType::Vec4, numDepthUniforms);
-        for (size_t i = 0; i < NUM_CASCADES; i++)
-        {
-            char name[] = "s_shadowMap_x";
-            bx::toString(&name[12], 2, i);
-            light.s_shadowMaps[i] = bgfx::createUniform(name, bgfx::UniformType::Sampler);
-
-        }
+        // Extent of each cascade in xy and the NDC depth it ends at in z
+        light.u_cascadeBounds = bgfx::createUniform("u_cascadeBounds", bgfx::UniformType::Vec4, MAX_CASCADES);
+        light.u_shadowAtlasRegions = bgfx::createUniform("u_shadowAtlasRegions", bgfx::UniformType::Vec4, 2 * MAX_CASCADES);
+        light.s_shadowAtlas = bgfx::createUniform("s_shadowAtlas", bgfx::UniformType::Sampler);
     }
 
     void destroy(DirectionalLight& light) {
@@ -88,21 +276,17 @@ namespace example
         bgfx::destroy(light.u_lightViewProj);
         bgfx::destroy(light.u_samplingDisk);
         bgfx::destroy(light.u_cascadeBounds);
-        for (bgfx::UniformHandle shadowMap : light.s_shadowMaps)
-        {
-            bgfx::destroy(shadowMap);
-        }
+        bgfx::destroy(light.u_shadowAtlasRegions);
+        bgfx::destroy(light.s_shadowAtlas);
     }
 
-    void bindUniforms(const DirectionalLight& light, const bgfx::TextureHandle shadowMapTextures[NUM_CASCADES]) {
+    void bindUniforms(const DirectionalLight& light, const bgfx::TextureHandle shadowAtlas) {
         bgfx::setUniform(light.u_directionalLightParams, &light, 2);
-        bgfx::setUniform(light.u_lightViewProj, glm::value_ptr(light.m_cascadeTransforms[0]), NUM_CASCADES);
+        bgfx::setUniform(light.u_lightViewProj, glm::value_ptr(light.m_cascadeTransforms[0]), MAX_CASCADES);
         bgfx::setUniform(light.u_samplingDisk, glm::value_ptr(poissonPattern[0]), 8u);
-        bgfx::setUniform(light.u_cascadeBounds, light.m_cascadeBounds, NUM_CASCADES);
-        for (uint8_t i = 0; i < NUM_CASCADES; i++)
-        {
-            bgfx::setTexture(i + 5, light.s_shadowMaps[i], shadowMapTextures[i], BGFX_SAMPLER_UVW_CLAMP);
-        }
+        bgfx::setUniform(light.u_cascadeBounds, light.m_cascadeBounds, MAX_CASCADES);
+        bgfx::setUniform(light.u_shadowAtlasRegions, light.m_atlasRegions, 2 * MAX_CASCADES);
+        bgfx::setTexture(5, light.s_shadowAtlas, shadowAtlas, BGFX_SAMPLER_UVW_CLAMP);
     }
 
     struct PBRShaderUniforms
@@ -242,6 +426,7 @@ namespace example
             initInfo.resolution.width = m_width;
             initInfo.resolution.height = m_height;
             initInfo.resolution.reset = m_reset;
+            initInfo.allocator = bae::getTrackingAllocator();
             bgfx::init(initInfo);
 
             // Enable m_debug text.
@@ -257,14 +442,21 @@ namespace example
 
             m_directionalShadowMapProgram = loadProgram("vs_directional_shadowmap", "fs_directional_shadowmap");
             m_prepassProgram = loadProgram("vs_z_prepass", "fs_z_prepass");
-            m_pbrShader = loadProgram("vs_shadowed_mesh", "fs_shadowed_mesh");
-            m_pbrShaderWithMasking = loadProgram("vs_shadowed_mesh", "fs_shadowed_mesh_masked");
+            for (size_t i = 0; i < size_t(ShadowFilter::COUNT); ++i) {
+                m_pbrShaders[i] = loadProgram("vs_shadowed_mesh", SHADOW_FILTER_SHADERS[i][0]);
+                m_pbrShadersWithMasking[i] = loadProgram("vs_shadowed_mesh", SHADOW_FILTER_SHADERS[i][1]);
+            }
             m_depthReductionInitial = loadProgram("cs_depth_reduction_initial", nullptr);
             m_depthReductionGeneral = loadProgram("cs_depth_reduction_general", nullptr);
+            m_depthReductionSingle = loadProgram("cs_depth_reduction_single", nullptr);
             m_drawDepthDebugProgram = loadProgram("vs_texture_pass_through", "fs_texture_pass_through");
+            m_shadowCopyProgram = loadProgram("vs_shadow_copy", "fs_shadow_copy");
+            m_directionalShadowMapInstancedProgram = loadProgram("vs_directional_shadowmap_instanced", "fs_directional_shadowmap_instanced");
+            m_dynamicCasterProgram = loadProgram("vs_dynamic_caster", "fs_dynamic_caster");
 
-            // Lets load all the meshes
-            m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf");
+            // Lets load all the meshes, sharing a few large buffers instead of a pair per mesh
+            m_geometryPool.init(bae::GeometryPoolParams{});
+            m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf", false, &m_geometryPool);
 
             example::init(m_pbrUniforms);
             example::init(m_sceneUniforms);
@@ -272,6 +464,24 @@ namespace example
             example::init(m_depthReductionUniforms);
             
             m_shadowMapDebugSampler = bgfx::createUniform("s_input", bgfx::UniformType::Sampler);
+            u_copyRegion = bgfx::createUniform("u_copyRegion", bgfx::UniformType::Vec4);
+            s_staticShadowAtlas = bgfx::createUniform("s_staticShadowAtlas", bgfx::UniformType::Sampler);
+            u_cascadeViewProj = bgfx::createUniform("u_cascadeViewProj", bgfx::UniformType::Mat4, MAX_CASCADES);
+            u_cascadeClipRegions = bgfx::createUniform("u_cascadeClipRegions", bgfx::UniformType::Vec4, MAX_CASCADES);
+            m_instancingSupported = !!(m_caps->supported & BGFX_CAPS_INSTANCING);
+            m_singlePassShadows = m_instancingSupported;
+            m_occlusionQueriesSupported = !!(m_caps->supported & BGFX_CAPS_OCCLUSION_QUERY);
+            if (m_occlusionQueriesSupported) {
+                m_occlusionQueries.init(m_model.opaqueMeshes.boundingBoxes.data(), m_model.opaqueMeshes.boundingBoxes.size(), bae::OcclusionQueryParams{});
+            }
+            else {
+                m_occlusionMode = bae::OcclusionMode::DISABLED;
+            }
+            m_shadowQuality = getDefaultShadowQuality(m_caps);
+            applyShadowSettings(SHADOW_QUALITY_SETTINGS[int(m_shadowQuality)]);
+
+            bae::IcosahedronFactory sphereFactory{ 2 };
+            m_dynamicCasterMesh = sphereFactory.getMesh();
             m_sceneUniforms.m_randomTexture = loadTexture("textures/random.png");
 
             m_toneMapParams.width = m_width;
@@ -282,15 +492,18 @@ namespace example
             m_toneMapPass.init(m_caps);
 
 
-            for (size_t i = 0; i < NUM_CASCADES; i++)
-            {
-                bgfx::Attachment attachment;
-                m_shadowMaps[i] = bgfx::createTexture2D(m_shadowMapWidth, m_shadowMapWidth, false, 1, bgfx::TextureFormat::D32);
-                attachment.init(m_shadowMaps[i], bgfx::Access::Write);
-                m_shadowMapFramebuffers[i] = bgfx::createFrameBuffer(1, &attachment, true);
-            }
+            // The single pass reduction accumulates into a buffer, and its last group writes the result out
+            const uint32_t initialMinMax[3] = { DEPTH_ONE_BITS, 0u, 0u };
+            m_depthReductionBuffer = bgfx::createDynamicIndexBuffer(
+                bgfx::copy(initialMinMax, sizeof(initialMinMax)), BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
+            m_depthValidationBuffer = bgfx::createDynamicIndexBuffer(
+                bgfx::copy(initialMinMax, sizeof(initialMinMax)), BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
+            m_depthReductionResult = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RG16F, BGFX_TEXTURE_COMPUTE_WRITE);
+            m_depthValidationResult = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RG16F, BGFX_TEXTURE_COMPUTE_WRITE);
 
-            m_cpuReadableDepth = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RG16F, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+            m_depthReadback.init(1, 1, bgfx::TextureFormat::RG16F, 3, "Depth Min Max Readback");
+            m_depthValidationReadback.init(1, 1, bgfx::TextureFormat::RG16F, 1, "Depth Validation Readback");
+            m_luminanceReadback.init(1, 1, bgfx::TextureFormat::R16F, 3, "Average Luminance Readback");
             // Imgui.
             imguiCreate();
 
@@ -319,17 +532,25 @@ namespace example
                 bgfx::destroy(m_pbrFramebuffer);
             }
 
-            if (bgfx::isValid(m_shadowMapFramebuffers[0]))
+            if (bgfx::isValid(m_shadowAtlasFramebuffer))
             {
-                for (size_t i = 0; i < NUM_CASCADES; ++i) {
-                    bgfx::destroy(m_shadowMapFramebuffers[i]);
-                }
-                for (auto texture : m_depthReductionTargets) {
-                    bgfx::destroy(texture);
-                }
-                bgfx::destroy(m_cpuReadableDepth);
+                bgfx::destroy(m_shadowAtlasFramebuffer);
             }
 
+            if (bgfx::isValid(m_staticShadowAtlasFramebuffer))
+            {
+                bgfx::destroy(m_staticShadowAtlasFramebuffer);
+            }
+
+            destroyDepthReductionTargets();
+            bgfx::destroy(m_depthReductionBuffer);
+            bgfx::destroy(m_depthValidationBuffer);
+            bgfx::destroy(m_depthReductionResult);
+            bgfx::destroy(m_depthValidationResult);
+            m_depthReadback.destroy();
+            m_depthValidationReadback.destroy();
+            m_luminanceReadback.destroy();
+
             m_toneMapPass.destroy();
             // Cleanup.
             destroy(m_directionalLight);
@@ -338,13 +559,27 @@ namespace example
             destroy(m_sceneUniforms);
             bgfx::destroy(m_shadowMapDebugSampler);
             bae::destroy(m_model);
+            bae::getTextureCache().destroy();
+            m_geometryPool.destroy();
+            m_occlusionQueries.destroy();
             bgfx::destroy(m_drawDepthDebugProgram);
+            bgfx::destroy(m_shadowCopyProgram);
+            bgfx::destroy(m_dynamicCasterProgram);
+            bgfx::destroy(u_copyRegion);
+            bgfx::destroy(s_staticShadowAtlas);
+            bgfx::destroy(u_cascadeViewProj);
+            bgfx::destroy(u_cascadeClipRegions);
+            bgfx::destroy(m_directionalShadowMapInstancedProgram);
+            bae::destroy(m_dynamicCasterMesh);
             bgfx::destroy(m_depthReductionGeneral);
             bgfx::destroy(m_depthReductionInitial);
+            bgfx::destroy(m_depthReductionSingle);
             bgfx::destroy(m_directionalShadowMapProgram);
             bgfx::destroy(m_prepassProgram);
-            bgfx::destroy(m_pbrShader);
-            bgfx::destroy(m_pbrShaderWithMasking);
+            for (size_t i = 0; i < size_t(ShadowFilter::COUNT); ++i) {
+                bgfx::destroy(m_pbrShaders[i]);
+                bgfx::destroy(m_pbrShadersWithMasking[i]);
+            }
 
             cameraDestroy();
 
@@ -360,11 +595,17 @@ namespace example
             const bx::Vec3& cameraPos,
             const uint64_t state,
             const bgfx::ProgramHandle program,
-            const bgfx::ViewId viewId) const
+            const bgfx::ViewId viewId,
+            const bae::OcclusionQueries* occlusion = nullptr,
+            const bool conditional = false) const
         {
             // Render all our opaque meshes
             for (size_t i = 0; i < meshes.meshes.size(); ++i)
             {
+                if (occlusion != nullptr && !occlusion->prepareDraw(i, conditional)) {
+                    continue;
+                }
+
                 const auto& mesh = meshes.meshes[i];
                 const auto& transform = meshes.transforms[i];
                 const auto& material = meshes.materials[i];
@@ -372,13 +613,115 @@ namespace example
                 bgfx::setState(state);
                 bindUniforms(m_pbrUniforms, material, transform);
                 bindUniforms(m_sceneUniforms, cameraPos);
-                bindUniforms(m_directionalLight, m_shadowMaps);
+                bindUniforms(m_directionalLight, m_shadowAtlasTexture);
                 mesh.setBuffers();
 
                 bgfx::submit(viewId, program);
             }
         }
 
+        const bae::OcclusionQueries* getOcclusionQueries() const
+        {
+            return m_occlusionMode != bae::OcclusionMode::DISABLED ? &m_occlusionQueries : nullptr;
+        }
+
+        void applyShadowSettings(const ShadowSettings& settings)
+        {
+            m_numCascades = settings.numCascades;
+            m_shadowAtlasSize = settings.shadowAtlasSize;
+            m_fixedCascadeSize = settings.fixedCascadeSize;
+            m_cascadeSizing = settings.cascadeSizing;
+            m_splitScheme = settings.splitScheme;
+            m_splitLambda = settings.splitLambda;
+            m_shadowFilter = settings.filter;
+        }
+
+        // Draws a caster into every cascade in cascadeMask. That's either one draw per cascade, into its own view, or
+        // a single instanced draw into singlePassView when we're rendering all our cascades at once.
+        void submitShadowCaster(
+            const bae::Mesh& mesh,
+            const glm::mat4& transform,
+            const uint32_t cascadeMask,
+            const uint64_t state,
+            const bgfx::ViewId cascadeViews[MAX_CASCADES],
+            const bgfx::ViewId singlePassView)
+        {
+            if (cascadeMask == 0) {
+                return;
+            }
+
+            if (!m_singlePassShadows) {
+                submitShadowCasterPerCascade(mesh, transform, cascadeMask, state, cascadeViews);
+                return;
+            }
+
+            // The only thing that changes per instance is the cascade we're drawing into
+            const uint16_t instanceStride = 16;
+            const uint32_t numInstances = bae::countCascades(cascadeMask);
+            if (numInstances != bgfx::getAvailInstanceDataBuffer(numInstances, instanceStride)) {
+                // Out of instance data for this frame. The per cascade views are set up either way, so the caster
+                // still makes it into every cascade, just with more draws.
+                submitShadowCasterPerCascade(mesh, transform, cascadeMask, state, cascadeViews);
+                ++m_shadowInstancingFallbacks;
+                return;
+            }
+            bgfx::InstanceDataBuffer instanceData;
+            bgfx::allocInstanceDataBuffer(&instanceData, numInstances, instanceStride);
+            float* data = (float*)instanceData.data;
+            for (uint32_t cascadeIdx = 0; cascadeIdx < MAX_CASCADES; ++cascadeIdx) {
+                if (cascadeMask & (1u << cascadeIdx)) {
+                    data[0] = float(cascadeIdx);
+                    data[1] = 0.0f;
+                    data[2] = 0.0f;
+                    data[3] = 0.0f;
+                    data += 4;
+                }
+            }
+
+            bgfx::setUniform(u_cascadeViewProj, glm::value_ptr(m_directionalLight.m_cascadeTransforms[0]), MAX_CASCADES);
+            bgfx::setUniform(u_cascadeClipRegions, glm::value_ptr(m_cascadeClipRegions[0]), MAX_CASCADES);
+            bgfx::setState(state);
+            bgfx::setTransform(glm::value_ptr(transform));
+            mesh.setBuffers();
+            bgfx::setInstanceDataBuffer(&instanceData);
+            bgfx::submit(singlePassView, m_directionalShadowMapInstancedProgram);
+            ++m_shadowDrawCount;
+            m_shadowInstanceCount += numInstances;
+        }
+
+        void submitShadowCasterPerCascade(
+            const bae::Mesh& mesh,
+            const glm::mat4& transform,
+            const uint32_t cascadeMask,
+            const uint64_t state,
+            const bgfx::ViewId cascadeViews[MAX_CASCADES])
+        {
+            for (uint32_t cascadeIdx = 0; cascadeIdx < MAX_CASCADES; ++cascadeIdx) {
+                if ((cascadeMask & (1u << cascadeIdx)) == 0) {
+                    continue;
+                }
+                bgfx::setState(state);
+                bgfx::setTransform(glm::value_ptr(transform));
+                mesh.setBuffers();
+                bgfx::submit(cascadeViews[cascadeIdx], m_directionalShadowMapProgram);
+                ++m_shadowDrawCount;
+                ++m_shadowInstanceCount;
+            }
+        }
+
+        // Only for programs that need nothing more than positions and transforms
+        uint32_t renderDynamicCasters(const uint64_t state, const bgfx::ProgramHandle program, const bgfx::ViewId viewId) const
+        {
+            for (int i = 0; i < m_numDynamicCasters; ++i)
+            {
+                bgfx::setState(state);
+                bgfx::setTransform(glm::value_ptr(m_dynamicCasterTransforms[i]));
+                m_dynamicCasterMesh.setBuffers();
+                bgfx::submit(viewId, program);
+            }
+            return uint32_t(m_numDynamicCasters);
+        }
+
         // Taken from MJP's Shadow Code: https://github.com/TheRealMJP/Shadows
         uint16_t getDispatchSize(uint16_t dim, uint16_t threadCount) const
         {
@@ -387,12 +730,112 @@ namespace example
             return dispatchSize;
         }
 
-        void setupDepthReductionTargets(uint16_t width, uint16_t height)
+        void initializeShadowAtlas()
+        {
+            if (bgfx::isValid(m_shadowAtlasFramebuffer))
+            {
+                bgfx::destroy(m_shadowAtlasFramebuffer);
+            }
+
+            const uint16_t width = SHADOW_ATLAS_SIZES[m_shadowAtlasSize][0];
+            const uint16_t height = SHADOW_ATLAS_SIZES[m_shadowAtlasSize][1];
+            m_shadowAtlas.init(width, height, MIN_CASCADE_SIZE);
+
+            bgfx::Attachment attachment;
+            m_shadowAtlasTexture = bgfx::createTexture2D(width, height, false, 1, bgfx::TextureFormat::D32);
+            bgfx::setName(m_shadowAtlasTexture, "Shadow Atlas");
+            attachment.init(m_shadowAtlasTexture, bgfx::Access::Write);
+            m_shadowAtlasFramebuffer = bgfx::createFrameBuffer(1, &attachment, true);
+
+            // Static casters get an atlas of their own, with the same layout, that we copy from every frame
+            if (bgfx::isValid(m_staticShadowAtlasFramebuffer))
+            {
+                bgfx::destroy(m_staticShadowAtlasFramebuffer);
+                m_staticShadowAtlasFramebuffer = BGFX_INVALID_HANDLE;
+                m_staticShadowAtlasTexture = BGFX_INVALID_HANDLE;
+            }
+            if (m_cacheStaticCasters)
+            {
+                m_staticShadowAtlasTexture = bgfx::createTexture2D(width, height, false, 1, bgfx::TextureFormat::D32);
+                bgfx::setName(m_staticShadowAtlasTexture, "Static Shadow Atlas");
+                attachment.init(m_staticShadowAtlasTexture, bgfx::Access::Write);
+                m_staticShadowAtlasFramebuffer = bgfx::createFrameBuffer(1, &attachment, true);
+            }
+
+            for (CascadeCache& cache : m_cascadeCaches)
+            {
+                cache.valid = false;
+            }
+        }
+
+        void dispatchSinglePassReduction(
+            const bgfx::ViewId viewId,
+            const bgfx::TextureHandle depthTexture,
+            const uint16_t width,
+            const uint16_t height,
+            const float projection[16],
+            const bgfx::DynamicIndexBufferHandle buffer,
+            const bgfx::TextureHandle result)
+        {
+            bindUniforms(m_depthReductionUniforms, width, height, projection);
+            bgfx::setTexture(0, m_depthReductionUniforms.u_depthSampler, depthTexture, SAMPLER_POINT_CLAMP);
+            bgfx::setBuffer(1, buffer, bgfx::Access::ReadWrite);
+            bgfx::setImage(2, result, 0, bgfx::Access::Write, bgfx::TextureFormat::RG16F);
+            bgfx::dispatch(
+                viewId,
+                m_depthReductionSingle,
+                getDispatchSize(width, PIXELS_PER_REDUCTION_GROUP),
+                getDispatchSize(height, PIXELS_PER_REDUCTION_GROUP),
+                1);
+        }
+
+        // Reduces a made up depth buffer on the GPU, with the single pass reduction, and on the CPU so that we can
+        // compare them once the GPU's result has been read back. The readback is queued in a later view, since
+        // blits happen before a view's dispatches.
+        void requestDepthReductionValidation(const bgfx::ViewId dispatchView, const bgfx::ViewId readbackView, const float projection[16])
+        {
+            const uint16_t width = 1280;
+            const uint16_t height = 720;
+            std::vector<float> depth(size_t(width) * height);
+            std::mt19937 generator{ 1337 };
+            std::uniform_real_distribution<float> viewDepths{ 2.0f * NEAR_PLANE, 0.5f * FAR_PLANE };
+            std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+            for (float& value : depth) {
+                // Leave some background in there, which both reductions should ignore
+                if (unit(generator) < 0.1f) {
+                    value = 1.0f;
+                    continue;
+                }
+                const float ndcDepth = projection[10] + projection[14] / viewDepths(generator);
+                value = m_caps->homogeneousDepth ? 0.5f * ndcDepth + 0.5f : ndcDepth;
+            }
+
+            const int64_t start = bx::getHPCounter();
+            m_depthValidationCpu = bae::reduceDepthMinMax(depth.data(), width, height, projection, m_caps->homogeneousDepth, NEAR_PLANE, FAR_PLANE);
+            m_depthValidationCpuMs = float(1000.0 * double(bx::getHPCounter() - start) / double(bx::getHPFrequency()));
+
+            bgfx::TextureHandle depthTexture = bgfx::createTexture2D(
+                width, height, false, 1, bgfx::TextureFormat::R32F, SAMPLER_POINT_CLAMP, bgfx::copy(depth.data(), uint32_t(depth.size() * sizeof(float))));
+            dispatchSinglePassReduction(dispatchView, depthTexture, width, height, projection, m_depthValidationBuffer, m_depthValidationResult);
+            // Destruction is deferred until the frame has been submitted
+            bgfx::destroy(depthTexture);
+
+            m_depthValidationRequested = m_depthValidationReadback.request(readbackView, m_depthValidationResult);
+        }
+
+        void destroyDepthReductionTargets()
         {
             for (bgfx::TextureHandle texture : m_depthReductionTargets) {
                 bgfx::destroy(texture);
             }
             m_depthReductionTargets.clear();
+        }
+
+        void setupDepthReductionTargets(uint16_t width, uint16_t height)
+        {
+            destroyDepthReductionTargets();
+            m_depthReductionTargetsWidth = width;
+            m_depthReductionTargetsHeight = height;
 
             while (width > 1 || height > 1) {
                 width = getDispatchSize(width, THREAD_COUNT_PER_DIM);
@@ -448,9 +891,13 @@ namespace example
                 bgfx::setName(m_pbrFbTextures[1], "HDR Depth Buffer");
 
                 m_pbrFramebuffer = bgfx::createFrameBuffer(BX_COUNTOF(m_pbrFbTextures), m_pbrFbTextures, true);
+            }
 
-                // Create new depth reduction targets for our new framebuffer
-                setupDepthReductionTargets(uint16_t(m_width), uint16_t(m_height));
+            if (!bgfx::isValid(m_shadowAtlasFramebuffer) || m_oldShadowAtlasSize != m_shadowAtlasSize || m_oldCacheStaticCasters != m_cacheStaticCasters)
+            {
+                m_oldShadowAtlasSize = m_shadowAtlasSize;
+                m_oldCacheStaticCasters = m_cacheStaticCasters;
+                initializeShadowAtlas();
             }
 
             imguiBeginFrame(m_mouseState.m_mx, m_mouseState.m_my, (m_mouseState.m_buttons[entry::MouseButton::Left] ? IMGUI_MBUT_LEFT : 0) | (m_mouseState.m_buttons[entry::MouseButton::Right] ? IMGUI_MBUT_RIGHT : 0) | (m_mouseState.m_buttons[entry::MouseButton::Middle] ? IMGUI_MBUT_MIDDLE : 0), m_mouseState.m_mz, uint16_t(m_width), uint16_t(m_height));
@@ -479,12 +926,140 @@ namespace example
             ImGui::Text("Poisson Disk Size");
             ImGui::SliderFloat("Disk", &m_directionalLight.m_cascadeBounds[0].w, 0.001f, 0.1f);
 
+            ImGui::Separator();
+            int shadowQuality = int(m_shadowQuality);
+            if (ImGui::Combo("Shadow Quality", &shadowQuality, SHADOW_QUALITY_NAMES, BX_COUNTOF(SHADOW_QUALITY_NAMES))) {
+                m_shadowQuality = ShadowQuality(shadowQuality);
+                applyShadowSettings(SHADOW_QUALITY_SETTINGS[shadowQuality]);
+            }
+            ImGui::SliderInt("Cascades", &m_numCascades, 1, int(MAX_CASCADES));
+            int splitScheme = int(m_splitScheme);
+            ImGui::Combo("Split Scheme", &splitScheme, CASCADE_SPLIT_SCHEME_NAMES, BX_COUNTOF(CASCADE_SPLIT_SCHEME_NAMES));
+            m_splitScheme = bae::CascadeSplitScheme(splitScheme);
+            if (m_splitScheme == bae::CascadeSplitScheme::PRACTICAL) {
+                ImGui::SliderFloat("Split Lambda", &m_splitLambda, 0.0f, 1.0f);
+            }
+            int shadowFilter = int(m_shadowFilter);
+            ImGui::Combo("Shadow Filter", &shadowFilter, SHADOW_FILTER_NAMES, BX_COUNTOF(SHADOW_FILTER_NAMES));
+            m_shadowFilter = ShadowFilter(shadowFilter);
+            ImGui::Combo("Shadow Atlas", &m_shadowAtlasSize, SHADOW_ATLAS_SIZE_NAMES, BX_COUNTOF(SHADOW_ATLAS_SIZE_NAMES));
+            int cascadeSizing = int(m_cascadeSizing);
+            ImGui::Combo("Cascade Sizing", &cascadeSizing, CASCADE_SIZING_NAMES, BX_COUNTOF(CASCADE_SIZING_NAMES));
+            m_cascadeSizing = CascadeSizing(cascadeSizing);
+            if (m_cascadeSizing == CascadeSizing::FIXED) {
+                ImGui::Combo("Cascade Size", &m_fixedCascadeSize, CASCADE_SIZE_NAMES, BX_COUNTOF(CASCADE_SIZE_NAMES));
+            }
+            ImGui::Checkbox("Stabilize Cascades", &m_stabilizeCascades);
+            ImGui::Checkbox("Cache Static Casters", &m_cacheStaticCasters);
+            if (m_cacheStaticCasters) {
+                ImGui::SliderInt("Scheduled From", &m_firstScheduledCascade, 0, m_numCascades);
+                ImGui::SliderInt("Far Cascade Interval", &m_farCascadeInterval, 1, 16);
+            }
+            ImGui::SliderInt("Dynamic Casters", &m_numDynamicCasters, 0, MAX_DYNAMIC_CASTERS);
+            for (size_t i = 0; i < size_t(m_numCascades); ++i) {
+                ImGui::Text("Cascade %d: %dx%d, %s", int(i), m_cascadeRegions[i].size, m_cascadeRegions[i].size, CASCADE_STATUS_NAMES[int(m_cascadeStatus[i])]);
+            }
+            if (m_cascadeCoverage.isValid()) {
+                ImGui::Text("Frustum Coverage: OK");
+            }
+            else {
+                ImGui::Text("Frustum Coverage: FAILED (%s, uncovered 0x%02x)", m_cascadeCoverage.contiguous ? "contiguous" : "gaps", m_cascadeCoverage.uncoveredCascades);
+            }
+            if (m_instancingSupported) {
+                ImGui::Checkbox("Single Pass Cascades", &m_singlePassShadows);
+            }
+            ImGui::Text("Shadow Draws: %u (%u instances, +%u copies)", m_shadowDrawCount, m_shadowInstanceCount, m_shadowCopyCount);
+            if (m_shadowInstancingFallbacks > 0) {
+                ImGui::Text("Casters drawn per cascade, out of instance data: %u", m_shadowInstancingFallbacks);
+            }
+            // What we used to spend on a separate 2048x2048 D32 map per cascade
+            const float separateMapsMB = float(uint32_t(m_numCascades) * 2048u * 2048u * 4u) / (1024.0f * 1024.0f);
+            const float atlasMB = float(uint32_t(m_shadowAtlas.getWidth()) * m_shadowAtlas.getHeight() * 4u) / (1024.0f * 1024.0f)
+                * (bgfx::isValid(m_staticShadowAtlasFramebuffer) ? 2.0f : 1.0f);
+            const float atlasUsage = float(m_shadowAtlas.getAllocatedTexels()) / float(uint32_t(m_shadowAtlas.getWidth()) * m_shadowAtlas.getHeight());
+            ImGui::Text("Atlas Memory: %.1f MB (vs %.1f MB)", atlasMB, separateMapsMB);
+            ImGui::Text("Atlas Usage: %.1f%%", 100.0f * atlasUsage);
+
+            ImGui::Separator();
+            ImGui::Text("Depth Reduction");
+            int depthReductionMode = int(m_depthReductionMode);
+            ImGui::Combo("Reduction", &depthReductionMode, DEPTH_REDUCTION_MODE_NAMES, BX_COUNTOF(DEPTH_REDUCTION_MODE_NAMES));
+            m_depthReductionMode = DepthReductionMode(depthReductionMode);
+            ImGui::Checkbox("Run Both", &m_compareDepthReductions);
+            ImGui::Text("Multi Pass: %.3f ms GPU, %u dispatches", m_depthReductionMs[int(DepthReductionMode::MULTI_PASS)], uint32_t(m_depthReductionTargets.size()));
+            ImGui::Text("Single Pass: %.3f ms GPU, 1 dispatch", m_depthReductionMs[int(DepthReductionMode::SINGLE_PASS)]);
+            if (ImGui::Button("Validate Against CPU") && m_depthValidation != DepthReductionValidation::PENDING) {
+                m_depthValidation = DepthReductionValidation::PENDING;
+            }
+            ImGui::Text("Validation: %s", DEPTH_REDUCTION_VALIDATION_NAMES[int(m_depthValidation)]);
+            if (m_depthValidation == DepthReductionValidation::PASSED || m_depthValidation == DepthReductionValidation::FAILED) {
+                ImGui::Text("  CPU: %.4f - %.4f (%.2f ms)", m_depthValidationCpu.x, m_depthValidationCpu.y, m_depthValidationCpuMs);
+                ImGui::Text("  GPU: %.4f - %.4f", m_depthValidationGpu.x, m_depthValidationGpu.y);
+            }
+
+            ImGui::Separator();
+            ImGui::Text("Occlusion Culling");
+            if (m_occlusionQueriesSupported) {
+                int occlusionMode = int(m_occlusionMode);
+                ImGui::Combo("Occlusion Queries", &occlusionMode, OCCLUSION_MODE_NAMES, BX_COUNTOF(OCCLUSION_MODE_NAMES));
+                m_occlusionMode = bae::OcclusionMode(occlusionMode);
+                const bae::OcclusionQueryStats& occlusionStats = m_occlusionQueries.getStats();
+                ImGui::Text("Queries: %u of %u meshes (%u pending)", occlusionStats.queries, occlusionStats.testedMeshes, occlusionStats.pendingResults);
+                ImGui::Text("Occluded: %u", occlusionStats.occludedMeshes);
+                ImGui::Text("Draws Skipped: %u, Conditional: %u", occlusionStats.skippedDraws, occlusionStats.conditionalDraws);
+                ImGui::Text("Popping Errors: %u", occlusionStats.poppingErrors);
+            }
+            else {
+                ImGui::Text("Not supported.");
+            }
+
+            ImGui::Separator();
+            ImGui::Text("Geometry Pool");
+            const bae::GeometryPoolStats poolStats = m_geometryPool.getStats();
+            ImGui::Text("Pages: %u, Ranges: %u, Failed: %u", poolStats.pages, poolStats.ranges, poolStats.failedAllocations);
+            ImGui::Text("Vertices: %u / %u (%.1f%%)", poolStats.allocatedVertices, poolStats.vertexCapacity,
+                poolStats.vertexCapacity > 0 ? 100.0f * poolStats.allocatedVertices / poolStats.vertexCapacity : 0.0f);
+            ImGui::Text("Indices: %u / %u (%.1f%%)", poolStats.allocatedIndices, poolStats.indexCapacity,
+                poolStats.indexCapacity > 0 ? 100.0f * poolStats.allocatedIndices / poolStats.indexCapacity : 0.0f);
+            ImGui::Text("Fragmentation: %.1f%% vertices (%u free), %.1f%% indices (%u free)",
+                100.0f * poolStats.vertexFragmentation, poolStats.freeVertexRanges,
+                100.0f * poolStats.indexFragmentation, poolStats.freeIndexRanges);
+
+            ImGui::Separator();
+            ImGui::Text("Readbacks");
+            const bae::AsyncReadbackStats& depthStats = m_depthReadback.getStats();
+            ImGui::Text("Depth: %.3f - %.3f", bx::halfToFloat(m_depthData[0]), bx::halfToFloat(m_depthData[1]));
+            ImGui::Text("  Latency: %u frames (avg %.2f, max %u)", depthStats.lastLatency, depthStats.averageLatency, depthStats.maxLatency);
+            ImGui::Text("  Stalls: %u / %u", depthStats.stalls, depthStats.requested + depthStats.stalls);
+            const bae::AsyncReadbackStats& luminanceStats = m_luminanceReadback.getStats();
+            ImGui::Text("Avg Luminance: %.3f", m_avgLuminance);
+            ImGui::Text("  Latency: %u frames (avg %.2f, max %u)", luminanceStats.lastLatency, luminanceStats.averageLatency, luminanceStats.maxLatency);
+            ImGui::Text("  Stalls: %u / %u", luminanceStats.stalls, luminanceStats.requested + luminanceStats.stalls);
+
             ImGui::End();
 
             imguiEndFrame();
 
             bgfx::touch(0);
 
+            // Pick up any readbacks that have landed since last frame
+            if (m_depthReadback.update(m_currentFrame)) {
+                const uint16_t* depthData = static_cast<const uint16_t*>(m_depthReadback.getData());
+                m_depthData[0] = depthData[0];
+                m_depthData[1] = depthData[1];
+            }
+            if (m_depthValidationReadback.update(m_currentFrame)) {
+                const uint16_t* depthData = static_cast<const uint16_t*>(m_depthValidationReadback.getData());
+                m_depthValidationGpu = glm::vec2{ bx::halfToFloat(depthData[0]), bx::halfToFloat(depthData[1]) };
+                // The GPU's result has been through a half float, which only has 11 bits of precision
+                const glm::vec2 error = glm::abs(m_depthValidationGpu - m_depthValidationCpu);
+                m_depthValidation = error.x <= 1e-3f && error.y <= 1e-3f ? DepthReductionValidation::PASSED : DepthReductionValidation::FAILED;
+                m_depthValidationRequested = false;
+            }
+            if (m_luminanceReadback.update(m_currentFrame)) {
+                m_avgLuminance = bx::halfToFloat(*static_cast<const uint16_t*>(m_luminanceReadback.getData()));
+            }
+
             bgfx::ViewId viewCount = 0;
             bgfx::ViewId zPrepass = viewCount++;
             bgfx::setViewFrameBuffer(zPrepass, m_pbrFramebuffer);
@@ -492,18 +1067,48 @@ namespace example
             bgfx::setViewRect(zPrepass, 0, 0, uint16_t(m_width), uint16_t(m_height));
             bgfx::setViewClear(zPrepass, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x000000ff, 1.0f, 0);
 
-            bgfx::ViewId depthReductionPass = viewCount++;
-            bgfx::setViewName(depthReductionPass, "Depth Reduction");
+            // Bounding box proxies for our occlusion queries, against the prepass' depth
+            bgfx::ViewId occlusionPass = viewCount++;
+            bgfx::setViewFrameBuffer(occlusionPass, m_pbrFramebuffer);
+            bgfx::setViewName(occlusionPass, "Occlusion Queries");
+            bgfx::setViewRect(occlusionPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+
+            bgfx::ViewId multiPassReduction = viewCount++;
+            bgfx::setViewName(multiPassReduction, "Depth Reduction (Multi Pass)");
+
+            bgfx::ViewId singlePassReduction = viewCount++;
+            bgfx::setViewName(singlePassReduction, "Depth Reduction (Single Pass)");
+
+            // Kept apart from the single pass reduction, so that validating doesn't show up in its timings
+            bgfx::ViewId depthValidationPass = viewCount++;
+            bgfx::setViewName(depthValidationPass, "Depth Reduction Validation");
+
+            // Only used when caching static casters, these views only get draws when a cascade needs updating
+            bgfx::ViewId staticShadowPasses[MAX_CASCADES];
+            for (size_t i = 0; i < size_t(m_numCascades); ++i) {
+                staticShadowPasses[i] = viewCount++;
+                bgfx::setViewFrameBuffer(staticShadowPasses[i], m_staticShadowAtlasFramebuffer);
+                bgfx::setViewName(staticShadowPasses[i], "Static Shadow Casters");
+                bgfx::setViewClear(staticShadowPasses[i], BGFX_CLEAR_DEPTH, 0x000000ff, 1.0f, 0);
+            }
+
+            bgfx::ViewId staticSinglePass = viewCount++;
+            bgfx::setViewFrameBuffer(staticSinglePass, m_staticShadowAtlasFramebuffer);
+            bgfx::setViewName(staticSinglePass, "Static Shadow Casters (Single Pass)");
 
-            bgfx::ViewId shadowPasses[NUM_CASCADES];
-            for (size_t i = 0; i < NUM_CASCADES; ++i) {
+            bgfx::ViewId shadowPasses[MAX_CASCADES];
+            for (size_t i = 0; i < size_t(m_numCascades); ++i) {
                 shadowPasses[i] = viewCount++;
-                bgfx::setViewFrameBuffer(shadowPasses[i], m_shadowMapFramebuffers[i]);
+                // Every cascade renders into its own region of the atlas, the view rect is set once we've packed them
+                bgfx::setViewFrameBuffer(shadowPasses[i], m_shadowAtlasFramebuffer);
                 bgfx::setViewName(shadowPasses[i], "Shadow Map");
-                bgfx::setViewRect(shadowPasses[i], 0, 0, m_shadowMapWidth, m_shadowMapWidth);
-                bgfx::setViewClear(shadowPasses[i], BGFX_CLEAR_DEPTH, 0x000000ff, 1.0f, 0);
             }
 
+            // Used instead of the per cascade views above when rendering all cascades with a single submit per caster
+            bgfx::ViewId singleShadowPass = viewCount++;
+            bgfx::setViewFrameBuffer(singleShadowPass, m_shadowAtlasFramebuffer);
+            bgfx::setViewName(singleShadowPass, "Shadow Map (Single Pass)");
+
             bgfx::ViewId meshPass = viewCount++;
             bgfx::setViewFrameBuffer(meshPass, m_pbrFramebuffer);
             bgfx::setViewName(meshPass, "Draw Meshes");
@@ -537,11 +1142,19 @@ namespace example
             cameraGetViewMtx(view);
             // Set view and projection matrix
             bgfx::setViewTransform(zPrepass, view, proj);
+            bgfx::setViewTransform(occlusionPass, view, proj);
             bgfx::setViewTransform(meshPass, view, proj);
 
             // Set view 0 default viewport.
             bx::Vec3 cameraPos = cameraGetPosition();
 
+            // Dynamic casters orbit around the middle of the atrium
+            for (int i = 0; i < m_numDynamicCasters; ++i) {
+                float angle = 0.5f * m_time + bx::kPi2 * float(i) / float(m_numDynamicCasters);
+                glm::vec3 position{ 4.0f * bx::cos(angle), 1.5f + 0.5f * bx::sin(2.0f * angle), 1.5f * bx::sin(angle) };
+                m_dynamicCasterTransforms[i] = glm::scale(glm::translate(glm::mat4{ 1.0f }, position), glm::vec3{ 0.5f });
+            }
+
             // DEPTH PREPASS
             {
                 uint64_t statePrepass = 0
@@ -550,10 +1163,34 @@ namespace example
                     | BGFX_STATE_CULL_CCW
                     | BGFX_STATE_MSAA;
 
-                renderMeshes(m_model.opaqueMeshes, cameraPos, statePrepass, m_prepassProgram, zPrepass);
+                // Uses whichever query results have made it back so far, without waiting for this frame's
+                m_occlusionQueries.update(m_occlusionMode, glm::vec3{ cameraPos.x, cameraPos.y, cameraPos.z });
+                renderMeshes(m_model.opaqueMeshes, cameraPos, statePrepass, m_prepassProgram, zPrepass, getOcclusionQueries());
+                renderDynamicCasters(statePrepass, m_prepassProgram, zPrepass);
+
+                if (m_occlusionMode != bae::OcclusionMode::DISABLED) {
+                    m_occlusionQueries.submitProxies(occlusionPass, m_prepassProgram);
+                }
             }
 
             // DEPTH REDUCTION
+            const bool runMultiPassReduction = m_depthReductionMode == DepthReductionMode::MULTI_PASS || m_compareDepthReductions;
+            const bool runSinglePassReduction = m_depthReductionMode == DepthReductionMode::SINGLE_PASS || m_compareDepthReductions;
+            // Only the multi pass reduction needs a chain of targets, so we only keep them around while it's in use.
+            // This has to come after the UI, which can change the mode for this frame.
+            if (runMultiPassReduction)
+            {
+                if (m_depthReductionTargets.empty() || m_depthReductionTargetsWidth != m_width || m_depthReductionTargetsHeight != m_height)
+                {
+                    setupDepthReductionTargets(uint16_t(m_width), uint16_t(m_height));
+                }
+            }
+            else if (!m_depthReductionTargets.empty())
+            {
+                destroyDepthReductionTargets();
+            }
+
+            if (runMultiPassReduction && !m_depthReductionTargets.empty())
             {
                 // Dispatch initial
                 uint16_t dispatchSizeX = getDispatchSize(uint16_t(m_width), THREAD_COUNT_PER_DIM);
@@ -562,7 +1199,7 @@ namespace example
                 bindUniforms(m_depthReductionUniforms, uint16_t(m_width), uint16_t(m_height), proj);
                 bgfx::setTexture(0, m_depthReductionUniforms.u_depthSampler, m_pbrFbTextures[1], SAMPLER_POINT_CLAMP);
                 bgfx::setImage(1, m_depthReductionTargets[0], 0, bgfx::Access::Write, bgfx::TextureFormat::RG16F);
-                bgfx::dispatch(depthReductionPass, m_depthReductionInitial, dispatchSizeX, dispatchSizeY, 1);
+                bgfx::dispatch(multiPassReduction, m_depthReductionInitial, dispatchSizeX, dispatchSizeY, 1);
 
                 for (size_t i = 1; i < m_depthReductionTargets.size(); i++) {
                     // Size of source reduction map
@@ -573,17 +1210,31 @@ namespace example
                     // Dispatch secondary
                     bgfx::setImage(0, m_depthReductionTargets[i - 1], 0, bgfx::Access::Read, bgfx::TextureFormat::RG16F);
                     bgfx::setImage(1, m_depthReductionTargets[i], 0, bgfx::Access::Write, bgfx::TextureFormat::RG16F);
-                    bgfx::dispatch(depthReductionPass, m_depthReductionGeneral, dispatchSizeX, dispatchSizeY, 1);
+                    bgfx::dispatch(multiPassReduction, m_depthReductionGeneral, dispatchSizeX, dispatchSizeY, 1);
                 }
 
             }
+            if (runSinglePassReduction)
+            {
+                dispatchSinglePassReduction(
+                    singlePassReduction, m_pbrFbTextures[1], uint16_t(m_width), uint16_t(m_height), proj, m_depthReductionBuffer, m_depthReductionResult);
+            }
+            if (m_depthValidation == DepthReductionValidation::PENDING && !m_depthValidationRequested)
+            {
+                requestDepthReductionValidation(depthValidationPass, meshPass, proj);
+            }
 
             // SHADOW MAP PASSES
             {
 
-                // Get a normalized min and max depth, where 0 maps to NEAR and 1 maps to FAR
-                bgfx::blit(shadowPasses[0], m_cpuReadableDepth, 0, 0, m_depthReductionTargets[m_depthReductionTargets.size() - 1], 0, 0);
-                bgfx::readTexture(m_cpuReadableDepth, m_depthData, 0);
+                // Get a normalized min and max depth, where 0 maps to NEAR and 1 maps to FAR. What we use this frame is
+                // the latest result that has made it back to the CPU, which is a few frames old.
+                if (m_depthReductionMode == DepthReductionMode::SINGLE_PASS) {
+                    m_depthReadback.request(meshPass, m_depthReductionResult);
+                }
+                else if (!m_depthReductionTargets.empty()) {
+                    m_depthReadback.request(meshPass, m_depthReductionTargets.back());
+                }
                 float minDepth = bx::halfToFloat(m_depthData[0]);
                 float maxDepth = bx::halfToFloat(m_depthData[1]);
 
@@ -593,135 +1244,216 @@ namespace example
                 // Get the depths in View space instead of the normalized coords we've read back
                 float minWorldDepth = minDepth * (FAR_PLANE - NEAR_PLANE) + NEAR_PLANE;
                 float maxWorldDepth = maxDepth * (FAR_PLANE - NEAR_PLANE) + NEAR_PLANE;
-                float depthRatio = bx::pow(maxWorldDepth / minWorldDepth, 1.0f / NUM_CASCADES);
-                glm::vec2 cascadeMinMax[NUM_CASCADES] = {};
-                cascadeMinMax[0] = { minWorldDepth, minWorldDepth * depthRatio };
-                for (int cascadeIdx = 1; cascadeIdx < NUM_CASCADES; ++cascadeIdx) {
-                    cascadeMinMax[cascadeIdx] = { cascadeMinMax[cascadeIdx - 1].y, cascadeMinMax[cascadeIdx - 1].y * depthRatio };
-                }
+                bae::computeCascadeSplits(minWorldDepth, maxWorldDepth, uint32_t(m_numCascades), m_splitScheme, m_splitLambda, m_cascadeSplits);
 
-                for (int cascadeIdx = 0; cascadeIdx < NUM_CASCADES; ++cascadeIdx) {
+                for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx) {
                     // Store NDC dpeths of near and far corners for use in our shader
-                    m_directionalLight.m_cascadeBounds[cascadeIdx].z = (proj[10] * cascadeMinMax[cascadeIdx].y + proj[14]) / (proj[11] * cascadeMinMax[cascadeIdx].y);
+                    m_directionalLight.m_cascadeBounds[cascadeIdx].z = (proj[10] * m_cascadeSplits[cascadeIdx].y + proj[14]) / (proj[11] * m_cascadeSplits[cascadeIdx].y);
                 }
+                // The shader picks the first cascade that ends beyond the fragment, so anything past the last one we're
+                // using (or beyond the depth range we read back) should land in the last one
+                for (int cascadeIdx = m_numCascades - 1; cascadeIdx < int(MAX_CASCADES); ++cascadeIdx) {
+                    m_directionalLight.m_cascadeBounds[cascadeIdx].z = 2.0f;
+                }
+
+                glm::vec3 up = bx::abs(m_directionalLight.m_direction.y) != 1.0f ? glm::vec3{ 0.0f, 1.0f, 0.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
+                // Only rotates into light space, so that stabilized cascades can be snapped to a fixed texel grid
+                glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), glm::vec3(m_directionalLight.m_direction), up);
 
-                // In clip space:
-                float clipNear = m_caps->homogeneousDepth ? -1.0f : 0.0f;
-                glm::vec4 clipFrustum[] =
+                bae::CascadeFit fits[MAX_CASCADES];
+                uint16_t requestedSizes[MAX_CASCADES];
+                for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx)
                 {
-                    glm::vec4(-1.0f,  1.0f, clipNear, 1.0f), // top left near
-                    glm::vec4(1.0f,  1.0f, clipNear, 1.0f), // top right near
-                    glm::vec4(1.0f, -1.0f, clipNear, 1.0f), // bottom right near
-                    glm::vec4(-1.0f, -1.0f, clipNear, 1.0f), // bottom left near
-                    glm::vec4(-1.0f,  1.0f, 1.0f, 1.0f), // top left far
-                    glm::vec4(1.0f,  1.0f, 1.0f, 1.0f), // top right far
-                    glm::vec4(1.0f, -1.0f, 1.0f, 1.0f), // bottom right far
-                    glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f), // botom left far
-                };
-
-                for (int cascadeIdx = 0; cascadeIdx < 4; ++cascadeIdx)
+                    bae::CascadeFit& fit = fits[cascadeIdx];
+                    bae::getFrustumSliceCorners(invViewProj, m_caps->homogeneousDepth ? -1.0f : 0.0f, NEAR_PLANE, FAR_PLANE, m_cascadeSplits[cascadeIdx], fit.corners);
+                    bae::fitCascade(fit, lightRotation, glm::vec3(m_directionalLight.m_direction), up, m_model.boundingBox, m_stabilizeCascades);
+
+                    if (m_cascadeSizing == CascadeSizing::FIXED) {
+                        requestedSizes[cascadeIdx] = CASCADE_SIZES[m_fixedCascadeSize];
+                    }
+                    else {
+                        requestedSizes[cascadeIdx] = bae::getShadowResolutionForCoverage(
+                            bx::max(fit.max.x - fit.min.x, fit.max.y - fit.min.y),
+                            m_cascadeSplits[cascadeIdx].x,
+                            float(m_height),
+                            proj[5],
+                            MIN_CASCADE_SIZE,
+                            m_shadowAtlas.getMaxRegionSize());
+                    }
+                }
+
+                // Cascades are repacked every frame, since their sizes can change whenever the camera moves
+                m_shadowAtlas.reset();
+                m_shadowAtlas.pack(requestedSizes, size_t(m_numCascades), m_cascadeRegions);
+
+                // NOTE: There's a bug somewhere in this code that means I need to cull CW rather than CCW like the rest of the code!
+                uint64_t stateShadowMapping = 0
+                    | BGFX_STATE_WRITE_Z
+                    | BGFX_STATE_CULL_CW
+                    | BGFX_STATE_DEPTH_TEST_LESS;
+
+                uint64_t stateShadowCopy = 0
+                    | BGFX_STATE_WRITE_Z
+                    | BGFX_STATE_DEPTH_TEST_ALWAYS;
+
+                m_shadowDrawCount = 0;
+                m_shadowInstanceCount = 0;
+                m_shadowCopyCount = 0;
+                m_shadowInstancingFallbacks = 0;
+
+                // Cascades with a region, ones whose static casters need redrawing, and ones whose atlas region gets rewritten
+                uint32_t validCascades = 0;
+                uint32_t staticCascades = 0;
+                uint32_t dynamicCascades = 0;
+                for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx)
                 {
-                    float cascMin = (cascadeMinMax[cascadeIdx].x - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE);
-                    float cascMax = (cascadeMinMax[cascadeIdx].y - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE);
-
-                    // Convert to world space
-                    glm::vec4 frustumCorners[8];
-                    for (size_t i = 0; i < 8; ++i) {
-                        frustumCorners[i] = invViewProj * clipFrustum[i];
-                        frustumCorners[i] /= frustumCorners[i].w;
+                    const bae::ShadowAtlasRegion& region = m_cascadeRegions[cascadeIdx];
+                    CascadeCache& cache = m_cascadeCaches[cascadeIdx];
+                    // Can only happen if the atlas is smaller than m_numCascades * MIN_CASCADE_SIZE^2
+                    if (!region.isValid()) {
+                        cache.valid = false;
+                        m_cascadeStatus[cascadeIdx] = CascadeStatus::SKIPPED;
+                        continue;
                     }
+                    validCascades |= 1u << cascadeIdx;
 
-                    // Use min and max bounds to get slice of frustum
-                    glm::vec4 center{ 0.0 };
-                    for (size_t i = 0; i < 4; ++i) {
-                        glm::vec4 cornerRay = frustumCorners[i + 4] - frustumCorners[i];
-                        frustumCorners[i] = cascMin * cornerRay + frustumCorners[i];
-                        frustumCorners[i + 4] = cascMax * cornerRay + frustumCorners[i];
-                        center += frustumCorners[i] + frustumCorners[i + 4];
+                    bae::CascadeFit& fit = fits[cascadeIdx];
+                    if (m_stabilizeCascades) {
+                        bae::snapCascadeToTexels(fit, region.size);
                     }
-                    center /= 8.0f;
 
-                    // Transform view frustum's corners to Light's view space:
-                    glm::vec3 up = bx::abs(m_directionalLight.m_direction.y) != 1.0f ? glm::vec3{ 0.0f, 1.0f, 0.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
-                    glm::mat4 lightView = glm::lookAt(glm::vec3(center - m_directionalLight.m_direction), glm::vec3(center), up);
-                    for (size_t i = 0; i < BX_COUNTOF(frustumCorners); ++i) {
-                        frustumCorners[i] = lightView * frustumCorners[i];
+                    //m_sceneUniforms.texelSize = bx::max(2.0f * (right - left), 2.0f * (top - bottom)) / m_cascadeRegions[cascadeIdx].size;
+                    glm::mat4 orthoProjection = bae::getCascadeProjection(fit, m_caps->homogeneousDepth);
+                    glm::mat4 lightViewProj = orthoProjection * fit.lightView;
+
+                    // Static casters only need to be redrawn when the cascade itself has changed
+                    const bool regionChanged = cache.region.x != region.x || cache.region.y != region.y || cache.region.size != region.size;
+                    bool renderStatic = !m_cacheStaticCasters || !cache.valid || regionChanged || cache.viewProj != lightViewProj;
+                    m_cascadeStatus[cascadeIdx] = renderStatic ? CascadeStatus::RENDERED : CascadeStatus::CACHED;
+
+                    // Far cascades can hang on to their old projection for a few frames, as long as it still covers their slice
+                    const bool farCascade = cascadeIdx >= m_firstScheduledCascade;
+                    if (renderStatic && m_cacheStaticCasters && farCascade && cache.valid && !regionChanged
+                        && m_currentFrame - cache.lastUpdateFrame < uint32_t(m_farCascadeInterval)
+                        && bae::coversFrustumSlice(cache.viewProj, fit.corners, &m_model.boundingBox))
+                    {
+                        renderStatic = false;
+                        m_cascadeStatus[cascadeIdx] = CascadeStatus::DEFERRED;
                     }
 
-                    // Find AABB bounding box around view frustum
-                    glm::vec4 min = frustumCorners[0];
-                    glm::vec4 max = frustumCorners[0];
-                    for (size_t i = 1; i < BX_COUNTOF(frustumCorners); ++i) {
-                        min = glm::min(min, frustumCorners[i]);
-                        max = glm::max(max, frustumCorners[i]);
+                    if (renderStatic) {
+                        cache.lightView = fit.lightView;
+                        cache.projection = orthoProjection;
+                        cache.viewProj = lightViewProj;
+                        cache.extent = glm::vec2(fit.max - fit.min);
+                        cache.region = region;
+                        cache.lastUpdateFrame = m_currentFrame;
+                        cache.valid = true;
+                        staticCascades |= 1u << cascadeIdx;
                     }
 
-                    // Ensure z-bounds include the scene
-                    glm::vec4 bbMin = glm::vec4{ m_model.boundingBox.min, 1.0f };
-                    glm::vec4 bbMax = glm::vec4{ m_model.boundingBox.max, 1.0f };
-                    glm::vec4 bbCorners[8] = {
-                        {bbMin.x, bbMax.y, bbMax.z, 1.0f },
-                        {bbMax.x, bbMax.y, bbMax.z, 1.0f },
-                        {bbMax.x, bbMin.y, bbMax.z, 1.0f },
-                        {bbMin.x, bbMin.y, bbMax.z, 1.0f },
-                        {bbMin.x, bbMax.y, bbMin.z, 1.0f },
-                        {bbMax.x, bbMax.y, bbMin.z, 1.0f },
-                        {bbMax.x, bbMin.y, bbMin.z, 1.0f },
-                        {bbMin.x, bbMin.y, bbMin.z, 1.0f },
-                    };
-                    bbMin = lightView * bbCorners[0];
-                    bbMax = lightView * bbCorners[0];
-                    for (size_t i = 1; i < BX_COUNTOF(bbCorners); ++i) {
-                        glm::vec4 bbCornerLightSpace = lightView * bbCorners[i];
-                        bbMin = glm::min(bbCornerLightSpace, bbMin);
-                        bbMax = glm::max(bbCornerLightSpace, bbMax);
+                    // Dynamic casters are drawn over a fresh copy of the static ones. When there's nothing dynamic and the
+                    // static casters haven't changed, last frame's contents are still correct and we can leave them be.
+                    if (renderStatic || m_numDynamicCasters > 0 || cache.hasDynamicCasters) {
+                        dynamicCascades |= 1u << cascadeIdx;
+                    }
+                    cache.hasDynamicCasters = m_numDynamicCasters > 0;
+
+                    // Everything, including the shader, uses whatever projection the cached shadow map was drawn with
+                    m_directionalLight.m_cascadeBounds[cascadeIdx].x = cache.extent.x;
+                    m_directionalLight.m_cascadeBounds[cascadeIdx].y = cache.extent.y;
+                    m_directionalLight.m_cascadeTransforms[cascadeIdx] = cache.viewProj;
+                    m_directionalLight.m_atlasRegions[2 * cascadeIdx] = m_shadowAtlas.getUVScaleOffset(region, m_caps->originBottomLeft);
+                    m_directionalLight.m_atlasRegions[2 * cascadeIdx + 1] = m_shadowAtlas.getUVBounds(region, m_caps->originBottomLeft);
+                    m_cascadeClipRegions[cascadeIdx] = m_shadowAtlas.getClipScaleOffset(region);
+
+                    bgfx::ViewId views[] = { shadowPasses[cascadeIdx], staticShadowPasses[cascadeIdx] };
+                    for (bgfx::ViewId viewId : views) {
+                        bgfx::setViewRect(viewId, region.x, region.y, region.size, region.size);
+                        bgfx::setViewTransform(viewId, glm::value_ptr(cache.lightView), glm::value_ptr(cache.projection));
+                    }
+                }
+
+                // Check what we've ended up with, deferred cascades included, still covers everything we can see
+                m_cascadeCoverage = bae::validateCascadeCoverage(
+                    invViewProj,
+                    m_caps->homogeneousDepth ? -1.0f : 0.0f,
+                    NEAR_PLANE,
+                    FAR_PLANE,
+                    minWorldDepth,
+                    maxWorldDepth,
+                    m_cascadeSplits,
+                    m_directionalLight.m_cascadeTransforms,
+                    uint32_t(m_numCascades),
+                    &m_model.boundingBox);
+
+                // Work out which cascades each caster touches
+                m_opaqueCascadeMasks.resize(m_model.opaqueMeshes.meshes.size());
+                for (size_t i = 0; i < m_model.opaqueMeshes.meshes.size(); ++i) {
+                    m_opaqueCascadeMasks[i] = validCascades & bae::getCascadeMask(m_model.opaqueMeshes.boundingBoxes[i], m_directionalLight.m_cascadeTransforms, uint32_t(m_numCascades));
+                }
+                for (int i = 0; i < m_numDynamicCasters; ++i) {
+                    glm::vec3 position{ m_dynamicCasterTransforms[i][3] };
+                    // Unit spheres, scaled by half
+                    bae::AABB bounds{ position - glm::vec3{ 0.5f }, position + glm::vec3{ 0.5f } };
+                    m_dynamicCasterMasks[i] = validCascades & bae::getCascadeMask(bounds, m_directionalLight.m_cascadeTransforms, uint32_t(m_numCascades));
+                }
+
+                // Single pass views cover the whole atlas, every cascade is routed to its own region by the vertex shader
+                const uint16_t atlasWidth = m_shadowAtlas.getWidth();
+                const uint16_t atlasHeight = m_shadowAtlas.getHeight();
+                bgfx::setViewRect(staticSinglePass, 0, 0, atlasWidth, atlasHeight);
+                bgfx::setViewRect(singleShadowPass, 0, 0, atlasWidth, atlasHeight);
+
+                // Per cascade views are always the ones to clear, since the single pass views can't clear just some of the regions
+                if (!m_cacheStaticCasters) {
+                    // Everything is drawn straight into the atlas, after clearing it
+                    for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx) {
+                        bgfx::setViewClear(shadowPasses[cascadeIdx], BGFX_CLEAR_DEPTH, 0x000000ff, 1.0f, 0);
+                        bgfx::setViewMode(shadowPasses[cascadeIdx], bgfx::ViewMode::Default);
+                        if (validCascades & (1u << cascadeIdx)) {
+                            bgfx::touch(shadowPasses[cascadeIdx]);
+                        }
+                    }
+
+                    for (size_t i = 0; i < m_model.opaqueMeshes.meshes.size(); ++i) {
+                        submitShadowCaster(m_model.opaqueMeshes.meshes[i], m_model.opaqueMeshes.transforms[i], m_opaqueCascadeMasks[i], stateShadowMapping, shadowPasses, singleShadowPass);
+                    }
+                    for (int i = 0; i < m_numDynamicCasters; ++i) {
+                        submitShadowCaster(m_dynamicCasterMesh, m_dynamicCasterTransforms[i], m_dynamicCasterMasks[i], stateShadowMapping, shadowPasses, singleShadowPass);
+                    }
+                }
+                else {
+                    for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx) {
+                        if (staticCascades & (1u << cascadeIdx)) {
+                            bgfx::touch(staticShadowPasses[cascadeIdx]);
+                        }
+                    }
+                    for (size_t i = 0; i < m_model.opaqueMeshes.meshes.size(); ++i) {
+                        submitShadowCaster(m_model.opaqueMeshes.meshes[i], m_model.opaqueMeshes.transforms[i], m_opaqueCascadeMasks[i] & staticCascades, stateShadowMapping, staticShadowPasses, staticSinglePass);
                     }
-                    // Aggressively bound X and Y, since we don't want any wasted space
-                    min.x = bx::max(bbMin.x, min.x);
-                    max.x = bx::min(bbMax.x, max.x);
-                    min.y = bx::max(bbMin.y, min.y);
-                    max.y = bx::min(bbMax.y, max.y);
-                    // Conservatively bound Z, since we need to make sure all occluders are included, even if they are behind the view frustum
-                    min.z = bx::min(bbMin.z, min.z);
-                    max.z = bx::max(bbMax.z, max.z);
-
-                    // NOTE: There's a bug somewhere in this code that means I need to cull CW rather than CCW like the rest of the code!
-                    uint64_t stateShadowMapping = 0
-                        | BGFX_STATE_WRITE_Z
-                        | BGFX_STATE_CULL_CW
-                        | BGFX_STATE_DEPTH_TEST_LESS;
-
-                    //m_sceneUniforms.texelSize = bx::max(2.0f * (right - left), 2.0f * (top - bottom)) / m_shadowMapWidth;
-                    float orthoProjectionRaw[16];
-                    bx::mtxOrtho(
-                        orthoProjectionRaw,
-                        min.x, // left
-                        max.x, // right
-                        min.y, // bottom
-                        max.y, // top,
-                        max.z, // near
-                        min.z, // far
-                        0.0, m_caps->homogeneousDepth);
-                    glm::mat4 orthoProjection = glm::make_mat4(orthoProjectionRaw);
-
-                    m_directionalLight.m_cascadeBounds[cascadeIdx].x = max.x - min.x;
-                    m_directionalLight.m_cascadeBounds[cascadeIdx].y = max.y - min.y;
-
-                    lightView = glm::lookAt(glm::vec3(center - m_directionalLight.m_direction), glm::vec3(center), up);
-
-                    bgfx::setViewTransform(shadowPasses[cascadeIdx], glm::value_ptr(lightView), glm::value_ptr(orthoProjection));
-                    m_directionalLight.m_cascadeTransforms[cascadeIdx] = orthoProjection * lightView;
-
-                    // Render all our opaque meshes into the shadow map
-                    for (size_t i = 0; i < m_model.opaqueMeshes.meshes.size(); ++i)
-                    {
-                        const auto& mesh = m_model.opaqueMeshes.meshes[i];
-                        const auto& transform = m_model.opaqueMeshes.transforms[i];
 
-                        bgfx::setState(stateShadowMapping);
-                        bgfx::setTransform(glm::value_ptr(transform));
-                        mesh.setBuffers();
-                        bgfx::submit(shadowPasses[cascadeIdx], m_directionalShadowMapProgram);
+                    // Copying the static casters has to happen before any dynamic ones are drawn on top
+                    for (int cascadeIdx = 0; cascadeIdx < m_numCascades; ++cascadeIdx) {
+                        bgfx::ViewId shadowPass = shadowPasses[cascadeIdx];
+                        bgfx::setViewClear(shadowPass, BGFX_CLEAR_NONE, 0x000000ff, 1.0f, 0);
+                        bgfx::setViewMode(shadowPass, bgfx::ViewMode::Sequential);
+                        if ((dynamicCascades & (1u << cascadeIdx)) == 0) {
+                            continue;
+                        }
+
+                        const bae::ShadowAtlasRegion& region = m_cascadeRegions[cascadeIdx];
+                        glm::vec4 copyRegion = m_shadowAtlas.getUVScaleOffset(region, m_caps->originBottomLeft);
+                        bgfx::setUniform(u_copyRegion, glm::value_ptr(copyRegion));
+                        bgfx::setTexture(0, s_staticShadowAtlas, m_staticShadowAtlasTexture, SAMPLER_POINT_CLAMP);
+                        bgfx::setState(stateShadowCopy);
+                        bae::setScreenSpaceQuad(float(region.size), float(region.size), m_caps->originBottomLeft);
+                        bgfx::submit(shadowPass, m_shadowCopyProgram);
+                        ++m_shadowCopyCount;
+                    }
+
+                    for (int i = 0; i < m_numDynamicCasters; ++i) {
+                        submitShadowCaster(m_dynamicCasterMesh, m_dynamicCasterTransforms[i], m_dynamicCasterMasks[i] & dynamicCascades, stateShadowMapping, shadowPasses, singleShadowPass);
                     }
                 }
             }
@@ -742,29 +1474,64 @@ namespace example
                 | BGFX_STATE_MSAA
                 | BGFX_STATE_BLEND_ALPHA;
 
-            // Render all our opaque meshes
-            renderMeshes(m_model.opaqueMeshes, cameraPos, stateOpaque, m_pbrShader, meshPass);
+            // The shader variant depends on how we're filtering our shadows
+            const bgfx::ProgramHandle pbrShader = m_pbrShaders[int(m_shadowFilter)];
+            const bgfx::ProgramHandle pbrShaderWithMasking = m_pbrShadersWithMasking[int(m_shadowFilter)];
+
+            // Render all our opaque meshes, letting the GPU skip the ones whose proxies are still hidden
+            renderMeshes(m_model.opaqueMeshes, cameraPos, stateOpaque, pbrShader, meshPass, getOcclusionQueries(), true);
 
             // Render all our masked meshes
-            renderMeshes(m_model.maskedMeshes, cameraPos, stateOpaque, m_pbrShaderWithMasking, meshPass);
+            renderMeshes(m_model.maskedMeshes, cameraPos, stateOpaque, pbrShaderWithMasking, meshPass);
+
+            for (int i = 0; i < m_numDynamicCasters; ++i) {
+                bindUniforms(m_directionalLight, m_shadowAtlasTexture);
+                bgfx::setTransform(glm::value_ptr(m_dynamicCasterTransforms[i]));
+                bgfx::setState(stateOpaque);
+                m_dynamicCasterMesh.setBuffers();
+                bgfx::submit(meshPass, m_dynamicCasterProgram);
+            }
 
             // Render all our transparent meshes
-            renderMeshes(m_model.transparentMeshes, cameraPos, stateTransparent, m_pbrShader, meshPass);
+            renderMeshes(m_model.transparentMeshes, cameraPos, stateTransparent, pbrShader, meshPass);
 
             viewCount = m_toneMapPass.render(m_pbrFbTextures[0], m_toneMapParams, deltaTime, viewCount);
 
             bgfx::ViewId debugShadowPass = viewCount++;
-            bgfx::setViewRect(debugShadowPass, 0, uint16_t(m_height) - 256u, 256, 256);
+            // Shows the whole atlas, keeping its aspect ratio
+            const uint16_t debugWidth = 512u;
+            const uint16_t debugHeight = uint16_t(debugWidth * m_shadowAtlas.getHeight() / m_shadowAtlas.getWidth());
+            bgfx::setViewRect(debugShadowPass, 0, uint16_t(m_height) - debugHeight, debugWidth, debugHeight);
 
             float debugProjection[16];
             bx::mtxOrtho(debugProjection, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, m_caps->homogeneousDepth);
             bgfx::setViewTransform(debugShadowPass, nullptr, debugProjection);
-            bgfx::setTexture(0, m_shadowMapDebugSampler, m_shadowMaps[0], BGFX_SAMPLER_UVW_CLAMP);
+            bgfx::setTexture(0, m_shadowMapDebugSampler, m_shadowAtlasTexture, BGFX_SAMPLER_UVW_CLAMP);
             bgfx::setState(BGFX_STATE_WRITE_RGB);
-            bae::setScreenSpaceQuad(m_shadowMapWidth, m_shadowMapWidth, m_caps->originBottomLeft);
+            bae::setScreenSpaceQuad(m_shadowAtlas.getWidth(), m_shadowAtlas.getHeight(), m_caps->originBottomLeft);
             bgfx::submit(debugShadowPass, m_drawDepthDebugProgram);
 
-            bgfx::frame();
+            // Read back our exposure as well, once the tonemapping passes have updated it
+            m_luminanceReadback.request(debugShadowPass, m_toneMapPass.avgLuminanceTarget);
+
+            // These are from a previous frame, but that's good enough for comparing our reductions
+            const bgfx::Stats* stats = bgfx::getStats();
+            for (uint16_t i = 0; i < stats->numViews; ++i) {
+                const bgfx::ViewStats& viewStats = stats->viewStats[i];
+                const float gpuMs = float(1000.0 * double(viewStats.gpuTimeElapsed) / double(stats->gpuTimerFreq));
+                // Smooth them out a bit so they're readable
+                constexpr float timingSmoothing = 0.05f;
+                if (viewStats.view == multiPassReduction) {
+                    m_depthReductionMs[int(DepthReductionMode::MULTI_PASS)] = bx::lerp(m_depthReductionMs[int(DepthReductionMode::MULTI_PASS)], gpuMs, timingSmoothing);
+                }
+                else if (viewStats.view == singlePassReduction) {
+                    m_depthReductionMs[int(DepthReductionMode::SINGLE_PASS)] = bx::lerp(m_depthReductionMs[int(DepthReductionMode::SINGLE_PASS)], gpuMs, timingSmoothing);
+                }
+            }
+
+            m_currentFrame = bgfx::frame();
+            bae::getTrackingAllocator()->endFrame();
+            bae::getFrameArena().endFrame();
 
             return true;
         }
@@ -782,30 +1549,102 @@ namespace example
         uint32_t m_oldHeight;
         uint32_t m_oldReset;
 
-        uint16_t m_shadowMapWidth = 2048u;
         float m_time;
 
         bgfx::ProgramHandle m_directionalShadowMapProgram;
         bgfx::ProgramHandle m_prepassProgram;
-        bgfx::ProgramHandle m_pbrShader;
-        bgfx::ProgramHandle m_pbrShaderWithMasking;
+        bgfx::ProgramHandle m_pbrShaders[size_t(ShadowFilter::COUNT)];
+        bgfx::ProgramHandle m_pbrShadersWithMasking[size_t(ShadowFilter::COUNT)];
         bgfx::ProgramHandle m_depthReductionInitial;
         bgfx::ProgramHandle m_depthReductionGeneral;
+        bgfx::ProgramHandle m_depthReductionSingle;
         bgfx::ProgramHandle m_drawDepthDebugProgram;
-
-        bgfx::TextureHandle m_shadowMaps[NUM_CASCADES]; // Is a texture array
-        bgfx::FrameBufferHandle m_shadowMapFramebuffers[NUM_CASCADES];
+        bgfx::ProgramHandle m_shadowCopyProgram;
+        bgfx::ProgramHandle m_directionalShadowMapInstancedProgram;
+        bgfx::ProgramHandle m_dynamicCasterProgram;
+
+        bae::ShadowAtlas m_shadowAtlas;
+        bae::ShadowAtlasRegion m_cascadeRegions[MAX_CASCADES];
+        bgfx::TextureHandle m_shadowAtlasTexture = BGFX_INVALID_HANDLE;
+        bgfx::FrameBufferHandle m_shadowAtlasFramebuffer = BGFX_INVALID_HANDLE;
+        int m_shadowAtlasSize = 1;
+        int m_oldShadowAtlasSize = 1;
+        CascadeSizing m_cascadeSizing = CascadeSizing::SCREEN_COVERAGE;
+        int m_fixedCascadeSize = 2;
+
+        ShadowQuality m_shadowQuality = ShadowQuality::HIGH;
+        int m_numCascades = 4;
+        bae::CascadeSplitScheme m_splitScheme = bae::CascadeSplitScheme::LOGARITHMIC;
+        float m_splitLambda = 0.75f;
+        ShadowFilter m_shadowFilter = ShadowFilter::POISSON_16;
+        // View space depth range of each cascade
+        glm::vec2 m_cascadeSplits[MAX_CASCADES];
+        bae::CascadeCoverage m_cascadeCoverage;
+
+        bool m_stabilizeCascades = true;
+        bool m_cacheStaticCasters = true;
+        bool m_oldCacheStaticCasters = true;
+        // Cascades from this one onwards only have to be redrawn every m_farCascadeInterval frames
+        int m_firstScheduledCascade = 2;
+        int m_farCascadeInterval = 4;
+        CascadeCache m_cascadeCaches[MAX_CASCADES];
+        CascadeStatus m_cascadeStatus[MAX_CASCADES] = {};
+        bgfx::TextureHandle m_staticShadowAtlasTexture = BGFX_INVALID_HANDLE;
+        bgfx::FrameBufferHandle m_staticShadowAtlasFramebuffer = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_copyRegion = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_staticShadowAtlas = BGFX_INVALID_HANDLE;
+        uint32_t m_shadowDrawCount = 0;
+        uint32_t m_shadowInstanceCount = 0;
+        uint32_t m_shadowCopyCount = 0;
+        uint32_t m_shadowInstancingFallbacks = 0;
+
+        bool m_instancingSupported = false;
+        bool m_singlePassShadows = false;
+        bgfx::UniformHandle u_cascadeViewProj = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_cascadeClipRegions = BGFX_INVALID_HANDLE;
+        glm::vec4 m_cascadeClipRegions[MAX_CASCADES];
+        // Which cascades each caster overlaps, one bit per cascade
+        std::vector<uint32_t> m_opaqueCascadeMasks;
+
+        static constexpr int MAX_DYNAMIC_CASTERS = 8;
+        int m_numDynamicCasters = 4;
+        bae::Mesh m_dynamicCasterMesh;
+        glm::mat4 m_dynamicCasterTransforms[MAX_DYNAMIC_CASTERS];
+        uint32_t m_dynamicCasterMasks[MAX_DYNAMIC_CASTERS] = {};
 
         bgfx::TextureHandle m_pbrFbTextures[2];
         bgfx::FrameBufferHandle m_pbrFramebuffer = BGFX_INVALID_HANDLE;
 
         std::vector<bgfx::TextureHandle> m_depthReductionTargets;
-        bgfx::TextureHandle m_cpuReadableDepth;
+        uint32_t m_depthReductionTargetsWidth = 0;
+        uint32_t m_depthReductionTargetsHeight = 0;
+        DepthReductionMode m_depthReductionMode = DepthReductionMode::SINGLE_PASS;
+        bool m_compareDepthReductions = false;
+        float m_depthReductionMs[2] = {};
+        bgfx::DynamicIndexBufferHandle m_depthReductionBuffer = BGFX_INVALID_HANDLE;
+        bgfx::TextureHandle m_depthReductionResult = BGFX_INVALID_HANDLE;
+
+        // Checking the single pass reduction against bae::reduceDepthMinMax, on a depth buffer we've made up
+        DepthReductionValidation m_depthValidation = DepthReductionValidation::NOT_RUN;
+        bool m_depthValidationRequested = false;
+        bgfx::DynamicIndexBufferHandle m_depthValidationBuffer = BGFX_INVALID_HANDLE;
+        bgfx::TextureHandle m_depthValidationResult = BGFX_INVALID_HANDLE;
+        bae::AsyncReadback m_depthValidationReadback;
+        glm::vec2 m_depthValidationCpu = glm::vec2{ 1.0f, 0.0f };
+        glm::vec2 m_depthValidationGpu = glm::vec2{ 1.0f, 0.0f };
+        float m_depthValidationCpuMs = 0.0f;
+        bae::AsyncReadback m_depthReadback;
+        bae::AsyncReadback m_luminanceReadback;
+
+        bae::OcclusionQueries m_occlusionQueries;
+        bae::OcclusionMode m_occlusionMode = bae::OcclusionMode::DISABLED;
+        bool m_occlusionQueriesSupported = false;
 
         PBRShaderUniforms m_pbrUniforms = {};
         SceneUniforms m_sceneUniforms = {};
         DepthReductionUniforms m_depthReductionUniforms = {};
         bgfx::UniformHandle m_shadowMapDebugSampler;
+        bae::GeometryPool m_geometryPool;
         bae::Model m_model;
 
         DirectionalLight m_directionalLight = {};
@@ -818,6 +1657,8 @@ namespace example
         bool m_computeSupported = true;
         bool m_updateLights = true;
         uint16_t m_depthData[2] = { 0, bx::kHalfFloatOne };
+        float m_avgLuminance = 0.0f;
+        uint32_t m_currentFrame = 0;
     };
 
 } // namespace example
@@ -0,0 +1,23 @@
+$input a_position, i_data0
+$output v_cascadeClip
+
+#include "../common/common.sh"
+
+#define MAX_CASCADES 8
+
+// Every instance is drawn into a different cascade, with i_data0.x as the cascade index. The view covers the
+// whole shadow atlas, so we squeeze each cascade's clip space into its own region.
+uniform mat4 u_cascadeViewProj[MAX_CASCADES];
+uniform vec4 u_cascadeClipRegions[MAX_CASCADES];
+
+void main()
+{
+    int cascadeIdx = int(i_data0.x);
+    vec4 worldPos = mul(u_model[0], vec4(a_position, 1.0));
+    vec4 clip = mul(u_cascadeViewProj[cascadeIdx], worldPos);
+
+    // Orthographic projection, so there's no need to divide by w
+    v_cascadeClip = clip.xy;
+    vec4 region = u_cascadeClipRegions[cascadeIdx];
+    gl_Position = vec4(clip.xy * region.xy + region.zw, clip.z, clip.w);
+}
@@ -0,0 +1,13 @@
+$input a_position
+$output v_position, v_normal
+
+#include "../common/common.sh"
+
+void main()
+{
+    v_position = mul(u_model[0], vec4(a_position, 1.0)).xyz;
+    // Our dynamic casters are unit spheres, so their positions double as normals
+    v_normal = normalize(mul(u_model[0], vec4(a_position, 0.0)).xyz);
+
+    gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
+}
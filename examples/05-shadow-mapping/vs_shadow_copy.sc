@@ -0,0 +1,12 @@
+$input a_position, a_texcoord0
+$output v_texcoord
+
+#include "../common/common.sh"
+
+void main()
+{
+    // Screen space quad coordinates are in [0, 1] with y pointing down, we want to cover whatever view rect
+    // we're drawn into regardless of the view's transform
+    gl_Position = vec4(a_position.x * 2.0 - 1.0, 1.0 - a_position.y * 2.0, 0.0, 1.0);
+    v_texcoord = a_texcoord0;
+}
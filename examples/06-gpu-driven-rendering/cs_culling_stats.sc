@@ -0,0 +1,15 @@
+#include "bgfx_compute.sh"
+
+// Moves the culling counters into a texture we can read back, and clears them for the next frame
+BUFFER_RW(b_cullingStats, uint, 0);
+IMAGE2D_WR(s_statsOutput, rgba32f, 1);
+
+NUM_THREADS(1, 1, 1)
+void main()
+{
+    vec4 stats = vec4(float(b_cullingStats[0]), float(b_cullingStats[1]), float(b_cullingStats[2]), 0.0);
+    b_cullingStats[0] = 0u;
+    b_cullingStats[1] = 0u;
+    b_cullingStats[2] = 0u;
+    imageStore(s_statsOutput, ivec2(0, 0), stats);
+}
@@ -0,0 +1,122 @@
+#include "bgfx_compute.sh"
+
+// One thread per draw record, writing that draw's indirect arguments. Culled draws keep their slot but get no
+// instances, so every material's draws stay one contiguous range of the indirect buffer.
+// Has to match bae::cullDrawRecords.
+
+// Matches bae::GpuDrawRecord: world space bounds min and max, then the draw's index count, first index,
+// base vertex and instance index stored as the bits of the last vec4
+#define RECORD_STRIDE 3u
+
+BUFFER_RO(b_drawRecords, vec4, 0);
+BUFFER_WR(b_indirectArgs, uvec4, 1);
+// Visible, frustum culled and occlusion culled counts, cleared by cs_culling_stats
+BUFFER_RW(b_cullingStats, uint, 2);
+// Max depth mip chain of the previous frame
+SAMPLER2D(s_hiZ, 3);
+
+// Left, right, bottom, top, near, far, pointing into the frustum
+uniform vec4 u_frustumPlanes[6];
+// The view projection the Hi-Z texture was rendered with
+uniform mat4 u_prevViewProj;
+uniform vec4 u_cullingParams[2];
+#define u_drawCount u_cullingParams[0].x
+#define u_occlusionEnabled u_cullingParams[0].y
+#define u_hiZLevelCount u_cullingParams[0].z
+#define u_hiZSize u_cullingParams[1].xy
+
+bool isOutsideFrustum(vec3 boxMin, vec3 boxMax)
+{
+    for (int i = 0; i < 6; ++i) {
+        vec4 plane = u_frustumPlanes[i];
+        // Corner furthest along the plane's normal, if that's behind the plane the whole box is
+        vec3 corner = mix(boxMin, boxMax, step(vec3_splat(0.0), plane.xyz));
+        if (dot(plane.xyz, corner) + plane.w < 0.0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isOccluded(vec3 boxMin, vec3 boxMax)
+{
+    vec2 uvMin = vec2_splat(1.0);
+    vec2 uvMax = vec2_splat(0.0);
+    float minDepth = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3(
+            (i & 1) != 0 ? boxMax.x : boxMin.x,
+            (i & 2) != 0 ? boxMax.y : boxMin.y,
+            (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = mul(u_prevViewProj, vec4(corner, 1.0));
+        // Boxes crossing the near plane are always visible
+        if (clip.w <= 0.0) {
+            return false;
+        }
+
+        vec3 ndc = clip.xyz / clip.w;
+#if BGFX_SHADER_LANGUAGE_GLSL
+        // GL's first row is the bottom of the screen, and its depth buffer holds 0.5 * ndc + 0.5
+        vec2 uv = 0.5 * ndc.xy + 0.5;
+        float depth = 0.5 * ndc.z + 0.5;
+#else
+        vec2 uv = vec2(0.5 * ndc.x + 0.5, 0.5 - 0.5 * ndc.y);
+        float depth = ndc.z;
+#endif
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        minDepth = min(minDepth, depth);
+    }
+
+    ivec2 size = ivec2(u_hiZSize);
+    ivec2 texelMin = clamp(ivec2(floor(saturate(uvMin) * u_hiZSize)), ivec2(0, 0), size - 1);
+    ivec2 texelMax = clamp(ivec2(floor(saturate(uvMax) * u_hiZSize)), ivec2(0, 0), size - 1);
+
+    // Smallest level where the box's footprint spans at most two texels in each direction
+    int extent = max(texelMax.x - texelMin.x, texelMax.y - texelMin.y);
+    int level = 0;
+    while ((1 << level) < extent) {
+        ++level;
+    }
+    level = min(level, int(u_hiZLevelCount) - 1);
+
+    // Texels past the end of a level are covered by its last row or column
+    ivec2 levelSize = max(size >> level, ivec2(1, 1));
+    ivec2 begin = min(texelMin >> level, levelSize - 1);
+    ivec2 end = min(texelMax >> level, levelSize - 1);
+
+    float maxDepth = 0.0;
+    for (int y = begin.y; y <= end.y; ++y) {
+        for (int x = begin.x; x <= end.x; ++x) {
+            maxDepth = max(maxDepth, texelFetch(s_hiZ, ivec2(x, y), level).x);
+        }
+    }
+    return minDepth > maxDepth;
+}
+
+NUM_THREADS(64, 1, 1)
+void main()
+{
+    uint drawIdx = gl_GlobalInvocationID.x;
+    if (drawIdx >= uint(u_drawCount)) {
+        return;
+    }
+
+    vec3 boxMin = b_drawRecords[RECORD_STRIDE * drawIdx].xyz;
+    vec3 boxMax = b_drawRecords[RECORD_STRIDE * drawIdx + 1u].xyz;
+    uvec4 draw = floatBitsToUint(b_drawRecords[RECORD_STRIDE * drawIdx + 2u]);
+
+    uint instanceCount = 0u;
+    if (isOutsideFrustum(boxMin, boxMax)) {
+        atomicAdd(b_cullingStats[1], 1u);
+    }
+    else if (u_occlusionEnabled != 0.0 && isOccluded(boxMin, boxMax)) {
+        atomicAdd(b_cullingStats[2], 1u);
+    }
+    else {
+        instanceCount = 1u;
+        atomicAdd(b_cullingStats[0], 1u);
+    }
+
+    drawIndexedIndirect(b_indirectArgs, drawIdx, draw.x, instanceCount, draw.y, draw.z, draw.w);
+}
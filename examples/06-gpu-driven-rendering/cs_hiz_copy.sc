@@ -0,0 +1,22 @@
+#include "bgfx_compute.sh"
+
+// Copies the depth buffer into the first mip of our Hi-Z texture, which we can then downsample with image loads
+SAMPLER2D(s_depth, 0);
+IMAGE2D_WR(s_hiZOutput, r32f, 1);
+
+// xy is the size of the depth buffer
+uniform vec4 u_hiZParams;
+
+NUM_THREADS(8, 8, 1)
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(u_hiZParams.xy);
+    if (coord.x >= size.x || coord.y >= size.y) {
+        return;
+    }
+
+    // NOTE: This doesn't support multisampled depth maps.
+    float depth = texelFetch(s_depth, coord, 0).x;
+    imageStore(s_hiZOutput, coord, vec4(depth, 0.0, 0.0, 0.0));
+}
@@ -0,0 +1,36 @@
+#include "bgfx_compute.sh"
+
+// Builds one mip of the Hi-Z texture from the one above it, keeping the furthest depth. Has to match
+// bae::HiZPyramid::build.
+IMAGE2D_RO(s_hiZInput, r32f, 0);
+IMAGE2D_WR(s_hiZOutput, r32f, 1);
+
+// xy is the size of the input mip, zw the size of the output mip
+uniform vec4 u_hiZParams;
+
+NUM_THREADS(8, 8, 1)
+void main()
+{
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 inputSize = ivec2(u_hiZParams.xy);
+    ivec2 outputSize = ivec2(u_hiZParams.zw);
+    if (coord.x >= outputSize.x || coord.y >= outputSize.y) {
+        return;
+    }
+
+    // Mips round their size down, so when the input is odd the last texel also covers the leftover row or column
+    float maxDepth = 0.0;
+    for (int y = 0; y < 3; ++y) {
+        int inputY = 2 * coord.y + y;
+        if ((y < 2 || coord.y == outputSize.y - 1) && inputY < inputSize.y) {
+            for (int x = 0; x < 3; ++x) {
+                int inputX = 2 * coord.x + x;
+                if ((x < 2 || coord.x == outputSize.x - 1) && inputX < inputSize.x) {
+                    maxDepth = max(maxDepth, imageLoad(s_hiZInput, ivec2(inputX, inputY)).x);
+                }
+            }
+        }
+    }
+
+    imageStore(s_hiZOutput, coord, vec4(maxDepth, 0.0, 0.0, 0.0));
+}
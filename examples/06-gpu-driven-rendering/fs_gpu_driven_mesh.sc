@@ -0,0 +1,19 @@
+$input v_texcoord, v_normal
+
+#include "../common/common.sh"
+
+SAMPLER2D(s_baseColor, 0);
+uniform vec4 u_baseColorFactor;
+// xyz is the direction towards the light, w its intensity
+uniform vec4 u_lightDirection;
+uniform vec4 u_ambientColor;
+
+void main()
+{
+    vec4 baseColor = toLinear(texture2D(s_baseColor, v_texcoord)) * u_baseColorFactor;
+    vec3 normal = normalize(v_normal);
+    float NoL = clamp(dot(normal, u_lightDirection.xyz), 0.0, 1.0);
+
+    vec3 color = baseColor.xyz * (u_lightDirection.w * NoL + u_ambientColor.xyz);
+    gl_FragColor = vec4(color, 1.0);
+}
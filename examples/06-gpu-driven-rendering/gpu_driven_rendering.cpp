@@ -0,0 +1,813 @@
+#include <algorithm>
+#include <vector>
+#include "bgfx_utils.h"
+#include "common.h"
+#include "imgui/imgui.h"
+
+#include <glm/glm.hpp>
+#include <glm/matrix.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "bae/PhysicallyBasedScene.h"
+#include "bae/Tonemapping.h"
+#include "bae/AsyncReadback.h"
+#include "bae/GpuCulling.h"
+#include "bae/gltf_model_loading.h"
+#include "bae/TextureCache.h"
+#include "bae/TrackingAllocator.h"
+#include "bae/FrameArena.h"
+
+namespace example
+{
+#define SAMPLER_POINT_CLAMP (BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP)
+
+    constexpr float NEAR_PLANE = 0.2f;
+    constexpr float FAR_PLANE = 1000.f;
+    constexpr uint16_t CULLING_THREAD_COUNT = 64u;
+    constexpr uint16_t HIZ_THREAD_COUNT_PER_DIM = 8u;
+    // The scene is copied onto a grid this many copies wide, to get a lot more draws out of Sponza
+    constexpr int MAX_GRID_SIZE = 8;
+
+    enum struct SubmitMode
+    {
+        // Frustum culled on the CPU with bae::cullDrawRecords, and every visible draw is its own submit
+        CPU_PER_DRAW,
+        // Culled by a compute shader, and each material's draws are a single indirect submit
+        GPU_DRIVEN,
+    };
+
+    static const char* SUBMIT_MODE_NAMES[] = {
+        "CPU (submit per draw)",
+        "GPU Driven (submit per material)",
+    };
+
+    // Layout of the shared vertex buffer, which only has the attributes our shaders use
+    struct SharedVertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 texcoord;
+    };
+
+    // Every opaque mesh of a model packed into one vertex buffer and one index buffer, plus a draw record for each
+    // mesh of every copy of the scene. Draws are sorted so that meshes sharing a material sit next to each other,
+    // which makes each material's draws one contiguous range of the indirect buffer.
+    struct GpuScene
+    {
+        struct MeshRange
+        {
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            uint32_t baseVertex = 0;
+            uint32_t vertexCount = 0;
+        };
+
+        // A run of meshOrder whose meshes all use the same material
+        struct MaterialGroup
+        {
+            uint32_t materialIdx = 0;
+            uint32_t firstMesh = 0;
+            uint32_t meshCount = 0;
+        };
+
+        std::vector<MeshRange> meshRanges;
+        std::vector<uint32_t> meshOrder;
+        std::vector<MaterialGroup> materialGroups;
+
+        // Per draw, with the draws of a mesh's copies next to each other
+        std::vector<bae::GpuDrawRecord> records;
+        std::vector<uint32_t> drawMeshes;
+        uint32_t copyCount = 0;
+
+        bgfx::VertexDecl vertexDecl;
+        bgfx::VertexDecl recordDecl;
+        bgfx::VertexDecl instanceDecl;
+
+        bgfx::VertexBufferHandle vertices = BGFX_INVALID_HANDLE;
+        bgfx::IndexBufferHandle indices = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle drawRecords = BGFX_INVALID_HANDLE;
+        bgfx::VertexBufferHandle instances = BGFX_INVALID_HANDLE;
+        bgfx::IndirectBufferHandle indirectArgs = BGFX_INVALID_HANDLE;
+
+        uint32_t getDrawCount() const { return uint32_t(records.size()); }
+    };
+
+    // The only parts of the material our shader uses
+    static bool isSameMaterial(const bae::PBRMaterial& a, const bae::PBRMaterial& b)
+    {
+        return a.baseColorTexture.idx == b.baseColorTexture.idx && a.baseColorFactor == b.baseColorFactor;
+    }
+
+    static bool isMaterialLess(const bae::PBRMaterial& a, const bae::PBRMaterial& b)
+    {
+        if (a.baseColorTexture.idx != b.baseColorTexture.idx) {
+            return a.baseColorTexture.idx < b.baseColorTexture.idx;
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (a.baseColorFactor[i] != b.baseColorFactor[i]) {
+                return a.baseColorFactor[i] < b.baseColorFactor[i];
+            }
+        }
+        return false;
+    }
+
+    void init(GpuScene& scene, const bae::MeshGroup& meshGroup)
+    {
+        if (meshGroup.meshData.size() != meshGroup.meshes.size()) {
+            throw std::runtime_error("GPU driven rendering needs the model's mesh data, load it with keepMeshData.");
+        }
+
+        scene.vertexDecl.begin()
+            .add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+            .end();
+        // Records are read as an array of vec4s by the culling shader
+        scene.recordDecl.begin()
+            .add(bgfx::Attrib::TexCoord0, 4, bgfx::AttribType::Float)
+            .end();
+        // A mat4 per draw, read as i_data0 to i_data3
+        scene.instanceDecl.begin()
+            .add(bgfx::Attrib::TexCoord7, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord6, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord5, 4, bgfx::AttribType::Float)
+            .add(bgfx::Attrib::TexCoord4, 4, bgfx::AttribType::Float)
+            .end();
+
+        std::vector<SharedVertex> vertices;
+        std::vector<uint16_t> indices;
+        scene.meshRanges.resize(meshGroup.meshes.size());
+        for (size_t i = 0; i < meshGroup.meshData.size(); ++i) {
+            const bae::MeshData& data = meshGroup.meshData[i];
+            GpuScene::MeshRange& range = scene.meshRanges[i];
+            range.firstIndex = uint32_t(indices.size());
+            range.indexCount = uint32_t(data.indices.size());
+            range.baseVertex = uint32_t(vertices.size());
+            range.vertexCount = uint32_t(data.positions.size());
+
+            // Indices stay 16 bit, since each draw offsets them by its base vertex
+            for (size_t v = 0; v < data.positions.size(); ++v) {
+                vertices.push_back({ data.positions[v], data.normals[v], data.texcoords[v] });
+            }
+            indices.insert(indices.end(), data.indices.begin(), data.indices.end());
+        }
+        scene.vertices = bgfx::createVertexBuffer(
+            bgfx::copy(vertices.data(), uint32_t(vertices.size() * sizeof(SharedVertex))), scene.vertexDecl);
+        scene.indices = bgfx::createIndexBuffer(bgfx::copy(indices.data(), uint32_t(indices.size() * sizeof(uint16_t))));
+        bgfx::setName(scene.vertices, "Shared Vertex Buffer");
+
+        scene.meshOrder.resize(meshGroup.meshes.size());
+        for (uint32_t i = 0; i < uint32_t(scene.meshOrder.size()); ++i) {
+            scene.meshOrder[i] = i;
+        }
+        std::stable_sort(scene.meshOrder.begin(), scene.meshOrder.end(), [&meshGroup](const uint32_t a, const uint32_t b) {
+            return isMaterialLess(meshGroup.materials[a], meshGroup.materials[b]);
+        });
+
+        scene.materialGroups.clear();
+        for (uint32_t i = 0; i < uint32_t(scene.meshOrder.size()); ++i) {
+            const uint32_t meshIdx = scene.meshOrder[i];
+            if (scene.materialGroups.empty() || !isSameMaterial(meshGroup.materials[scene.materialGroups.back().materialIdx], meshGroup.materials[meshIdx])) {
+                scene.materialGroups.push_back({ meshIdx, i, 0 });
+            }
+            ++scene.materialGroups.back().meshCount;
+        }
+    }
+
+    void destroyDraws(GpuScene& scene)
+    {
+        if (bgfx::isValid(scene.drawRecords)) {
+            bgfx::destroy(scene.drawRecords);
+            bgfx::destroy(scene.instances);
+            bgfx::destroy(scene.indirectArgs);
+        }
+        scene.drawRecords = BGFX_INVALID_HANDLE;
+        scene.instances = BGFX_INVALID_HANDLE;
+        scene.indirectArgs = BGFX_INVALID_HANDLE;
+        scene.records.clear();
+        scene.drawMeshes.clear();
+        scene.copyCount = 0;
+    }
+
+    // (Re)creates the draws for a gridSize x gridSize grid of copies of the scene, spaced apart by spacing in x and z
+    void initDraws(GpuScene& scene, const bae::MeshGroup& meshGroup, const uint32_t gridSize, const glm::vec2& spacing)
+    {
+        destroyDraws(scene);
+
+        scene.copyCount = gridSize * gridSize;
+        const size_t drawCount = scene.meshOrder.size() * scene.copyCount;
+        scene.records.resize(drawCount);
+        scene.drawMeshes.resize(drawCount);
+        std::vector<glm::mat4> instances(drawCount);
+
+        for (uint32_t i = 0; i < uint32_t(scene.meshOrder.size()); ++i) {
+            const uint32_t meshIdx = scene.meshOrder[i];
+            const GpuScene::MeshRange& range = scene.meshRanges[meshIdx];
+            // Loaded bounds can have min and max swapped by the mesh's transform
+            const bae::AABB& bounds = meshGroup.boundingBoxes[meshIdx];
+            const glm::vec3 boundsMin = glm::min(bounds.min, bounds.max);
+            const glm::vec3 boundsMax = glm::max(bounds.min, bounds.max);
+
+            for (uint32_t copyIdx = 0; copyIdx < scene.copyCount; ++copyIdx) {
+                const uint32_t drawIdx = i * scene.copyCount + copyIdx;
+                const glm::vec3 offset{ spacing.x * float(copyIdx % gridSize), 0.0f, spacing.y * float(copyIdx / gridSize) };
+
+                bae::GpuDrawRecord& record = scene.records[drawIdx];
+                record.boundsMin = glm::vec4{ boundsMin + offset, 0.0f };
+                record.boundsMax = glm::vec4{ boundsMax + offset, 0.0f };
+                record.indexCount = range.indexCount;
+                record.firstIndex = range.firstIndex;
+                record.baseVertex = range.baseVertex;
+                record.instanceIdx = drawIdx;
+
+                instances[drawIdx] = glm::translate(glm::mat4{ 1.0f }, offset) * meshGroup.transforms[meshIdx];
+                scene.drawMeshes[drawIdx] = meshIdx;
+            }
+        }
+
+        scene.drawRecords = bgfx::createVertexBuffer(
+            bgfx::copy(scene.records.data(), uint32_t(drawCount * sizeof(bae::GpuDrawRecord))), scene.recordDecl, BGFX_BUFFER_COMPUTE_READ);
+        scene.instances = bgfx::createVertexBuffer(
+            bgfx::copy(instances.data(), uint32_t(drawCount * sizeof(glm::mat4))), scene.instanceDecl);
+        scene.indirectArgs = bgfx::createIndirectBuffer(uint32_t(drawCount));
+    }
+
+    void destroy(GpuScene& scene)
+    {
+        destroyDraws(scene);
+        if (bgfx::isValid(scene.vertices)) {
+            bgfx::destroy(scene.vertices);
+            bgfx::destroy(scene.indices);
+        }
+        scene.vertices = BGFX_INVALID_HANDLE;
+        scene.indices = BGFX_INVALID_HANDLE;
+    }
+
+    struct SceneUniforms
+    {
+        glm::vec4 lightDirection = glm::vec4{ glm::normalize(glm::vec3{ 0.3f, 1.0f, 0.2f }), 8.0f };
+        glm::vec4 ambientColor = glm::vec4{ 0.15f, 0.15f, 0.18f, 0.0f };
+
+        bgfx::UniformHandle s_baseColor = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_baseColorFactor = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_lightDirection = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_ambientColor = BGFX_INVALID_HANDLE;
+    };
+
+    void init(SceneUniforms& uniforms)
+    {
+        uniforms.s_baseColor = bgfx::createUniform("s_baseColor", bgfx::UniformType::Sampler);
+        uniforms.u_baseColorFactor = bgfx::createUniform("u_baseColorFactor", bgfx::UniformType::Vec4);
+        uniforms.u_lightDirection = bgfx::createUniform("u_lightDirection", bgfx::UniformType::Vec4);
+        uniforms.u_ambientColor = bgfx::createUniform("u_ambientColor", bgfx::UniformType::Vec4);
+    }
+
+    void destroy(SceneUniforms& uniforms)
+    {
+        bgfx::destroy(uniforms.s_baseColor);
+        bgfx::destroy(uniforms.u_baseColorFactor);
+        bgfx::destroy(uniforms.u_lightDirection);
+        bgfx::destroy(uniforms.u_ambientColor);
+    }
+
+    void bindUniforms(const SceneUniforms& uniforms, const bae::PBRMaterial& material)
+    {
+        bgfx::setTexture(0, uniforms.s_baseColor, material.baseColorTexture);
+        bgfx::setUniform(uniforms.u_baseColorFactor, glm::value_ptr(material.baseColorFactor));
+        bgfx::setUniform(uniforms.u_lightDirection, glm::value_ptr(uniforms.lightDirection));
+        bgfx::setUniform(uniforms.u_ambientColor, glm::value_ptr(uniforms.ambientColor));
+    }
+
+    struct CullingUniforms
+    {
+        bgfx::UniformHandle u_frustumPlanes = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_prevViewProj = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_cullingParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle u_hiZParams = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_hiZ = BGFX_INVALID_HANDLE;
+        bgfx::UniformHandle s_depth = BGFX_INVALID_HANDLE;
+    };
+
+    void init(CullingUniforms& uniforms)
+    {
+        uniforms.u_frustumPlanes = bgfx::createUniform("u_frustumPlanes", bgfx::UniformType::Vec4, 6);
+        uniforms.u_prevViewProj = bgfx::createUniform("u_prevViewProj", bgfx::UniformType::Mat4);
+        uniforms.u_cullingParams = bgfx::createUniform("u_cullingParams", bgfx::UniformType::Vec4, 2);
+        uniforms.u_hiZParams = bgfx::createUniform("u_hiZParams", bgfx::UniformType::Vec4);
+        uniforms.s_hiZ = bgfx::createUniform("s_hiZ", bgfx::UniformType::Sampler);
+        uniforms.s_depth = bgfx::createUniform("s_depth", bgfx::UniformType::Sampler);
+    }
+
+    void destroy(CullingUniforms& uniforms)
+    {
+        bgfx::destroy(uniforms.u_frustumPlanes);
+        bgfx::destroy(uniforms.u_prevViewProj);
+        bgfx::destroy(uniforms.u_cullingParams);
+        bgfx::destroy(uniforms.u_hiZParams);
+        bgfx::destroy(uniforms.s_hiZ);
+        bgfx::destroy(uniforms.s_depth);
+    }
+
+    static uint16_t getDispatchSize(const uint32_t dim, const uint16_t threadCount)
+    {
+        return uint16_t((dim + threadCount - 1) / threadCount);
+    }
+
+    class ExampleGpuDrivenRendering : public entry::AppI
+    {
+    public:
+        ExampleGpuDrivenRendering(const char* _name, const char* _description) : entry::AppI(_name, _description) {}
+
+        void init(int32_t _argc, const char* const* _argv, uint32_t _width, uint32_t _height) override
+        {
+            Args args(_argc, _argv);
+
+            m_width = _width;
+            m_height = _height;
+            m_debug = BGFX_DEBUG_TEXT;
+            m_reset = BGFX_RESET_VSYNC | BGFX_RESET_MAXANISOTROPY;
+
+            bgfx::Init initInfo;
+            initInfo.type = args.m_type;
+            initInfo.vendorId = args.m_pciId;
+            initInfo.resolution.width = m_width;
+            initInfo.resolution.height = m_height;
+            initInfo.resolution.reset = m_reset;
+            initInfo.allocator = bae::getTrackingAllocator();
+            bgfx::init(initInfo);
+
+            // Enable m_debug text.
+            bgfx::setDebug(m_debug);
+
+            m_caps = bgfx::getCaps();
+            m_computeSupported = !!(m_caps->supported & BGFX_CAPS_COMPUTE);
+
+            if (!m_computeSupported)
+            {
+                return;
+            }
+
+            // Without indirect draws we can still cull on the GPU, but we've no way to use the results
+            m_drawIndirectSupported = !!(m_caps->supported & BGFX_CAPS_DRAW_INDIRECT);
+            m_submitMode = m_drawIndirectSupported ? SubmitMode::GPU_DRIVEN : SubmitMode::CPU_PER_DRAW;
+
+            m_meshProgram = loadProgram("vs_gpu_driven_mesh", "fs_gpu_driven_mesh");
+            m_cullingProgram = loadProgram("cs_gpu_culling", nullptr);
+            m_cullingStatsProgram = loadProgram("cs_culling_stats", nullptr);
+            m_hiZCopyProgram = loadProgram("cs_hiz_copy", nullptr);
+            m_hiZDownsampleProgram = loadProgram("cs_hiz_downsample", nullptr);
+
+            // We need the vertex data to pack every mesh into one buffer
+            m_model = bae::loadGltfModel("meshes/Sponza/", "Sponza.gltf", true);
+            example::init(m_gpuScene, m_model.opaqueMeshes);
+
+            example::init(m_sceneUniforms);
+            example::init(m_cullingUniforms);
+
+            const uint32_t initialStats[3] = { 0u, 0u, 0u };
+            m_cullingStatsBuffer = bgfx::createDynamicIndexBuffer(
+                bgfx::copy(initialStats, sizeof(initialStats)), BGFX_BUFFER_COMPUTE_READ_WRITE | BGFX_BUFFER_INDEX32);
+            m_cullingStatsResult = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RGBA32F, BGFX_TEXTURE_COMPUTE_WRITE);
+            m_cullingStatsReadback.init(1, 1, bgfx::TextureFormat::RGBA32F, 3, "Culling Stats Readback");
+
+            m_toneMapParams.width = m_width;
+            m_toneMapParams.height = m_height;
+            m_toneMapParams.originBottomLeft = m_caps->originBottomLeft;
+            m_toneMapParams.minLogLuminance = -5.0f;
+            m_toneMapParams.maxLogLuminance = 10.0f;
+            m_toneMapPass.init(m_caps);
+
+            // Imgui.
+            imguiCreate();
+
+            // Init camera
+            cameraCreate();
+            cameraSetPosition({ 0.0f, 2.0f, 0.0f });
+            m_oldWidth = 0;
+            m_oldHeight = 0;
+            m_oldReset = m_reset;
+        }
+
+        virtual int shutdown() override
+        {
+            if (!m_computeSupported)
+            {
+                return 0;
+            }
+
+            if (bgfx::isValid(m_pbrFramebuffer))
+            {
+                bgfx::destroy(m_pbrFramebuffer);
+            }
+
+            if (bgfx::isValid(m_hiZTexture))
+            {
+                bgfx::destroy(m_hiZTexture);
+            }
+
+            bgfx::destroy(m_cullingStatsBuffer);
+            bgfx::destroy(m_cullingStatsResult);
+            m_cullingStatsReadback.destroy();
+
+            m_toneMapPass.destroy();
+            // Cleanup.
+            destroy(m_gpuScene);
+            destroy(m_sceneUniforms);
+            destroy(m_cullingUniforms);
+            bgfx::destroy(m_meshProgram);
+            bgfx::destroy(m_cullingProgram);
+            bgfx::destroy(m_cullingStatsProgram);
+            bgfx::destroy(m_hiZCopyProgram);
+            bgfx::destroy(m_hiZDownsampleProgram);
+
+            bae::destroy(m_model);
+            bae::getTextureCache().destroy();
+
+            cameraDestroy();
+            imguiDestroy();
+
+            // Shutdown bgfx.
+            bgfx::shutdown();
+
+            return 0;
+        }
+
+        // Everything is frustum culled with the CPU reference of our culling shader, then each visible draw gets
+        // its own submit, with its own material bindings, like a typical forward renderer would do it
+        void submitPerDraw(const bgfx::ViewId viewId, const uint64_t state, const glm::vec4 frustumPlanes[6])
+        {
+            const uint32_t drawCount = m_gpuScene.getDrawCount();
+            m_cpuArgs.resize(drawCount);
+            bae::cullDrawRecords(
+                m_gpuScene.records.data(), drawCount, frustumPlanes, nullptr, glm::mat4{ 1.0f }, m_caps->homogeneousDepth, m_cpuArgs.data(), &m_cpuCullingStats);
+
+            for (uint32_t drawIdx = 0; drawIdx < drawCount; ++drawIdx) {
+                const bae::IndirectDrawArgs& args = m_cpuArgs[drawIdx];
+                if (args.instanceCount == 0) {
+                    continue;
+                }
+
+                const uint32_t meshIdx = m_gpuScene.drawMeshes[drawIdx];
+                bindUniforms(m_sceneUniforms, m_model.opaqueMeshes.materials[meshIdx]);
+                bgfx::setVertexBuffer(0, m_gpuScene.vertices, args.baseVertex, m_gpuScene.meshRanges[meshIdx].vertexCount);
+                bgfx::setIndexBuffer(m_gpuScene.indices, args.firstIndex, args.indexCount);
+                bgfx::setInstanceDataBuffer(m_gpuScene.instances, args.firstInstance, 1);
+                bgfx::setState(state);
+                bgfx::submit(viewId, m_meshProgram);
+                ++m_submitCount;
+            }
+        }
+
+        void dispatchCulling(const bgfx::ViewId viewId, const glm::vec4 frustumPlanes[6])
+        {
+            const bool useHiZ = m_occlusionCulling && m_hiZValid;
+            const float cullingParams[8] = {
+                float(m_gpuScene.getDrawCount()), useHiZ ? 1.0f : 0.0f, float(m_hiZLevelCount), 0.0f,
+                float(m_hiZWidth), float(m_hiZHeight), 0.0f, 0.0f,
+            };
+            bgfx::setUniform(m_cullingUniforms.u_frustumPlanes, glm::value_ptr(frustumPlanes[0]), 6);
+            bgfx::setUniform(m_cullingUniforms.u_prevViewProj, glm::value_ptr(m_hiZViewProj));
+            bgfx::setUniform(m_cullingUniforms.u_cullingParams, cullingParams, 2);
+            bgfx::setBuffer(0, m_gpuScene.drawRecords, bgfx::Access::Read);
+            bgfx::setBuffer(1, m_gpuScene.indirectArgs, bgfx::Access::Write);
+            bgfx::setBuffer(2, m_cullingStatsBuffer, bgfx::Access::ReadWrite);
+            bgfx::setTexture(3, m_cullingUniforms.s_hiZ, m_hiZTexture, SAMPLER_POINT_CLAMP);
+            bgfx::dispatch(viewId, m_cullingProgram, getDispatchSize(m_gpuScene.getDrawCount(), CULLING_THREAD_COUNT), 1, 1);
+
+            // Dispatches within a view run in order, so this sees all of the culling shader's counts
+            bgfx::setBuffer(0, m_cullingStatsBuffer, bgfx::Access::ReadWrite);
+            bgfx::setImage(1, m_cullingStatsResult, 0, bgfx::Access::Write, bgfx::TextureFormat::RGBA32F);
+            bgfx::dispatch(viewId, m_cullingStatsProgram, 1, 1, 1);
+        }
+
+        // One indirect submit per material, covering all of its draws. The CPU cost no longer depends on how many
+        // meshes there are, only on how many materials.
+        void submitIndirect(const bgfx::ViewId viewId, const uint64_t state)
+        {
+            for (const GpuScene::MaterialGroup& group : m_gpuScene.materialGroups) {
+                bindUniforms(m_sceneUniforms, m_model.opaqueMeshes.materials[group.materialIdx]);
+                bgfx::setVertexBuffer(0, m_gpuScene.vertices);
+                bgfx::setIndexBuffer(m_gpuScene.indices);
+                bgfx::setInstanceDataBuffer(m_gpuScene.instances, 0, m_gpuScene.getDrawCount());
+                bgfx::setState(state);
+                bgfx::submit(
+                    viewId, m_meshProgram, m_gpuScene.indirectArgs, uint16_t(group.firstMesh * m_gpuScene.copyCount), uint16_t(group.meshCount * m_gpuScene.copyCount));
+                ++m_submitCount;
+            }
+        }
+
+        // Max depth mip chain of this frame's depth buffer, which the next frame's culling tests against
+        void buildHiZ(const bgfx::ViewId viewId)
+        {
+            const float copyParams[4] = { float(m_hiZWidth), float(m_hiZHeight), 0.0f, 0.0f };
+            bgfx::setUniform(m_cullingUniforms.u_hiZParams, copyParams);
+            bgfx::setTexture(0, m_cullingUniforms.s_depth, m_pbrFbTextures[1], SAMPLER_POINT_CLAMP);
+            bgfx::setImage(1, m_hiZTexture, 0, bgfx::Access::Write, bgfx::TextureFormat::R32F);
+            bgfx::dispatch(
+                viewId,
+                m_hiZCopyProgram,
+                getDispatchSize(m_hiZWidth, HIZ_THREAD_COUNT_PER_DIM),
+                getDispatchSize(m_hiZHeight, HIZ_THREAD_COUNT_PER_DIM),
+                1);
+
+            for (uint8_t level = 1; level < m_hiZLevelCount; ++level) {
+                const uint32_t inputWidth = bx::max(m_hiZWidth >> (level - 1), 1u);
+                const uint32_t inputHeight = bx::max(m_hiZHeight >> (level - 1), 1u);
+                const uint32_t outputWidth = bx::max(m_hiZWidth >> level, 1u);
+                const uint32_t outputHeight = bx::max(m_hiZHeight >> level, 1u);
+
+                const float downsampleParams[4] = { float(inputWidth), float(inputHeight), float(outputWidth), float(outputHeight) };
+                bgfx::setUniform(m_cullingUniforms.u_hiZParams, downsampleParams);
+                bgfx::setImage(0, m_hiZTexture, level - 1, bgfx::Access::Read, bgfx::TextureFormat::R32F);
+                bgfx::setImage(1, m_hiZTexture, level, bgfx::Access::Write, bgfx::TextureFormat::R32F);
+                bgfx::dispatch(
+                    viewId,
+                    m_hiZDownsampleProgram,
+                    getDispatchSize(outputWidth, HIZ_THREAD_COUNT_PER_DIM),
+                    getDispatchSize(outputHeight, HIZ_THREAD_COUNT_PER_DIM),
+                    1);
+            }
+        }
+
+        bool update() override
+        {
+            if (entry::processEvents(m_width, m_height, m_debug, m_reset, &m_mouseState))
+            {
+                return false;
+            }
+
+            if (!m_computeSupported)
+            {
+                return false;
+            }
+
+            if (!bgfx::isValid(m_pbrFramebuffer) || m_oldWidth != m_width || m_oldHeight != m_height || m_oldReset != m_reset)
+            {
+                // Recreate variable size render targets when resolution changes.
+                m_oldWidth = m_width;
+                m_oldHeight = m_height;
+                m_oldReset = m_reset;
+
+                if (bgfx::isValid(m_pbrFramebuffer))
+                {
+                    bgfx::destroy(m_pbrFramebuffer);
+                }
+                if (bgfx::isValid(m_hiZTexture))
+                {
+                    bgfx::destroy(m_hiZTexture);
+                }
+
+                m_toneMapParams.width = m_width;
+                m_toneMapParams.height = m_height;
+
+                // No MSAA, since the Hi-Z copy reads the depth buffer texel by texel
+                m_pbrFbTextures[0] = bgfx::createTexture2D(
+                    uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_TEXTURE_RT);
+                m_pbrFbTextures[1] = bgfx::createTexture2D(
+                    uint16_t(m_width), uint16_t(m_height), false, 1, bgfx::TextureFormat::D32, BGFX_TEXTURE_RT | SAMPLER_POINT_CLAMP);
+
+                bgfx::setName(m_pbrFbTextures[0], "HDR Buffer");
+                bgfx::setName(m_pbrFbTextures[1], "HDR Depth Buffer");
+
+                m_pbrFramebuffer = bgfx::createFrameBuffer(BX_COUNTOF(m_pbrFbTextures), m_pbrFbTextures, true);
+
+                m_hiZWidth = m_width;
+                m_hiZHeight = m_height;
+                m_hiZLevelCount = 1;
+                while ((m_hiZWidth >> m_hiZLevelCount) > 0 || (m_hiZHeight >> m_hiZLevelCount) > 0) {
+                    ++m_hiZLevelCount;
+                }
+                m_hiZTexture = bgfx::createTexture2D(
+                    uint16_t(m_hiZWidth), uint16_t(m_hiZHeight), true, 1, bgfx::TextureFormat::R32F, BGFX_TEXTURE_COMPUTE_WRITE | SAMPLER_POINT_CLAMP);
+                bgfx::setName(m_hiZTexture, "Hi-Z Buffer");
+                m_hiZValid = false;
+            }
+
+            if (m_gpuScene.copyCount != uint32_t(m_gridSize * m_gridSize))
+            {
+                const glm::vec3 extent = glm::abs(m_model.boundingBox.max - m_model.boundingBox.min);
+                initDraws(m_gpuScene, m_model.opaqueMeshes, uint32_t(m_gridSize), 1.1f * glm::vec2{ extent.x, extent.z });
+                // The Hi-Z buffer is fine, but its draws moved around, so give it a frame to catch up
+                m_hiZValid = false;
+            }
+
+            imguiBeginFrame(m_mouseState.m_mx, m_mouseState.m_my, (m_mouseState.m_buttons[entry::MouseButton::Left] ? IMGUI_MBUT_LEFT : 0) | (m_mouseState.m_buttons[entry::MouseButton::Right] ? IMGUI_MBUT_RIGHT : 0) | (m_mouseState.m_buttons[entry::MouseButton::Middle] ? IMGUI_MBUT_MIDDLE : 0), m_mouseState.m_mz, uint16_t(m_width), uint16_t(m_height));
+
+            showExampleDialog(this);
+
+            ImGui::SetNextWindowPos(
+                ImVec2(m_width - m_width / 5.0f - 10.0f, 10.0f), ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize(
+                ImVec2(m_width / 5.0f, m_height / 3.0f), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Settings", NULL, 0);
+
+            ImGui::DragFloat("Light Intensity", &m_sceneUniforms.lightDirection.w, 0.5f, 0.0f, 100.0f);
+            ImGui::SliderInt("Scene Grid Size", &m_gridSize, 1, MAX_GRID_SIZE);
+
+            if (m_drawIndirectSupported) {
+                int submitMode = int(m_submitMode);
+                ImGui::Combo("Submission", &submitMode, SUBMIT_MODE_NAMES, BX_COUNTOF(SUBMIT_MODE_NAMES));
+                m_submitMode = SubmitMode(submitMode);
+            }
+            else {
+                ImGui::Text("Indirect draws aren't supported, so we can only submit from the CPU.");
+            }
+
+            if (m_submitMode == SubmitMode::GPU_DRIVEN) {
+                ImGui::Checkbox("Hi-Z Occlusion Culling", &m_occlusionCulling);
+            }
+
+            ImGui::Separator();
+            ImGui::Text("Draws: %u (%u materials)", m_gpuScene.getDrawCount(), uint32_t(m_gpuScene.materialGroups.size()));
+            ImGui::Text("Submits: %u", m_submitCount);
+            ImGui::Text("CPU Submission: %.3f ms", m_cpuSubmitMs);
+            if (m_submitMode == SubmitMode::GPU_DRIVEN) {
+                ImGui::Text("GPU Culling: %.3f ms", m_cullingMs);
+                ImGui::Text("Hi-Z Build: %.3f ms", m_hiZMs);
+                // Counted on the GPU and read back a few frames later
+                ImGui::Text("Visible: %.0f", m_gpuCullingStats[0]);
+                ImGui::Text("Frustum Culled: %.0f", m_gpuCullingStats[1]);
+                ImGui::Text("Occlusion Culled: %.0f", m_gpuCullingStats[2]);
+            }
+            else {
+                ImGui::Text("Visible: %u", m_cpuCullingStats.visible);
+                ImGui::Text("Frustum Culled: %u", m_cpuCullingStats.frustumCulled);
+            }
+            ImGui::Text("Mesh Pass: %.3f ms GPU", m_meshPassMs);
+
+            ImGui::End();
+
+            imguiEndFrame();
+
+            if (m_cullingStatsReadback.update(m_currentFrame)) {
+                bx::memCopy(m_gpuCullingStats, m_cullingStatsReadback.getData(), sizeof(m_gpuCullingStats));
+            }
+
+            bgfx::ViewId viewCount = 0;
+            bgfx::ViewId cullingPass = viewCount++;
+            bgfx::setViewName(cullingPass, "GPU Culling");
+
+            bgfx::ViewId meshPass = viewCount++;
+            bgfx::setViewFrameBuffer(meshPass, m_pbrFramebuffer);
+            bgfx::setViewName(meshPass, "Draw Meshes");
+            bgfx::setViewClear(meshPass, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x000000ff, 1.0f, 0);
+            bgfx::setViewRect(meshPass, 0, 0, uint16_t(m_width), uint16_t(m_height));
+
+            bgfx::ViewId hiZPass = viewCount++;
+            bgfx::setViewName(hiZPass, "Build Hi-Z");
+
+            int64_t now = bx::getHPCounter();
+            static int64_t last = now;
+            const int64_t frameTime = now - last;
+            last = now;
+            const double freq = double(bx::getHPFrequency());
+            const float deltaTime = (float)(frameTime / freq);
+
+            float fov = 60.0f;
+            float proj[16];
+            bx::mtxProj(proj, fov, float(m_width) / float(m_height), NEAR_PLANE, FAR_PLANE, m_caps->homogeneousDepth);
+
+            // Update camera
+            float view[16];
+
+            cameraUpdate(0.1f * deltaTime, m_mouseState);
+            cameraGetViewMtx(view);
+            // Set view and projection matrix
+            bgfx::setViewTransform(meshPass, view, proj);
+
+            const glm::mat4 viewProj = glm::make_mat4(proj) * glm::make_mat4(view);
+            glm::vec4 frustumPlanes[6];
+            bae::extractFrustumPlanes(viewProj, m_caps->homogeneousDepth, frustumPlanes);
+
+            uint64_t stateOpaque = 0
+                | BGFX_STATE_WRITE_RGB
+                | BGFX_STATE_WRITE_A
+                | BGFX_STATE_WRITE_Z
+                | BGFX_STATE_DEPTH_TEST_LESS
+                | BGFX_STATE_CULL_CCW;
+
+            m_submitCount = 0;
+            const int64_t submitStart = bx::getHPCounter();
+            if (m_submitMode == SubmitMode::GPU_DRIVEN) {
+                dispatchCulling(cullingPass, frustumPlanes);
+                submitIndirect(meshPass, stateOpaque);
+            }
+            else {
+                submitPerDraw(meshPass, stateOpaque, frustumPlanes);
+            }
+            const float submitMs = float(1000.0 * double(bx::getHPCounter() - submitStart) / freq);
+            // Smooth it out a bit so it's readable
+            m_cpuSubmitMs = bx::lerp(m_cpuSubmitMs, submitMs, 0.05f);
+
+            if (m_submitMode == SubmitMode::GPU_DRIVEN) {
+                // Blits happen before the view's draws, so this copies the counts the culling pass just wrote
+                m_cullingStatsReadback.request(meshPass, m_cullingStatsResult);
+
+                if (m_occlusionCulling) {
+                    buildHiZ(hiZPass);
+                    m_hiZViewProj = viewProj;
+                    m_hiZValid = true;
+                }
+                else {
+                    m_hiZValid = false;
+                }
+            }
+            else {
+                m_hiZValid = false;
+            }
+
+            viewCount = m_toneMapPass.render(m_pbrFbTextures[0], m_toneMapParams, deltaTime, viewCount);
+
+            // These are from a previous frame, but that's good enough for comparing our submission modes
+            const bgfx::Stats* stats = bgfx::getStats();
+            for (uint16_t i = 0; i < stats->numViews; ++i) {
+                const bgfx::ViewStats& viewStats = stats->viewStats[i];
+                const float gpuMs = float(1000.0 * double(viewStats.gpuTimeElapsed) / double(stats->gpuTimerFreq));
+                constexpr float timingSmoothing = 0.05f;
+                if (viewStats.view == cullingPass) {
+                    m_cullingMs = bx::lerp(m_cullingMs, gpuMs, timingSmoothing);
+                }
+                else if (viewStats.view == meshPass) {
+                    m_meshPassMs = bx::lerp(m_meshPassMs, gpuMs, timingSmoothing);
+                }
+                else if (viewStats.view == hiZPass) {
+                    m_hiZMs = bx::lerp(m_hiZMs, gpuMs, timingSmoothing);
+                }
+            }
+
+            m_currentFrame = bgfx::frame();
+            bae::getTrackingAllocator()->endFrame();
+            bae::getFrameArena().endFrame();
+
+            return true;
+        }
+
+        entry::MouseState m_mouseState;
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_debug;
+        uint32_t m_reset;
+
+        uint32_t m_oldWidth;
+        uint32_t m_oldHeight;
+        uint32_t m_oldReset;
+
+        bae::ToneMapParams m_toneMapParams;
+        bae::ToneMapping m_toneMapPass;
+
+        bae::Model m_model;
+        GpuScene m_gpuScene;
+        SceneUniforms m_sceneUniforms;
+        CullingUniforms m_cullingUniforms;
+
+        bgfx::ProgramHandle m_meshProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_cullingProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_cullingStatsProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_hiZCopyProgram = BGFX_INVALID_HANDLE;
+        bgfx::ProgramHandle m_hiZDownsampleProgram = BGFX_INVALID_HANDLE;
+
+        bgfx::TextureHandle m_pbrFbTextures[2];
+        bgfx::FrameBufferHandle m_pbrFramebuffer = BGFX_INVALID_HANDLE;
+
+        // Built at the end of every GPU driven frame, along with the view projection it was rendered with
+        bgfx::TextureHandle m_hiZTexture = BGFX_INVALID_HANDLE;
+        uint32_t m_hiZWidth = 0;
+        uint32_t m_hiZHeight = 0;
+        uint8_t m_hiZLevelCount = 0;
+        glm::mat4 m_hiZViewProj = glm::mat4{ 1.0f };
+        bool m_hiZValid = false;
+
+        bgfx::DynamicIndexBufferHandle m_cullingStatsBuffer = BGFX_INVALID_HANDLE;
+        bgfx::TextureHandle m_cullingStatsResult = BGFX_INVALID_HANDLE;
+        bae::AsyncReadback m_cullingStatsReadback;
+        float m_gpuCullingStats[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+        std::vector<bae::IndirectDrawArgs> m_cpuArgs;
+        bae::GpuCullingStats m_cpuCullingStats;
+
+        SubmitMode m_submitMode = SubmitMode::GPU_DRIVEN;
+        bool m_occlusionCulling = true;
+        int m_gridSize = 3;
+
+        uint32_t m_submitCount = 0;
+        float m_cpuSubmitMs = 0.0f;
+        float m_cullingMs = 0.0f;
+        float m_meshPassMs = 0.0f;
+        float m_hiZMs = 0.0f;
+
+        const bgfx::Caps* m_caps;
+
+        bool m_computeSupported = true;
+        bool m_drawIndirectSupported = true;
+        uint32_t m_currentFrame = 0;
+    };
+
+} // namespace example
+
+ENTRY_IMPLEMENT_MAIN(
+    example::ExampleGpuDrivenRendering,
+    "06-gpu-driven-rendering",
+    "Culling Sponza on the GPU and drawing it with a handful of indirect submits.");
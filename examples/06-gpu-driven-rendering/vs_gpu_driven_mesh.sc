@@ -0,0 +1,24 @@
+$input a_position, a_normal, a_texcoord0, i_data0, i_data1, i_data2, i_data3
+$output v_texcoord, v_normal
+
+#include "../common/common.sh"
+
+void main()
+{
+    // Every draw reads its transform from the instance buffer, starting at the startInstance of its draw
+    // arguments, so draws sharing a material can all be part of the same indirect submit
+    mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+    vec4 worldPos = mul(model, vec4(a_position, 1.0));
+
+    // glTF nodes can scale non-uniformly, so normals need the inverse transpose. Up to a factor of the determinant
+    // that's the cofactor matrix, whose columns are cross products of the model's, and the determinant's sign
+    // keeps mirrored nodes' normals pointing out.
+    vec3 cofactor0 = cross(i_data1.xyz, i_data2.xyz);
+    vec3 cofactor1 = cross(i_data2.xyz, i_data0.xyz);
+    vec3 cofactor2 = cross(i_data0.xyz, i_data1.xyz);
+    float determinantSign = dot(i_data0.xyz, cofactor0) < 0.0 ? -1.0 : 1.0;
+    v_normal = normalize(determinantSign * (a_normal.x * cofactor0 + a_normal.y * cofactor1 + a_normal.z * cofactor2));
+    v_texcoord = a_texcoord0;
+
+    gl_Position = mul(u_viewProj, worldPos);
+}
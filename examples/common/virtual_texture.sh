@@ -0,0 +1,49 @@
+// Sampling and feedback for bae::VirtualTexture. Whatever includes this declares s_vtIndirection (the
+// indirection texture of the virtual texture being sampled) and s_vtCache (the physical page cache).
+// u_vtParams and u_vtInfo come from VirtualTexture::getParams and getInfo.
+
+// xy: pages per side at mip 0, z: page size, w: page border
+uniform vec4 u_vtParams;
+// xy: cache size in texels, z: coarsest mip, w: texture id
+uniform vec4 u_vtInfo;
+
+// Mip of the virtual texture a pixel would sample, from the screen space derivatives of its uvs
+float vtMipLevel(vec2 uv)
+{
+    vec2 texels = uv * u_vtParams.xy * u_vtParams.z;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, u_vtInfo.z);
+}
+
+// Where uv lives in the cache, at the requested mip or whichever coarser page is resident
+vec2 vtCacheUV(vec2 uv, float mip)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    // Entries hold the page's slot in xy and the mip it actually came from in z
+    vec4 entry = texture2DLod(s_vtIndirection, uv, floor(mip)) * 255.0;
+    vec2 pages = max(floor(u_vtParams.xy / exp2(entry.z)), vec2_splat(1.0));
+    vec2 inPage = fract(uv * pages);
+
+    float paddedPageSize = u_vtParams.z + 2.0 * u_vtParams.w;
+    return (entry.xy * paddedPageSize + u_vtParams.w + inPage * u_vtParams.z) / u_vtInfo.xy;
+}
+
+vec4 vtSample(vec2 uv)
+{
+    return texture2DLod(s_vtCache, vtCacheUV(uv, vtMipLevel(uv)), 0.0);
+}
+
+// The page a pixel wants, packed like bae::VirtualPage::pack for an RGBA8 target. Feedback is usually
+// rendered at a lower resolution, mipBias (-log2 of the downscale) takes the mip back to full resolution.
+vec4 vtFeedback(vec2 uv, float mipBias)
+{
+    uv = clamp(uv, 0.0, 1.0);
+    float mip = clamp(floor(vtMipLevel(uv) + mipBias), 0.0, u_vtInfo.z);
+    vec2 pages = max(floor(u_vtParams.xy / exp2(mip)), vec2_splat(1.0));
+    vec2 page = min(floor(uv * pages), pages - 1.0);
+
+    vec2 low = mod(page, 256.0);
+    vec2 high = floor(page / 256.0);
+    return vec4(low.x, low.y, high.x + high.y * 4.0 + mip * 16.0, u_vtInfo.w) / 255.0;
+}
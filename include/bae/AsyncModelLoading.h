@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GltfModelSource.h"
+#include "PhysicallyBasedScene.h"
+
+namespace bimg
+{
+    struct ImageContainer;
+}
+
+namespace bae
+{
+    struct ModelHandle
+    {
+        static constexpr uint32_t INVALID = UINT32_MAX;
+
+        uint32_t idx = INVALID;
+
+        bool isValid() const { return idx != INVALID; }
+    };
+
+    enum struct ModelLoadState
+    {
+        LOADING,
+        READY,
+        // Whatever was uploaded before the error stays in the model
+        FAILED,
+    };
+
+    struct AsyncLoadingParams
+    {
+        // Time the main thread spends creating bgfx resources per update. At least one resource is created every
+        // update, so loading always makes progress.
+        float uploadBudgetMs = 2.0f;
+        uint32_t uploadBudgetBytes = 16u << 20;
+    };
+
+    struct AsyncLoadingStats
+    {
+        // This update
+        uint32_t meshesUploaded = 0;
+        uint32_t texturesUploaded = 0;
+        uint32_t bytesUploaded = 0;
+        float uploadMs = 0.0f;
+        // Meshes and textures ready on the loading thread's side, waiting for their turn to be uploaded
+        uint32_t pendingUploads = 0;
+    };
+
+    // Loads glTF models without blocking the main thread. A loading thread parses each model, generates missing
+    // tangents and decodes its textures, and update creates the bgfx resources for whatever is ready, within a time
+    // and byte budget. Models can be drawn while they load: meshes show up as they're uploaded, and use the dummy
+    // textures until their own are.
+    //
+    // Only creates its own vertex and index buffers, or allocates from a GeometryPool. Textures go through the
+    // TextureCache, so destroying the models with bae::destroy works the same as for loadGltfModel.
+    //
+    // Usage, once per frame:
+    //   loader.update();
+    //   const Model& model = loader.getModel(handle);
+    class AsyncModelLoader
+    {
+    public:
+        void init(const AsyncLoadingParams& params);
+        // Stops the loading thread and destroys every model, so any GeometryPool they use has to still be around
+        void destroy();
+
+        // Returns straight away, the model starts out empty
+        ModelHandle load(
+            const std::string& assetPath,
+            const std::string& fileName,
+            const bool keepMeshData = false,
+            GeometryPool* geometryPool = nullptr);
+
+        // Uploads what the loading thread has finished, on the thread that owns bgfx
+        void update();
+
+        ModelLoadState getState(const ModelHandle handle) const { return requests[handle.idx]->state; }
+        // Fraction of the meshes and textures parsed so far that have been uploaded
+        float getProgress(const ModelHandle handle) const;
+        const std::string& getError(const ModelHandle handle) const { return requests[handle.idx]->error; }
+        const Model& getModel(const ModelHandle handle) const { return requests[handle.idx]->model; }
+
+        const AsyncLoadingParams& getParams() const { return params; }
+        void setParams(const AsyncLoadingParams& _params) { params = _params; }
+        const AsyncLoadingStats& getStats() const { return stats; }
+
+    private:
+        struct DecodedTexture
+        {
+            uint32_t textureIdx;
+            // nullptr if it couldn't be decoded, the dummy stays in its place
+            bimg::ImageContainer* image;
+        };
+
+        struct Request
+        {
+            std::string assetPath;
+            std::string fileName;
+            bool keepMeshData;
+            GeometryPool* geometryPool;
+
+            // Handed over from the loading thread, guarded by mutex
+            bool hasLayout = false;
+            GltfSource source;
+            std::deque<GltfSourceMesh> meshes;
+            std::deque<DecodedTexture> textures;
+            uint32_t parsedItems = 0;
+            bool parsed = false;
+            std::string loadError;
+            // Set by the main thread when an upload fails, the loading thread stops parsing the model
+            bool cancelled = false;
+
+            // Main thread only
+            ModelLoadState state = ModelLoadState::LOADING;
+            std::string error;
+            bool layoutApplied = false;
+            Model model;
+            // Every material with the textures uploaded so far, and which one each mesh of each group uses
+            std::vector<PBRMaterial> materials;
+            std::vector<uint32_t> meshMaterials[3];
+            uint32_t uploadedItems = 0;
+        };
+
+        void runLoadingThread();
+        void applyLayout(Request& request);
+        uint32_t uploadMesh(Request& request, GltfSourceMesh& sourceMesh);
+        void fail(Request& request, const std::string& error);
+        uint32_t uploadTexture(Request& request, const DecodedTexture& decoded);
+
+        AsyncLoadingParams params;
+        AsyncLoadingStats stats;
+        std::vector<std::unique_ptr<Request>> requests;
+
+        std::thread thread;
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<Request*> queue;
+        std::atomic<bool> stopping{ false };
+    };
+}
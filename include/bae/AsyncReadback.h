@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+namespace bae
+{
+    struct AsyncReadbackStats
+    {
+        // Number of copies we've queued, and how many of them have made it back to the CPU
+        uint32_t requested = 0;
+        uint32_t completed = 0;
+        // Requests we had to skip because every texture in the ring was still in flight
+        uint32_t stalls = 0;
+        // Frames between queueing a copy and its data being available, for the latest result
+        uint32_t lastLatency = 0;
+        uint32_t maxLatency = 0;
+        float averageLatency = 0.0f;
+    };
+
+    // Copies a small GPU texture back to the CPU without ever waiting on the GPU. Each request blits the source
+    // into the next texture of a ring of readback textures and queues a bgfx::readTexture, tagged with the frame
+    // bgfx says its data will be ready on. Results are only handed out once that frame has been reached, and if
+    // every texture in the ring is still in flight the request is skipped rather than overwriting a pending copy.
+    //
+    // Usage, once per frame:
+    //   readback.update(currentFrame);        // currentFrame is what the last bgfx::frame() returned
+    //   if (readback.hasData()) { use readback.getData() }
+    //   readback.request(viewId, gpuTexture); // blit happens when viewId is processed
+    struct AsyncReadback
+    {
+        struct Slot
+        {
+            bgfx::TextureHandle texture = BGFX_INVALID_HANDLE;
+            std::vector<uint8_t> data;
+            uint32_t requestFrame = 0;
+            uint32_t readyFrame = 0;
+            bool inFlight = false;
+        };
+
+        std::vector<Slot> slots;
+        // Copy of the most recent completed readback, so it stays valid while its slot is reused
+        std::vector<uint8_t> latestData;
+        uint32_t latestFrame = 0;
+        bool hasLatest = false;
+        uint32_t nextSlot = 0;
+        uint32_t currentFrame = 0;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        AsyncReadbackStats stats;
+
+        // Readback latency is usually two frames, so three slots let us request every frame without stalling
+        void init(const uint16_t width, const uint16_t height, const bgfx::TextureFormat::Enum format, const uint32_t ringSize = 3, const char* name = nullptr);
+
+        void destroy();
+
+        // Queues a copy of the given region of source. Returns false, and counts a stall, if there was no free slot.
+        bool request(const bgfx::ViewId viewId, const bgfx::TextureHandle source, const uint16_t sourceX = 0, const uint16_t sourceY = 0);
+
+        // Collects any readbacks that have completed by frame. Returns true if there's a newer result than before.
+        bool update(const uint32_t frame);
+
+        bool hasData() const { return hasLatest; }
+        const void* getData() const { return latestData.data(); }
+        // Frame on which the latest result was requested
+        uint32_t getDataFrame() const { return latestFrame; }
+        const AsyncReadbackStats& getStats() const { return stats; }
+        void resetStats() { stats = AsyncReadbackStats{}; }
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // CPU reference for the reduced resolution lighting in 03-deferred-rendering. Needs to be kept in sync
+    // with fs_downsample_gbuffer.sc and fs_bilateral_upsample.sc.
+
+    struct BilateralUpsampleParams
+    {
+        // Size of the block of full resolution pixels covered by each low resolution one
+        uint32_t factor = 2;
+        float nearZ = 0.1f;
+        float farZ = 1000.0f;
+        // Relative view space depth difference at which a low resolution sample's weight falls off
+        float depthSigma = 0.05f;
+    };
+
+    struct UpsampleError
+    {
+        float rmsRelative = 0.0f;
+        float maxRelative = 0.0f;
+    };
+
+    // Converts a window space depth into view space distance. Window space depth is in [0, 1] with both
+    // GL and D3D style projections, which is what our G-buffer stores.
+    float linearizeDepth(const float depth, const float nearZ, const float farZ);
+
+    // Picks a single full resolution pixel for every factor x factor block, alternating between the closest
+    // and furthest one in a checkerboard so that both foreground and background edges survive.
+    // outSourceIndices stores which full resolution pixel each low resolution one was taken from.
+    void downsampleMinMaxDepth(
+        const float* depth,
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t factor,
+        std::vector<float>& outDepth,
+        std::vector<uint32_t>& outSourceIndices);
+
+    // Upsamples using the four nearest low resolution samples, weighted both bilinearly and by how close
+    // their depth is to the full resolution pixel. Falls back to the closest depth when none of them match.
+    void bilateralUpsample(
+        const glm::vec3* lowResColor,
+        const float* lowResDepth,
+        const float* fullResDepth,
+        const uint32_t width,
+        const uint32_t height,
+        const BilateralUpsampleParams& params,
+        glm::vec3* outColor);
+
+    // Runs the full downsample, shade, upsample round trip against a full resolution reference, where
+    // shading a low resolution pixel is the same as taking the radiance of the full resolution pixel it
+    // was downsampled from. Errors are in luminance, relative to the reference's RMS and max respectively.
+    UpsampleError measureUpsampleError(
+        const float* depth,
+        const glm::vec3* radiance,
+        const uint32_t width,
+        const uint32_t height,
+        const BilateralUpsampleParams& params);
+}
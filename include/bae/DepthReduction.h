@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // Converts a depth buffer value into linear depth, normalized so the near plane is 0 and the far plane is 1.
+    // projection is the bx style perspective projection the depth was rendered with, and homogeneousDepth
+    // should match bgfx::Caps::homogeneousDepth (the depth buffer then holds 0.5 * ndc + 0.5).
+    float linearizeDepth(const float depth, const float projection[16], const bool homogeneousDepth, const float nearZ, const float farZ);
+
+    // CPU reference for the depth reduction compute shaders: min linear depth in x and max in y, ignoring
+    // background (depth of 1). A buffer with nothing but background gives (1, 0), same as the shaders.
+    glm::vec2 reduceDepthMinMax(
+        const float* depth,
+        const uint32_t width,
+        const uint32_t height,
+        const float projection[16],
+        const bool homogeneousDepth,
+        const float nearZ,
+        const float farZ);
+}
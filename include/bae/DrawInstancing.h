@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    // Draws sharing the same mesh, material and state, which can go out as a single submit
+    struct InstanceBatch
+    {
+        const Mesh* mesh = nullptr;
+        uint32_t material = 0;
+        uint64_t state = 0;
+        // The batch's transforms are getTransform(firstDraw) up to getTransform(firstDraw + count - 1)
+        uint32_t firstDraw = 0;
+        uint32_t count = 0;
+    };
+
+    struct DrawInstancingStats
+    {
+        // Draws added this frame, and the batches they were grouped into
+        uint32_t draws = 0;
+        uint32_t batches = 0;
+        // Batches that were actually submitted instanced, and how many draws they covered
+        uint32_t instancedBatches = 0;
+        uint32_t instances = 0;
+        // Submits we didn't have to make, i.e. draws - submits
+        uint32_t drawsSaved = 0;
+    };
+
+    // Groups draws of the same (mesh, material, state) so each group can be submitted once, with the world
+    // matrices of its draws in an instance data buffer. Meshes are matched on the buffers they use, so copies of a
+    // Mesh drawn with different transforms still end up in the same batch. material is whatever index the caller
+    // uses to find its material uniforms, and is only compared, never read.
+    //
+    // Draws whose state has any BGFX_STATE_BLEND_* bits set are order dependent, so they're only merged with
+    // identical blended draws added right before them, never with ones further back. Add them back to front and
+    // they're submitted back to front.
+    //
+    // Instance data is 64 bytes per draw, the world matrix's columns, read as i_data0..3 in the vertex shader.
+    //
+    // begin, add and end only touch the instancer's own members and no global state, not even the frame arena, so
+    // views can be batched on jobs with one instancer each. setInstanceData calls into bgfx, so it stays on the
+    // thread that submits.
+    //
+    // Usage, once per frame:
+    //   instancer.begin();
+    //   instancer.add(mesh, material, state, transform);   // for every draw
+    //   instancer.end();
+    //   for each batch:
+    //     if (instancer.setInstanceData(i)) { bind material, state, buffers, submit instanced program }
+    //     else { submit each of the batch's draws like before }
+    class DrawInstancer
+    {
+    public:
+        static constexpr uint16_t INSTANCE_STRIDE = sizeof(glm::mat4);
+
+        void begin();
+        void add(const Mesh& mesh, const uint32_t material, const uint64_t state, const glm::mat4& transform);
+        // Groups the draws into batches, with each batch's transforms stored contiguously. Batches keep the order
+        // their first draw was added in.
+        void end();
+
+        size_t getBatchCount() const { return batches.size(); }
+        const InstanceBatch& getBatch(const size_t batchIdx) const { return batches[batchIdx]; }
+        const glm::mat4& getTransform(const size_t drawIdx) const { return draws[drawIdx].transform; }
+
+        // Fills and binds an instance data buffer for the batch. Returns false, with nothing bound, for batches
+        // of a single draw, when instancing isn't enabled, or when bgfx is out of instance data space this frame,
+        // in which case the batch's draws have to be submitted one by one.
+        bool setInstanceData(const size_t batchIdx);
+
+        void setEnabled(const bool _enabled) { enabled = _enabled; }
+        bool isEnabled() const { return enabled; }
+
+        const DrawInstancingStats& getStats() const { return stats; }
+
+    private:
+        struct Draw
+        {
+            const Mesh* mesh;
+            uint32_t material;
+            uint64_t state;
+            // Zero for draws that can be reordered, otherwise the run of consecutive blended draws it belongs to
+            uint32_t blendRun;
+            uint32_t order;
+            glm::mat4 transform;
+        };
+
+        std::vector<Draw> draws;
+        std::vector<InstanceBatch> batches;
+        DrawInstancingStats stats;
+        uint32_t blendRuns = 0;
+        bool enabled = true;
+    };
+}
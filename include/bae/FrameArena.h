@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+namespace bae
+{
+    struct FrameArenaParams
+    {
+        // Initial size of each frame's buffer. A frame that needs more spills into extra blocks, and its buffer
+        // grows to fit the next time it comes around, so this only has to be a first guess.
+        uint32_t capacity = 1u << 20;
+        // bgfx reads memory passed with makeRef up to two bgfx::frame calls later
+        uint32_t frameCount = 2;
+    };
+
+    struct FrameArenaStats
+    {
+        // Last frame, scratch memory given back with rewind included
+        uint32_t allocations = 0;
+        uint32_t bytesAllocated = 0;
+        // Every frame's buffers together
+        uint32_t capacity = 0;
+        // Blocks allocated since init because a frame ran out of space, which should stop once the buffers have grown
+        uint32_t overflowBlocks = 0;
+    };
+
+    // Bump allocator for data that only lives for a frame: culling output, sort keys, draw packets and uniform or
+    // buffer staging for bgfx. Allocating is a pointer increment and nothing is freed on its own, the whole frame's
+    // memory is dropped at once by endFrame. Each frame gets its own buffer and buffers are reused round robin, so
+    // memory handed to bgfx with copy stays valid for as long as bgfx needs it, without bgfx::copy's heap copy.
+    //
+    // Not thread safe, so memory that jobs write into has to be allocated before they're run. Only meant for
+    // trivially copyable types, no constructors or destructors are run. Buffers come from the tracking allocator
+    // under the per-frame tag, so once they've grown to fit, a frame allocates nothing at all.
+    //
+    // Usage, once per frame:
+    //   bgfx::frame();
+    //   bae::getFrameArena().endFrame();
+    class FrameArena
+    {
+    public:
+        // Where the current frame's allocations are up to, to give back scratch memory before the frame ends
+        struct Marker
+        {
+            uint32_t block;
+            uint32_t offset;
+        };
+
+        void init(const FrameArenaParams& params);
+        void destroy();
+
+        void* allocate(const size_t size, const size_t align = 16);
+        template<class T>
+        T* allocate(const size_t count)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "The frame arena doesn't run constructors or destructors");
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+        }
+        // Drop-in for bgfx::copy, for data that's uploaded within the frame
+        const bgfx::Memory* copy(const void* data, const uint32_t size);
+
+        Marker getMarker() const;
+        // Frees everything allocated since the marker was taken
+        void rewind(const Marker& marker);
+
+        // Moves on to the next frame's buffer, which is free to reuse by now
+        void endFrame();
+
+        const FrameArenaParams& getParams() const { return params; }
+        const FrameArenaStats& getStats() const { return stats; }
+
+    private:
+        struct Block
+        {
+            uint8_t* data;
+            uint32_t size;
+        };
+
+        struct Frame
+        {
+            std::vector<Block> blocks;
+            uint32_t block = 0;
+            uint32_t offset = 0;
+        };
+
+        uint8_t* allocateBlock(const uint32_t size);
+        void freeBlock(const Block& block);
+        void resetFrame(Frame& frame);
+
+        FrameArenaParams params;
+        FrameArenaStats stats;
+        std::vector<Frame> frames;
+        uint32_t currentFrame = 0;
+        uint32_t frameAllocations = 0;
+        uint32_t frameBytes = 0;
+    };
+
+    // Shared by the examples and by bae's own per-frame work. Lazily initialized with the default params.
+    FrameArena& getFrameArena();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // CPU versions of the packing our compact G-buffer does in its shaders. These need to be kept in sync
+    // with encodeNormalOctahedron/decodeNormalOctahedron in shaderlib.sh and the position reconstruction
+    // done in the point light shaders, so they can be used to check precision without a GPU.
+    //
+    // The compact layouts built on these cut the deferred example from 32 to 24 bytes per pixel with 16-bit
+    // normals, and to 20 with 8-bit ones. Neither halves the total, since light accumulation and depth-stencil
+    // stay as they were, but with 8-bit normals the G-buffer targets themselves go from 20 to 8 bytes.
+
+    // Maps a unit normal onto the octahedron, unfolded into [0, 1]^2
+    glm::vec2 encodeNormalOctahedron(const glm::vec3& normal);
+
+    glm::vec3 decodeNormalOctahedron(const glm::vec2& encodedNormal);
+
+    // Rounds a value in [0, 1] to what a UNORM render target with the given number of bits per channel stores
+    float quantizeUnorm(const float value, const uint32_t bits);
+    glm::vec2 quantizeUnorm(const glm::vec2& value, const uint32_t bits);
+
+    // Reconstructs a world space position from a hardware depth buffer value and the inverse view projection.
+    // glslConventions should match BGFX_SHADER_LANGUAGE_GLSL: depth in [-1, 1] and texcoords with a bottom
+    // left origin, rather than depth in [0, 1] and a top left origin.
+    glm::vec3 reconstructWorldPosition(
+        const glm::vec2& texcoord,
+        const float depth,
+        const glm::mat4& invViewProj,
+        const bool glslConventions);
+}
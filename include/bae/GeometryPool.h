@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // Hands out ranges of a fixed size block, like vertices or indices of a buffer. Free ranges are kept sorted
+    // by offset and merged with their neighbours as soon as they're released, allocations take the smallest free
+    // range they fit in.
+    class RangeAllocator
+    {
+    public:
+        static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+        void init(const uint32_t capacity);
+
+        // Returns INVALID_OFFSET when there's no free range of at least count
+        uint32_t allocate(const uint32_t count);
+        void free(const uint32_t offset, const uint32_t count);
+
+        uint32_t getCapacity() const { return capacity; }
+        uint32_t getAllocated() const { return allocated; }
+        uint32_t getFreeRangeCount() const { return uint32_t(freeRanges.size()); }
+        uint32_t getLargestFreeRange() const;
+
+    private:
+        struct Range
+        {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        std::vector<Range> freeRanges;
+        uint32_t capacity = 0;
+        uint32_t allocated = 0;
+    };
+
+    struct GeometryPoolParams
+    {
+        // Size of each page's buffers, a mesh has to fit in a single page
+        uint32_t verticesPerPage = 1u << 19;
+        uint32_t indicesPerPage = 1u << 21;
+        // Pages are only created once the existing ones are too full for an allocation
+        uint32_t maxPages = 4;
+    };
+
+    struct GeometryRange
+    {
+        static constexpr uint16_t INVALID_PAGE = UINT16_MAX;
+
+        uint16_t page = INVALID_PAGE;
+        uint32_t baseVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+
+        bool isValid() const { return page != INVALID_PAGE; }
+    };
+
+    struct GeometryPoolStats
+    {
+        uint32_t pages = 0;
+        uint32_t ranges = 0;
+        uint32_t failedAllocations = 0;
+        uint32_t allocatedVertices = 0;
+        uint32_t vertexCapacity = 0;
+        uint32_t allocatedIndices = 0;
+        uint32_t indexCapacity = 0;
+        uint32_t freeVertexRanges = 0;
+        uint32_t freeIndexRanges = 0;
+        // 1 - largest free range / total free space, over every page. 0 means all the free space is in one piece.
+        float vertexFragmentation = 0.0f;
+        float indexFragmentation = 0.0f;
+    };
+
+    // A few large vertex and index buffers that meshes get sub-allocated from, instead of every mesh creating
+    // buffers of its own. Vertices use the same four streams the model loader creates (position, normal, tangent
+    // and texcoord0, all floats) and indices stay 16 bit, with each draw offsetting them by its base vertex.
+    // Ranges can be freed again, e.g. when streaming meshes out, as long as nothing submitted in the current frame
+    // still uses them.
+    class GeometryPool
+    {
+    public:
+        void init(const GeometryPoolParams& params);
+        void destroy();
+
+        // Copies the vertices and indices into the pool. Returns an invalid range if no page has room for them.
+        GeometryRange allocate(
+            const glm::vec3* positions,
+            const glm::vec3* normals,
+            const glm::vec4* tangents,
+            const glm::vec2* texcoords,
+            const uint32_t vertexCount,
+            const uint16_t* indices,
+            const uint32_t indexCount);
+        void free(const GeometryRange& range);
+
+        // Binds the shared buffers with the range's offsets, in place of Mesh::setBuffers
+        void setBuffers(const GeometryRange& range) const;
+
+        GeometryPoolStats getStats() const;
+        const GeometryPoolParams& getParams() const { return params; }
+
+    private:
+        static constexpr uint8_t STREAM_COUNT = 4;
+
+        struct Page
+        {
+            bgfx::DynamicVertexBufferHandle vertexBuffers[STREAM_COUNT] = {
+                BGFX_INVALID_HANDLE,
+                BGFX_INVALID_HANDLE,
+                BGFX_INVALID_HANDLE,
+                BGFX_INVALID_HANDLE,
+            };
+            bgfx::DynamicIndexBufferHandle indexBuffer = BGFX_INVALID_HANDLE;
+            RangeAllocator vertices;
+            RangeAllocator indices;
+        };
+
+        void addPage();
+
+        GeometryPoolParams params;
+        bgfx::VertexDecl decls[STREAM_COUNT];
+        std::vector<Page> pages;
+        uint32_t rangeCount = 0;
+        uint32_t failedAllocations = 0;
+    };
+}
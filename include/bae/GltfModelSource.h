@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    enum struct TransparencyMode
+    {
+        OPAQUE_,
+        MASKED,
+        BLENDED,
+    };
+
+    // Files loaded in place of the textures a material doesn't have, and which of them each of PBRMaterial's texture
+    // slots (base color, metallic roughness, normal, emissive, occlusion) falls back to
+    constexpr const char* GLTF_DUMMY_TEXTURE_FILES[] = {
+        "textures/dummy_white.dds",
+        "textures/dummy_metallicRoughness.dds",
+        "textures/dummy_normal_map.dds",
+    };
+    constexpr uint8_t GLTF_DUMMY_TEXTURE_FOR_SLOT[5] = { 0, 1, 2, 0, 0 };
+
+    struct GltfSourceTexture
+    {
+        std::string path;
+        uint64_t flags = 0;
+    };
+
+    struct GltfSourceMaterial
+    {
+        // Factors only, the texture handles are left for whoever creates the textures to fill in
+        PBRMaterial material;
+        // Index of each slot's texture in GltfSource::textures, or -1 for the slot's dummy
+        int32_t textures[5] = { -1, -1, -1, -1, -1 };
+        TransparencyMode mode = TransparencyMode::OPAQUE_;
+    };
+
+    struct GltfSource
+    {
+        std::vector<GltfSourceTexture> textures;
+        std::vector<GltfSourceMaterial> materials;
+    };
+
+    struct GltfSourceMesh
+    {
+        MeshData data;
+        AABB boundingBox;
+        glm::mat4 transform;
+        uint32_t material = 0;
+    };
+
+    // CPU side of loading a glTF model: reads the file, its materials and every mesh's vertices, generating tangents
+    // where they're missing, without calling into bgfx, so it can run on any thread. onLayout gets the textures and
+    // materials first, then onMesh gets each mesh as soon as it's read. Attributes have to be floats.
+    void parseGltfModel(
+        const std::string& assetPath,
+        const std::string& fileName,
+        const std::function<void(GltfSource&&)>& onLayout,
+        const std::function<void(GltfSourceMesh&&)>& onMesh);
+
+    // GPU side, shared by loadGltfModel and AsyncModelLoader. Uploads a parsed mesh into geometryPool, or into buffers
+    // of its own without one. When the pool has no room left, the mesh's geometry is invalid.
+    Mesh createMesh(const MeshData& data, GeometryPool* geometryPool);
+    // Adds a mesh to the group for its material's mode and grows the model's bounding box, moving the mesh data along
+    // with keepMeshData
+    void addMesh(Model& model, const Mesh& mesh, const PBRMaterial& material, const TransparencyMode mode, GltfSourceMesh& sourceMesh, const bool keepMeshData);
+
+    MeshGroup& getMeshGroup(Model& model, const TransparencyMode mode);
+
+    // The handle and layer fields of one of PBRMaterial's texture slots, in the same order as above
+    bgfx::TextureHandle& getTextureSlot(PBRMaterial& material, const uint8_t slot);
+    uint16_t& getTextureLayerSlot(PBRMaterial& material, const uint8_t slot);
+}
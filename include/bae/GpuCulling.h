@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // One draw of a GPU driven scene, as the culling compute shader reads it: three vec4s, with the last one
+    // holding integers. Bounds are in world space.
+    struct GpuDrawRecord
+    {
+        glm::vec4 boundsMin = glm::vec4{ 0.0f };
+        glm::vec4 boundsMax = glm::vec4{ 0.0f };
+        uint32_t indexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t baseVertex = 0;
+        // Index into the instance data buffer that holds this draw's transform
+        uint32_t instanceIdx = 0;
+    };
+    static_assert(sizeof(GpuDrawRecord) == 3 * sizeof(glm::vec4), "GpuDrawRecord has to match cs_gpu_culling.sc");
+
+    // The arguments drawIndexedIndirect writes for a single draw. Culled draws keep their slot, with no instances.
+    struct IndirectDrawArgs
+    {
+        uint32_t indexCount = 0;
+        uint32_t instanceCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t baseVertex = 0;
+        uint32_t firstInstance = 0;
+    };
+
+    // Planes with their normals pointing into the frustum, so a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+    // Order is left, right, bottom, top, near, far.
+    void extractFrustumPlanes(const glm::mat4& viewProj, const bool homogeneousDepth, glm::vec4 outPlanes[6]);
+
+    bool isBoxOutsideFrustum(const glm::vec4 planes[6], const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    // Max depth mip chain of a depth buffer, with rows stored top to bottom (D3D's texture layout). Each level is
+    // half the size of the one above, rounded down, and a texel covers the 2x2 texels above it plus the odd
+    // row or column left over at the edges, so that every texel is conservative.
+    class HiZPyramid
+    {
+    public:
+        void build(const float* depth, const uint32_t width, const uint32_t height);
+
+        uint32_t getLevelCount() const { return uint32_t(levels.size()); }
+        uint32_t getWidth(const uint32_t level) const { return levels[level].width; }
+        uint32_t getHeight(const uint32_t level) const { return levels[level].height; }
+        float load(const uint32_t level, const uint32_t x, const uint32_t y) const
+        {
+            return levels[level].depth[size_t(y) * levels[level].width + x];
+        }
+
+    private:
+        struct Level
+        {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            std::vector<float> depth;
+        };
+
+        std::vector<Level> levels;
+    };
+
+    // Whether a box is hidden behind the depth in hiZ, which was rendered with viewProj. Depth is in [0, 1], with
+    // smaller values being closer. Boxes crossing the near plane are never occluded.
+    bool isBoxOccluded(
+        const HiZPyramid& hiZ,
+        const glm::mat4& viewProj,
+        const bool homogeneousDepth,
+        const glm::vec3& boxMin,
+        const glm::vec3& boxMax);
+
+    struct GpuCullingStats
+    {
+        uint32_t visible = 0;
+        uint32_t frustumCulled = 0;
+        uint32_t occlusionCulled = 0;
+    };
+
+    // CPU reference for cs_gpu_culling.sc: writes the indirect arguments for every record, with instanceCount set
+    // to zero for draws outside the frustum or, when hiZ isn't null, hidden behind the previous frame's depth.
+    void cullDrawRecords(
+        const GpuDrawRecord* records,
+        const size_t count,
+        const glm::vec4 frustumPlanes[6],
+        const HiZPyramid* hiZ,
+        const glm::mat4& hiZViewProj,
+        const bool homogeneousDepth,
+        IndirectDrawArgs* outArgs,
+        GpuCullingStats* outStats = nullptr);
+}
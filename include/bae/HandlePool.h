@@ -0,0 +1,221 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+namespace bae
+{
+    // Handle to a resource in a HandlePool. The low bits are the index of its slot and the high bits that slot's
+    // generation, which changes whenever the slot's resource is released, so handles to it from before can tell.
+    // With 12 bits of generation a slot can only tell 4096 resources apart, so rather than wrapping back to
+    // generation 0, where handles from 4096 releases ago would match again, a slot is retired for good once its
+    // last generation is released.
+    struct PoolHandle
+    {
+        static constexpr uint32_t INDEX_BITS = 20;
+        static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+        static constexpr uint32_t GENERATION_MASK = UINT32_MAX >> INDEX_BITS;
+        static constexpr uint32_t INVALID = UINT32_MAX;
+
+        uint32_t value = INVALID;
+
+        uint32_t index() const { return value & INDEX_MASK; }
+        uint32_t generation() const { return value >> INDEX_BITS; }
+        bool isValid() const { return value != INVALID; }
+
+        bool operator==(const PoolHandle& other) const { return value == other.value; }
+        bool operator!=(const PoolHandle& other) const { return value != other.value; }
+    };
+
+    // Names are turned into ids once, so pools only store and compare integers. Shared by every pool.
+    uint32_t internName(const std::string& name);
+    // Returns UINT32_MAX for names that were never interned
+    uint32_t findInternedName(const std::string& name);
+    const std::string& getInternedName(const uint32_t nameId);
+
+    // bgfx handles stored in a dense array of slots, looked up by PoolHandle in constant time. Looking up a handle
+    // whose resource was released fails instead of returning whatever reused the slot.
+    //
+    // Released resources aren't destroyed right away, they wait destroyLatency frames, so a resource can be
+    // released while frames that still use it are in flight. Retired slots cost their few bytes forever, one for
+    // every 4096 releases that land on the same slot.
+    //
+    // Usage, once per frame:
+    //   pool.update(frame);   // destroys whatever was released long enough ago
+    template<class Resource>
+    class HandlePool
+    {
+    public:
+        // name is optional, and only kept so the resource can be found by it while debugging. Names are unique
+        // among alive resources, adding a second one under a name that is in use throws.
+        PoolHandle add(const Resource resource, const char* name = nullptr)
+        {
+            const uint32_t nameId = name != nullptr ? internName(name) : NO_NAME;
+            if (nameId != NO_NAME && nameToSlot.count(nameId) != 0) {
+                throw std::runtime_error("Handle pool already has a resource named " + std::string(name));
+            }
+
+            uint32_t slotIdx;
+            if (!freeSlots.empty()) {
+                slotIdx = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            else {
+                // The last index is reserved, so that no valid handle can be equal to PoolHandle::INVALID
+                if (slots.size() >= PoolHandle::INDEX_MASK) {
+                    throw std::runtime_error("Handle pool is full");
+                }
+                slotIdx = uint32_t(slots.size());
+                slots.push_back({});
+            }
+
+            Slot& slot = slots[slotIdx];
+            slot.resource = resource;
+            slot.alive = true;
+            slot.nameId = nameId;
+            if (nameId != NO_NAME) {
+                nameToSlot[nameId] = slotIdx;
+            }
+            ++aliveCount;
+            return makeHandle(slotIdx);
+        }
+
+        bool isValid(const PoolHandle handle) const
+        {
+            return handle.index() < slots.size()
+                && slots[handle.index()].alive
+                && slots[handle.index()].generation == handle.generation();
+        }
+
+        // Throws for stale handles, use tryGet when they are expected
+        const Resource& get(const PoolHandle handle) const
+        {
+            if (!isValid(handle)) {
+                throw std::runtime_error("Stale or invalid pool handle");
+            }
+            return slots[handle.index()].resource;
+        }
+
+        const Resource* tryGet(const PoolHandle handle) const
+        {
+            return isValid(handle) ? &slots[handle.index()].resource : nullptr;
+        }
+
+        // Invalidates the handle now, the resource is destroyed by the first update destroyLatency frames later
+        void release(const PoolHandle handle, const uint32_t frame)
+        {
+            if (!isValid(handle)) {
+                return;
+            }
+
+            Slot& slot = slots[handle.index()];
+            slot.alive = false;
+            // Retired slots keep their last generation, no handle can be valid for a slot that isn't alive
+            slot.retired = slot.generation == PoolHandle::GENERATION_MASK;
+            if (!slot.retired) {
+                ++slot.generation;
+            }
+            if (slot.nameId != NO_NAME) {
+                const auto it = nameToSlot.find(slot.nameId);
+                if (it != nameToSlot.end() && it->second == handle.index()) {
+                    nameToSlot.erase(it);
+                }
+                slot.nameId = NO_NAME;
+            }
+            --aliveCount;
+            pending.push_back({ handle.index(), frame });
+        }
+
+        void update(const uint32_t frame)
+        {
+            size_t destroyed = 0;
+            while (destroyed < pending.size() && frame - pending[destroyed].frame >= destroyLatency) {
+                const uint32_t slotIdx = pending[destroyed].slot;
+                bgfx::destroy(slots[slotIdx].resource);
+                if (slots[slotIdx].retired) {
+                    ++retiredCount;
+                }
+                else {
+                    freeSlots.push_back(slotIdx);
+                }
+                ++destroyed;
+            }
+            pending.erase(pending.begin(), pending.begin() + destroyed);
+        }
+
+        // Destroys every resource, released or not
+        void destroy()
+        {
+            for (Slot& slot : slots) {
+                if (slot.alive) {
+                    bgfx::destroy(slot.resource);
+                }
+            }
+            for (const Pending& released : pending) {
+                bgfx::destroy(slots[released.slot].resource);
+            }
+            slots.clear();
+            freeSlots.clear();
+            pending.clear();
+            nameToSlot.clear();
+            aliveCount = 0;
+            retiredCount = 0;
+        }
+
+        PoolHandle find(const std::string& name) const
+        {
+            const auto it = nameToSlot.find(findInternedName(name));
+            return it != nameToSlot.end() ? makeHandle(it->second) : PoolHandle{};
+        }
+
+        const char* getName(const PoolHandle handle) const
+        {
+            if (!isValid(handle) || slots[handle.index()].nameId == NO_NAME) {
+                return "";
+            }
+            return getInternedName(slots[handle.index()].nameId).c_str();
+        }
+
+        void setDestroyLatency(const uint32_t frames) { destroyLatency = frames; }
+
+        uint32_t getAliveCount() const { return aliveCount; }
+        uint32_t getPendingCount() const { return uint32_t(pending.size()); }
+        uint32_t getRetiredCount() const { return retiredCount; }
+
+    private:
+        static constexpr uint32_t NO_NAME = UINT32_MAX;
+
+        struct Slot
+        {
+            Resource resource;
+            uint32_t generation = 0;
+            uint32_t nameId = NO_NAME;
+            bool alive = false;
+            bool retired = false;
+        };
+
+        struct Pending
+        {
+            uint32_t slot;
+            uint32_t frame;
+        };
+
+        PoolHandle makeHandle(const uint32_t slotIdx) const
+        {
+            return { slots[slotIdx].generation << PoolHandle::INDEX_BITS | slotIdx };
+        }
+
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+        // In the order they were released, so also by frame
+        std::vector<Pending> pending;
+        std::unordered_map<uint32_t, uint32_t> nameToSlot;
+        uint32_t aliveCount = 0;
+        uint32_t retiredCount = 0;
+        uint32_t destroyLatency = 2;
+    };
+}
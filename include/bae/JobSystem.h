@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bae
+{
+    // Jobs still to finish. Every job run with a counter adds one to it, and takes one off once it's done.
+    struct JobCounter
+    {
+        std::atomic<uint32_t> pending{ 0 };
+
+        bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+    };
+
+    // A function over [begin, end) of whatever data points at. Nothing is copied or owned: data has to stay alive
+    // until the job's counter has been waited on.
+    struct Job
+    {
+        void (*function)(const void* data, uint32_t begin, uint32_t end) = nullptr;
+        const void* data = nullptr;
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        JobCounter* counter = nullptr;
+    };
+
+    struct JobSystemParams
+    {
+        // Threads besides the one that calls init, 0 to leave one core for it and use all the others
+        uint32_t workerCount = 0;
+        // Per thread. Jobs run on a full queue are run straight away instead.
+        uint32_t queueCapacity = 4096;
+    };
+
+    struct JobSystemStats
+    {
+        uint64_t jobsRun = 0;
+        // Taken from another thread's queue, and run by the thread that tried to queue them because its queue was full
+        uint64_t jobsStolen = 0;
+        uint64_t jobsRunInline = 0;
+    };
+
+    // Work stealing job system. Every thread has its own queue: it pushes and pops jobs at the back of it, while
+    // threads that run out of work steal from the front of the others, so nested work stays on the thread that
+    // spawned it and idle threads take the oldest, usually biggest, pieces. Waiting on a counter runs jobs instead
+    // of blocking, so the main thread helps out, and jobs can spawn and wait on more jobs without deadlocking.
+    //
+    // The thread that calls init owns the first queue. Any other thread that isn't a worker, like the model
+    // loading thread, shares it, which works but puts that queue's lock under more contention.
+    //
+    // Usage:
+    //   jobs.parallelFor(count, grainSize, [&](uint32_t begin, uint32_t end) { ... });
+    // or, to overlap the jobs with other work:
+    //   JobCounter counter;
+    //   jobs.run(job, counter);              // for each job
+    //   ...
+    //   jobs.wait(counter);
+    //
+    // There are no continuations: a job that depends on others waits on their counter, which runs other jobs in the
+    // meantime, so the dependency costs a thread nothing while it's not met. Counters have to be waited on before
+    // they go out of scope, which waiting inside the dependent job does.
+    class JobSystem
+    {
+    public:
+        void init(const JobSystemParams& params);
+        // Waits for the workers to finish whatever they're running, jobs still queued are dropped
+        void destroy();
+
+        void run(const Job& job, JobCounter& counter);
+        void run(const Job* jobs, const uint32_t count, JobCounter& counter);
+        // Runs queued jobs until counter gets to zero
+        void wait(JobCounter& counter);
+
+        // Splits [0, count) into ranges of grainSize and calls body(begin, end) for each of them, on any thread,
+        // returning once they're all done. Works from within a job too.
+        template<class Body>
+        void parallelFor(const uint32_t count, const uint32_t grainSize, const Body& body)
+        {
+            if (count == 0) {
+                return;
+            }
+            const uint32_t grain = std::max(grainSize, 1u);
+            if (count <= grain || workers.empty()) {
+                body(0u, count);
+                return;
+            }
+
+            // Queued a batch at a time, so a huge count doesn't overflow the queue before anyone starts stealing
+            constexpr uint32_t BATCH_SIZE = 64;
+            Job batch[BATCH_SIZE];
+            uint32_t batchSize = 0;
+            JobCounter counter;
+            for (uint32_t begin = 0; begin < count; begin += grain) {
+                Job& job = batch[batchSize++];
+                job.function = [](const void* data, uint32_t jobBegin, uint32_t jobEnd) {
+                    (*static_cast<const Body*>(data))(jobBegin, jobEnd);
+                };
+                job.data = &body;
+                job.begin = begin;
+                job.end = std::min(begin + grain, count);
+                if (batchSize == BATCH_SIZE) {
+                    run(batch, batchSize, counter);
+                    batchSize = 0;
+                }
+            }
+            run(batch, batchSize, counter);
+            wait(counter);
+        }
+
+        // Threads that run jobs, the one that called init included
+        uint32_t getThreadCount() const { return uint32_t(queues.size()); }
+        const JobSystemParams& getParams() const { return params; }
+        JobSystemStats getStats() const;
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            // Ring buffer, front is where thieves take jobs from
+            std::vector<Job> jobs;
+            uint32_t front = 0;
+            uint32_t size = 0;
+
+            std::atomic<uint64_t> jobsRun{ 0 };
+            std::atomic<uint64_t> jobsStolen{ 0 };
+            std::atomic<uint64_t> jobsRunInline{ 0 };
+        };
+
+        uint32_t getQueueIndex() const;
+        bool push(Queue& queue, const Job& job);
+        bool pop(Queue& queue, Job& outJob);
+        bool steal(Queue& queue, Job& outJob);
+        // Runs one job from this thread's queue or another's, returns false if there were none
+        bool runOne(const uint32_t queueIdx);
+        void execute(Queue& queue, const Job& job);
+        void runWorker(const uint32_t queueIdx);
+
+        JobSystemParams params;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+
+        // Workers sleep while every queue is empty
+        std::atomic<uint32_t> queuedJobs{ 0 };
+        std::atomic<uint32_t> sleepingWorkers{ 0 };
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        std::atomic<bool> stopping{ false };
+    };
+}
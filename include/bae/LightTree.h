@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    class JobSystem;
+
+    // Everything the light LOD needs to know about the camera that's looking at our lights
+    struct LightLODView
+    {
+        glm::vec3 cameraPos = { 0.0f, 0.0f, 0.0f };
+        glm::vec3 cameraForward = { 0.0f, 0.0f, 1.0f };
+        // proj[5] of a perspective projection, i.e. 1 / tan(fovY / 2)
+        float projScale = 1.0f;
+        float viewportWidth = 1.0f;
+        float viewportHeight = 1.0f;
+    };
+
+    struct LightLODParams
+    {
+        // Maximum number of lights we'll hand back, no matter what
+        uint32_t lightBudget = 512;
+        // Lights (or clusters) covering fewer pixels than this are dropped entirely
+        float minScreenCoverage = 4.0f;
+        // Clusters whose lights are spread over fewer pixels than this are merged into a single light
+        float mergeThreshold = 16.0f;
+        // Same epsilon used to derive a light's radius from its intensity: radius = sqrt(intensity / epsilon)
+        float falloffEpsilon = 0.01f;
+    };
+
+    struct LightLODStats
+    {
+        uint32_t inputLights = 0;
+        uint32_t droppedLights = 0;
+        uint32_t mergedLights = 0;
+        uint32_t outputLights = 0;
+    };
+
+    struct LightingError
+    {
+        float rmsRelative = 0.0f;
+        float maxRelative = 0.0f;
+    };
+
+    // Approximate number of pixels covered by a light volume's bounding sphere
+    float estimateScreenCoverage(const glm::vec3& center, const float radius, const LightLODView& view);
+
+    // Binary tree over a set of point lights, where each interior node stores an aggregate light that can
+    // stand in for all the lights below it. Lights are passed in the same layout as our light sets use:
+    // position + radius in one vec4, color + intensity in another.
+    class LightTree
+    {
+    public:
+        void build(const glm::vec4* positionRadius, const glm::vec4* colorIntensity, const size_t count);
+
+        // Chooses a cut through the tree such that no more than params.lightBudget lights are output.
+        // Clusters are refined in order of their projected size until they are either small enough to
+        // merge or we've run out of budget. Anything that ends up smaller than minScreenCoverage is dropped.
+        void selectLights(
+            const LightLODView& view,
+            const LightLODParams& params,
+            std::vector<glm::vec4>& outPositionRadius,
+            std::vector<glm::vec4>& outColorIntensity,
+            LightLODStats* stats = nullptr);
+
+        size_t getLightCount() const { return lightCount; }
+
+    private:
+        static constexpr uint32_t invalidIdx = UINT32_MAX;
+
+        struct Node
+        {
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+            // Intensity weighted centroid of all the lights in this node
+            glm::vec3 position;
+            // Intensity weighted average color
+            glm::vec3 color;
+            float intensity;
+            float radius;
+            // Radius of the sphere around position containing all the light positions in this node
+            float spread;
+            // Radius of the sphere around position containing all the light volumes in this node
+            float extent;
+            uint32_t left = invalidIdx;
+            uint32_t right = invalidIdx;
+            uint32_t lightCount = 0;
+        };
+
+        uint32_t buildRecursive(uint32_t first, uint32_t last);
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> lightIndices;
+        const glm::vec4* p_positionRadius = nullptr;
+        const glm::vec4* p_colorIntensity = nullptr;
+        size_t lightCount = 0;
+
+        // Scratch space, kept around to avoid reallocating every frame
+        std::vector<std::pair<float, uint32_t>> cutHeap;
+    };
+
+    // Compares the irradiance from two sets of lights at the given sample points, using the same windowed
+    // falloff our light volume shader uses. Useful for tuning the light LOD params against the full set. Spreads
+    // the sample points over jobSystem's threads if there is one.
+    LightingError computeLightingError(
+        const glm::vec4* referencePositionRadius,
+        const glm::vec4* referenceColorIntensity,
+        const size_t referenceCount,
+        const glm::vec4* positionRadius,
+        const glm::vec4* colorIntensity,
+        const size_t count,
+        const std::vector<glm::vec3>& samplePoints,
+        JobSystem* jobSystem = nullptr);
+}
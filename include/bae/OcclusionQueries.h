@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    enum struct OcclusionMode
+    {
+        DISABLED,
+        // Meshes whose latest query came back occluded aren't submitted at all. Cheapest, but a mesh that
+        // becomes visible pops in once its query result catches up.
+        SKIP_OCCLUDED,
+        // Meshes whose latest query came back occluded are submitted with this frame's query as a condition,
+        // so the GPU skips them if their proxy is still hidden, without any popping
+        CONDITIONAL,
+    };
+
+    struct OcclusionQueryParams
+    {
+        // Only meshes whose bounding box diagonal is at least this long get a query, smaller ones always draw
+        float minBoundsSize = 1.0f;
+        // Meshes whose bounds the camera is inside of (grown by this much) always draw, since their proxy
+        // would be clipped by the near plane
+        float cameraMargin = 0.1f;
+    };
+
+    struct OcclusionQueryStats
+    {
+        // Meshes with a query, and how many proxies we drew for them this frame
+        uint32_t testedMeshes = 0;
+        uint32_t queries = 0;
+        // Queries that haven't returned anything yet
+        uint32_t pendingResults = 0;
+        uint32_t occludedMeshes = 0;
+        // Draws we dropped on the CPU, and draws we left for the GPU to skip
+        uint32_t skippedDraws = 0;
+        uint32_t conditionalDraws = 0;
+        // Meshes we skipped while their query came back visible, i.e. that popped in a frame or more late
+        uint32_t poppingErrors = 0;
+    };
+
+    // Hardware occlusion queries for the meshes of a MeshGroup. Each frame, after a depth prepass, the bounding
+    // box of every large mesh is drawn as a proxy with a query attached. Query results are read with
+    // bgfx::getResult, which never waits on the GPU, so we always act on a result that's a frame or more old:
+    // meshes that were visible keep drawing normally, and meshes that were occluded are either skipped or drawn
+    // with their new query as a condition, depending on the mode.
+    //
+    // Usage, once per frame:
+    //   queries.update(mode, cameraPos);                 // before any draws
+    //   if (queries.prepareDraw(i, false)) { submit i }  // depth prepass
+    //   queries.submitProxies(viewId, depthOnlyProgram); // view after the prepass, sharing its depth
+    //   if (queries.prepareDraw(i, true)) { submit i }   // shaded pass
+    class OcclusionQueries
+    {
+    public:
+        // Bounds are the world space bounds of each mesh in the group we're culling
+        void init(const AABB* bounds, const size_t count, const OcclusionQueryParams& params);
+        void destroy();
+
+        // Reads back whatever query results have arrived and decides how each mesh is drawn this frame
+        void update(const OcclusionMode mode, const glm::vec3& cameraPos);
+
+        // Draws a proxy for each mesh we're testing. Proxies only depth test, so they leave the view untouched.
+        void submitProxies(const bgfx::ViewId viewId, const bgfx::ProgramHandle program) const;
+
+        // Returns false if a mesh shouldn't be submitted. When conditional is true, and we're in CONDITIONAL mode,
+        // this also sets the bgfx condition for meshes that were occluded, so call it right before their submit.
+        bool prepareDraw(const size_t meshIdx, const bool conditional) const;
+
+        const OcclusionQueryStats& getStats() const { return stats; }
+        const OcclusionQueryParams& getParams() const { return params; }
+
+    private:
+        enum struct DrawMode : uint8_t
+        {
+            DRAW,
+            CONDITIONAL,
+            SKIP,
+        };
+
+        struct MeshQuery
+        {
+            bgfx::OcclusionQueryHandle query = BGFX_INVALID_HANDLE;
+            AABB bounds = {};
+            DrawMode drawMode = DrawMode::DRAW;
+            // Latest result we've seen, meshes count as visible until their first result arrives
+            bool visible = true;
+            bool submitProxy = false;
+        };
+
+        std::vector<MeshQuery> meshQueries;
+        OcclusionQueryParams params;
+        OcclusionQueryStats stats;
+
+        bgfx::VertexBufferHandle proxyVertices = BGFX_INVALID_HANDLE;
+        bgfx::IndexBufferHandle proxyIndices = BGFX_INVALID_HANDLE;
+    };
+}
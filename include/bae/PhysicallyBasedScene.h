@@ -5,6 +5,7 @@
 #include <vector>
 #include <stdexcept>
 
+#include "GeometryPool.h"
 #include "ResourceList.h"
 
 namespace bae
@@ -25,6 +26,10 @@ namespace bae
         bgfx::IndexBufferHandle indexHandle = BGFX_INVALID_HANDLE;
         uint8_t numVertexHandles = 0;
 
+        // Set for meshes allocated from a GeometryPool, which have no buffers of their own
+        GeometryPool* pool = nullptr;
+        GeometryRange geometry = {};
+
         static const uint8_t maxVertexHandles = 4;
 
         void addVertexHandle(const bgfx::VertexBufferHandle vbh)
@@ -39,6 +44,10 @@ namespace bae
 
         void setBuffers() const
         {
+            if (pool != nullptr) {
+                pool->setBuffers(geometry);
+                return;
+            }
             bgfx::setIndexBuffer(indexHandle);
             for (uint8_t j = 0; j < numVertexHandles; ++j) {
                 bgfx::setVertexBuffer(j, vertexHandles[j]);
@@ -48,6 +57,16 @@ namespace bae
 
     void destroy(const Mesh& mesh);
 
+    // CPU side copy of a mesh's vertex streams, in the same layout as the GPU buffers
+    struct MeshData
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec4> tangents;
+        std::vector<glm::vec2> texcoords;
+        std::vector<uint16_t> indices;
+    };
+
     struct AABB
     {
         glm::vec3 min = { 0.0f, 0.0f, 0.0f };
@@ -69,6 +88,12 @@ namespace bae
         bgfx::TextureHandle normalTexture = BGFX_INVALID_HANDLE;
         bgfx::TextureHandle emissiveTexture = BGFX_INVALID_HANDLE;
         bgfx::TextureHandle occlusionTexture = BGFX_INVALID_HANDLE;
+        // For models loaded into TextureArrays, where the textures above are arrays, the layer each one samples
+        uint16_t baseColorLayer = 0;
+        uint16_t metallicRoughnessLayer = 0;
+        uint16_t normalLayer = 0;
+        uint16_t emissiveLayer = 0;
+        uint16_t occlusionLayer = 0;
     };
 
     struct MeshGroup
@@ -77,6 +102,8 @@ namespace bae
         std::vector<Mesh> meshes;
         std::vector<glm::mat4> transforms;
         std::vector<AABB> boundingBoxes;
+        // Only filled in when the model was loaded with keepMeshData, otherwise empty
+        std::vector<MeshData> meshData;
     };
 
     struct Model
@@ -0,0 +1,143 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "LightTree.h"
+#include "PhysicallyBasedScene.h"
+#include "ShadowAtlas.h"
+
+namespace bae
+{
+    constexpr uint32_t POINT_SHADOW_FACES = 6;
+
+    struct PointShadowParams
+    {
+        // Only this many of the most important lights get shadows
+        uint32_t maxShadowedLights = 8;
+        uint16_t minFaceSize = 64;
+        uint16_t maxFaceSize = 512;
+        // Faces we're allowed to redraw in a frame. A light's faces are always redrawn together, so lights that
+        // don't fit keep their old shadows for another frame.
+        uint32_t maxFaceUpdates = 24;
+        float nearPlane = 0.05f;
+    };
+
+    struct PointShadowStats
+    {
+        uint32_t shadowedLights = 0;
+        // Lights that wanted a shadow but either weren't important enough or didn't fit in the atlas
+        uint32_t skippedLights = 0;
+        uint32_t renderedFaces = 0;
+        uint32_t cachedFaces = 0;
+        // Faces that needed redrawing but were pushed back to a later frame
+        uint32_t deferredFaces = 0;
+        uint32_t casterDraws = 0;
+        uint32_t allocationFailures = 0;
+    };
+
+    struct PointShadowFace
+    {
+        ShadowAtlasRegion region;
+        bool valid = false;
+        bool dirty = true;
+    };
+
+    // A light that currently owns space in the atlas
+    struct PointShadowLight
+    {
+        uint32_t lightIdx = 0;
+        // Where the light was when its faces were last drawn, which is what the shader should use
+        glm::vec4 positionRadius = glm::vec4{ 0.0f };
+        uint16_t faceSize = 0;
+        // What we last asked the atlas for. Larger than faceSize when it had to fall back to smaller faces, in which
+        // case we don't try to grow again until the light asks for more.
+        uint16_t requestedFaceSize = 0;
+        float importance = 0.0f;
+        // Frames this light has been waiting for its dirty faces to be redrawn
+        uint32_t staleFrames = 0;
+        PointShadowFace faces[POINT_SHADOW_FACES];
+        // Seen during the latest update, slots that aren't are freed
+        bool active = false;
+
+        // Every face has been drawn at least once, so we can sample its shadows
+        bool isReady() const;
+    };
+
+    // A face to draw this frame. Its casters are casterCount indices into getFaceCasters(), from casterBegin.
+    struct PointShadowFaceUpdate
+    {
+        uint32_t slot = 0;
+        uint32_t face = 0;
+        uint32_t casterBegin = 0;
+        uint32_t casterCount = 0;
+    };
+
+    // Looks after the shadows of a set of point lights, as six cube faces per light packed into one shadow atlas.
+    // The most important lights (by screen coverage and intensity) get shadows, with face resolution based on how
+    // much of the screen they cover. Faces are only redrawn when their light moves or a caster moves inside them,
+    // and culling, allocation and scheduling are all plain CPU code, so that none of it needs a GPU.
+    //
+    // Faces use a 90 degree perspective projection, with the basis from getFaceBasis.
+    //
+    // update only touches the atlas' own members and no global state, not even the frame arena, so it can run on a
+    // job as long as nothing else uses the same atlas meanwhile.
+    class PointShadowAtlas
+    {
+    public:
+        void init(const uint16_t width, const uint16_t height, const PointShadowParams& params, const bool homogeneousDepth);
+
+        // Drops every cached face
+        void reset();
+
+        // casterBounds are world space, and any caster whose bounds have changed since the last update counts as moved
+        void update(
+            const glm::vec4* positionRadius,
+            const glm::vec4* colorIntensity,
+            const uint32_t lightCount,
+            const LightLODView& view,
+            const AABB* casterBounds,
+            const uint32_t casterCount);
+
+        const std::vector<PointShadowLight>& getSlots() const { return slots; }
+        // Slots whose shadows can be sampled this frame, most important first
+        const std::vector<uint32_t>& getShadowedSlots() const { return shadowedSlots; }
+        const std::vector<PointShadowFaceUpdate>& getFaceUpdates() const { return faceUpdates; }
+        const std::vector<uint32_t>& getFaceCasters() const { return faceCasters; }
+        const PointShadowStats& getStats() const { return stats; }
+        const ShadowAtlas& getAtlas() const { return atlas; }
+        const PointShadowParams& getParams() const { return params; }
+
+        glm::mat4 getFaceView(const uint32_t slot, const uint32_t face) const;
+        glm::mat4 getFaceProjection(const uint32_t slot) const;
+
+        // Right, up and forward of a face. Forward is +X, -X, +Y, -Y, +Z, -Z for faces 0 to 5.
+        static void getFaceBasis(const uint32_t face, glm::vec3& right, glm::vec3& up, glm::vec3& forward);
+
+        // Whether a box overlaps the part of a light's sphere that one of its faces can see
+        static bool faceOverlapsBox(const glm::vec4& positionRadius, const uint32_t face, const AABB& box);
+
+    private:
+        uint16_t getFaceSize(const float coverage) const;
+        void freeSlot(PointShadowLight& slot);
+        bool allocateSlot(PointShadowLight& slot, uint16_t faceSize);
+
+        ShadowAtlas atlas;
+        PointShadowParams params;
+        bool homogeneousDepth = false;
+        bool repackAtlas = false;
+
+        std::vector<PointShadowLight> slots;
+        std::vector<uint32_t> shadowedSlots;
+        std::vector<PointShadowFaceUpdate> faceUpdates;
+        std::vector<uint32_t> faceCasters;
+        std::vector<AABB> previousCasterBounds;
+        PointShadowStats stats;
+
+        // Scratch space for update
+        std::vector<uint32_t> lightOrder;
+        std::vector<float> lightImportance;
+        std::vector<uint32_t> movedCasters;
+        std::vector<uint32_t> slotOrder;
+    };
+}
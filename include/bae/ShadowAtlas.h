@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace bae
+{
+    // A square region of the shadow atlas, in texels with a top left origin (same as bgfx::setViewRect)
+    struct ShadowAtlasRegion
+    {
+        uint16_t x = 0;
+        uint16_t y = 0;
+        uint16_t size = 0;
+
+        bool isValid() const { return size > 0; }
+    };
+
+    // Packs square, power of two shadow maps into a single depth texture, so every shadow caster can share one
+    // framebuffer and one sampler. The atlas is split into a grid of square root tiles (so it doesn't need to be
+    // square itself) and each tile is recursively split into quadrants, i.e. a buddy allocator in two dimensions.
+    // Regions can be freed individually, so long lived casters such as the faces of a point or spot light shadow
+    // can keep their place while others are repacked every frame.
+    class ShadowAtlas
+    {
+    public:
+        // Width and height need to be powers of two. Regions are never smaller than minRegionSize.
+        void init(const uint16_t width, const uint16_t height, const uint16_t minRegionSize);
+
+        // Frees every region
+        void reset();
+
+        // Size is rounded up to a power of two. Returns an invalid region when there's no space left.
+        ShadowAtlasRegion allocate(const uint16_t size);
+
+        void free(const ShadowAtlasRegion& region);
+
+        // Allocates a region for each requested size, largest first. If the requests add up to more than the free
+        // space, the largest ones are halved until they fit, later requests first on ties. Any region that still can't be placed is left invalid.
+        // outRegions is in the same order as requestedSizes.
+        void pack(const uint16_t* requestedSizes, const size_t count, ShadowAtlasRegion* outRegions);
+
+        // Scale in xy and offset in zw, taking the [0, 1] uvs of a region's shadow map into atlas uvs.
+        // originBottomLeft should match bgfx::Caps::originBottomLeft.
+        glm::vec4 getUVScaleOffset(const ShadowAtlasRegion& region, const bool originBottomLeft) const;
+
+        // Min uv in xy and max in zw, inset by half a texel so filtering never reads a neighbouring region
+        glm::vec4 getUVBounds(const ShadowAtlasRegion& region, const bool originBottomLeft) const;
+
+        // Scale in xy and offset in zw, taking a shadow projection's clip space xy into the region, when the
+        // view rect covers the whole atlas. Used to render into several regions from a single view.
+        glm::vec4 getClipScaleOffset(const ShadowAtlasRegion& region) const;
+
+        uint16_t getWidth() const { return width; }
+        uint16_t getHeight() const { return height; }
+        // Largest region the atlas can hand out
+        uint16_t getMaxRegionSize() const { return rootSize; }
+        uint16_t getMinRegionSize() const { return minRegionSize; }
+        uint32_t getAllocatedTexels() const { return allocatedTexels; }
+
+    private:
+        uint32_t getLevel(const uint16_t size) const;
+        uint16_t getRegionSize(const uint16_t size) const;
+        bool takeFreeNode(const uint32_t level, uint16_t& x, uint16_t& y);
+        bool removeFreeNode(const uint32_t level, const uint16_t x, const uint16_t y);
+
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint16_t rootSize = 0;
+        uint16_t minRegionSize = 0;
+        uint32_t allocatedTexels = 0;
+        // Free nodes for each level of the quadtree, level 0 being the root tiles. Positions are packed as x | y << 16.
+        std::vector<std::vector<uint32_t>> freeNodes;
+        // Scratch space for pack
+        std::vector<uint16_t> packSizes;
+        std::vector<size_t> packOrder;
+    };
+
+    // Smallest power of two shadow map resolution, between minSize and maxSize, that gives at least one shadow
+    // map texel per screen pixel for a shadow projection covering worldExtent, when viewed at the given distance.
+    // projScale is proj[5] of the camera's perspective projection.
+    uint16_t getShadowResolutionForCoverage(
+        const float worldExtent,
+        const float distance,
+        const float viewportHeight,
+        const float projScale,
+        const uint16_t minSize,
+        const uint16_t maxSize);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    // Shaders size their cascade arrays to this, and pick the cascades actually in use at runtime
+    constexpr uint32_t MAX_SHADOW_CASCADES = 8;
+
+    enum struct CascadeSplitScheme
+    {
+        // Every cascade covers the same ratio of far to near depth, which matches perspective aliasing
+        LOGARITHMIC,
+        // Every cascade covers the same range of depths
+        UNIFORM,
+        // Parallel split shadow maps: a blend of the two, with lambda = 1 being fully logarithmic
+        PRACTICAL,
+    };
+
+    // Splits [nearDepth, farDepth] into count contiguous view space depth ranges, min in x and max in y
+    void computeCascadeSplits(
+        const float nearDepth,
+        const float farDepth,
+        const uint32_t count,
+        const CascadeSplitScheme scheme,
+        const float lambda,
+        glm::vec2* outSplits);
+
+    // World space corners of the part of a view frustum between two view space depths, near corners first.
+    // clipNear is -1 for homogeneous depth and 0 otherwise, nearPlane and farPlane are the projection's.
+    void getFrustumSliceCorners(
+        const glm::mat4& invViewProj,
+        const float clipNear,
+        const float nearPlane,
+        const float farPlane,
+        const glm::vec2& slice,
+        glm::vec4 outCorners[8]);
+
+    // Light space bounds we'd like a cascade to have this frame
+    struct CascadeFit
+    {
+        glm::vec4 corners[8];
+        glm::mat4 lightView;
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Light space bounds around a cascade's slice of the view frustum, whose corners should already be in fit.
+    // lightRotation only rotates into light space. Stabilized fits use it as their view, so that they can be snapped
+    // to a fixed texel grid, and fit a sphere rather than a box, so their size doesn't change as the camera rotates.
+    void fitCascade(
+        CascadeFit& fit,
+        const glm::mat4& lightRotation,
+        const glm::vec3& lightDirection,
+        const glm::vec3& up,
+        const AABB& sceneBounds,
+        const bool stabilize);
+
+    // Snaps a stabilized fit to whole texels of a regionSize shadow map, so rasterized shadows don't shimmer as the
+    // camera moves
+    void snapCascadeToTexels(CascadeFit& fit, const uint16_t regionSize);
+
+    // Orthographic projection of a fit, for clip space depth in [-1, 1] with homogeneous depth and [0, 1] otherwise
+    glm::mat4 getCascadeProjection(const CascadeFit& fit, const bool homogeneousDepth);
+
+    // Whether the corners of a frustum slice land inside a shadow projection in x and y. When sceneBounds is
+    // given, any part of the slice outside the scene's footprint is ignored, since there's nothing to shadow there.
+    bool coversFrustumSlice(
+        const glm::mat4& lightViewProj,
+        const glm::vec4 corners[8],
+        const AABB* sceneBounds = nullptr,
+        const float epsilon = 1e-3f);
+
+    struct CascadeCoverage
+    {
+        // The splits start at or before the near depth, end at or after the far depth and leave no gaps
+        bool contiguous = true;
+        // One bit for each cascade whose projection doesn't cover its slice of the frustum
+        uint32_t uncoveredCascades = 0;
+
+        bool isValid() const { return contiguous && uncoveredCascades == 0; }
+    };
+
+    // CPU check that a set of cascades covers the view frustum between nearDepth and farDepth
+    CascadeCoverage validateCascadeCoverage(
+        const glm::mat4& invViewProj,
+        const float clipNear,
+        const float nearPlane,
+        const float farPlane,
+        const float nearDepth,
+        const float farDepth,
+        const glm::vec2* splits,
+        const glm::mat4* lightViewProjs,
+        const uint32_t count,
+        const AABB* sceneBounds = nullptr);
+}
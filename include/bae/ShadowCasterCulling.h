@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    // Bitmask of the shadow projections (up to 32 of them) that a world space bounding box overlaps in x and y.
+    // Depth isn't tested, since casters in front of a directional light's near plane still need to cast shadows,
+    // so the projections should have their depth range fit around the whole scene.
+    uint32_t getCascadeMask(const AABB& boundingBox, const glm::mat4* lightViewProjs, const uint32_t count);
+
+    uint32_t countCascades(uint32_t cascadeMask);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    // Part of a batch's index buffer that came from one source mesh, along with that mesh's world space bounds
+    struct StaticBatchRange
+    {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        AABB bounds = {};
+        uint32_t sourceMesh = 0;
+    };
+
+    struct StaticBatchingStats
+    {
+        uint32_t sourceMeshes = 0;
+        uint32_t batches = 0;
+        uint32_t vertices = 0;
+        uint32_t indices = 0;
+        // CPU time spent transforming, merging and uploading
+        float buildMs = 0.0f;
+    };
+
+    // The meshes of a MeshGroup merged by material, with their vertices transformed into world space. group looks
+    // like any other MeshGroup, with one mesh per batch, identity transforms and bounds covering the whole batch,
+    // so batches can be drawn by the same code as regular meshes. Each batch also keeps the range of indices of
+    // every mesh that went into it, so it can still be culled one source mesh at a time.
+    struct StaticBatches
+    {
+        MeshGroup group;
+        std::vector<StaticBatchRange> ranges;
+        // Batch i owns ranges[rangeOffsets[i]] up to ranges[rangeOffsets[i + 1]]
+        std::vector<uint32_t> rangeOffsets;
+        StaticBatchingStats stats;
+    };
+
+    // Part of a batch to draw with a single submit
+    struct StaticBatchDraw
+    {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    // Merges every mesh that shares a material into as few batches as 16 bit indices allow. Only for meshes that
+    // never move, and it needs the group's meshData, so load the model with keepMeshData. When keepMeshData is
+    // set here too, the batches' merged vertices are kept in group.meshData.
+    StaticBatches buildStaticBatches(const MeshGroup& meshGroup, const bool keepMeshData = false);
+
+    void destroy(StaticBatches& batches);
+
+    // Appends the parts of a batch that are inside the frustum, merging neighbouring ranges into a single draw.
+    // Planes are the ones from extractFrustumPlanes. Returns the number of ranges that were culled.
+    uint32_t cullStaticBatch(
+        const StaticBatches& batches,
+        const size_t batchIdx,
+        const glm::vec4 frustumPlanes[6],
+        std::vector<StaticBatchDraw>& outDraws);
+}
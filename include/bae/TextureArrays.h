@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+namespace bimg
+{
+    struct ImageContainer;
+}
+
+namespace bae
+{
+    // Where a texture ended up inside a TextureArrays
+    struct TextureLayer
+    {
+        static constexpr uint16_t INVALID_ARRAY = UINT16_MAX;
+
+        uint16_t array = INVALID_ARRAY;
+        uint16_t layer = 0;
+
+        bool isValid() const { return array != INVALID_ARRAY; }
+    };
+
+    struct TextureArraysStats
+    {
+        uint32_t textures = 0;
+        // Adds of a file and flags that were already in an array, which get its existing layer back
+        uint32_t hits = 0;
+        uint32_t arrays = 0;
+        // Most layers in any one array
+        uint32_t largestArray = 0;
+        uint32_t uploadedBytes = 0;
+    };
+
+    // Packs textures into 2D texture arrays, with one array for each combination of size, format, mip count and
+    // sampler flags, so that draws using different textures can still bind the same arrays and only change which
+    // layers they sample. An array's layer count has to be known when it's created, so textures are decoded as
+    // they're added and only uploaded once build is called. Textures added after that go into new arrays. Every
+    // file is only added once per set of sampler flags, however many materials or models use it.
+    //
+    // Arrays always get at least two layers, a lone texture is uploaded twice, since bgfx creates a plain 2D
+    // texture for a single layer and shaders sampling it as an array would then be bound the wrong type.
+    //
+    // Needs BGFX_CAPS_TEXTURE_2D_ARRAY and room for two layers, check isSupported and fall back to plain textures
+    // and shaders without it.
+    class TextureArrays
+    {
+    public:
+        static bool isSupported();
+
+        // Decodes the texture at filePath and queues it up as a layer of the matching array, or returns the layer
+        // it's already in. Throws if texture arrays aren't supported.
+        TextureLayer add(const char* filePath, const uint64_t flags);
+
+        // Creates and uploads every array that has textures waiting on it
+        void build();
+        void destroy();
+
+        // Only valid once build has been called for the array
+        bgfx::TextureHandle getTexture(const uint16_t arrayIdx) const { return arrays[arrayIdx].texture; }
+        size_t getArrayCount() const { return arrays.size(); }
+
+        const TextureArraysStats& getStats() const { return stats; }
+
+    private:
+        struct Array
+        {
+            uint16_t width;
+            uint16_t height;
+            uint8_t numMips;
+            bgfx::TextureFormat::Enum format;
+            uint64_t flags;
+            // Waiting to be uploaded, empty once the array is built
+            std::vector<bimg::ImageContainer*> images;
+            uint16_t numLayers;
+            bgfx::TextureHandle texture;
+        };
+
+        std::vector<Array> arrays;
+        // Keyed by path and sampler flags
+        std::unordered_map<std::string, TextureLayer> layers;
+        TextureArraysStats stats;
+    };
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+namespace bimg
+{
+    struct ImageContainer;
+}
+
+namespace bae
+{
+    struct TextureCacheStats
+    {
+        uint32_t textures = 0;
+        uint32_t references = 0;
+        // Acquires that found the texture already loaded, by path or by contents
+        uint32_t hits = 0;
+        uint32_t contentHits = 0;
+        uint32_t misses = 0;
+    };
+
+    // Reference counted textures, keyed by path and sampler flags, so every model that uses the same file shares one
+    // handle. With hashContents, files that weren't seen under that path yet are hashed too, so copies of the same
+    // image under different names are shared as well, at the cost of reading each new file one extra time.
+    //
+    // Every acquire needs a matching release, the texture is destroyed along with its last reference.
+    class TextureCache
+    {
+    public:
+        bgfx::TextureHandle acquire(const std::string& filePath, const uint64_t flags = BGFX_TEXTURE_NONE | BGFX_SAMPLER_NONE);
+        // Only returns the texture if it's already loaded, for callers that decode textures themselves
+        bgfx::TextureHandle tryAcquire(const std::string& filePath, const uint64_t flags);
+        // Hands a texture created from filePath over to the cache, holding one reference to it
+        void add(const std::string& filePath, const uint64_t flags, const bgfx::TextureHandle handle);
+        // Returns true if that was the last reference and the texture was destroyed. Textures the cache doesn't own
+        // are left alone and reported with a debug message.
+        bool release(const bgfx::TextureHandle handle);
+        bool owns(const bgfx::TextureHandle handle) const { return entries.find(handle.idx) != entries.end(); }
+
+        // Destroys every texture still referenced, before shutting bgfx down
+        void destroy();
+
+        void setHashContents(const bool enabled) { hashContents = enabled; }
+        const TextureCacheStats& getStats() const { return stats; }
+
+    private:
+        struct Entry
+        {
+            bgfx::TextureHandle handle;
+            uint32_t references;
+            // Every path key and the content key that lead to this texture
+            std::vector<std::string> keys;
+            std::string contentKey;
+        };
+
+        void insert(const std::string& key, const std::string& contentKey, const bgfx::TextureHandle handle);
+
+        std::unordered_map<std::string, uint16_t> pathToTexture;
+        std::unordered_map<std::string, uint16_t> contentToTexture;
+        std::unordered_map<uint16_t, Entry> entries;
+        TextureCacheStats stats;
+        bool hashContents = false;
+    };
+
+    // Shared by every model
+    TextureCache& getTextureCache();
+
+    // Reads and decodes an image file with the tracking allocator, so unlike imageLoad it can run on any thread.
+    // Returns nullptr if the file can't be read or decoded, free the image with bimg::imageFree.
+    bimg::ImageContainer* decodeImageFile(const std::string& filePath);
+}
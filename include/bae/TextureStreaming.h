@@ -0,0 +1,198 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bimg
+{
+    struct ImageContainer;
+}
+
+namespace bae
+{
+    struct TextureStreamingParams
+    {
+        // Total size of every streamed texture's resident mips
+        uint64_t budgetBytes = 256ull << 20;
+        // Mips this size or smaller are loaded up front and never evicted
+        uint16_t tailSize = 64;
+        // Textures recreated per update at most, streaming in or out
+        uint32_t maxSwapsPerUpdate = 4;
+        // Textures being decoded on the loading thread at most. Their bytes count against the budget from the
+        // moment they're queued.
+        uint32_t maxLoadsInFlight = 4;
+        // Loads a little more detail than the estimate asks for, negative values load less
+        float mipBias = 0.0f;
+    };
+
+    // Residency of one streamed texture. Mip 0 is the full resolution one, and every mip from residentMip down to
+    // the last one is loaded.
+    struct StreamedTextureInfo
+    {
+        std::string path;
+        uint16_t width = 0;
+        uint16_t height = 0;
+        uint8_t mipCount = 0;
+        // Finest mip of the always loaded tail
+        uint8_t tailMip = 0;
+        uint8_t residentMip = 0;
+        // Finest mip any visible mesh asked for this frame, tailMip if none did
+        uint8_t requestedMip = 0;
+        uint32_t residentBytes = 0;
+        uint32_t lastUsedFrame = 0;
+    };
+
+    struct TextureStreamingStats
+    {
+        uint32_t textures = 0;
+        uint64_t residentBytes = 0;
+        // Bytes every texture would take with all of its mips
+        uint64_t fullBytes = 0;
+        // Textures recreated this update with more or fewer mips
+        uint32_t streamedIn = 0;
+        uint32_t streamedOut = 0;
+        // Textures that still want finer mips than they have, waiting on the budget, the loading thread or the per
+        // update limit
+        uint32_t pending = 0;
+        // Of those, the ones being decoded right now
+        uint32_t loading = 0;
+    };
+
+    // A texture whose handle changed. Materials still pointing at from have to be updated before anything is
+    // submitted with them, since from is destroyed. A texture swapped twice in one update has both of its old
+    // handles lead straight to the newest one.
+    struct TextureSwap
+    {
+        bgfx::TextureHandle from;
+        bgfx::TextureHandle to;
+    };
+
+    // Loads textures with only their tail mips, then streams finer mips in as visible meshes ask for them, within a
+    // memory budget. bgfx textures can't gain or lose mips, so changing a texture's residency means recreating it
+    // with a different top mip, which hands out a new handle, so update reports every swapped handle. When the
+    // budget is exceeded, the least recently used textures drop back to their tails first, while textures that are
+    // still visible only lose the mips they no longer need.
+    //
+    // Streaming in decodes the file again on a loading thread, and a later update creates the texture once it's
+    // ready, so the main thread never waits on disk. Streaming out creates the smaller texture empty and blits the
+    // mips it keeps over from the old one, falling back to reading the file on renderers that can't blit.
+    //
+    // Usage, once per frame:
+    //   streamer.requestForMesh(...);             // for each visible mesh
+    //   streamer.update(frame, blitView, swaps);  // then applyTextureSwaps to every copy of the materials
+    class TextureStreamer
+    {
+    public:
+        void init(const TextureStreamingParams& params);
+        // Stops the loading thread and destroys every streamed texture
+        void destroy();
+
+        // Loads the tail of the texture at filePath, returning its handle for now
+        bgfx::TextureHandle add(const char* filePath, const uint64_t flags);
+
+        // Asks for at least the given mip of a texture this frame. Textures that aren't streamed are ignored.
+        void request(const bgfx::TextureHandle texture, const float mip, const uint32_t frame);
+        // Estimates the mip each texture of a material needs from the mesh's world space bounds, its uvDensity (uv
+        // units per world unit, see computeUvDensity) and projScale, the screen height in pixels over
+        // 2 * tan(fovY / 2), i.e. pixels per world unit at a distance of 1.
+        void requestForMesh(
+            const PBRMaterial& material,
+            const AABB& bounds,
+            const float uvDensity,
+            const glm::vec3& cameraPos,
+            const float projScale,
+            const uint32_t frame);
+
+        // Streams textures in and out, appending every handle that changed to outSwaps. Mips kept by textures that
+        // stream out are copied in blitView, which has to come before any view that samples them.
+        void update(const uint32_t frame, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps);
+
+        size_t getTextureCount() const { return textures.size(); }
+        const StreamedTextureInfo& getInfo(const size_t textureIdx) const { return textures[textureIdx].info; }
+        bgfx::TextureHandle getHandle(const size_t textureIdx) const { return textures[textureIdx].handle; }
+
+        const TextureStreamingParams& getParams() const { return params; }
+        void setParams(const TextureStreamingParams& _params) { params = _params; }
+        const TextureStreamingStats& getStats() const { return stats; }
+
+    private:
+        struct Texture
+        {
+            StreamedTextureInfo info;
+            uint64_t flags;
+            bgfx::TextureFormat::Enum format;
+            bgfx::TextureHandle handle;
+            // Size of mip i and every mip after it
+            std::vector<uint32_t> chainBytes;
+            uint32_t requestFrame;
+            // Bytes the loading thread's result will add, while it's decoding this texture
+            uint32_t loadingBytes;
+            bool loading;
+            // The update that last recreated it, which can't evict it again
+            uint32_t swapUpdate;
+        };
+
+        // Handed to the loading thread, with a copy of the path since textures can be added while it runs
+        struct LoadRequest
+        {
+            size_t textureIdx;
+            uint8_t mip;
+            std::string path;
+        };
+
+        struct LoadedImage
+        {
+            size_t textureIdx;
+            uint8_t mip;
+            // nullptr if the file couldn't be decoded
+            bimg::ImageContainer* image;
+        };
+
+        void runLoadingThread();
+        // Creates the textures the loading thread has finished decoding
+        void applyLoads(std::vector<TextureSwap>& outSwaps);
+        void queueLoad(const size_t textureIdx, const uint8_t mip);
+        void dropMips(Texture& texture, const uint8_t mip, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps);
+        void swapHandle(Texture& texture, const bgfx::TextureHandle handle, const uint8_t mip, std::vector<TextureSwap>& outSwaps);
+        // Drops a texture other than exclude back towards the mip it needs, least recently used first. Textures
+        // loading or already swapped this update are left alone. Returns false if nothing can be dropped.
+        bool evictOne(const size_t exclude, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps);
+
+        TextureStreamingParams params;
+        TextureStreamingStats stats;
+        std::vector<Texture> textures;
+        std::unordered_map<uint16_t, size_t> handleToTexture;
+        std::vector<size_t> upgrades;
+        uint32_t swapsThisUpdate = 0;
+        uint32_t updateCount = 0;
+        // Bytes and textures queued on the loading thread that haven't been applied yet
+        uint64_t loadingBytes = 0;
+        uint32_t loadsInFlight = 0;
+        bool blitSupported = false;
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<LoadRequest> loadQueue;
+        std::deque<LoadedImage> loaded;
+        std::vector<LoadedImage> finishedLoads;
+        std::atomic<bool> stopping{ false };
+    };
+
+    // Average uv units per world unit over a mesh's triangles, for estimating which mip its textures need
+    float computeUvDensity(const MeshData& meshData, const glm::mat4& transform);
+
+    // Points every material texture that was swapped at its new handle
+    void applyTextureSwaps(const std::vector<TextureSwap>& swaps, std::vector<PBRMaterial>& materials);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <bx/allocator.h>
+
+namespace bae
+{
+    // Who an allocation is for. Allocations are tagged with whatever tag is current on the calling thread, which is
+    // BGFX unless a ScopedAllocationTag says otherwise, since bgfx's own threads never set one.
+    enum struct AllocationTag : uint8_t
+    {
+        BGFX,
+        LOADER,
+        FRAME,
+        OTHER,
+        COUNT,
+    };
+
+    const char* getAllocationTagName(const AllocationTag tag);
+
+    // Sets the current thread's allocation tag until it goes out of scope
+    class ScopedAllocationTag
+    {
+    public:
+        explicit ScopedAllocationTag(const AllocationTag tag);
+        ~ScopedAllocationTag();
+
+        ScopedAllocationTag(const ScopedAllocationTag&) = delete;
+        ScopedAllocationTag& operator=(const ScopedAllocationTag&) = delete;
+
+    private:
+        AllocationTag previous;
+    };
+
+    static constexpr uint32_t ALLOCATION_TAG_COUNT = uint32_t(AllocationTag::COUNT);
+    // Requested sizes, bucket i holds sizes up to 16 << i bytes and the last one everything bigger
+    static constexpr uint32_t ALLOCATION_HISTOGRAM_BUCKETS = 17;
+    static constexpr uint32_t ALLOCATION_FRAME_HISTORY = 128;
+
+    struct AllocationTagStats
+    {
+        // Currently alive
+        uint64_t bytes = 0;
+        uint32_t allocations = 0;
+        uint64_t peakBytes = 0;
+        uint64_t totalAllocations = 0;
+    };
+
+    struct AllocationFrameStats
+    {
+        // A realloc counts as freeing the old block and allocating a new one
+        uint32_t allocations[ALLOCATION_TAG_COUNT] = {};
+        uint32_t frees[ALLOCATION_TAG_COUNT] = {};
+        uint64_t bytesAllocated[ALLOCATION_TAG_COUNT] = {};
+        uint32_t histogram[ALLOCATION_TAG_COUNT][ALLOCATION_HISTOGRAM_BUCKETS] = {};
+        // Served from the size classed pools, or passed on to malloc
+        uint32_t pooledAllocations = 0;
+        uint32_t heapAllocations = 0;
+
+        uint32_t getTotalAllocations() const;
+    };
+
+    struct TrackingAllocatorStats
+    {
+        AllocationTagStats tags[ALLOCATION_TAG_COUNT];
+        // Memory held by the pools, whether handed out or sitting in a free list
+        uint64_t pooledBytesReserved = 0;
+        // Frames in a row that allocated nothing, the render loop is in a steady state once this keeps growing
+        uint32_t quietFrames = 0;
+    };
+
+    // bx::AllocatorI that counts bytes and allocations per tag and per frame, and serves small allocations from
+    // size classed free lists instead of malloc. Pool memory is kept for reuse until the allocator is destroyed.
+    // Thread safe, bgfx calls it from both the API and the render thread.
+    //
+    // Install it before bgfx::init, and keep it alive until after bgfx::shutdown:
+    //   initInfo.allocator = bae::getTrackingAllocator();
+    //
+    // Usage, once per frame:
+    //   bgfx::frame();
+    //   bae::getTrackingAllocator()->endFrame();
+    class TrackingAllocator : public bx::AllocatorI
+    {
+    public:
+        static constexpr uint32_t SIZE_CLASS_COUNT = 15;
+        static constexpr uint32_t CHUNK_SIZE = 64u << 10;
+
+        TrackingAllocator();
+        ~TrackingAllocator() override;
+
+        void* realloc(void* ptr, size_t size, size_t align, const char* file, uint32_t line) override;
+
+        // Closes the current frame's stats and histograms, and starts the next one
+        void endFrame();
+
+        TrackingAllocatorStats getStats() const;
+        AllocationFrameStats getLastFrame() const;
+        // Allocations made during each of the last ALLOCATION_FRAME_HISTORY frames, oldest first
+        void getFrameHistory(float* outAllocations) const;
+
+        // Largest request that bucket can hold, UINT32_MAX for the last one
+        static uint32_t getHistogramBucketLimit(const uint32_t bucket);
+
+    private:
+        struct SizeClass
+        {
+            uint32_t blockSize;
+            void* freeList;
+            uint8_t* carveCursor;
+            uint8_t* carveEnd;
+        };
+
+        void* allocate(const size_t size, const size_t align, const AllocationTag tag);
+        void free(void* ptr);
+        void* allocateBlock(SizeClass& sizeClass);
+
+        mutable std::mutex mutex;
+        SizeClass sizeClasses[SIZE_CLASS_COUNT];
+        // Size class of every block size up to the largest one, in 16 byte steps
+        uint8_t sizeClassLookup[256];
+        // Linked through their first bytes
+        void* chunks = nullptr;
+
+        TrackingAllocatorStats stats;
+        AllocationFrameStats currentFrame;
+        AllocationFrameStats lastFrame;
+        uint32_t frameHistory[ALLOCATION_FRAME_HISTORY] = {};
+        uint32_t frameHistoryHead = 0;
+    };
+
+    // Shared by bgfx and bae's own tagged allocations, lives until the program exits
+    TrackingAllocator* getTrackingAllocator();
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bae
+{
+    // A page of a virtual texture, packed the same way the feedback pass writes it into an RGBA8 target, so a
+    // read back feedback buffer can be used as an array of page ids directly:
+    //   r: x & 0xff, g: y & 0xff, b: (x >> 8) | (y >> 8) << 2 | mip << 4, a: texture
+    // A texture of 0xff marks texels that didn't sample any virtual texture.
+    struct VirtualPage
+    {
+        static constexpr uint32_t MAX_PAGES_PER_SIDE = 1024;
+        static constexpr uint32_t MAX_MIPS = 16;
+        static constexpr uint8_t NO_TEXTURE = 0xff;
+
+        uint8_t texture = NO_TEXTURE;
+        uint8_t mip = 0;
+        uint16_t x = 0;
+        uint16_t y = 0;
+
+        uint32_t pack() const;
+        static VirtualPage unpack(const uint32_t packed);
+    };
+
+    struct VirtualPageTableParams
+    {
+        // Texels per page side, not counting the border
+        uint16_t pageSize = 128;
+        // Texels repeated from neighbouring pages on every side, so filtering never reads outside a page
+        uint16_t pageBorder = 4;
+        // Size of the physical page cache, in pages
+        uint16_t cacheWidth = 32;
+        uint16_t cacheHeight = 32;
+        // Pages uploaded per update at most, the rest stay requested until a later frame
+        uint32_t maxUploadsPerUpdate = 16;
+    };
+
+    // Where a virtual page lives in the physical cache
+    struct PhysicalSlot
+    {
+        static constexpr uint16_t INVALID = UINT16_MAX;
+
+        uint16_t x = 0;
+        uint16_t y = 0;
+    };
+
+    // One texel of a texture's indirection table: where to find the page covering it, which is either the page of
+    // that mip itself or, while it isn't resident, the closest coarser page that is. mip is that page's mip.
+    struct IndirectionEntry
+    {
+        uint8_t x = 0;
+        uint8_t y = 0;
+        uint8_t mip = 0;
+        uint8_t valid = 0;
+    };
+
+    // A page to copy into the physical cache. evicted is the page that used to live in the slot, if any.
+    struct PageUpload
+    {
+        VirtualPage page;
+        PhysicalSlot slot;
+        VirtualPage evicted;
+    };
+
+    struct VirtualPageTableStats
+    {
+        // Page ids passed to request, and how many distinct pages they came down to
+        uint32_t requests = 0;
+        uint32_t uniquePages = 0;
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint32_t uploads = 0;
+        uint32_t evictions = 0;
+        // Misses left for a later update, either because of the upload budget or because every slot is in use
+        uint32_t deferred = 0;
+        uint32_t residentPages = 0;
+    };
+
+    // CPU side of virtual texturing: which pages of which virtual textures are resident in the physical page
+    // cache, and where. Each frame, the pages sampled by the GPU (read back from a feedback pass) or estimated on
+    // the CPU from visible meshes are requested, then update picks which missing pages get uploaded, coarsest mips
+    // first, evicting the least recently used pages to make room. Pages used this frame are never evicted, and the
+    // single page of each texture's coarsest mip stays resident so every lookup has something to fall back to.
+    //
+    // Nothing here touches the GPU, so it can be driven and measured without one. VirtualTexture turns its uploads
+    // and indirection tables into texture updates.
+    //
+    // Usage, once per frame:
+    //   table.request(feedback, count);       // and/or requestArea for each visible mesh
+    //   table.update(frame, uploads);         // then upload each page and refresh dirty indirection tables
+    class VirtualPageTable
+    {
+    public:
+        void init(const VirtualPageTableParams& params);
+
+        // Width and height are in texels, and need to be a power of two multiple of the page size. Returns the
+        // texture's id, the first request for it will be its coarsest page.
+        uint8_t addTexture(const uint32_t width, const uint32_t height);
+
+        void request(const VirtualPage& page);
+        // Takes page ids as written by the feedback pass, ignoring texels that sampled nothing
+        void request(const uint32_t* packedPages, const size_t count);
+        // CPU estimate for a mesh covering the uv rectangle [uvMin, uvMax] of a texture, drawn across roughly
+        // screenWidth by screenHeight pixels. Requests every page of the mip that gives about a texel per pixel.
+        void requestArea(const uint8_t texture, const float uvMin[2], const float uvMax[2], const float screenWidth, const float screenHeight);
+
+        // Resolves this frame's requests. Appends the pages to upload to outUploads, every one of them already
+        // counted as resident, so their data has to be copied into the cache before anything samples them.
+        void update(const uint32_t frame, std::vector<PageUpload>& outUploads);
+
+        bool isResident(const VirtualPage& page) const;
+        IndirectionEntry lookup(const VirtualPage& page) const;
+        // Fills a mip of a texture's indirection table, pagesX(mip) * pagesY(mip) entries, rows top to bottom
+        void writeIndirection(const uint8_t texture, const uint8_t mip, IndirectionEntry* outEntries) const;
+        // Whether a texture's indirection table changed since the last call for it
+        bool takeDirty(const uint8_t texture);
+
+        uint8_t getTextureCount() const { return uint8_t(textures.size()); }
+        uint8_t getMipCount(const uint8_t texture) const { return uint8_t(textures[texture].mips.size()); }
+        uint16_t getPagesX(const uint8_t texture, const uint8_t mip) const { return textures[texture].mips[mip].pagesX; }
+        uint16_t getPagesY(const uint8_t texture, const uint8_t mip) const { return textures[texture].mips[mip].pagesY; }
+
+        const VirtualPageTableParams& getParams() const { return params; }
+        const VirtualPageTableStats& getStats() const { return stats; }
+
+    private:
+        struct Mip
+        {
+            uint16_t pagesX;
+            uint16_t pagesY;
+            // Slot index of each page, or PhysicalSlot::INVALID
+            std::vector<uint16_t> slots;
+        };
+
+        struct Texture
+        {
+            std::vector<Mip> mips;
+            bool dirty;
+        };
+
+        struct Slot
+        {
+            VirtualPage page;
+            uint32_t lastUsedFrame;
+            // Least recently used list, with UINT16_MAX as the end
+            uint16_t prev;
+            uint16_t next;
+            bool pinned;
+        };
+
+        uint16_t& getSlotIndex(const VirtualPage& page);
+        uint16_t getSlotIndex(const VirtualPage& page) const;
+        void unlink(const uint16_t slotIdx);
+        void pushBack(const uint16_t slotIdx);
+
+        VirtualPageTableParams params;
+        VirtualPageTableStats stats;
+        std::vector<Texture> textures;
+        std::vector<Slot> slots;
+        // Oldest and newest slots in use
+        uint16_t lruHead = PhysicalSlot::INVALID;
+        uint16_t lruTail = PhysicalSlot::INVALID;
+        // Slots that have never been used yet
+        std::vector<uint16_t> freeSlots;
+        // Packed page ids requested since the last update
+        std::vector<uint32_t> requested;
+        std::vector<VirtualPage> misses;
+    };
+
+    // Copies one page, with its border, out of a mip of an RGBA8 image, as an offline step to cut textures into
+    // pages. Borders past the image's edges repeat its edge texels. outTexels holds (pageSize + 2 * border)^2 texels.
+    void extractPage(
+        const uint32_t* mipTexels,
+        const uint32_t mipWidth,
+        const uint32_t mipHeight,
+        const uint16_t pageX,
+        const uint16_t pageY,
+        const uint16_t pageSize,
+        const uint16_t border,
+        uint32_t* outTexels);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+#include <glm/glm.hpp>
+
+#include "VirtualPageTable.h"
+
+namespace bae
+{
+    // GPU side of virtual texturing: the physical page cache every virtual texture's resident pages are copied
+    // into, and an indirection texture per virtual texture, with a texel per page and a mip per page table mip,
+    // pointing at the cache slot to sample. Shaders use examples/common/virtual_texture.sh to turn uvs into cache
+    // uvs, and to write the feedback that VirtualPageTable::request reads.
+    class VirtualTexture
+    {
+    public:
+        // Every texture has to be added to the table before this, since their indirection textures are created here
+        void init(const VirtualPageTable& table, const bgfx::TextureFormat::Enum format = bgfx::TextureFormat::RGBA8);
+        void destroy();
+
+        // Copies a page into its slot of the cache. texels holds the page with its borders, as extractPage writes it.
+        void uploadPage(const PageUpload& upload, const bgfx::Memory* texels);
+        // Rewrites the indirection texture of every virtual texture whose pages moved. The new entries are staged in
+        // the frame arena, which has to be reset every frame.
+        void updateIndirection(VirtualPageTable& table);
+
+        bgfx::TextureHandle getCache() const { return cache; }
+        bgfx::TextureHandle getIndirection(const uint8_t texture) const { return indirections[texture]; }
+
+        // u_vtParams, xy: pages per side at mip 0, z: page size, w: page border
+        glm::vec4 getParams(const uint8_t texture) const;
+        // u_vtInfo, xy: cache size in texels, z: coarsest mip, w: texture id for the feedback pass
+        glm::vec4 getInfo(const uint8_t texture) const;
+
+    private:
+        const VirtualPageTable* table = nullptr;
+        bgfx::TextureHandle cache = BGFX_INVALID_HANDLE;
+        std::vector<bgfx::TextureHandle> indirections;
+        uint16_t paddedPageSize = 0;
+    };
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "PhysicallyBasedScene.h"
+
+namespace bae
+{
+    // Each visibility buffer texel packs (drawID + 1) into the top bits and the triangle ID within that draw
+    // into the bottom ones, so that a cleared texel (zero) means nothing was drawn there.
+    // Needs to be kept in sync with visibility.sh.
+    constexpr uint32_t VISIBILITY_TRIANGLE_BITS = 20;
+    constexpr uint32_t VISIBILITY_MAX_TRIANGLES = 1u << VISIBILITY_TRIANGLE_BITS;
+    constexpr uint32_t VISIBILITY_MAX_DRAWS = (1u << (32 - VISIBILITY_TRIANGLE_BITS)) - 1;
+    // The resolve classifies tiles by material in group shared memory, with one more bin for empty pixels.
+    // Needs to be kept in sync with VISIBILITY_MAX_BINS in visibility.sh.
+    constexpr uint32_t VISIBILITY_MAX_MATERIALS = 255;
+
+    uint32_t packVisibilityId(const uint32_t drawId, const uint32_t triangleId);
+
+    // Returns false for texels that nothing was drawn to
+    bool unpackVisibilityId(const uint32_t packed, uint32_t& drawId, uint32_t& triangleId);
+
+    // Everything a visibility buffer resolve needs to rebuild a pixel's attributes, flattened into arrays
+    // of vec4s so that they can be uploaded as compute buffers. Vertices are pre-transformed into world space.
+    struct VisibilityScene
+    {
+        // xyz - Position, w - Texcoord U
+        std::vector<glm::vec4> positions;
+        // xyz - Normal, w - Texcoord V
+        std::vector<glm::vec4> normals;
+        // xyz - Tangent, w - Bitangent sign
+        std::vector<glm::vec4> tangents;
+        // xyz - Indices into the vertex arrays, stored as floats so they're exact up to 2^24 vertices
+        std::vector<glm::vec4> triangles;
+        // x - First triangle, y - Triangle count, z - Material index
+        std::vector<glm::vec4> draws;
+        // Materials shared by several meshes only show up once, so the resolve can run once per material
+        std::vector<PBRMaterial> materials;
+    };
+
+    // Frees the vertex and triangle arrays, for once they've been uploaded. The draws and materials are kept,
+    // since the resolve still binds each material's textures.
+    void releaseGeometry(VisibilityScene& scene);
+
+    // Appends one draw per mesh in the group, in the same order as the group's meshes.
+    // Requires the model to have been loaded with keepMeshData. Returns the draw ID of the first mesh.
+    uint32_t appendMeshGroup(VisibilityScene& scene, const MeshGroup& meshGroup);
+
+    // Barycentric coordinates of where a ray hits the plane of a triangle. Same math the resolve pass uses
+    // to rebuild attributes from a triangle ID, and still valid when the hit is outside the triangle,
+    // which is what we want for neighbouring pixels when computing texture derivatives.
+    glm::vec3 computeBarycentrics(
+        const glm::vec3& rayOrigin,
+        const glm::vec3& rayDirection,
+        const glm::vec3& p0,
+        const glm::vec3& p1,
+        const glm::vec3& p2);
+}
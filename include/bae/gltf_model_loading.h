@@ -4,6 +4,26 @@
 namespace bae
 {
     struct Model;
+    class GeometryPool;
+    class TextureArrays;
+    class TextureStreamer;
 
-    Model loadGltfModel(const std::string& assetPath, const std::string& fileName);
+    // Textures come from the shared TextureCache, so models that use the same files share their handles, and
+    // destroying a model only releases its references.
+    //
+    // A synchronous driver over parseGltfModel, so like it, it only takes float attributes.
+    //
+    // keepMeshData holds on to a CPU copy of every mesh's vertices and indices, for passes that need
+    // to read geometry outside of the regular vertex pipeline. With a geometryPool, meshes are allocated
+    // from its shared buffers instead of creating their own. With textureArrays, textures are packed into its arrays
+    // and materials reference arrays and layers, the arrays staying owned by textureArrays. With a textureStreamer,
+    // textures start out with only their smallest mips and are owned by the streamer, which can't be combined with
+    // textureArrays.
+    Model loadGltfModel(
+        const std::string& assetPath,
+        const std::string& fileName,
+        const bool keepMeshData = false,
+        GeometryPool* geometryPool = nullptr,
+        TextureArrays* textureArrays = nullptr,
+        TextureStreamer* textureStreamer = nullptr);
 }
\ No newline at end of file
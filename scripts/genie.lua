@@ -23,6 +23,11 @@ newoption {
     description = "Enable building examples."
 }
 
+newoption {
+    trigger = "with-tsan",
+    description = "Build everything with ThreadSanitizer, to run bae-test against data races."
+}
+
 BAE_DIR = (path.getabsolute("..") .. "/")
 DEPENDENCY_DIR = (BAE_DIR .. "deps/")
 EXAMPLES_DIR = (BAE_DIR .. "examples/")
@@ -68,6 +73,13 @@ if _OPTIONS["with-profiler"] then
     }
 end
 
+if _OPTIONS["with-tsan"] then
+    configuration {"linux-* or osx"}
+    buildoptions {"-fsanitize=thread"}
+    linkoptions {"-fsanitize=thread"}
+    configuration {}
+end
+
 function exampleProjectDefaults()
     debugdir(path.join(EXAMPLES_DIR, "runtime"))
 
@@ -267,9 +279,13 @@ exampleProject(
     "02-forward-rendering",
     "03-deferred-rendering",
     "04-pbr-ibl",
-    "05-shadow-mapping"
+    "05-shadow-mapping",
+    "06-gpu-driven-rendering"
 )
 
+group "tests"
+dofile("tests.lua")
+
 group "tools"
 dofile(path.join(BGFX_SCRIPTS_DIR, "shaderc.lua"))
 dofile(path.join(BGFX_SCRIPTS_DIR, "texturec.lua"))
@@ -0,0 +1,85 @@
+TESTS_DIR = path.join(BAE_DIR, "tests")
+
+function testProjectDefaults()
+  kind "ConsoleApp"
+
+  includedirs {
+    TESTS_DIR,
+    path.join(BAE_DIR, "include", "bae"),
+    path.join(BX_DIR, "include"),
+    path.join(BIMG_DIR, "include"),
+    path.join(BGFX_DIR, "include"),
+    path.join(BGFX_DIR, "examples/common"),
+    path.join(GLM_DIR, "include"),
+  }
+
+  flags {
+    "FatalWarnings"
+  }
+
+  links {
+    "bae",
+    "example-common",
+    "bgfx",
+    "bimg_decode",
+    "bimg",
+    "bx"
+  }
+
+  configuration {"vs20*", "x32 or x64"}
+  links {
+    "gdi32",
+    "psapi"
+  }
+
+  configuration {"mingw*"}
+  targetextension ".exe"
+  links {
+    "gdi32",
+    "psapi"
+  }
+
+  configuration {"linux-* or freebsd", "not linux-steamlink"}
+  links {
+    "X11",
+    "GL",
+    "pthread",
+    "dl"
+  }
+
+  configuration {"osx"}
+  linkoptions {
+    "-framework Cocoa",
+    "-framework QuartzCore",
+    "-framework OpenGL",
+    "-weak_framework Metal"
+  }
+
+  configuration {}
+
+  strip()
+end
+
+-- Checks of the CPU side logic that don't need a GPU or a window. Run from the repo root.
+project("bae-test")
+uuid(os.uuid("bae-test"))
+
+files {
+  path.join(TESTS_DIR, "test.h"),
+  path.join(TESTS_DIR, "test.cpp"),
+  path.join(TESTS_DIR, "*_test.cpp")
+}
+
+testProjectDefaults()
+
+-- Microbenchmarks of the same CPU side code. Build in release and run from the repo root.
+project("bae-bench")
+uuid(os.uuid("bae-bench"))
+
+files {
+  path.join(TESTS_DIR, "bench.h"),
+  path.join(TESTS_DIR, "bench.cpp"),
+  path.join(TESTS_DIR, "*_bench.cpp")
+}
+
+testProjectDefaults()
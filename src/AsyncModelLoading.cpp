@@ -0,0 +1,316 @@
+#include "AsyncModelLoading.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <bimg/bimg.h>
+#include "TextureCache.h"
+#include "TrackingAllocator.h"
+
+namespace bae
+{
+    void AsyncModelLoader::init(const AsyncLoadingParams& _params)
+    {
+        params = _params;
+        stats = {};
+        stopping = false;
+        thread = std::thread([this]() { runLoadingThread(); });
+    }
+
+    void AsyncModelLoader::destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            queue.clear();
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+
+        for (std::unique_ptr<Request>& request : requests) {
+            for (const DecodedTexture& decoded : request->textures) {
+                if (decoded.image != nullptr) {
+                    bimg::imageFree(decoded.image);
+                }
+            }
+            bae::destroy(request->model);
+        }
+        requests.clear();
+        stats = {};
+    }
+
+    ModelHandle AsyncModelLoader::load(
+        const std::string& assetPath,
+        const std::string& fileName,
+        const bool keepMeshData,
+        GeometryPool* geometryPool)
+    {
+        std::unique_ptr<Request> request(new Request);
+        request->assetPath = assetPath;
+        request->fileName = fileName;
+        request->keepMeshData = keepMeshData;
+        request->geometryPool = geometryPool;
+
+        ModelHandle handle{ uint32_t(requests.size()) };
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(request.get());
+        }
+        requests.push_back(std::move(request));
+        wake.notify_one();
+        return handle;
+    }
+
+    void AsyncModelLoader::runLoadingThread()
+    {
+        ScopedAllocationTag tag(AllocationTag::LOADER);
+        while (true) {
+            Request* request = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = queue.front();
+                queue.pop_front();
+            }
+
+            // Meshes first, so the model takes shape while its textures are still being decoded
+            std::vector<GltfSourceTexture> textures;
+            try {
+                parseGltfModel(
+                    request->assetPath,
+                    request->fileName,
+                    [&](GltfSource&& source) {
+                        textures = source.textures;
+                        std::lock_guard<std::mutex> lock(mutex);
+                        request->source = std::move(source);
+                        request->hasLayout = true;
+                    },
+                    [&](GltfSourceMesh&& mesh) {
+                        if (stopping) {
+                            throw std::runtime_error("Loading was stopped");
+                        }
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (request->cancelled) {
+                            throw std::runtime_error("Loading was cancelled");
+                        }
+                        request->meshes.push_back(std::move(mesh));
+                        ++request->parsedItems;
+                    });
+
+                for (uint32_t i = 0; i < uint32_t(textures.size()) && !stopping; ++i) {
+                    bimg::ImageContainer* image = decodeImageFile(textures[i].path);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (request->cancelled) {
+                        if (image != nullptr) {
+                            bimg::imageFree(image);
+                        }
+                        break;
+                    }
+                    request->textures.push_back({ i, image });
+                    ++request->parsedItems;
+                }
+            }
+            catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                request->loadError = e.what();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            request->parsed = true;
+        }
+    }
+
+    void AsyncModelLoader::update()
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        stats.meshesUploaded = 0;
+        stats.texturesUploaded = 0;
+        stats.bytesUploaded = 0;
+
+        bool budgetLeft = true;
+        for (std::unique_ptr<Request>& requestPtr : requests) {
+            Request& request = *requestPtr;
+            while (budgetLeft && request.state == ModelLoadState::LOADING) {
+                // Take one item off the loading thread's hands, then upload it without holding the lock
+                GltfSourceMesh mesh;
+                DecodedTexture texture = { 0, nullptr };
+                bool needsLayout = false;
+                bool hasMesh = false;
+                bool hasTexture = false;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!request.layoutApplied && request.hasLayout) {
+                        needsLayout = true;
+                    }
+                    else if (!request.meshes.empty()) {
+                        mesh = std::move(request.meshes.front());
+                        request.meshes.pop_front();
+                        hasMesh = true;
+                    }
+                    else if (!request.textures.empty()) {
+                        texture = request.textures.front();
+                        request.textures.pop_front();
+                        hasTexture = true;
+                    }
+                    else if (request.parsed) {
+                        request.error = request.loadError;
+                        request.state = request.error.empty() ? ModelLoadState::READY : ModelLoadState::FAILED;
+                    }
+                }
+                if (needsLayout) {
+                    applyLayout(request);
+                    continue;
+                }
+                if (!hasMesh && !hasTexture) {
+                    break;
+                }
+
+                if (hasMesh) {
+                    stats.bytesUploaded += uploadMesh(request, mesh);
+                    if (request.state == ModelLoadState::FAILED) {
+                        break;
+                    }
+                    ++stats.meshesUploaded;
+                }
+                else {
+                    stats.bytesUploaded += uploadTexture(request, texture);
+                    ++stats.texturesUploaded;
+                }
+                ++request.uploadedItems;
+
+                const std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+                budgetLeft = elapsed.count() < params.uploadBudgetMs && stats.bytesUploaded < params.uploadBudgetBytes;
+            }
+        }
+
+        const std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        stats.uploadMs = elapsed.count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.pendingUploads = 0;
+        for (const std::unique_ptr<Request>& request : requests) {
+            stats.pendingUploads += uint32_t(request->meshes.size() + request->textures.size());
+        }
+    }
+
+    float AsyncModelLoader::getProgress(const ModelHandle handle) const
+    {
+        const Request& request = *requests[handle.idx];
+        if (request.state != ModelLoadState::LOADING) {
+            return 1.0f;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        return request.parsedItems > 0 ? float(request.uploadedItems) / float(request.parsedItems) : 0.0f;
+    }
+
+    // Called without holding the lock: acquiring the dummies may load them from disk, and the loading thread is done
+    // with the request's source once it has handed it over
+    void AsyncModelLoader::applyLayout(Request& request)
+    {
+        // Every material starts out with the dummies, and picks up its own textures as they're uploaded
+        for (const char* dummyFile : GLTF_DUMMY_TEXTURE_FILES) {
+            request.model.textures.push_back(getTextureCache().acquire(dummyFile));
+        }
+        request.materials.reserve(request.source.materials.size());
+        for (const GltfSourceMaterial& sourceMaterial : request.source.materials) {
+            PBRMaterial material = sourceMaterial.material;
+            for (uint8_t slot = 0; slot < 5; ++slot) {
+                getTextureSlot(material, slot) = request.model.textures[GLTF_DUMMY_TEXTURE_FOR_SLOT[slot]];
+            }
+            request.materials.push_back(material);
+        }
+        request.layoutApplied = true;
+    }
+
+    uint32_t AsyncModelLoader::uploadMesh(Request& request, GltfSourceMesh& sourceMesh)
+    {
+        const MeshData& data = sourceMesh.data;
+        const Mesh mesh = createMesh(data, request.geometryPool);
+        if (request.geometryPool != nullptr && !mesh.geometry.isValid()) {
+            fail(request, "Geometry pool has no room left for a mesh of " + request.fileName);
+            return 0;
+        }
+        const uint32_t bytes = uint32_t(data.indices.size() * sizeof(uint16_t)
+            + data.positions.size() * (2 * sizeof(glm::vec3) + sizeof(glm::vec4) + sizeof(glm::vec2)));
+
+        const TransparencyMode mode = request.source.materials[sourceMesh.material].mode;
+        addMesh(request.model, mesh, request.materials[sourceMesh.material], mode, sourceMesh, request.keepMeshData);
+        request.meshMaterials[int(mode)].push_back(sourceMesh.material);
+        return bytes;
+    }
+
+    void AsyncModelLoader::fail(Request& request, const std::string& error)
+    {
+        request.error = error;
+        request.state = ModelLoadState::FAILED;
+
+        // Nothing else of it will be uploaded, so stop the loading thread from parsing more and drop what it already has
+        std::lock_guard<std::mutex> lock(mutex);
+        request.cancelled = true;
+        for (const DecodedTexture& decoded : request.textures) {
+            if (decoded.image != nullptr) {
+                bimg::imageFree(decoded.image);
+            }
+        }
+        request.textures.clear();
+        request.meshes.clear();
+    }
+
+    uint32_t AsyncModelLoader::uploadTexture(Request& request, const DecodedTexture& decoded)
+    {
+        const GltfSourceTexture& sourceTexture = request.source.textures[decoded.textureIdx];
+
+        // Another model may have loaded it since it was decoded
+        uint32_t bytes = 0;
+        bgfx::TextureHandle handle = getTextureCache().tryAcquire(sourceTexture.path, sourceTexture.flags);
+        if (!bgfx::isValid(handle) && decoded.image != nullptr) {
+            const bimg::ImageContainer& image = *decoded.image;
+            if (!image.m_cubeMap && image.m_depth == 1) {
+                handle = bgfx::createTexture2D(
+                    uint16_t(image.m_width),
+                    uint16_t(image.m_height),
+                    image.m_numMips > 1,
+                    image.m_numLayers,
+                    bgfx::TextureFormat::Enum(image.m_format),
+                    sourceTexture.flags,
+                    bgfx::copy(image.m_data, image.m_size));
+                bytes = image.m_size;
+            }
+            if (bgfx::isValid(handle)) {
+                bgfx::setName(handle, sourceTexture.path.c_str());
+                getTextureCache().add(sourceTexture.path, sourceTexture.flags, handle);
+            }
+        }
+        if (decoded.image != nullptr) {
+            bimg::imageFree(decoded.image);
+        }
+        if (!bgfx::isValid(handle)) {
+            std::cout << "Failed to load texture " << sourceTexture.path << ", keeping the dummy in its place" << std::endl;
+            return bytes;
+        }
+        request.model.textures.push_back(handle);
+
+        // Point every material that uses it at the texture, then refresh the meshes' copies of the materials
+        for (size_t i = 0; i < request.materials.size(); ++i) {
+            const GltfSourceMaterial& sourceMaterial = request.source.materials[i];
+            for (uint8_t slot = 0; slot < 5; ++slot) {
+                if (sourceMaterial.textures[slot] == int32_t(decoded.textureIdx)) {
+                    getTextureSlot(request.materials[i], slot) = handle;
+                }
+            }
+        }
+        MeshGroup* groups[] = { &request.model.opaqueMeshes, &request.model.maskedMeshes, &request.model.transparentMeshes };
+        for (int groupIdx = 0; groupIdx < 3; ++groupIdx) {
+            const std::vector<uint32_t>& meshMaterials = request.meshMaterials[groupIdx];
+            for (size_t i = 0; i < meshMaterials.size(); ++i) {
+                groups[groupIdx]->materials[i] = request.materials[meshMaterials[i]];
+            }
+        }
+        return bytes;
+    }
+}
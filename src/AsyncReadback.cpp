@@ -0,0 +1,99 @@
+#include "AsyncReadback.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace bae
+{
+    void AsyncReadback::init(const uint16_t _width, const uint16_t _height, const bgfx::TextureFormat::Enum format, const uint32_t ringSize, const char* name)
+    {
+        if (ringSize == 0) {
+            throw std::runtime_error("Async readback needs at least one slot");
+        }
+
+        width = _width;
+        height = _height;
+
+        bgfx::TextureInfo info;
+        bgfx::calcTextureSize(info, width, height, 1, false, false, 1, format);
+
+        slots.resize(ringSize);
+        for (Slot& slot : slots) {
+            slot.texture = bgfx::createTexture2D(width, height, false, 1, format, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK);
+            if (name != nullptr) {
+                bgfx::setName(slot.texture, name);
+            }
+            slot.data.resize(info.storageSize);
+            slot.inFlight = false;
+        }
+        latestData.resize(info.storageSize);
+        hasLatest = false;
+        nextSlot = 0;
+        resetStats();
+    }
+
+    void AsyncReadback::destroy()
+    {
+        for (Slot& slot : slots) {
+            if (bgfx::isValid(slot.texture)) {
+                bgfx::destroy(slot.texture);
+            }
+        }
+        slots.clear();
+        latestData.clear();
+        hasLatest = false;
+    }
+
+    bool AsyncReadback::request(const bgfx::ViewId viewId, const bgfx::TextureHandle source, const uint16_t sourceX, const uint16_t sourceY)
+    {
+        Slot& slot = slots[nextSlot];
+        if (slot.inFlight) {
+            ++stats.stalls;
+            return false;
+        }
+
+        bgfx::blit(viewId, slot.texture, 0, 0, source, sourceX, sourceY, width, height);
+        slot.readyFrame = bgfx::readTexture(slot.texture, slot.data.data());
+        // We're recording the frame after the one the last bgfx::frame() call returned
+        slot.requestFrame = currentFrame + 1;
+        slot.inFlight = true;
+
+        nextSlot = (nextSlot + 1) % uint32_t(slots.size());
+        ++stats.requested;
+        return true;
+    }
+
+    bool AsyncReadback::update(const uint32_t frame)
+    {
+        currentFrame = frame;
+
+        const Slot* newest = nullptr;
+        for (Slot& slot : slots) {
+            if (!slot.inFlight || frame < slot.readyFrame) {
+                continue;
+            }
+            slot.inFlight = false;
+
+            const uint32_t latency = frame - slot.requestFrame;
+            ++stats.completed;
+            stats.maxLatency = std::max(stats.maxLatency, latency);
+            stats.averageLatency += (float(latency) - stats.averageLatency) / float(stats.completed);
+
+            // Several slots can complete on the same frame if we've been skipping updates
+            if (newest == nullptr || slot.requestFrame > newest->requestFrame) {
+                newest = &slot;
+            }
+        }
+
+        if (newest == nullptr || (hasLatest && newest->requestFrame <= latestFrame)) {
+            return false;
+        }
+
+        std::memcpy(latestData.data(), newest->data.data(), latestData.size());
+        latestFrame = newest->requestFrame;
+        hasLatest = true;
+        stats.lastLatency = frame - newest->requestFrame;
+        return true;
+    }
+}
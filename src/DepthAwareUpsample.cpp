@@ -0,0 +1,149 @@
+#include "DepthAwareUpsample.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bae
+{
+    static const glm::vec3 LUMINANCE_WEIGHTS{ 0.2126f, 0.7152f, 0.0722f };
+
+    // Below this, we consider none of our low resolution samples to belong to the same surface
+    static constexpr float MIN_TOTAL_WEIGHT = 1e-4f;
+
+    static uint32_t getLowResSize(const uint32_t size, const uint32_t factor)
+    {
+        return (size + factor - 1) / factor;
+    }
+
+    float linearizeDepth(const float depth, const float nearZ, const float farZ)
+    {
+        return nearZ * farZ / (farZ - depth * (farZ - nearZ));
+    }
+
+    void downsampleMinMaxDepth(
+        const float* depth,
+        const uint32_t width,
+        const uint32_t height,
+        const uint32_t factor,
+        std::vector<float>& outDepth,
+        std::vector<uint32_t>& outSourceIndices)
+    {
+        const uint32_t lowWidth = getLowResSize(width, factor);
+        const uint32_t lowHeight = getLowResSize(height, factor);
+        outDepth.resize(lowWidth * lowHeight);
+        outSourceIndices.resize(lowWidth * lowHeight);
+
+        for (uint32_t y = 0; y < lowHeight; ++y) {
+            for (uint32_t x = 0; x < lowWidth; ++x) {
+                const bool takeMax = ((x + y) & 1) != 0;
+                uint32_t bestIdx = (y * factor) * width + x * factor;
+                for (uint32_t j = y * factor; j < std::min((y + 1) * factor, height); ++j) {
+                    for (uint32_t i = x * factor; i < std::min((x + 1) * factor, width); ++i) {
+                        const uint32_t idx = j * width + i;
+                        if (takeMax ? depth[idx] > depth[bestIdx] : depth[idx] < depth[bestIdx]) {
+                            bestIdx = idx;
+                        }
+                    }
+                }
+                outDepth[y * lowWidth + x] = depth[bestIdx];
+                outSourceIndices[y * lowWidth + x] = bestIdx;
+            }
+        }
+    }
+
+    void bilateralUpsample(
+        const glm::vec3* lowResColor,
+        const float* lowResDepth,
+        const float* fullResDepth,
+        const uint32_t width,
+        const uint32_t height,
+        const BilateralUpsampleParams& params,
+        glm::vec3* outColor)
+    {
+        const int lowWidth = int(getLowResSize(width, params.factor));
+        const int lowHeight = int(getLowResSize(height, params.factor));
+        const float invFactor = 1.0f / float(params.factor);
+
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const float depth = linearizeDepth(fullResDepth[y * width + x], params.nearZ, params.farZ);
+
+                // Position of our pixel center relative to the low resolution pixel centers
+                const float lowX = (float(x) + 0.5f) * invFactor - 0.5f;
+                const float lowY = (float(y) + 0.5f) * invFactor - 0.5f;
+                const int x0 = int(std::floor(lowX));
+                const int y0 = int(std::floor(lowY));
+                const float fx = lowX - float(x0);
+                const float fy = lowY - float(y0);
+
+                glm::vec3 color{ 0.0f };
+                float totalWeight = 0.0f;
+                glm::vec3 closestColor{ 0.0f };
+                float closestDiff = INFINITY;
+                for (int tap = 0; tap < 4; ++tap) {
+                    const int tapX = tap & 1;
+                    const int tapY = tap >> 1;
+                    const int sampleX = glm::clamp(x0 + tapX, 0, lowWidth - 1);
+                    const int sampleY = glm::clamp(y0 + tapY, 0, lowHeight - 1);
+                    const int sampleIdx = sampleY * lowWidth + sampleX;
+
+                    const float bilinear = (tapX ? fx : 1.0f - fx) * (tapY ? fy : 1.0f - fy);
+                    const float sampleDepth = linearizeDepth(lowResDepth[sampleIdx], params.nearZ, params.farZ);
+                    const float relativeDiff = std::abs(sampleDepth - depth) / (depth * params.depthSigma);
+                    const float weight = bilinear * std::exp(-relativeDiff * relativeDiff);
+
+                    color += weight * lowResColor[sampleIdx];
+                    totalWeight += weight;
+                    if (relativeDiff < closestDiff) {
+                        closestDiff = relativeDiff;
+                        closestColor = lowResColor[sampleIdx];
+                    }
+                }
+
+                outColor[y * width + x] = totalWeight > MIN_TOTAL_WEIGHT ? color / totalWeight : closestColor;
+            }
+        }
+    }
+
+    UpsampleError measureUpsampleError(
+        const float* depth,
+        const glm::vec3* radiance,
+        const uint32_t width,
+        const uint32_t height,
+        const BilateralUpsampleParams& params)
+    {
+        std::vector<float> lowResDepth;
+        std::vector<uint32_t> sourceIndices;
+        downsampleMinMaxDepth(depth, width, height, params.factor, lowResDepth, sourceIndices);
+
+        std::vector<glm::vec3> lowResColor(sourceIndices.size());
+        for (size_t i = 0; i < sourceIndices.size(); ++i) {
+            lowResColor[i] = radiance[sourceIndices[i]];
+        }
+
+        std::vector<glm::vec3> upsampled(size_t(width) * height);
+        bilateralUpsample(lowResColor.data(), lowResDepth.data(), depth, width, height, params, upsampled.data());
+
+        float sumSquaredError = 0.0f;
+        float sumSquaredReference = 0.0f;
+        float maxError = 0.0f;
+        float maxReference = 0.0f;
+        for (size_t i = 0; i < upsampled.size(); ++i) {
+            float reference = glm::dot(LUMINANCE_WEIGHTS, radiance[i]);
+            float error = glm::dot(LUMINANCE_WEIGHTS, upsampled[i]) - reference;
+            sumSquaredError += error * error;
+            sumSquaredReference += reference * reference;
+            maxError = std::max(maxError, std::abs(error));
+            maxReference = std::max(maxReference, reference);
+        }
+
+        UpsampleError upsampleError{};
+        if (sumSquaredReference > 0.0f) {
+            upsampleError.rmsRelative = std::sqrt(sumSquaredError / sumSquaredReference);
+        }
+        if (maxReference > 0.0f) {
+            upsampleError.maxRelative = maxError / maxReference;
+        }
+        return upsampleError;
+    }
+}
@@ -0,0 +1,34 @@
+#include "DepthReduction.h"
+
+#include <algorithm>
+
+namespace bae
+{
+    float linearizeDepth(const float depth, const float projection[16], const bool homogeneousDepth, const float nearZ, const float farZ)
+    {
+        const float ndcDepth = homogeneousDepth ? 2.0f * depth - 1.0f : depth;
+        const float viewDepth = projection[14] / (ndcDepth - projection[10]);
+        return std::min(std::max((viewDepth - nearZ) / (farZ - nearZ), 0.0f), 1.0f);
+    }
+
+    glm::vec2 reduceDepthMinMax(
+        const float* depth,
+        const uint32_t width,
+        const uint32_t height,
+        const float projection[16],
+        const bool homogeneousDepth,
+        const float nearZ,
+        const float farZ)
+    {
+        glm::vec2 minMax{ 1.0f, 0.0f };
+        const size_t count = size_t(width) * height;
+        for (size_t i = 0; i < count; ++i) {
+            if (depth[i] < 1.0f) {
+                const float linearDepth = linearizeDepth(depth[i], projection, homogeneousDepth, nearZ, farZ);
+                minMax.x = std::min(minMax.x, linearDepth);
+                minMax.y = std::max(minMax.y, linearDepth);
+            }
+        }
+        return minMax;
+    }
+}
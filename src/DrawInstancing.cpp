@@ -0,0 +1,105 @@
+#include "DrawInstancing.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace bae
+{
+    // Pooled meshes are told apart by their range, other meshes by the buffers they own
+    using MeshKey = std::tuple<const GeometryPool*, uint16_t, uint32_t, uint16_t, uint16_t>;
+
+    static MeshKey getMeshKey(const Mesh& mesh)
+    {
+        return std::make_tuple(
+            mesh.pool,
+            mesh.geometry.page,
+            mesh.geometry.firstIndex,
+            mesh.indexHandle.idx,
+            mesh.vertexHandles[0].idx);
+    }
+
+    static bool isSameBatch(const Mesh& a, const uint32_t materialA, const uint64_t stateA, const Mesh& b, const uint32_t materialB, const uint64_t stateB)
+    {
+        return getMeshKey(a) == getMeshKey(b) && materialA == materialB && stateA == stateB;
+    }
+
+    void DrawInstancer::begin()
+    {
+        draws.clear();
+        batches.clear();
+        stats = {};
+        blendRuns = 0;
+    }
+
+    void DrawInstancer::add(const Mesh& mesh, const uint32_t material, const uint64_t state, const glm::mat4& transform)
+    {
+        // Blended draws have to be submitted in the order they were added, so they only join the run of identical
+        // blended draws right before them
+        uint32_t blendRun = 0;
+        if ((state & BGFX_STATE_BLEND_MASK) != 0) {
+            const Draw* previous = draws.empty() ? nullptr : &draws.back();
+            const bool continuesRun = previous != nullptr
+                && previous->blendRun != 0
+                && isSameBatch(*previous->mesh, previous->material, previous->state, mesh, material, state);
+            blendRun = continuesRun ? previous->blendRun : ++blendRuns;
+        }
+        draws.push_back({ &mesh, material, state, blendRun, uint32_t(draws.size()), transform });
+    }
+
+    void DrawInstancer::end()
+    {
+        // Stable, so draws within a batch keep the order they were added in. std::stable_sort allocates a temporary
+        // buffer per call, but it's thread safe, and on draws this big it beats both std::sort with the order as a
+        // tie break and merging through frame arena memory (see draw_instancing_bench.cpp).
+        std::stable_sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) {
+            return std::make_tuple(a.blendRun, getMeshKey(*a.mesh), a.material, a.state) < std::make_tuple(b.blendRun, getMeshKey(*b.mesh), b.material, b.state);
+        });
+
+        for (uint32_t i = 0; i < uint32_t(draws.size()); ++i) {
+            const Draw& draw = draws[i];
+            if (!batches.empty()) {
+                InstanceBatch& last = batches.back();
+                if (draws[last.firstDraw].blendRun == draw.blendRun
+                    && isSameBatch(*last.mesh, last.material, last.state, *draw.mesh, draw.material, draw.state)) {
+                    ++last.count;
+                    continue;
+                }
+            }
+            batches.push_back({ draw.mesh, draw.material, draw.state, i, 1 });
+        }
+
+        // Submit batches in the order their first draw was added, so opaque draws added before transparent ones
+        // still go first, and blended runs go out in the order they were added. Each batch's first draw is also the
+        // earliest one added, thanks to the stable sort.
+        std::sort(batches.begin(), batches.end(), [this](const InstanceBatch& a, const InstanceBatch& b) {
+            return draws[a.firstDraw].order < draws[b.firstDraw].order;
+        });
+
+        stats.draws = uint32_t(draws.size());
+        stats.batches = uint32_t(batches.size());
+    }
+
+    bool DrawInstancer::setInstanceData(const size_t batchIdx)
+    {
+        const InstanceBatch& batch = batches[batchIdx];
+        if (!enabled || batch.count < 2) {
+            return false;
+        }
+        if (bgfx::getAvailInstanceDataBuffer(batch.count, INSTANCE_STRIDE) != batch.count) {
+            return false;
+        }
+
+        bgfx::InstanceDataBuffer instanceData;
+        bgfx::allocInstanceDataBuffer(&instanceData, batch.count, INSTANCE_STRIDE);
+        glm::mat4* transforms = reinterpret_cast<glm::mat4*>(instanceData.data);
+        for (uint32_t i = 0; i < batch.count; ++i) {
+            transforms[i] = draws[batch.firstDraw + i].transform;
+        }
+        bgfx::setInstanceDataBuffer(&instanceData);
+
+        ++stats.instancedBatches;
+        stats.instances += batch.count;
+        stats.drawsSaved += batch.count - 1;
+        return true;
+    }
+}
@@ -0,0 +1,147 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "TrackingAllocator.h"
+
+namespace bae
+{
+    static constexpr size_t BLOCK_ALIGNMENT = 64;
+
+    static uintptr_t alignUp(const uintptr_t value, const size_t align)
+    {
+        return (value + align - 1) & ~uintptr_t(align - 1);
+    }
+
+    uint8_t* FrameArena::allocateBlock(const uint32_t size)
+    {
+        ScopedAllocationTag tag(AllocationTag::FRAME);
+        bx::AllocatorI* allocator = getTrackingAllocator();
+        stats.capacity += size;
+        return static_cast<uint8_t*>(BX_ALIGNED_ALLOC(allocator, size, BLOCK_ALIGNMENT));
+    }
+
+    void FrameArena::freeBlock(const Block& block)
+    {
+        bx::AllocatorI* allocator = getTrackingAllocator();
+        stats.capacity -= block.size;
+        BX_ALIGNED_FREE(allocator, block.data, BLOCK_ALIGNMENT);
+    }
+
+    void FrameArena::init(const FrameArenaParams& _params)
+    {
+        destroy();
+        params = _params;
+
+        frames.resize(std::max(params.frameCount, 1u));
+        for (Frame& frame : frames) {
+            frame.blocks.push_back({ allocateBlock(params.capacity), params.capacity });
+        }
+        currentFrame = 0;
+    }
+
+    void FrameArena::destroy()
+    {
+        for (Frame& frame : frames) {
+            for (const Block& block : frame.blocks) {
+                freeBlock(block);
+            }
+        }
+        frames.clear();
+        stats = {};
+        frameAllocations = 0;
+        frameBytes = 0;
+    }
+
+    void* FrameArena::allocate(const size_t size, const size_t align)
+    {
+        if (frames.empty()) {
+            init(params);
+        }
+
+        ++frameAllocations;
+        frameBytes += uint32_t(size);
+
+        Frame& frame = frames[currentFrame];
+        while (true) {
+            const Block& block = frame.blocks[frame.block];
+            const uintptr_t start = reinterpret_cast<uintptr_t>(block.data);
+            const uintptr_t aligned = alignUp(start + frame.offset, align);
+            if (aligned + size <= start + block.size) {
+                frame.offset = uint32_t(aligned + size - start);
+                return reinterpret_cast<void*>(aligned);
+            }
+
+            // Move on to a block an earlier allocation already spilled into, or spill into a new one
+            if (frame.block + 1 == frame.blocks.size()) {
+                const uint32_t blockSize = std::max(uint32_t(size + align), params.capacity);
+                frame.blocks.push_back({ allocateBlock(blockSize), blockSize });
+                ++stats.overflowBlocks;
+            }
+            ++frame.block;
+            frame.offset = 0;
+        }
+    }
+
+    const bgfx::Memory* FrameArena::copy(const void* data, const uint32_t size)
+    {
+        void* ptr = allocate(size);
+        memcpy(ptr, data, size);
+        return bgfx::makeRef(ptr, size);
+    }
+
+    FrameArena::Marker FrameArena::getMarker() const
+    {
+        if (frames.empty()) {
+            return { 0, 0 };
+        }
+        const Frame& frame = frames[currentFrame];
+        return { frame.block, frame.offset };
+    }
+
+    void FrameArena::rewind(const Marker& marker)
+    {
+        if (frames.empty()) {
+            return;
+        }
+        Frame& frame = frames[currentFrame];
+        frame.block = marker.block;
+        frame.offset = marker.offset;
+    }
+
+    void FrameArena::resetFrame(Frame& frame)
+    {
+        // Replace the blocks a frame spilled into with a single one that fits all of it
+        if (frame.blocks.size() > 1) {
+            uint32_t size = 0;
+            for (const Block& block : frame.blocks) {
+                size += block.size;
+                freeBlock(block);
+            }
+            frame.blocks.clear();
+            frame.blocks.push_back({ allocateBlock(size), size });
+        }
+        frame.block = 0;
+        frame.offset = 0;
+    }
+
+    void FrameArena::endFrame()
+    {
+        if (frames.empty()) {
+            return;
+        }
+        currentFrame = (currentFrame + 1) % uint32_t(frames.size());
+        resetFrame(frames[currentFrame]);
+        stats.allocations = frameAllocations;
+        stats.bytesAllocated = frameBytes;
+        frameAllocations = 0;
+        frameBytes = 0;
+    }
+
+    FrameArena& getFrameArena()
+    {
+        static FrameArena arena;
+        return arena;
+    }
+}
@@ -0,0 +1,62 @@
+#include "GBufferEncoding.h"
+
+#include <cmath>
+
+namespace bae
+{
+    static glm::vec2 octahedronWrap(const glm::vec2& value)
+    {
+        return glm::vec2{
+            (1.0f - std::abs(value.y)) * (value.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(value.x)) * (value.y >= 0.0f ? 1.0f : -1.0f),
+        };
+    }
+
+    glm::vec2 encodeNormalOctahedron(const glm::vec3& normal)
+    {
+        glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+        glm::vec2 encoded = n.z >= 0.0f ? glm::vec2{ n.x, n.y } : octahedronWrap(glm::vec2{ n.x, n.y });
+        return encoded * 0.5f + 0.5f;
+    }
+
+    glm::vec3 decodeNormalOctahedron(const glm::vec2& encodedNormal)
+    {
+        glm::vec2 encoded = encodedNormal * 2.0f - 1.0f;
+
+        glm::vec3 normal;
+        normal.z = 1.0f - std::abs(encoded.x) - std::abs(encoded.y);
+        glm::vec2 xy = normal.z >= 0.0f ? encoded : octahedronWrap(encoded);
+        normal.x = xy.x;
+        normal.y = xy.y;
+        return glm::normalize(normal);
+    }
+
+    float quantizeUnorm(const float value, const uint32_t bits)
+    {
+        const float maxValue = float((1u << bits) - 1u);
+        return std::round(glm::clamp(value, 0.0f, 1.0f) * maxValue) / maxValue;
+    }
+
+    glm::vec2 quantizeUnorm(const glm::vec2& value, const uint32_t bits)
+    {
+        return glm::vec2{ quantizeUnorm(value.x, bits), quantizeUnorm(value.y, bits) };
+    }
+
+    glm::vec3 reconstructWorldPosition(
+        const glm::vec2& texcoord,
+        const float depth,
+        const glm::mat4& invViewProj,
+        const bool glslConventions)
+    {
+        glm::vec4 clip;
+        if (glslConventions) {
+            clip = glm::vec4{ texcoord * 2.0f - 1.0f, 2.0f * depth - 1.0f, 1.0f };
+        }
+        else {
+            clip = glm::vec4{ texcoord.x * 2.0f - 1.0f, (1.0f - texcoord.y) * 2.0f - 1.0f, depth, 1.0f };
+        }
+
+        glm::vec4 world = invViewProj * clip;
+        return glm::vec3{ world } / world.w;
+    }
+}
@@ -0,0 +1,224 @@
+#include "GeometryPool.h"
+
+#include <algorithm>
+
+namespace bae
+{
+    void RangeAllocator::init(const uint32_t _capacity)
+    {
+        capacity = _capacity;
+        allocated = 0;
+        freeRanges.clear();
+        if (capacity > 0) {
+            freeRanges.push_back({ 0, capacity });
+        }
+    }
+
+    uint32_t RangeAllocator::allocate(const uint32_t count)
+    {
+        if (count == 0) {
+            return INVALID_OFFSET;
+        }
+
+        // Best fit, so that big free ranges stay around for big meshes
+        size_t bestIdx = freeRanges.size();
+        for (size_t i = 0; i < freeRanges.size(); ++i) {
+            if (freeRanges[i].count >= count && (bestIdx == freeRanges.size() || freeRanges[i].count < freeRanges[bestIdx].count)) {
+                bestIdx = i;
+                if (freeRanges[i].count == count) {
+                    break;
+                }
+            }
+        }
+        if (bestIdx == freeRanges.size()) {
+            return INVALID_OFFSET;
+        }
+
+        Range& range = freeRanges[bestIdx];
+        const uint32_t offset = range.offset;
+        range.offset += count;
+        range.count -= count;
+        if (range.count == 0) {
+            freeRanges.erase(freeRanges.begin() + bestIdx);
+        }
+        allocated += count;
+        return offset;
+    }
+
+    void RangeAllocator::free(const uint32_t offset, const uint32_t count)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const Range& range, const uint32_t value) {
+            return range.offset < value;
+        });
+        const bool mergesPrev = next != freeRanges.begin() && (next - 1)->offset + (next - 1)->count == offset;
+        const bool mergesNext = next != freeRanges.end() && offset + count == next->offset;
+
+        if (mergesPrev && mergesNext) {
+            (next - 1)->count += count + next->count;
+            freeRanges.erase(next);
+        }
+        else if (mergesPrev) {
+            (next - 1)->count += count;
+        }
+        else if (mergesNext) {
+            next->offset = offset;
+            next->count += count;
+        }
+        else {
+            freeRanges.insert(next, { offset, count });
+        }
+        allocated -= count;
+    }
+
+    uint32_t RangeAllocator::getLargestFreeRange() const
+    {
+        uint32_t largest = 0;
+        for (const Range& range : freeRanges) {
+            largest = std::max(largest, range.count);
+        }
+        return largest;
+    }
+
+    void GeometryPool::init(const GeometryPoolParams& _params)
+    {
+        destroy();
+        params = _params;
+
+        decls[0].begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).end();
+        decls[1].begin().add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float).end();
+        decls[2].begin().add(bgfx::Attrib::Tangent, 4, bgfx::AttribType::Float).end();
+        decls[3].begin().add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+    }
+
+    void GeometryPool::destroy()
+    {
+        for (Page& page : pages) {
+            for (uint8_t i = 0; i < STREAM_COUNT; ++i) {
+                bgfx::destroy(page.vertexBuffers[i]);
+            }
+            bgfx::destroy(page.indexBuffer);
+        }
+        pages.clear();
+        rangeCount = 0;
+        failedAllocations = 0;
+    }
+
+    void GeometryPool::addPage()
+    {
+        Page page;
+        for (uint8_t i = 0; i < STREAM_COUNT; ++i) {
+            page.vertexBuffers[i] = bgfx::createDynamicVertexBuffer(params.verticesPerPage, decls[i]);
+        }
+        page.indexBuffer = bgfx::createDynamicIndexBuffer(params.indicesPerPage);
+        page.vertices.init(params.verticesPerPage);
+        page.indices.init(params.indicesPerPage);
+        pages.push_back(page);
+    }
+
+    GeometryRange GeometryPool::allocate(
+        const glm::vec3* positions,
+        const glm::vec3* normals,
+        const glm::vec4* tangents,
+        const glm::vec2* texcoords,
+        const uint32_t vertexCount,
+        const uint16_t* indices,
+        const uint32_t indexCount)
+    {
+        GeometryRange range;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+
+        for (size_t i = 0; i <= pages.size() && !range.isValid(); ++i) {
+            if (i == pages.size()) {
+                if (pages.size() >= params.maxPages) {
+                    break;
+                }
+                addPage();
+            }
+
+            Page& page = pages[i];
+            const uint32_t baseVertex = page.vertices.allocate(vertexCount);
+            if (baseVertex == RangeAllocator::INVALID_OFFSET) {
+                continue;
+            }
+            const uint32_t firstIndex = page.indices.allocate(indexCount);
+            if (firstIndex == RangeAllocator::INVALID_OFFSET) {
+                page.vertices.free(baseVertex, vertexCount);
+                continue;
+            }
+
+            range.page = uint16_t(i);
+            range.baseVertex = baseVertex;
+            range.firstIndex = firstIndex;
+        }
+
+        if (!range.isValid()) {
+            ++failedAllocations;
+            return range;
+        }
+
+        const Page& page = pages[range.page];
+        bgfx::update(page.vertexBuffers[0], range.baseVertex, bgfx::copy(positions, vertexCount * sizeof(glm::vec3)));
+        bgfx::update(page.vertexBuffers[1], range.baseVertex, bgfx::copy(normals, vertexCount * sizeof(glm::vec3)));
+        bgfx::update(page.vertexBuffers[2], range.baseVertex, bgfx::copy(tangents, vertexCount * sizeof(glm::vec4)));
+        bgfx::update(page.vertexBuffers[3], range.baseVertex, bgfx::copy(texcoords, vertexCount * sizeof(glm::vec2)));
+        bgfx::update(page.indexBuffer, range.firstIndex, bgfx::copy(indices, indexCount * sizeof(uint16_t)));
+        ++rangeCount;
+        return range;
+    }
+
+    void GeometryPool::free(const GeometryRange& range)
+    {
+        if (!range.isValid() || range.page >= pages.size()) {
+            return;
+        }
+
+        Page& page = pages[range.page];
+        page.vertices.free(range.baseVertex, range.vertexCount);
+        page.indices.free(range.firstIndex, range.indexCount);
+        --rangeCount;
+    }
+
+    void GeometryPool::setBuffers(const GeometryRange& range) const
+    {
+        const Page& page = pages[range.page];
+        for (uint8_t i = 0; i < STREAM_COUNT; ++i) {
+            bgfx::setVertexBuffer(i, page.vertexBuffers[i], range.baseVertex, range.vertexCount);
+        }
+        bgfx::setIndexBuffer(page.indexBuffer, range.firstIndex, range.indexCount);
+    }
+
+    static float getFragmentation(const uint32_t largestFree, const uint32_t totalFree)
+    {
+        return totalFree > 0 ? 1.0f - float(largestFree) / float(totalFree) : 0.0f;
+    }
+
+    GeometryPoolStats GeometryPool::getStats() const
+    {
+        GeometryPoolStats stats;
+        stats.pages = uint32_t(pages.size());
+        stats.ranges = rangeCount;
+        stats.failedAllocations = failedAllocations;
+
+        uint32_t largestFreeVertices = 0;
+        uint32_t largestFreeIndices = 0;
+        for (const Page& page : pages) {
+            stats.allocatedVertices += page.vertices.getAllocated();
+            stats.vertexCapacity += page.vertices.getCapacity();
+            stats.allocatedIndices += page.indices.getAllocated();
+            stats.indexCapacity += page.indices.getCapacity();
+            stats.freeVertexRanges += page.vertices.getFreeRangeCount();
+            stats.freeIndexRanges += page.indices.getFreeRangeCount();
+            largestFreeVertices = std::max(largestFreeVertices, page.vertices.getLargestFreeRange());
+            largestFreeIndices = std::max(largestFreeIndices, page.indices.getLargestFreeRange());
+        }
+
+        stats.vertexFragmentation = getFragmentation(largestFreeVertices, stats.vertexCapacity - stats.allocatedVertices);
+        stats.indexFragmentation = getFragmentation(largestFreeIndices, stats.indexCapacity - stats.allocatedIndices);
+        return stats;
+    }
+}
@@ -0,0 +1,188 @@
+#include "GpuCulling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bae
+{
+    static glm::vec4 getRow(const glm::mat4& mat, const int row)
+    {
+        return glm::vec4{ mat[0][row], mat[1][row], mat[2][row], mat[3][row] };
+    }
+
+    static glm::vec4 normalizePlane(const glm::vec4& plane)
+    {
+        return plane / glm::length(glm::vec3{ plane });
+    }
+
+    void extractFrustumPlanes(const glm::mat4& viewProj, const bool homogeneousDepth, glm::vec4 outPlanes[6])
+    {
+        const glm::vec4 row0 = getRow(viewProj, 0);
+        const glm::vec4 row1 = getRow(viewProj, 1);
+        const glm::vec4 row2 = getRow(viewProj, 2);
+        const glm::vec4 row3 = getRow(viewProj, 3);
+
+        outPlanes[0] = normalizePlane(row3 + row0);
+        outPlanes[1] = normalizePlane(row3 - row0);
+        outPlanes[2] = normalizePlane(row3 + row1);
+        outPlanes[3] = normalizePlane(row3 - row1);
+        // Clip space z goes from -w in OpenGL, and from 0 everywhere else
+        outPlanes[4] = normalizePlane(homogeneousDepth ? row3 + row2 : row2);
+        outPlanes[5] = normalizePlane(row3 - row2);
+    }
+
+    bool isBoxOutsideFrustum(const glm::vec4 planes[6], const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        for (int i = 0; i < 6; ++i) {
+            const glm::vec3 normal{ planes[i] };
+            // Corner furthest along the plane's normal, if that's behind the plane the whole box is
+            const glm::vec3 corner = glm::mix(boxMin, boxMax, glm::greaterThanEqual(normal, glm::vec3{ 0.0f }));
+            if (glm::dot(normal, corner) + planes[i].w < 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void HiZPyramid::build(const float* depth, const uint32_t width, const uint32_t height)
+    {
+        levels.clear();
+        if (width == 0 || height == 0) {
+            return;
+        }
+
+        levels.push_back({ width, height, std::vector<float>(depth, depth + size_t(width) * height) });
+
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            const Level& src = levels.back();
+            Level dst;
+            dst.width = std::max(src.width >> 1, 1u);
+            dst.height = std::max(src.height >> 1, 1u);
+            dst.depth.resize(size_t(dst.width) * dst.height);
+
+            for (uint32_t y = 0; y < dst.height; ++y) {
+                // The last row also takes the row left over when the source height is odd
+                const uint32_t yEnd = std::min(y == dst.height - 1 ? src.height : 2 * y + 2, src.height);
+                for (uint32_t x = 0; x < dst.width; ++x) {
+                    const uint32_t xEnd = std::min(x == dst.width - 1 ? src.width : 2 * x + 2, src.width);
+
+                    float maxDepth = 0.0f;
+                    for (uint32_t sy = 2 * y; sy < yEnd; ++sy) {
+                        for (uint32_t sx = 2 * x; sx < xEnd; ++sx) {
+                            maxDepth = std::max(maxDepth, src.depth[size_t(sy) * src.width + sx]);
+                        }
+                    }
+                    dst.depth[size_t(y) * dst.width + x] = maxDepth;
+                }
+            }
+            levels.push_back(std::move(dst));
+        }
+    }
+
+    bool isBoxOccluded(
+        const HiZPyramid& hiZ,
+        const glm::mat4& viewProj,
+        const bool homogeneousDepth,
+        const glm::vec3& boxMin,
+        const glm::vec3& boxMax)
+    {
+        if (hiZ.getLevelCount() == 0) {
+            return false;
+        }
+
+        glm::vec2 uvMin{ 1.0f };
+        glm::vec2 uvMax{ 0.0f };
+        float minDepth = 1.0f;
+        for (uint32_t i = 0; i < 8; ++i) {
+            const glm::vec3 corner{
+                (i & 1) ? boxMax.x : boxMin.x,
+                (i & 2) ? boxMax.y : boxMin.y,
+                (i & 4) ? boxMax.z : boxMin.z,
+            };
+            const glm::vec4 clip = viewProj * glm::vec4{ corner, 1.0f };
+            if (clip.w <= 0.0f) {
+                return false;
+            }
+
+            const glm::vec3 ndc = glm::vec3{ clip } / clip.w;
+            // Flip y, since our first row is the top of the screen
+            const glm::vec2 uv{ 0.5f * ndc.x + 0.5f, 0.5f - 0.5f * ndc.y };
+            uvMin = glm::min(uvMin, uv);
+            uvMax = glm::max(uvMax, uv);
+            minDepth = std::min(minDepth, homogeneousDepth ? 0.5f * ndc.z + 0.5f : ndc.z);
+        }
+
+        const uint32_t width = hiZ.getWidth(0);
+        const uint32_t height = hiZ.getHeight(0);
+        const glm::vec2 size{ float(width), float(height) };
+        const glm::ivec2 maxTexel{ int(width) - 1, int(height) - 1 };
+        const glm::ivec2 texelMin = glm::clamp(glm::ivec2{ glm::floor(glm::clamp(uvMin, 0.0f, 1.0f) * size) }, glm::ivec2{ 0 }, maxTexel);
+        const glm::ivec2 texelMax = glm::clamp(glm::ivec2{ glm::floor(glm::clamp(uvMax, 0.0f, 1.0f) * size) }, glm::ivec2{ 0 }, maxTexel);
+
+        // Smallest level where the box's footprint spans at most two texels in each direction
+        const int extent = std::max(texelMax.x - texelMin.x, texelMax.y - texelMin.y);
+        uint32_t level = 0;
+        while ((1 << level) < extent) {
+            ++level;
+        }
+        level = std::min(level, hiZ.getLevelCount() - 1);
+
+        // Texels past the end of a level are covered by its last row or column
+        const uint32_t levelWidth = hiZ.getWidth(level);
+        const uint32_t levelHeight = hiZ.getHeight(level);
+        const uint32_t x0 = std::min(uint32_t(texelMin.x) >> level, levelWidth - 1);
+        const uint32_t x1 = std::min(uint32_t(texelMax.x) >> level, levelWidth - 1);
+        const uint32_t y0 = std::min(uint32_t(texelMin.y) >> level, levelHeight - 1);
+        const uint32_t y1 = std::min(uint32_t(texelMax.y) >> level, levelHeight - 1);
+
+        float maxDepth = 0.0f;
+        for (uint32_t y = y0; y <= y1; ++y) {
+            for (uint32_t x = x0; x <= x1; ++x) {
+                maxDepth = std::max(maxDepth, hiZ.load(level, x, y));
+            }
+        }
+        return minDepth > maxDepth;
+    }
+
+    void cullDrawRecords(
+        const GpuDrawRecord* records,
+        const size_t count,
+        const glm::vec4 frustumPlanes[6],
+        const HiZPyramid* hiZ,
+        const glm::mat4& hiZViewProj,
+        const bool homogeneousDepth,
+        IndirectDrawArgs* outArgs,
+        GpuCullingStats* outStats)
+    {
+        GpuCullingStats stats;
+        for (size_t i = 0; i < count; ++i) {
+            const GpuDrawRecord& record = records[i];
+            const glm::vec3 boxMin{ record.boundsMin };
+            const glm::vec3 boxMax{ record.boundsMax };
+
+            bool visible = true;
+            if (isBoxOutsideFrustum(frustumPlanes, boxMin, boxMax)) {
+                visible = false;
+                ++stats.frustumCulled;
+            }
+            else if (hiZ != nullptr && isBoxOccluded(*hiZ, hiZViewProj, homogeneousDepth, boxMin, boxMax)) {
+                visible = false;
+                ++stats.occlusionCulled;
+            }
+            else {
+                ++stats.visible;
+            }
+
+            IndirectDrawArgs& args = outArgs[i];
+            args.indexCount = record.indexCount;
+            args.instanceCount = visible ? 1 : 0;
+            args.firstIndex = record.firstIndex;
+            args.baseVertex = record.baseVertex;
+            args.firstInstance = record.instanceIdx;
+        }
+
+        if (outStats != nullptr) {
+            *outStats = stats;
+        }
+    }
+}
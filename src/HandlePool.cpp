@@ -0,0 +1,33 @@
+#include "HandlePool.h"
+
+#include <deque>
+
+namespace bae
+{
+    static std::unordered_map<std::string, uint32_t> s_nameIds;
+    // A deque, so the strings handed out by getInternedName stay put as more are added
+    static std::deque<std::string> s_names;
+
+    uint32_t internName(const std::string& name)
+    {
+        const auto it = s_nameIds.find(name);
+        if (it != s_nameIds.end()) {
+            return it->second;
+        }
+        const uint32_t nameId = uint32_t(s_names.size());
+        s_names.push_back(name);
+        s_nameIds[name] = nameId;
+        return nameId;
+    }
+
+    uint32_t findInternedName(const std::string& name)
+    {
+        const auto it = s_nameIds.find(name);
+        return it != s_nameIds.end() ? it->second : UINT32_MAX;
+    }
+
+    const std::string& getInternedName(const uint32_t nameId)
+    {
+        return s_names[nameId];
+    }
+}
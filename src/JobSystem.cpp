@@ -0,0 +1,205 @@
+#include "JobSystem.h"
+
+namespace bae
+{
+    // Which queue the current thread owns, for threads started by a job system
+    struct WorkerIdentity
+    {
+        const JobSystem* system = nullptr;
+        uint32_t queueIdx = 0;
+    };
+    static thread_local WorkerIdentity s_worker;
+
+    void JobSystem::init(const JobSystemParams& _params)
+    {
+        destroy();
+        params = _params;
+
+        uint32_t workerCount = params.workerCount;
+        if (workerCount == 0) {
+            const uint32_t cores = std::thread::hardware_concurrency();
+            workerCount = cores > 1 ? cores - 1 : 0;
+        }
+
+        queues.resize(workerCount + 1);
+        for (std::unique_ptr<Queue>& queue : queues) {
+            queue.reset(new Queue());
+            queue->jobs.resize(std::max(params.queueCapacity, 1u));
+        }
+
+        stopping = false;
+        for (uint32_t i = 1; i <= workerCount; ++i) {
+            workers.emplace_back(&JobSystem::runWorker, this, i);
+        }
+    }
+
+    void JobSystem::destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        queues.clear();
+        queuedJobs = 0;
+    }
+
+    uint32_t JobSystem::getQueueIndex() const
+    {
+        return s_worker.system == this ? s_worker.queueIdx : 0;
+    }
+
+    bool JobSystem::push(Queue& queue, const Job& job)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        const uint32_t capacity = uint32_t(queue.jobs.size());
+        if (queue.size == capacity) {
+            return false;
+        }
+        queue.jobs[(queue.front + queue.size) % capacity] = job;
+        ++queue.size;
+        return true;
+    }
+
+    bool JobSystem::pop(Queue& queue, Job& outJob)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size == 0) {
+            return false;
+        }
+        --queue.size;
+        outJob = queue.jobs[(queue.front + queue.size) % queue.jobs.size()];
+        return true;
+    }
+
+    bool JobSystem::steal(Queue& queue, Job& outJob)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size == 0) {
+            return false;
+        }
+        outJob = queue.jobs[queue.front];
+        queue.front = (queue.front + 1) % uint32_t(queue.jobs.size());
+        --queue.size;
+        return true;
+    }
+
+    void JobSystem::execute(Queue& queue, const Job& job)
+    {
+        job.function(job.data, job.begin, job.end);
+        queue.jobsRun.fetch_add(1, std::memory_order_relaxed);
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void JobSystem::run(const Job& job, JobCounter& counter)
+    {
+        run(&job, 1, counter);
+    }
+
+    void JobSystem::run(const Job* jobs, const uint32_t count, JobCounter& counter)
+    {
+        if (count == 0) {
+            return;
+        }
+        counter.pending.fetch_add(count, std::memory_order_relaxed);
+
+        Queue& queue = *queues[getQueueIndex()];
+        uint32_t queued = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            Job job = jobs[i];
+            job.counter = &counter;
+            if (push(queue, job)) {
+                ++queued;
+            }
+            else {
+                queue.jobsRunInline.fetch_add(1, std::memory_order_relaxed);
+                execute(queue, job);
+            }
+        }
+        if (queued == 0) {
+            return;
+        }
+
+        // Pairs with the check in runWorker: either the worker sees the new jobs before going to sleep, or we see
+        // it asleep and wake it up, after it's actually waiting since we go through its mutex
+        queuedJobs.fetch_add(queued);
+        if (sleepingWorkers.load() > 0) {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            if (queued == 1) {
+                wake.notify_one();
+            }
+            else {
+                wake.notify_all();
+            }
+        }
+    }
+
+    bool JobSystem::runOne(const uint32_t queueIdx)
+    {
+        Job job;
+        Queue& queue = *queues[queueIdx];
+        if (pop(queue, job)) {
+            queuedJobs.fetch_sub(1);
+            execute(queue, job);
+            return true;
+        }
+
+        const uint32_t queueCount = uint32_t(queues.size());
+        for (uint32_t i = 1; i < queueCount; ++i) {
+            Queue& victim = *queues[(queueIdx + i) % queueCount];
+            if (steal(victim, job)) {
+                queuedJobs.fetch_sub(1);
+                queue.jobsStolen.fetch_add(1, std::memory_order_relaxed);
+                execute(queue, job);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void JobSystem::wait(JobCounter& counter)
+    {
+        const uint32_t queueIdx = getQueueIndex();
+        while (!counter.isDone()) {
+            if (!runOne(queueIdx)) {
+                // The last jobs are running on other threads
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void JobSystem::runWorker(const uint32_t queueIdx)
+    {
+        s_worker = { this, queueIdx };
+        while (true) {
+            if (runOne(queueIdx)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers.fetch_add(1);
+            wake.wait(lock, [this]() { return stopping || queuedJobs.load() > 0; });
+            sleepingWorkers.fetch_sub(1);
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    JobSystemStats JobSystem::getStats() const
+    {
+        JobSystemStats stats;
+        for (const std::unique_ptr<Queue>& queue : queues) {
+            stats.jobsRun += queue->jobsRun.load(std::memory_order_relaxed);
+            stats.jobsStolen += queue->jobsStolen.load(std::memory_order_relaxed);
+            stats.jobsRunInline += queue->jobsRunInline.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,314 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+namespace bae
+{
+    static constexpr float PI = 3.141592653589793f;
+    static const glm::vec3 LUMINANCE_WEIGHTS{ 0.2126f, 0.7152f, 0.0722f };
+
+    // Same falloff as karisFalloff in fs_point_light_volume.sc
+    static float karisFalloff(const float dist, const float lightRadius)
+    {
+        float ratio = dist / lightRadius;
+        float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+        return window * window / (dist * dist + 1.0f);
+    }
+
+    float estimateScreenCoverage(const glm::vec3& center, const float radius, const LightLODView& view)
+    {
+        const float screenArea = view.viewportWidth * view.viewportHeight;
+        const glm::vec3 toCenter = center - view.cameraPos;
+        const float distSq = glm::dot(toCenter, toCenter);
+        // Camera is inside the volume, so it can cover the whole screen
+        if (distSq <= radius * radius) {
+            return screenArea;
+        }
+        // Entirely behind the camera
+        if (glm::dot(toCenter, view.cameraForward) < -radius) {
+            return 0.0f;
+        }
+
+        float pixelRadius = 0.5f * view.viewportHeight * view.projScale * radius / std::sqrt(distSq - radius * radius);
+        return std::min(PI * pixelRadius * pixelRadius, screenArea);
+    }
+
+    // Size in pixels that a world space length would have if it was facing the camera at the given distance
+    static float projectedSize(const float worldSize, const float distance, const LightLODView& view)
+    {
+        return 0.5f * view.viewportHeight * view.projScale * worldSize / distance;
+    }
+
+    void LightTree::build(const glm::vec4* positionRadius, const glm::vec4* colorIntensity, const size_t count)
+    {
+        p_positionRadius = positionRadius;
+        p_colorIntensity = colorIntensity;
+        lightCount = count;
+
+        nodes.clear();
+        if (count == 0) {
+            return;
+        }
+        nodes.reserve(2 * count - 1);
+
+        lightIndices.resize(count);
+        for (uint32_t i = 0; i < uint32_t(count); ++i) {
+            lightIndices[i] = i;
+        }
+
+        buildRecursive(0, uint32_t(count));
+    }
+
+    uint32_t LightTree::buildRecursive(uint32_t first, uint32_t last)
+    {
+        uint32_t nodeIdx = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        if (last - first == 1) {
+            const glm::vec4& positionRadius = p_positionRadius[lightIndices[first]];
+            const glm::vec4& colorIntensity = p_colorIntensity[lightIndices[first]];
+
+            Node& leaf = nodes[nodeIdx];
+            leaf.position = glm::vec3{ positionRadius };
+            leaf.boundsMin = leaf.position;
+            leaf.boundsMax = leaf.position;
+            leaf.color = glm::vec3{ colorIntensity };
+            leaf.intensity = colorIntensity.w;
+            leaf.radius = positionRadius.w;
+            leaf.spread = 0.0f;
+            leaf.extent = positionRadius.w;
+            leaf.lightCount = 1;
+            return nodeIdx;
+        }
+
+        // Split along the longest axis of the light positions, at the median
+        glm::vec3 boundsMin{ p_positionRadius[lightIndices[first]] };
+        glm::vec3 boundsMax = boundsMin;
+        for (uint32_t i = first + 1; i < last; ++i) {
+            glm::vec3 position{ p_positionRadius[lightIndices[i]] };
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        glm::vec3 boundsSize = boundsMax - boundsMin;
+        int axis = 0;
+        if (boundsSize.y > boundsSize[axis]) {
+            axis = 1;
+        }
+        if (boundsSize.z > boundsSize[axis]) {
+            axis = 2;
+        }
+
+        uint32_t mid = first + (last - first) / 2;
+        const glm::vec4* positions = p_positionRadius;
+        std::nth_element(
+            lightIndices.begin() + first,
+            lightIndices.begin() + mid,
+            lightIndices.begin() + last,
+            [positions, axis](const uint32_t a, const uint32_t b) {
+                return positions[a][axis] < positions[b][axis];
+            });
+
+        // Careful, recursing invalidates references into nodes
+        uint32_t left = buildRecursive(first, mid);
+        uint32_t right = buildRecursive(mid, last);
+
+        const Node& leftNode = nodes[left];
+        const Node& rightNode = nodes[right];
+        Node node{};
+        node.left = left;
+        node.right = right;
+        node.lightCount = leftNode.lightCount + rightNode.lightCount;
+        node.boundsMin = boundsMin;
+        node.boundsMax = boundsMax;
+        node.intensity = leftNode.intensity + rightNode.intensity;
+        if (node.intensity > 0.0f) {
+            node.position = (leftNode.position * leftNode.intensity + rightNode.position * rightNode.intensity) / node.intensity;
+            node.color = (leftNode.color * leftNode.intensity + rightNode.color * rightNode.intensity) / node.intensity;
+        }
+        else {
+            node.position = 0.5f * (leftNode.position + rightNode.position);
+            node.color = 0.5f * (leftNode.color + rightNode.color);
+        }
+        float leftDist = glm::length(leftNode.position - node.position);
+        float rightDist = glm::length(rightNode.position - node.position);
+        node.spread = std::max(leftDist + leftNode.spread, rightDist + rightNode.spread);
+        node.extent = std::max(leftDist + leftNode.extent, rightDist + rightNode.extent);
+        // Radius of the representative light is only known once we have a falloff epsilon
+        node.radius = 0.0f;
+
+        nodes[nodeIdx] = node;
+        return nodeIdx;
+    }
+
+    void LightTree::selectLights(
+        const LightLODView& view,
+        const LightLODParams& params,
+        std::vector<glm::vec4>& outPositionRadius,
+        std::vector<glm::vec4>& outColorIntensity,
+        LightLODStats* stats)
+    {
+        outPositionRadius.clear();
+        outColorIntensity.clear();
+
+        LightLODStats localStats{};
+        localStats.inputLights = uint32_t(lightCount);
+
+        if (nodes.empty()) {
+            if (stats != nullptr) {
+                *stats = localStats;
+            }
+            return;
+        }
+
+        const uint32_t budget = std::max(params.lightBudget, 1u);
+
+        // Adds a node to the cut, unless it's too small to matter, in which case all its lights are dropped
+        cutHeap.clear();
+        auto pushNode = [&](const uint32_t nodeIdx) {
+            const Node& node = nodes[nodeIdx];
+            if (estimateScreenCoverage(node.position, node.extent, view) < params.minScreenCoverage) {
+                localStats.droppedLights += node.lightCount;
+                return;
+            }
+
+            // Leaves can't be refined any further, so they always sit at the bottom of the heap
+            float priority = 0.0f;
+            if (node.lightCount > 1) {
+                float distance = glm::length(node.position - view.cameraPos);
+                priority = distance > node.spread
+                    ? projectedSize(node.spread, distance, view)
+                    : std::numeric_limits<float>::max();
+            }
+            cutHeap.emplace_back(priority, nodeIdx);
+            std::push_heap(cutHeap.begin(), cutHeap.end());
+        };
+
+        pushNode(0);
+        while (!cutHeap.empty()) {
+            const std::pair<float, uint32_t> top = cutHeap.front();
+            // Everything left in the cut is small enough to be represented by a single light
+            if (top.first <= params.mergeThreshold) {
+                break;
+            }
+            // Splitting a node grows our cut by one
+            if (cutHeap.size() + 1 > budget) {
+                break;
+            }
+
+            std::pop_heap(cutHeap.begin(), cutHeap.end());
+            cutHeap.pop_back();
+            pushNode(nodes[top.second].left);
+            pushNode(nodes[top.second].right);
+        }
+
+        outPositionRadius.reserve(cutHeap.size());
+        outColorIntensity.reserve(cutHeap.size());
+        for (const auto& entry : cutHeap) {
+            const Node& node = nodes[entry.second];
+            float radius = node.radius;
+            if (node.lightCount > 1) {
+                radius = std::sqrt(node.intensity / params.falloffEpsilon);
+                localStats.mergedLights += node.lightCount;
+            }
+            outPositionRadius.emplace_back(node.position, radius);
+            outColorIntensity.emplace_back(node.color, node.intensity);
+        }
+        localStats.outputLights = uint32_t(cutHeap.size());
+
+        if (stats != nullptr) {
+            *stats = localStats;
+        }
+    }
+
+    static glm::vec3 accumulateIrradiance(const glm::vec3& point, const glm::vec4* positionRadius, const glm::vec4* colorIntensity, const size_t count)
+    {
+        glm::vec3 irradiance{ 0.0f };
+        for (size_t i = 0; i < count; ++i) {
+            float dist = glm::length(glm::vec3{ positionRadius[i] } - point);
+            if (dist < positionRadius[i].w) {
+                irradiance += glm::vec3{ colorIntensity[i] } * colorIntensity[i].w * karisFalloff(dist, positionRadius[i].w);
+            }
+        }
+        return irradiance;
+    }
+
+    LightingError computeLightingError(
+        const glm::vec4* referencePositionRadius,
+        const glm::vec4* referenceColorIntensity,
+        const size_t referenceCount,
+        const glm::vec4* positionRadius,
+        const glm::vec4* colorIntensity,
+        const size_t count,
+        const std::vector<glm::vec3>& samplePoints,
+        JobSystem* jobSystem)
+    {
+        struct ErrorSums
+        {
+            float squaredError;
+            float squaredReference;
+            float maxError;
+            float maxReference;
+        };
+
+        // Summed per chunk of samples, then the chunks in order, so the result doesn't depend on how many threads
+        // there were
+        constexpr uint32_t SAMPLES_PER_CHUNK = 64;
+        const uint32_t sampleCount = uint32_t(samplePoints.size());
+        const uint32_t chunkCount = (sampleCount + SAMPLES_PER_CHUNK - 1) / SAMPLES_PER_CHUNK;
+        FrameArena& arena = getFrameArena();
+        const FrameArena::Marker marker = arena.getMarker();
+        ErrorSums* chunkSums = arena.allocate<ErrorSums>(chunkCount);
+
+        auto sumChunks = [&](const uint32_t beginChunk, const uint32_t endChunk) {
+            for (uint32_t chunk = beginChunk; chunk < endChunk; ++chunk) {
+                ErrorSums sums{};
+                const uint32_t end = std::min((chunk + 1) * SAMPLES_PER_CHUNK, sampleCount);
+                for (uint32_t i = chunk * SAMPLES_PER_CHUNK; i < end; ++i) {
+                    const glm::vec3& point = samplePoints[i];
+                    float reference = glm::dot(LUMINANCE_WEIGHTS, accumulateIrradiance(point, referencePositionRadius, referenceColorIntensity, referenceCount));
+                    float approximation = glm::dot(LUMINANCE_WEIGHTS, accumulateIrradiance(point, positionRadius, colorIntensity, count));
+                    float error = approximation - reference;
+                    sums.squaredError += error * error;
+                    sums.squaredReference += reference * reference;
+                    sums.maxError = std::max(sums.maxError, std::abs(error));
+                    sums.maxReference = std::max(sums.maxReference, reference);
+                }
+                chunkSums[chunk] = sums;
+            }
+        };
+        if (jobSystem != nullptr) {
+            jobSystem->parallelFor(chunkCount, 1, sumChunks);
+        }
+        else {
+            sumChunks(0, chunkCount);
+        }
+
+        // The RMS error is normalized by the RMS of the reference, and the max error by the brightest
+        // reference sample, so that both are independent of our total brightness
+        float sumSquaredError = 0.0f;
+        float sumSquaredReference = 0.0f;
+        float maxError = 0.0f;
+        float maxReference = 0.0f;
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk) {
+            sumSquaredError += chunkSums[chunk].squaredError;
+            sumSquaredReference += chunkSums[chunk].squaredReference;
+            maxError = std::max(maxError, chunkSums[chunk].maxError);
+            maxReference = std::max(maxReference, chunkSums[chunk].maxReference);
+        }
+        arena.rewind(marker);
+
+        LightingError lightingError{};
+        if (sumSquaredReference > 0.0f) {
+            lightingError.rmsRelative = std::sqrt(sumSquaredError / sumSquaredReference);
+        }
+        if (maxReference > 0.0f) {
+            lightingError.maxRelative = maxError / maxReference;
+        }
+        return lightingError;
+    }
+}
@@ -0,0 +1,164 @@
+#include "OcclusionQueries.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace bae
+{
+    // Unit cube from (0, 0, 0) to (1, 1, 1), scaled onto each mesh's bounds
+    static const glm::vec3 PROXY_VERTICES[8] = {
+        { 0.0f, 0.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f },
+        { 1.0f, 1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f },
+        { 1.0f, 0.0f, 1.0f },
+        { 0.0f, 1.0f, 1.0f },
+        { 1.0f, 1.0f, 1.0f },
+    };
+
+    // Proxies are drawn without culling, so winding doesn't matter
+    static const uint16_t PROXY_INDICES[36] = {
+        0, 1, 2, 1, 3, 2,
+        4, 6, 5, 5, 6, 7,
+        0, 2, 4, 4, 2, 6,
+        1, 5, 3, 5, 7, 3,
+        0, 4, 1, 4, 5, 1,
+        2, 3, 6, 6, 3, 7,
+    };
+
+    static bool containsPoint(const AABB& bounds, const glm::vec3& point, const float margin)
+    {
+        return glm::all(glm::greaterThanEqual(point, bounds.min - margin))
+            && glm::all(glm::lessThanEqual(point, bounds.max + margin));
+    }
+
+    void OcclusionQueries::init(const AABB* bounds, const size_t count, const OcclusionQueryParams& _params)
+    {
+        params = _params;
+        stats = OcclusionQueryStats{};
+
+        bgfx::VertexDecl decl;
+        decl.begin()
+            .add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+            .end();
+        proxyVertices = bgfx::createVertexBuffer(bgfx::makeRef(PROXY_VERTICES, sizeof(PROXY_VERTICES)), decl);
+        proxyIndices = bgfx::createIndexBuffer(bgfx::makeRef(PROXY_INDICES, sizeof(PROXY_INDICES)));
+
+        meshQueries.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            MeshQuery& meshQuery = meshQueries[i];
+            // Loaded bounds can have min and max swapped by the mesh's transform
+            meshQuery.bounds = { glm::min(bounds[i].min, bounds[i].max), glm::max(bounds[i].min, bounds[i].max) };
+            if (glm::length(meshQuery.bounds.max - meshQuery.bounds.min) >= params.minBoundsSize) {
+                // bgfx has a fixed number of queries, meshes beyond that just aren't tested
+                meshQuery.query = bgfx::createOcclusionQuery();
+            }
+            if (bgfx::isValid(meshQuery.query)) {
+                ++stats.testedMeshes;
+            }
+        }
+    }
+
+    void OcclusionQueries::destroy()
+    {
+        for (MeshQuery& meshQuery : meshQueries) {
+            if (bgfx::isValid(meshQuery.query)) {
+                bgfx::destroy(meshQuery.query);
+            }
+        }
+        meshQueries.clear();
+
+        if (bgfx::isValid(proxyVertices)) {
+            bgfx::destroy(proxyVertices);
+            bgfx::destroy(proxyIndices);
+        }
+        proxyVertices = BGFX_INVALID_HANDLE;
+        proxyIndices = BGFX_INVALID_HANDLE;
+    }
+
+    void OcclusionQueries::update(const OcclusionMode mode, const glm::vec3& cameraPos)
+    {
+        const uint32_t testedMeshes = stats.testedMeshes;
+        stats = OcclusionQueryStats{};
+        stats.testedMeshes = testedMeshes;
+
+        for (MeshQuery& meshQuery : meshQueries) {
+            const bool wasSkipped = meshQuery.drawMode == DrawMode::SKIP;
+            meshQuery.drawMode = DrawMode::DRAW;
+            meshQuery.submitProxy = false;
+            if (mode == OcclusionMode::DISABLED || !bgfx::isValid(meshQuery.query)) {
+                continue;
+            }
+
+            // Whatever the GPU has finished with by now, which is the result of an earlier frame's proxy
+            const bgfx::OcclusionQueryResult::Enum result = bgfx::getResult(meshQuery.query);
+            if (result == bgfx::OcclusionQueryResult::NoResult) {
+                ++stats.pendingResults;
+            }
+            else {
+                const bool visible = result == bgfx::OcclusionQueryResult::Visible;
+                if (visible && !meshQuery.visible && wasSkipped) {
+                    ++stats.poppingErrors;
+                }
+                meshQuery.visible = visible;
+            }
+
+            if (containsPoint(meshQuery.bounds, cameraPos, params.cameraMargin)) {
+                meshQuery.visible = true;
+                continue;
+            }
+
+            meshQuery.submitProxy = true;
+            ++stats.queries;
+            if (!meshQuery.visible) {
+                ++stats.occludedMeshes;
+                if (mode == OcclusionMode::SKIP_OCCLUDED) {
+                    meshQuery.drawMode = DrawMode::SKIP;
+                    ++stats.skippedDraws;
+                }
+                else {
+                    meshQuery.drawMode = DrawMode::CONDITIONAL;
+                    ++stats.conditionalDraws;
+                }
+            }
+        }
+    }
+
+    void OcclusionQueries::submitProxies(const bgfx::ViewId viewId, const bgfx::ProgramHandle program) const
+    {
+        // Depth test only, against whatever the prepass left behind
+        const uint64_t stateProxy = 0 | BGFX_STATE_DEPTH_TEST_LEQUAL;
+
+        for (const MeshQuery& meshQuery : meshQueries) {
+            if (!meshQuery.submitProxy) {
+                continue;
+            }
+
+            glm::mat4 transform = glm::translate(glm::mat4{ 1.0f }, meshQuery.bounds.min);
+            transform = glm::scale(transform, meshQuery.bounds.max - meshQuery.bounds.min);
+
+            bgfx::setTransform(glm::value_ptr(transform));
+            bgfx::setVertexBuffer(0, proxyVertices);
+            bgfx::setIndexBuffer(proxyIndices);
+            bgfx::setState(stateProxy);
+            bgfx::submit(viewId, program, meshQuery.query);
+        }
+    }
+
+    bool OcclusionQueries::prepareDraw(const size_t meshIdx, const bool conditional) const
+    {
+        if (meshIdx >= meshQueries.size()) {
+            return true;
+        }
+
+        const MeshQuery& meshQuery = meshQueries[meshIdx];
+        if (meshQuery.drawMode == DrawMode::SKIP) {
+            return false;
+        }
+        if (conditional && meshQuery.drawMode == DrawMode::CONDITIONAL) {
+            bgfx::setCondition(meshQuery.query, true);
+        }
+        return true;
+    }
+}
@@ -1,9 +1,15 @@
 #include "PhysicallyBasedScene.h"
 
+#include "TextureCache.h"
+
 namespace bae
 {
     void destroy(const Mesh& mesh)
     {
+        if (mesh.pool != nullptr) {
+            mesh.pool->free(mesh.geometry);
+            return;
+        }
         for (uint8_t i = 0; i < mesh.numVertexHandles; ++i) {
             bgfx::destroy(mesh.vertexHandles[i]);
         }
@@ -23,8 +29,10 @@ namespace bae
             destroy(mesh);
         }
 
+        // Textures can be shared with other models, so they're only destroyed once nothing uses them anymore
         for (const bgfx::TextureHandle texture : model.textures) {
-            bgfx::destroy(texture);
+            getTextureCache().release(texture);
         }
+        model.textures.clear();
     }
 }
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "PointShadows.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bae
+{
+    bool PointShadowLight::isReady() const
+    {
+        for (const PointShadowFace& face : faces) {
+            if (!face.valid) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool sphereOverlapsBox(const glm::vec4& positionRadius, const AABB& box)
+    {
+        const glm::vec3 center{ positionRadius };
+        const glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        const glm::vec3 offset = closest - center;
+        return glm::dot(offset, offset) <= positionRadius.w * positionRadius.w;
+    }
+
+    static bool boundsEqual(const AABB& a, const AABB& b)
+    {
+        return a.min == b.min && a.max == b.max;
+    }
+
+    void PointShadowAtlas::init(
+        const uint16_t width,
+        const uint16_t height,
+        const PointShadowParams& _params,
+        const bool _homogeneousDepth)
+    {
+        params = _params;
+        params.minFaceSize = std::max<uint16_t>(params.minFaceSize, 1);
+        params.maxFaceSize = std::max(params.maxFaceSize, params.minFaceSize);
+        // Every face of a light is drawn in the same frame, so we need room for at least one light
+        params.maxFaceUpdates = std::max(params.maxFaceUpdates, POINT_SHADOW_FACES);
+        homogeneousDepth = _homogeneousDepth;
+        atlas.init(width, height, params.minFaceSize);
+        reset();
+    }
+
+    void PointShadowAtlas::reset()
+    {
+        atlas.reset();
+        slots.clear();
+        shadowedSlots.clear();
+        faceUpdates.clear();
+        faceCasters.clear();
+        previousCasterBounds.clear();
+        repackAtlas = false;
+    }
+
+    void PointShadowAtlas::getFaceBasis(const uint32_t face, glm::vec3& right, glm::vec3& up, glm::vec3& forward)
+    {
+        static const glm::vec3 forwards[POINT_SHADOW_FACES] = {
+            { 1.0f, 0.0f, 0.0f },
+            { -1.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, -1.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, -1.0f },
+        };
+        static const glm::vec3 ups[POINT_SHADOW_FACES] = {
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, -1.0f },
+            { 0.0f, 0.0f, 1.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+        };
+        forward = forwards[face];
+        up = ups[face];
+        // Left handed, same as our cameras
+        right = glm::cross(up, forward);
+    }
+
+    bool PointShadowAtlas::faceOverlapsBox(const glm::vec4& positionRadius, const uint32_t face, const AABB& box)
+    {
+        if (!sphereOverlapsBox(positionRadius, box)) {
+            return false;
+        }
+
+        // A face sees the square pyramid where its axis coordinate is at least as large as the other two, so
+        // test the box against each of the four side planes
+        const glm::vec3 boxMin = box.min - glm::vec3{ positionRadius };
+        const glm::vec3 boxMax = box.max - glm::vec3{ positionRadius };
+        const uint32_t axis = face / 2;
+        const float maxAlongAxis = face % 2 == 0 ? boxMax[axis] : -boxMin[axis];
+        for (uint32_t other = 0; other < 3; ++other) {
+            if (other == axis) {
+                continue;
+            }
+            if (maxAlongAxis + boxMax[other] < 0.0f || maxAlongAxis - boxMin[other] < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    glm::mat4 PointShadowAtlas::getFaceView(const uint32_t slot, const uint32_t face) const
+    {
+        glm::vec3 right, up, forward;
+        getFaceBasis(face, right, up, forward);
+        const glm::vec3 position{ slots[slot].positionRadius };
+
+        glm::mat4 view{ 1.0f };
+        for (int i = 0; i < 3; ++i) {
+            view[i][0] = right[i];
+            view[i][1] = up[i];
+            view[i][2] = forward[i];
+        }
+        view[3][0] = -glm::dot(right, position);
+        view[3][1] = -glm::dot(up, position);
+        view[3][2] = -glm::dot(forward, position);
+        return view;
+    }
+
+    glm::mat4 PointShadowAtlas::getFaceProjection(const uint32_t slot) const
+    {
+        const float nearPlane = params.nearPlane;
+        const float farPlane = std::max(slots[slot].positionRadius.w, nearPlane * 2.0f);
+        const float depthRange = farPlane - nearPlane;
+
+        // 90 degree field of view, so x and y are unscaled
+        glm::mat4 proj{ 0.0f };
+        proj[0][0] = 1.0f;
+        proj[1][1] = 1.0f;
+        proj[2][3] = 1.0f;
+        if (homogeneousDepth) {
+            proj[2][2] = (farPlane + nearPlane) / depthRange;
+            proj[3][2] = -2.0f * farPlane * nearPlane / depthRange;
+        }
+        else {
+            proj[2][2] = farPlane / depthRange;
+            proj[3][2] = -farPlane * nearPlane / depthRange;
+        }
+        return proj;
+    }
+
+    uint16_t PointShadowAtlas::getFaceSize(const float coverage) const
+    {
+        // Each face covers roughly a quarter of the light's footprint on screen, in each dimension
+        const float idealSize = 0.5f * std::sqrt(coverage);
+        uint32_t size = params.minFaceSize;
+        while (float(size) < idealSize && size < params.maxFaceSize) {
+            size <<= 1;
+        }
+        return uint16_t(std::min<uint32_t>(size, params.maxFaceSize));
+    }
+
+    void PointShadowAtlas::freeSlot(PointShadowLight& slot)
+    {
+        for (PointShadowFace& face : slot.faces) {
+            atlas.free(face.region);
+            face = PointShadowFace{};
+        }
+        slot.faceSize = 0;
+    }
+
+    bool PointShadowAtlas::allocateSlot(PointShadowLight& slot, uint16_t faceSize)
+    {
+        slot.requestedFaceSize = faceSize;
+        // Fall back to smaller faces before giving up on the light altogether
+        while (faceSize >= params.minFaceSize) {
+            bool allocated = true;
+            for (PointShadowFace& face : slot.faces) {
+                face = PointShadowFace{};
+                face.region = atlas.allocate(faceSize);
+                if (!face.region.isValid()) {
+                    allocated = false;
+                    break;
+                }
+            }
+            if (allocated) {
+                slot.faceSize = faceSize;
+                return true;
+            }
+            freeSlot(slot);
+            faceSize >>= 1;
+        }
+        return false;
+    }
+
+    void PointShadowAtlas::update(
+        const glm::vec4* positionRadius,
+        const glm::vec4* colorIntensity,
+        const uint32_t lightCount,
+        const LightLODView& view,
+        const AABB* casterBounds,
+        const uint32_t casterCount)
+    {
+        stats = PointShadowStats{};
+        shadowedSlots.clear();
+        faceUpdates.clear();
+        faceCasters.clear();
+
+        // Lights with the largest, brightest footprint on screen get shadows first
+        lightOrder.clear();
+        lightImportance.resize(lightCount);
+        for (uint32_t i = 0; i < lightCount; ++i) {
+            const float coverage = positionRadius[i].w > 0.0f
+                ? estimateScreenCoverage(glm::vec3{ positionRadius[i] }, positionRadius[i].w, view)
+                : 0.0f;
+            lightImportance[i] = coverage * colorIntensity[i].w;
+            if (lightImportance[i] > 0.0f) {
+                lightOrder.push_back(i);
+            }
+        }
+        const float* importance = lightImportance.data();
+        std::sort(lightOrder.begin(), lightOrder.end(), [importance](const uint32_t a, const uint32_t b) {
+            return importance[a] != importance[b] ? importance[a] > importance[b] : a < b;
+        });
+        if (lightOrder.size() > params.maxShadowedLights) {
+            stats.skippedLights += uint32_t(lightOrder.size()) - params.maxShadowedLights;
+            lightOrder.resize(params.maxShadowedLights);
+        }
+
+        // An allocation failed last frame, so start over with an empty atlas rather than live with fragmentation
+        if (repackAtlas) {
+            atlas.reset();
+            slots.clear();
+            repackAtlas = false;
+        }
+
+        // Release lights that dropped out of the budget, before we allocate space for new ones
+        for (PointShadowLight& slot : slots) {
+            slot.active = std::find(lightOrder.begin(), lightOrder.end(), slot.lightIdx) != lightOrder.end();
+            if (!slot.active) {
+                freeSlot(slot);
+            }
+        }
+        slots.erase(
+            std::remove_if(slots.begin(), slots.end(), [](const PointShadowLight& slot) { return !slot.active; }),
+            slots.end());
+
+        for (const uint32_t lightIdx : lightOrder) {
+            auto it = std::find_if(slots.begin(), slots.end(), [lightIdx](const PointShadowLight& slot) {
+                return slot.lightIdx == lightIdx;
+            });
+            const float coverage = estimateScreenCoverage(
+                glm::vec3{ positionRadius[lightIdx] }, positionRadius[lightIdx].w, view);
+            const uint16_t faceSize = getFaceSize(coverage);
+
+            if (it == slots.end()) {
+                PointShadowLight slot{};
+                slot.lightIdx = lightIdx;
+                slot.active = true;
+                if (!allocateSlot(slot, faceSize)) {
+                    ++stats.allocationFailures;
+                    ++stats.skippedLights;
+                    repackAtlas = true;
+                    continue;
+                }
+                slots.push_back(slot);
+                it = slots.end() - 1;
+            }
+            // Grow straight away, but only shrink once we're well below the current size, so a light sitting
+            // near a threshold doesn't reallocate (and redraw) every frame
+            else if (faceSize > it->requestedFaceSize || faceSize < it->faceSize / 2) {
+                freeSlot(*it);
+                if (!allocateSlot(*it, faceSize)) {
+                    ++stats.allocationFailures;
+                    ++stats.skippedLights;
+                    repackAtlas = true;
+                    slots.erase(it);
+                    continue;
+                }
+            }
+            it->importance = importance[lightIdx];
+        }
+
+        // Work out which faces are out of date
+        movedCasters.clear();
+        const bool casterCountChanged = previousCasterBounds.size() != casterCount;
+        for (uint32_t i = 0; i < casterCount && !casterCountChanged; ++i) {
+            if (!boundsEqual(previousCasterBounds[i], casterBounds[i])) {
+                movedCasters.push_back(i);
+            }
+        }
+
+        for (PointShadowLight& slot : slots) {
+            const glm::vec4& current = positionRadius[slot.lightIdx];
+            const bool lightMoved = current != slot.positionRadius;
+            for (uint32_t face = 0; face < POINT_SHADOW_FACES; ++face) {
+                PointShadowFace& shadowFace = slot.faces[face];
+                if (!shadowFace.valid || lightMoved || casterCountChanged) {
+                    shadowFace.dirty = true;
+                    continue;
+                }
+                for (const uint32_t caster : movedCasters) {
+                    if (faceOverlapsBox(current, face, previousCasterBounds[caster])
+                        || faceOverlapsBox(current, face, casterBounds[caster])) {
+                        shadowFace.dirty = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Lights without any shadows yet go first, then the ones that have waited longest, then the most important
+        // ones. A light's faces are all drawn from the same position, so we redraw every dirty face of a light or none.
+        slotOrder.clear();
+        for (uint32_t i = 0; i < slots.size(); ++i) {
+            slotOrder.push_back(i);
+        }
+        const PointShadowLight* slotData = slots.data();
+        std::sort(slotOrder.begin(), slotOrder.end(), [slotData](const uint32_t a, const uint32_t b) {
+            const bool readyA = slotData[a].isReady();
+            const bool readyB = slotData[b].isReady();
+            if (readyA != readyB) {
+                return !readyA;
+            }
+            if (slotData[a].staleFrames != slotData[b].staleFrames) {
+                return slotData[a].staleFrames > slotData[b].staleFrames;
+            }
+            if (slotData[a].importance != slotData[b].importance) {
+                return slotData[a].importance > slotData[b].importance;
+            }
+            return a < b;
+        });
+
+        uint32_t remainingFaces = params.maxFaceUpdates;
+        for (const uint32_t slotIdx : slotOrder) {
+            PointShadowLight& slot = slots[slotIdx];
+            uint32_t dirtyFaces = 0;
+            for (const PointShadowFace& face : slot.faces) {
+                dirtyFaces += face.dirty ? 1 : 0;
+            }
+            if (dirtyFaces == 0) {
+                continue;
+            }
+            if (dirtyFaces > remainingFaces) {
+                stats.deferredFaces += dirtyFaces;
+                ++slot.staleFrames;
+                continue;
+            }
+            remainingFaces -= dirtyFaces;
+            slot.staleFrames = 0;
+
+            slot.positionRadius = positionRadius[slot.lightIdx];
+            for (uint32_t face = 0; face < POINT_SHADOW_FACES; ++face) {
+                PointShadowFace& shadowFace = slot.faces[face];
+                if (!shadowFace.dirty) {
+                    continue;
+                }
+
+                PointShadowFaceUpdate faceUpdate{};
+                faceUpdate.slot = slotIdx;
+                faceUpdate.face = face;
+                faceUpdate.casterBegin = uint32_t(faceCasters.size());
+                for (uint32_t caster = 0; caster < casterCount; ++caster) {
+                    if (faceOverlapsBox(slot.positionRadius, face, casterBounds[caster])) {
+                        faceCasters.push_back(caster);
+                    }
+                }
+                faceUpdate.casterCount = uint32_t(faceCasters.size()) - faceUpdate.casterBegin;
+                faceUpdates.push_back(faceUpdate);
+
+                shadowFace.valid = true;
+                shadowFace.dirty = false;
+                ++stats.renderedFaces;
+                stats.casterDraws += faceUpdate.casterCount;
+            }
+        }
+
+        for (uint32_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].isReady()) {
+                shadowedSlots.push_back(i);
+            }
+        }
+        std::sort(shadowedSlots.begin(), shadowedSlots.end(), [slotData](const uint32_t a, const uint32_t b) {
+            return slotData[a].importance != slotData[b].importance ? slotData[a].importance > slotData[b].importance : a < b;
+        });
+        stats.shadowedLights = uint32_t(shadowedSlots.size());
+        stats.cachedFaces = stats.shadowedLights * POINT_SHADOW_FACES;
+        for (const PointShadowFaceUpdate& faceUpdate : faceUpdates) {
+            stats.cachedFaces -= slots[faceUpdate.slot].isReady() ? 1 : 0;
+        }
+
+        previousCasterBounds.assign(casterBounds, casterBounds + casterCount);
+    }
+}
@@ -0,0 +1,287 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace bae
+{
+    static bool isPowerOfTwo(const uint32_t value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    static uint32_t packPosition(const uint16_t x, const uint16_t y)
+    {
+        return uint32_t(x) | (uint32_t(y) << 16);
+    }
+
+    void ShadowAtlas::init(const uint16_t _width, const uint16_t _height, const uint16_t _minRegionSize)
+    {
+        if (!isPowerOfTwo(_width) || !isPowerOfTwo(_height) || !isPowerOfTwo(_minRegionSize)) {
+            throw std::runtime_error("Shadow atlas dimensions need to be powers of two");
+        }
+
+        width = _width;
+        height = _height;
+        rootSize = std::min(width, height);
+        if (_minRegionSize > rootSize) {
+            throw std::runtime_error("Shadow atlas minimum region size is larger than the atlas");
+        }
+        minRegionSize = _minRegionSize;
+
+        uint32_t levelCount = 1;
+        for (uint16_t size = rootSize; size > minRegionSize; size >>= 1) {
+            ++levelCount;
+        }
+        freeNodes.resize(levelCount);
+
+        reset();
+    }
+
+    void ShadowAtlas::reset()
+    {
+        for (auto& nodes : freeNodes) {
+            nodes.clear();
+        }
+        allocatedTexels = 0;
+
+        // Pushed in reverse, so that we fill the atlas from the top left
+        for (uint32_t y = height; y > 0; y -= rootSize) {
+            for (uint32_t x = width; x > 0; x -= rootSize) {
+                freeNodes[0].push_back(packPosition(uint16_t(x - rootSize), uint16_t(y - rootSize)));
+            }
+        }
+    }
+
+    uint32_t ShadowAtlas::getLevel(const uint16_t size) const
+    {
+        uint32_t level = 0;
+        for (uint16_t levelSize = rootSize; levelSize > size; levelSize >>= 1) {
+            ++level;
+        }
+        return level;
+    }
+
+    bool ShadowAtlas::takeFreeNode(const uint32_t level, uint16_t& x, uint16_t& y)
+    {
+        std::vector<uint32_t>& nodes = freeNodes[level];
+        if (nodes.empty()) {
+            return false;
+        }
+        x = uint16_t(nodes.back() & 0xffff);
+        y = uint16_t(nodes.back() >> 16);
+        nodes.pop_back();
+        return true;
+    }
+
+    bool ShadowAtlas::removeFreeNode(const uint32_t level, const uint16_t x, const uint16_t y)
+    {
+        std::vector<uint32_t>& nodes = freeNodes[level];
+        auto it = std::find(nodes.begin(), nodes.end(), packPosition(x, y));
+        if (it == nodes.end()) {
+            return false;
+        }
+        nodes.erase(it);
+        return true;
+    }
+
+    uint16_t ShadowAtlas::getRegionSize(const uint16_t size) const
+    {
+        uint16_t regionSize = minRegionSize;
+        while (regionSize < size) {
+            regionSize <<= 1;
+        }
+        return regionSize;
+    }
+
+    ShadowAtlasRegion ShadowAtlas::allocate(const uint16_t size)
+    {
+        if (size == 0 || size > rootSize || freeNodes.empty()) {
+            return ShadowAtlasRegion{};
+        }
+
+        const uint16_t regionSize = getRegionSize(size);
+        const uint32_t level = getLevel(regionSize);
+
+        // Find the smallest free node that our region fits in
+        uint32_t sourceLevel = level + 1;
+        while (sourceLevel > 0 && freeNodes[sourceLevel - 1].empty()) {
+            --sourceLevel;
+        }
+        if (sourceLevel == 0) {
+            return ShadowAtlasRegion{};
+        }
+        --sourceLevel;
+
+        ShadowAtlasRegion region{};
+        takeFreeNode(sourceLevel, region.x, region.y);
+
+        // Split it down to the size we need, keeping the top left quadrant each time
+        for (uint32_t splitLevel = sourceLevel + 1; splitLevel <= level; ++splitLevel) {
+            const uint16_t childSize = uint16_t(rootSize >> splitLevel);
+            std::vector<uint32_t>& nodes = freeNodes[splitLevel];
+            nodes.push_back(packPosition(region.x + childSize, region.y + childSize));
+            nodes.push_back(packPosition(region.x, region.y + childSize));
+            nodes.push_back(packPosition(region.x + childSize, region.y));
+        }
+
+        region.size = regionSize;
+        allocatedTexels += uint32_t(regionSize) * regionSize;
+        return region;
+    }
+
+    void ShadowAtlas::free(const ShadowAtlasRegion& region)
+    {
+        if (!region.isValid()) {
+            return;
+        }
+        allocatedTexels -= uint32_t(region.size) * region.size;
+
+        uint32_t level = getLevel(region.size);
+        uint16_t x = region.x;
+        uint16_t y = region.y;
+        uint16_t size = region.size;
+
+        // Merge with our siblings for as long as they're all free
+        while (level > 0) {
+            const uint16_t parentSize = uint16_t(size << 1);
+            const uint16_t parentX = uint16_t(x - x % parentSize);
+            const uint16_t parentY = uint16_t(y - y % parentSize);
+            const uint32_t siblings[4] = {
+                packPosition(parentX, parentY),
+                packPosition(parentX + size, parentY),
+                packPosition(parentX, parentY + size),
+                packPosition(parentX + size, parentY + size),
+            };
+
+            const std::vector<uint32_t>& nodes = freeNodes[level];
+            bool siblingsFree = true;
+            for (uint32_t sibling : siblings) {
+                if (sibling != packPosition(x, y) && std::find(nodes.begin(), nodes.end(), sibling) == nodes.end()) {
+                    siblingsFree = false;
+                    break;
+                }
+            }
+            if (!siblingsFree) {
+                break;
+            }
+
+            for (uint32_t sibling : siblings) {
+                if (sibling != packPosition(x, y)) {
+                    removeFreeNode(level, uint16_t(sibling & 0xffff), uint16_t(sibling >> 16));
+                }
+            }
+            x = parentX;
+            y = parentY;
+            size = parentSize;
+            --level;
+        }
+
+        freeNodes[level].push_back(packPosition(x, y));
+    }
+
+    void ShadowAtlas::pack(const uint16_t* requestedSizes, const size_t count, ShadowAtlasRegion* outRegions)
+    {
+        packSizes.resize(count);
+        packOrder.resize(count);
+        uint64_t requestedTexels = 0;
+        for (size_t i = 0; i < count; ++i) {
+            packSizes[i] = requestedSizes[i] == 0 ? 0 : getRegionSize(std::min(requestedSizes[i], rootSize));
+            requestedTexels += uint64_t(packSizes[i]) * packSizes[i];
+            packOrder[i] = i;
+        }
+
+        // Scale down the largest requests until everything fits, rather than leaving the last ones without space.
+        // Ties go to the later request, so callers can put their most important casters first.
+        const uint64_t freeTexels = uint64_t(width) * height - allocatedTexels;
+        while (requestedTexels > freeTexels) {
+            size_t largest = 0;
+            for (size_t i = 1; i < count; ++i) {
+                if (packSizes[i] >= packSizes[largest]) {
+                    largest = i;
+                }
+            }
+            if (count == 0 || packSizes[largest] <= minRegionSize) {
+                break;
+            }
+            const uint64_t oldTexels = uint64_t(packSizes[largest]) * packSizes[largest];
+            packSizes[largest] >>= 1;
+            requestedTexels -= oldTexels - oldTexels / 4;
+        }
+
+        // Packing largest first means every allocation is aligned to its own size, so a fresh atlas never fragments
+        const uint16_t* sizes = packSizes.data();
+        std::sort(packOrder.begin(), packOrder.end(), [sizes](const size_t a, const size_t b) {
+            return sizes[a] != sizes[b] ? sizes[a] > sizes[b] : a < b;
+        });
+
+        // Previous allocations might have left the atlas fragmented, so we can still fail to find space
+        for (size_t idx : packOrder) {
+            ShadowAtlasRegion region{};
+            uint16_t size = packSizes[idx];
+            while (size > 0) {
+                region = allocate(size);
+                if (region.isValid() || size <= minRegionSize) {
+                    break;
+                }
+                size >>= 1;
+            }
+            outRegions[idx] = region;
+        }
+    }
+
+    glm::vec4 ShadowAtlas::getUVScaleOffset(const ShadowAtlasRegion& region, const bool originBottomLeft) const
+    {
+        glm::vec4 scaleOffset{
+            float(region.size) / float(width),
+            float(region.size) / float(height),
+            float(region.x) / float(width),
+            float(region.y) / float(height),
+        };
+        // Region y is measured from the top, but GL's texture coordinates start at the bottom
+        if (originBottomLeft) {
+            scaleOffset.w = float(height - region.y - region.size) / float(height);
+        }
+        return scaleOffset;
+    }
+
+    glm::vec4 ShadowAtlas::getUVBounds(const ShadowAtlasRegion& region, const bool originBottomLeft) const
+    {
+        const glm::vec4 scaleOffset = getUVScaleOffset(region, originBottomLeft);
+        const glm::vec2 halfTexel{ 0.5f / float(width), 0.5f / float(height) };
+        return glm::vec4{
+            glm::vec2{ scaleOffset.z, scaleOffset.w } + halfTexel,
+            glm::vec2{ scaleOffset.z + scaleOffset.x, scaleOffset.w + scaleOffset.y } - halfTexel,
+        };
+    }
+
+    glm::vec4 ShadowAtlas::getClipScaleOffset(const ShadowAtlasRegion& region) const
+    {
+        // Clip space y points up, towards the top of the view rect, with both GL and D3D style framebuffers
+        return glm::vec4{
+            float(region.size) / float(width),
+            float(region.size) / float(height),
+            float(2 * region.x + region.size) / float(width) - 1.0f,
+            1.0f - float(2 * region.y + region.size) / float(height),
+        };
+    }
+
+    uint16_t getShadowResolutionForCoverage(
+        const float worldExtent,
+        const float distance,
+        const float viewportHeight,
+        const float projScale,
+        const uint16_t minSize,
+        const uint16_t maxSize)
+    {
+        // Pixels covered by one world space unit at this distance from the camera
+        const float pixelsPerUnit = 0.5f * viewportHeight * projScale / std::max(distance, 1e-4f);
+        const float idealResolution = worldExtent * pixelsPerUnit;
+
+        uint32_t resolution = std::max<uint16_t>(minSize, 1u);
+        while (float(resolution) < idealResolution && resolution < maxSize) {
+            resolution <<= 1;
+        }
+        return uint16_t(std::min<uint32_t>(resolution, maxSize));
+    }
+}
@@ -0,0 +1,243 @@
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+namespace bae
+{
+    void computeCascadeSplits(
+        const float nearDepth,
+        const float farDepth,
+        const uint32_t count,
+        const CascadeSplitScheme scheme,
+        const float lambda,
+        glm::vec2* outSplits)
+    {
+        if (count == 0) {
+            return;
+        }
+
+        float blend = 1.0f;
+        if (scheme == CascadeSplitScheme::UNIFORM) {
+            blend = 0.0f;
+        }
+        else if (scheme == CascadeSplitScheme::PRACTICAL) {
+            blend = std::min(std::max(lambda, 0.0f), 1.0f);
+        }
+
+        float splitStart = nearDepth;
+        for (uint32_t i = 0; i < count; ++i) {
+            const float t = float(i + 1) / float(count);
+            const float logSplit = nearDepth * std::pow(farDepth / nearDepth, t);
+            const float uniformSplit = nearDepth + (farDepth - nearDepth) * t;
+            // The last split is set exactly, so rounding can't leave a sliver of the frustum uncovered
+            const float splitEnd = i + 1 == count ? farDepth : blend * logSplit + (1.0f - blend) * uniformSplit;
+            outSplits[i] = glm::vec2{ splitStart, splitEnd };
+            splitStart = splitEnd;
+        }
+    }
+
+    void getFrustumSliceCorners(
+        const glm::mat4& invViewProj,
+        const float clipNear,
+        const float nearPlane,
+        const float farPlane,
+        const glm::vec2& slice,
+        glm::vec4 outCorners[8])
+    {
+        const glm::vec4 clipCorners[8] = {
+            { -1.0f,  1.0f, clipNear, 1.0f },
+            {  1.0f,  1.0f, clipNear, 1.0f },
+            {  1.0f, -1.0f, clipNear, 1.0f },
+            { -1.0f, -1.0f, clipNear, 1.0f },
+            { -1.0f,  1.0f, 1.0f, 1.0f },
+            {  1.0f,  1.0f, 1.0f, 1.0f },
+            {  1.0f, -1.0f, 1.0f, 1.0f },
+            { -1.0f, -1.0f, 1.0f, 1.0f },
+        };
+
+        glm::vec4 worldCorners[8];
+        for (size_t i = 0; i < 8; ++i) {
+            worldCorners[i] = invViewProj * clipCorners[i];
+            worldCorners[i] /= worldCorners[i].w;
+        }
+
+        // Points along the edges of a perspective frustum move linearly with view space depth
+        const float sliceMin = (slice.x - nearPlane) / (farPlane - nearPlane);
+        const float sliceMax = (slice.y - nearPlane) / (farPlane - nearPlane);
+        for (size_t i = 0; i < 4; ++i) {
+            const glm::vec4 cornerRay = worldCorners[i + 4] - worldCorners[i];
+            outCorners[i] = worldCorners[i] + sliceMin * cornerRay;
+            outCorners[i + 4] = worldCorners[i] + sliceMax * cornerRay;
+        }
+    }
+
+    void fitCascade(
+        CascadeFit& fit,
+        const glm::mat4& lightRotation,
+        const glm::vec3& lightDirection,
+        const glm::vec3& up,
+        const AABB& sceneBounds,
+        const bool stabilize)
+    {
+        glm::vec4 center{ 0.0 };
+        for (size_t i = 0; i < 8; ++i) {
+            center += fit.corners[i];
+        }
+        center /= 8.0f;
+
+        glm::vec4 min;
+        glm::vec4 max;
+        if (stabilize) {
+            // Fit a sphere around the slice, so that our bounds don't change as the camera rotates
+            float radius = 0.0f;
+            for (size_t i = 0; i < 8; ++i) {
+                radius = std::max(radius, glm::length(glm::vec3(fit.corners[i] - center)));
+            }
+            // Round up to a quarter of an octave, so that small changes in our depth bounds don't resize it
+            radius = std::pow(2.0f, std::ceil(std::log2(radius) * 4.0f) / 4.0f);
+
+            fit.lightView = lightRotation;
+            glm::vec4 lightCenter = lightRotation * center;
+            min = lightCenter - glm::vec4{ radius, radius, radius, 0.0f };
+            max = lightCenter + glm::vec4{ radius, radius, radius, 0.0f };
+        }
+        else {
+            // Transform view frustum's corners to Light's view space:
+            fit.lightView = glm::lookAt(glm::vec3(center) - lightDirection, glm::vec3(center), up);
+
+            // Find AABB bounding box around view frustum
+            min = fit.lightView * fit.corners[0];
+            max = min;
+            for (size_t i = 1; i < 8; ++i) {
+                glm::vec4 cornerLightSpace = fit.lightView * fit.corners[i];
+                min = glm::min(min, cornerLightSpace);
+                max = glm::max(max, cornerLightSpace);
+            }
+        }
+
+        // Ensure z-bounds include the scene
+        glm::vec4 bbMin = glm::vec4{ sceneBounds.min, 1.0f };
+        glm::vec4 bbMax = glm::vec4{ sceneBounds.max, 1.0f };
+        glm::vec4 bbCorners[8] = {
+            {bbMin.x, bbMax.y, bbMax.z, 1.0f },
+            {bbMax.x, bbMax.y, bbMax.z, 1.0f },
+            {bbMax.x, bbMin.y, bbMax.z, 1.0f },
+            {bbMin.x, bbMin.y, bbMax.z, 1.0f },
+            {bbMin.x, bbMax.y, bbMin.z, 1.0f },
+            {bbMax.x, bbMax.y, bbMin.z, 1.0f },
+            {bbMax.x, bbMin.y, bbMin.z, 1.0f },
+            {bbMin.x, bbMin.y, bbMin.z, 1.0f },
+        };
+        bbMin = fit.lightView * bbCorners[0];
+        bbMax = fit.lightView * bbCorners[0];
+        for (size_t i = 1; i < 8; ++i) {
+            glm::vec4 bbCornerLightSpace = fit.lightView * bbCorners[i];
+            bbMin = glm::min(bbCornerLightSpace, bbMin);
+            bbMax = glm::max(bbCornerLightSpace, bbMax);
+        }
+        if (!stabilize) {
+            // Aggressively bound X and Y, since we don't want any wasted space
+            min.x = std::max(bbMin.x, min.x);
+            max.x = std::min(bbMax.x, max.x);
+            min.y = std::max(bbMin.y, min.y);
+            max.y = std::min(bbMax.y, max.y);
+        }
+        // Conservatively bound Z, since we need to make sure all occluders are included, even if they are behind the view frustum
+        min.z = std::min(bbMin.z, min.z);
+        max.z = std::max(bbMax.z, max.z);
+        fit.min = glm::vec3(min);
+        fit.max = glm::vec3(max);
+    }
+
+    void snapCascadeToTexels(CascadeFit& fit, const uint16_t regionSize)
+    {
+        float texelSize = (fit.max.x - fit.min.x) / float(regionSize);
+        glm::vec2 snapOffset = glm::floor(glm::vec2(fit.min) / texelSize) * texelSize - glm::vec2(fit.min);
+        fit.min += glm::vec3(snapOffset, 0.0f);
+        fit.max += glm::vec3(snapOffset, 0.0f);
+    }
+
+    glm::mat4 getCascadeProjection(const CascadeFit& fit, const bool homogeneousDepth)
+    {
+        // Light space looks down -z, so the nearest depth is max.z. Same matrix as bx::mtxOrtho gives us.
+        if (homogeneousDepth) {
+            return glm::orthoLH_NO(fit.min.x, fit.max.x, fit.min.y, fit.max.y, fit.max.z, fit.min.z);
+        }
+        return glm::orthoLH_ZO(fit.min.x, fit.max.x, fit.min.y, fit.max.y, fit.max.z, fit.min.z);
+    }
+
+    bool coversFrustumSlice(
+        const glm::mat4& lightViewProj,
+        const glm::vec4 corners[8],
+        const AABB* sceneBounds,
+        const float epsilon)
+    {
+        glm::vec2 sceneMin{ -INFINITY };
+        glm::vec2 sceneMax{ INFINITY };
+        if (sceneBounds != nullptr) {
+            const glm::vec3 boxMin = glm::min(sceneBounds->min, sceneBounds->max);
+            const glm::vec3 boxMax = glm::max(sceneBounds->min, sceneBounds->max);
+            sceneMin = glm::vec2{ INFINITY };
+            sceneMax = glm::vec2{ -INFINITY };
+            for (uint32_t i = 0; i < 8; ++i) {
+                const glm::vec4 corner{
+                    (i & 1) ? boxMax.x : boxMin.x,
+                    (i & 2) ? boxMax.y : boxMin.y,
+                    (i & 4) ? boxMax.z : boxMin.z,
+                    1.0f,
+                };
+                const glm::vec2 clip{ lightViewProj * corner };
+                sceneMin = glm::min(sceneMin, clip);
+                sceneMax = glm::max(sceneMax, clip);
+            }
+        }
+
+        for (size_t i = 0; i < 8; ++i) {
+            // Our shadow projections are orthographic, so w is always one
+            const glm::vec2 clip = glm::clamp(glm::vec2{ lightViewProj * corners[i] }, sceneMin, sceneMax);
+            if (std::abs(clip.x) > 1.0f + epsilon || std::abs(clip.y) > 1.0f + epsilon) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CascadeCoverage validateCascadeCoverage(
+        const glm::mat4& invViewProj,
+        const float clipNear,
+        const float nearPlane,
+        const float farPlane,
+        const float nearDepth,
+        const float farDepth,
+        const glm::vec2* splits,
+        const glm::mat4* lightViewProjs,
+        const uint32_t count,
+        const AABB* sceneBounds)
+    {
+        CascadeCoverage coverage;
+        if (count == 0) {
+            coverage.contiguous = false;
+            return coverage;
+        }
+
+        // Allow for the rounding in converting between depth representations
+        const float tolerance = 1e-4f * farDepth;
+        coverage.contiguous = splits[0].x <= nearDepth + tolerance && splits[count - 1].y >= farDepth - tolerance;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (splits[i].y < splits[i].x || (i > 0 && splits[i].x > splits[i - 1].y + tolerance)) {
+                coverage.contiguous = false;
+            }
+
+            glm::vec4 corners[8];
+            getFrustumSliceCorners(invViewProj, clipNear, nearPlane, farPlane, splits[i], corners);
+            if (!coversFrustumSlice(lightViewProjs[i], corners, sceneBounds)) {
+                coverage.uncoveredCascades |= 1u << i;
+            }
+        }
+        return coverage;
+    }
+}
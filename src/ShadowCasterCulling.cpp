@@ -0,0 +1,48 @@
+#include "ShadowCasterCulling.h"
+
+namespace bae
+{
+    uint32_t getCascadeMask(const AABB& boundingBox, const glm::mat4* lightViewProjs, const uint32_t count)
+    {
+        // Our loader transforms the min and max corners individually, so they can end up swapped
+        const glm::vec3 boxMin = glm::min(boundingBox.min, boundingBox.max);
+        const glm::vec3 boxMax = glm::max(boundingBox.min, boundingBox.max);
+        const glm::vec4 corners[8] = {
+            { boxMin.x, boxMin.y, boxMin.z, 1.0f },
+            { boxMax.x, boxMin.y, boxMin.z, 1.0f },
+            { boxMin.x, boxMax.y, boxMin.z, 1.0f },
+            { boxMax.x, boxMax.y, boxMin.z, 1.0f },
+            { boxMin.x, boxMin.y, boxMax.z, 1.0f },
+            { boxMax.x, boxMin.y, boxMax.z, 1.0f },
+            { boxMin.x, boxMax.y, boxMax.z, 1.0f },
+            { boxMax.x, boxMax.y, boxMax.z, 1.0f },
+        };
+
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < count && i < 32; ++i) {
+            // Our shadow projections are orthographic, so w is always one
+            glm::vec2 clipMin{ lightViewProjs[i] * corners[0] };
+            glm::vec2 clipMax = clipMin;
+            for (size_t j = 1; j < 8; ++j) {
+                glm::vec2 clip{ lightViewProjs[i] * corners[j] };
+                clipMin = glm::min(clipMin, clip);
+                clipMax = glm::max(clipMax, clip);
+            }
+
+            if (clipMin.x <= 1.0f && clipMax.x >= -1.0f && clipMin.y <= 1.0f && clipMax.y >= -1.0f) {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+
+    uint32_t countCascades(uint32_t cascadeMask)
+    {
+        uint32_t count = 0;
+        while (cascadeMask != 0) {
+            cascadeMask &= cascadeMask - 1;
+            ++count;
+        }
+        return count;
+    }
+}
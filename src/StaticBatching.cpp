@@ -0,0 +1,191 @@
+#include "StaticBatching.h"
+
+#include <cfloat>
+#include <chrono>
+#include <stdexcept>
+
+#include "GpuCulling.h"
+
+namespace bae
+{
+    // Batches can use every value a 16 bit index can hold
+    static constexpr size_t MAX_BATCH_VERTICES = size_t(UINT16_MAX) + 1;
+
+    static bool isSameMaterial(const PBRMaterial& a, const PBRMaterial& b)
+    {
+        return a.baseColorFactor == b.baseColorFactor
+            && a.emissiveFactor == b.emissiveFactor
+            && a.alphaCutoff == b.alphaCutoff
+            && a.metallicFactor == b.metallicFactor
+            && a.roughnessFactor == b.roughnessFactor
+            && a.baseColorTexture.idx == b.baseColorTexture.idx
+            && a.metallicRoughnessTexture.idx == b.metallicRoughnessTexture.idx
+            && a.normalTexture.idx == b.normalTexture.idx
+            && a.emissiveTexture.idx == b.emissiveTexture.idx
+            && a.occlusionTexture.idx == b.occlusionTexture.idx
+            && a.baseColorLayer == b.baseColorLayer
+            && a.metallicRoughnessLayer == b.metallicRoughnessLayer
+            && a.normalLayer == b.normalLayer
+            && a.emissiveLayer == b.emissiveLayer
+            && a.occlusionLayer == b.occlusionLayer;
+    }
+
+    struct BatchBuilder
+    {
+        // Any of the source meshes, they all share the same material
+        size_t materialMesh = 0;
+        MeshData data;
+        AABB bounds = { glm::vec3{ FLT_MAX }, glm::vec3{ -FLT_MAX } };
+        std::vector<StaticBatchRange> ranges;
+    };
+
+    static void appendMesh(BatchBuilder& batch, const MeshData& source, const glm::mat4& transform, const AABB& bounds, const uint32_t sourceMesh)
+    {
+        const size_t baseVertex = batch.data.positions.size();
+        const glm::mat3 normalTransform = glm::transpose(glm::inverse(glm::mat3{ transform }));
+        // Mirroring transforms flip the winding of our triangles and the handedness of our tangent frames
+        const bool mirrored = glm::determinant(glm::mat3{ transform }) < 0.0f;
+
+        for (size_t i = 0; i < source.positions.size(); ++i) {
+            batch.data.positions.push_back(glm::vec3{ transform * glm::vec4{ source.positions[i], 1.0f } });
+            batch.data.normals.push_back(glm::normalize(normalTransform * source.normals[i]));
+            const glm::vec4& tangent = source.tangents[i];
+            batch.data.tangents.push_back(glm::vec4{
+                glm::normalize(glm::mat3{ transform } * glm::vec3{ tangent }),
+                mirrored ? -tangent.w : tangent.w,
+            });
+            batch.data.texcoords.push_back(source.texcoords[i]);
+        }
+
+        StaticBatchRange range;
+        range.firstIndex = uint32_t(batch.data.indices.size());
+        range.indexCount = uint32_t(source.indices.size());
+        // Loaded bounds can have min and max swapped by the mesh's transform
+        range.bounds = { glm::min(bounds.min, bounds.max), glm::max(bounds.min, bounds.max) };
+        range.sourceMesh = sourceMesh;
+
+        for (size_t i = 0; i + 2 < source.indices.size(); i += 3) {
+            batch.data.indices.push_back(uint16_t(baseVertex + source.indices[i]));
+            batch.data.indices.push_back(uint16_t(baseVertex + source.indices[mirrored ? i + 2 : i + 1]));
+            batch.data.indices.push_back(uint16_t(baseVertex + source.indices[mirrored ? i + 1 : i + 2]));
+        }
+
+        batch.bounds.min = glm::min(batch.bounds.min, range.bounds.min);
+        batch.bounds.max = glm::max(batch.bounds.max, range.bounds.max);
+        batch.ranges.push_back(range);
+    }
+
+    static Mesh createBatchMesh(const MeshData& data)
+    {
+        bgfx::VertexDecl positionDecl;
+        positionDecl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).end();
+        bgfx::VertexDecl normalDecl;
+        normalDecl.begin().add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float).end();
+        bgfx::VertexDecl tangentDecl;
+        tangentDecl.begin().add(bgfx::Attrib::Tangent, 4, bgfx::AttribType::Float).end();
+        bgfx::VertexDecl texcoordDecl;
+        texcoordDecl.begin().add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+
+        // Same streams, in the same order, as the meshes the loader creates
+        Mesh mesh{};
+        const uint32_t vertexCount = uint32_t(data.positions.size());
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.positions.data(), vertexCount * sizeof(glm::vec3)), positionDecl));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.normals.data(), vertexCount * sizeof(glm::vec3)), normalDecl));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.tangents.data(), vertexCount * sizeof(glm::vec4)), tangentDecl));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.texcoords.data(), vertexCount * sizeof(glm::vec2)), texcoordDecl));
+        mesh.indexHandle = bgfx::createIndexBuffer(bgfx::copy(data.indices.data(), uint32_t(data.indices.size() * sizeof(uint16_t))));
+        return mesh;
+    }
+
+    StaticBatches buildStaticBatches(const MeshGroup& meshGroup, const bool keepMeshData)
+    {
+        if (meshGroup.meshData.size() != meshGroup.meshes.size()) {
+            throw std::runtime_error("Static batching needs the mesh data, load the model with keepMeshData.");
+        }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<BatchBuilder> builders;
+        for (size_t i = 0; i < meshGroup.meshes.size(); ++i) {
+            const MeshData& source = meshGroup.meshData[i];
+
+            // Latest batch with the same material that still has room, batches that ran out just stay behind
+            BatchBuilder* batch = nullptr;
+            for (auto it = builders.rbegin(); it != builders.rend(); ++it) {
+                if (isSameMaterial(meshGroup.materials[it->materialMesh], meshGroup.materials[i])) {
+                    if (it->data.positions.size() + source.positions.size() <= MAX_BATCH_VERTICES) {
+                        batch = &(*it);
+                    }
+                    break;
+                }
+            }
+            if (batch == nullptr) {
+                builders.emplace_back();
+                batch = &builders.back();
+                batch->materialMesh = i;
+            }
+
+            appendMesh(*batch, source, meshGroup.transforms[i], meshGroup.boundingBoxes[i], uint32_t(i));
+        }
+
+        StaticBatches batches;
+        batches.rangeOffsets.push_back(0);
+        for (BatchBuilder& builder : builders) {
+            batches.group.meshes.push_back(createBatchMesh(builder.data));
+            batches.group.materials.push_back(meshGroup.materials[builder.materialMesh]);
+            batches.group.transforms.push_back(glm::mat4{ 1.0f });
+            batches.group.boundingBoxes.push_back(builder.bounds);
+
+            batches.ranges.insert(batches.ranges.end(), builder.ranges.begin(), builder.ranges.end());
+            batches.rangeOffsets.push_back(uint32_t(batches.ranges.size()));
+
+            batches.stats.vertices += uint32_t(builder.data.positions.size());
+            batches.stats.indices += uint32_t(builder.data.indices.size());
+            if (keepMeshData) {
+                batches.group.meshData.push_back(std::move(builder.data));
+            }
+        }
+
+        batches.stats.sourceMeshes = uint32_t(meshGroup.meshes.size());
+        batches.stats.batches = uint32_t(builders.size());
+        const std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        batches.stats.buildMs = elapsed.count();
+        return batches;
+    }
+
+    void destroy(StaticBatches& batches)
+    {
+        for (const Mesh& mesh : batches.group.meshes) {
+            destroy(mesh);
+        }
+        batches.group = MeshGroup{};
+        batches.ranges.clear();
+        batches.rangeOffsets.clear();
+    }
+
+    uint32_t cullStaticBatch(
+        const StaticBatches& batches,
+        const size_t batchIdx,
+        const glm::vec4 frustumPlanes[6],
+        std::vector<StaticBatchDraw>& outDraws)
+    {
+        const size_t firstDraw = outDraws.size();
+        uint32_t culled = 0;
+        for (uint32_t i = batches.rangeOffsets[batchIdx]; i < batches.rangeOffsets[batchIdx + 1]; ++i) {
+            const StaticBatchRange& range = batches.ranges[i];
+            if (isBoxOutsideFrustum(frustumPlanes, range.bounds.min, range.bounds.max)) {
+                ++culled;
+                continue;
+            }
+
+            // Ranges are laid out back to back, so visible neighbours can share a draw
+            if (outDraws.size() > firstDraw && outDraws.back().firstIndex + outDraws.back().indexCount == range.firstIndex) {
+                outDraws.back().indexCount += range.indexCount;
+            }
+            else {
+                outDraws.push_back({ range.firstIndex, range.indexCount });
+            }
+        }
+        return culled;
+    }
+}
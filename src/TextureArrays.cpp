@@ -0,0 +1,129 @@
+#include "TextureArrays.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <bimg/bimg.h>
+
+#include "bgfx_utils.h"
+
+namespace bae
+{
+    bool TextureArrays::isSupported()
+    {
+        const bgfx::Caps* caps = bgfx::getCaps();
+        return (caps->supported & BGFX_CAPS_TEXTURE_2D_ARRAY) != 0 && caps->limits.maxTextureLayers >= 2;
+    }
+
+    TextureLayer TextureArrays::add(const char* filePath, const uint64_t flags)
+    {
+        if (!isSupported()) {
+            throw std::runtime_error("Texture arrays aren't supported");
+        }
+
+        const std::string key = std::string(filePath) + "|" + std::to_string(flags);
+        const auto layerIt = layers.find(key);
+        if (layerIt != layers.end()) {
+            ++stats.hits;
+            return layerIt->second;
+        }
+
+        // Keep whatever format the file is in, so compressed textures stay compressed
+        bimg::ImageContainer* image = imageLoad(filePath, bgfx::TextureFormat::Count);
+        if (image == nullptr) {
+            throw std::runtime_error(std::string("Failed to load texture ") + filePath);
+        }
+        if (image->m_cubeMap || image->m_depth > 1 || image->m_numLayers > 1) {
+            bimg::imageFree(image);
+            throw std::runtime_error(std::string("Texture arrays only take 2D textures, not ") + filePath);
+        }
+
+        const uint16_t maxLayers = uint16_t(std::min<uint32_t>(bgfx::getCaps()->limits.maxTextureLayers, UINT16_MAX));
+        const bgfx::TextureFormat::Enum format = bgfx::TextureFormat::Enum(image->m_format);
+
+        // Arrays that have already been built can't take any more layers, so only look at the ones still waiting
+        size_t arrayIdx = arrays.size();
+        for (size_t i = 0; i < arrays.size(); ++i) {
+            const Array& array = arrays[i];
+            if (bgfx::isValid(array.texture) || array.numLayers >= maxLayers) {
+                continue;
+            }
+            if (array.width == image->m_width && array.height == image->m_height && array.numMips == image->m_numMips
+                && array.format == format && array.flags == flags) {
+                arrayIdx = i;
+                break;
+            }
+        }
+
+        if (arrayIdx == arrays.size()) {
+            if (arrays.size() >= TextureLayer::INVALID_ARRAY) {
+                bimg::imageFree(image);
+                throw std::runtime_error("Too many texture arrays");
+            }
+            Array array;
+            array.width = uint16_t(image->m_width);
+            array.height = uint16_t(image->m_height);
+            array.numMips = image->m_numMips;
+            array.format = format;
+            array.flags = flags;
+            array.numLayers = 0;
+            array.texture = BGFX_INVALID_HANDLE;
+            arrays.push_back(array);
+        }
+
+        Array& array = arrays[arrayIdx];
+        array.images.push_back(image);
+        ++stats.textures;
+        const TextureLayer layer = { uint16_t(arrayIdx), array.numLayers++ };
+        layers[key] = layer;
+        return layer;
+    }
+
+    void TextureArrays::build()
+    {
+        for (Array& array : arrays) {
+            if (array.images.empty()) {
+                continue;
+            }
+
+            // Same size, format and mip count, so every layer's mip chain takes up the same space. bgfx expects the
+            // layers one after the other, each with all of its mips. A single layer is repeated, so bgfx still
+            // creates an array.
+            const uint32_t layerSize = array.images[0]->m_size;
+            array.numLayers = std::max<uint16_t>(array.numLayers, 2);
+            const bgfx::Memory* memory = bgfx::alloc(layerSize * array.numLayers);
+            for (uint16_t layer = 0; layer < array.numLayers; ++layer) {
+                const bimg::ImageContainer* image = array.images[std::min<size_t>(layer, array.images.size() - 1)];
+                std::memcpy(memory->data + layer * layerSize, image->m_data, layerSize);
+            }
+            for (bimg::ImageContainer* image : array.images) {
+                bimg::imageFree(image);
+            }
+            array.images.clear();
+
+            array.texture = bgfx::createTexture2D(array.width, array.height, array.numMips > 1, array.numLayers, array.format, array.flags, memory);
+            bgfx::setName(array.texture, "Material Texture Array");
+
+            ++stats.arrays;
+            stats.largestArray = std::max<uint32_t>(stats.largestArray, array.numLayers);
+            stats.uploadedBytes += memory->size;
+        }
+    }
+
+    void TextureArrays::destroy()
+    {
+        for (Array& array : arrays) {
+            for (bimg::ImageContainer* image : array.images) {
+                bimg::imageFree(image);
+            }
+            if (bgfx::isValid(array.texture)) {
+                bgfx::destroy(array.texture);
+            }
+        }
+        arrays.clear();
+        layers.clear();
+        stats = {};
+    }
+}
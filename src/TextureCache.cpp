@@ -0,0 +1,160 @@
+#include "TextureCache.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <bimg/decode.h>
+#include <bx/debug.h>
+#include "bgfx_utils.h"
+#include "TrackingAllocator.h"
+
+namespace bae
+{
+    static std::string makeKey(const std::string& name, const uint64_t flags)
+    {
+        return name + "|" + std::to_string(flags);
+    }
+
+    // FNV-1a over the whole file, empty if it can't be read
+    static std::string hashFile(const std::string& filePath)
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) {
+            return {};
+        }
+
+        uint64_t hash = 14695981039346656037ull;
+        for (std::istreambuf_iterator<char> it(file), end; it != end; ++it) {
+            hash ^= uint8_t(*it);
+            hash *= 1099511628211ull;
+        }
+        return std::to_string(hash);
+    }
+
+    bgfx::TextureHandle TextureCache::tryAcquire(const std::string& filePath, const uint64_t flags)
+    {
+        const auto pathIt = pathToTexture.find(makeKey(filePath, flags));
+        if (pathIt == pathToTexture.end()) {
+            return BGFX_INVALID_HANDLE;
+        }
+        Entry& entry = entries[pathIt->second];
+        ++entry.references;
+        ++stats.references;
+        ++stats.hits;
+        return entry.handle;
+    }
+
+    bgfx::TextureHandle TextureCache::acquire(const std::string& filePath, const uint64_t flags)
+    {
+        const bgfx::TextureHandle cached = tryAcquire(filePath, flags);
+        if (bgfx::isValid(cached)) {
+            return cached;
+        }
+
+        const std::string key = makeKey(filePath, flags);
+
+        std::string contentKey;
+        if (hashContents) {
+            const std::string hash = hashFile(filePath);
+            if (!hash.empty()) {
+                contentKey = makeKey(hash, flags);
+                const auto contentIt = contentToTexture.find(contentKey);
+                if (contentIt != contentToTexture.end()) {
+                    // Same image under another name, remember this path too so it doesn't get hashed again
+                    Entry& entry = entries[contentIt->second];
+                    entry.keys.push_back(key);
+                    pathToTexture[key] = contentIt->second;
+                    ++entry.references;
+                    ++stats.references;
+                    ++stats.contentHits;
+                    return entry.handle;
+                }
+            }
+        }
+
+        const bgfx::TextureHandle handle = loadTexture(filePath.c_str(), flags);
+        ++stats.misses;
+        if (bgfx::isValid(handle)) {
+            insert(key, contentKey, handle);
+        }
+        return handle;
+    }
+
+    void TextureCache::add(const std::string& filePath, const uint64_t flags, const bgfx::TextureHandle handle)
+    {
+        ++stats.misses;
+        insert(makeKey(filePath, flags), {}, handle);
+    }
+
+    void TextureCache::insert(const std::string& key, const std::string& contentKey, const bgfx::TextureHandle handle)
+    {
+        Entry entry;
+        entry.handle = handle;
+        entry.references = 1;
+        entry.keys.push_back(key);
+        entry.contentKey = contentKey;
+        entries[handle.idx] = entry;
+        pathToTexture[key] = handle.idx;
+        if (!contentKey.empty()) {
+            contentToTexture[contentKey] = handle.idx;
+        }
+        ++stats.textures;
+        ++stats.references;
+    }
+
+    bool TextureCache::release(const bgfx::TextureHandle handle)
+    {
+        const auto it = entries.find(handle.idx);
+        if (it == entries.end()) {
+            // Nothing else will destroy it, so it leaks until bgfx shuts down
+            bx::debugPrintf("TextureCache: released texture %u that the cache doesn't own\n", handle.idx);
+            return false;
+        }
+
+        Entry& entry = it->second;
+        --stats.references;
+        if (--entry.references > 0) {
+            return false;
+        }
+
+        for (const std::string& key : entry.keys) {
+            pathToTexture.erase(key);
+        }
+        if (!entry.contentKey.empty()) {
+            contentToTexture.erase(entry.contentKey);
+        }
+        bgfx::destroy(entry.handle);
+        entries.erase(it);
+        --stats.textures;
+        return true;
+    }
+
+    void TextureCache::destroy()
+    {
+        for (auto& pair : entries) {
+            bgfx::destroy(pair.second.handle);
+        }
+        entries.clear();
+        pathToTexture.clear();
+        contentToTexture.clear();
+        stats = {};
+    }
+
+    TextureCache& getTextureCache()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    bimg::ImageContainer* decodeImageFile(const std::string& filePath)
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) {
+            return nullptr;
+        }
+        const std::vector<char> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+        // The tracking allocator is thread safe, unlike the examples' allocator
+        return bimg::imageParse(getTrackingAllocator(), data.data(), uint32_t(data.size()));
+    }
+}
@@ -0,0 +1,472 @@
+#include "TextureStreaming.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <bimg/bimg.h>
+
+#include "TextureCache.h"
+#include "TrackingAllocator.h"
+
+namespace bae
+{
+    static bimg::ImageContainer* loadImage(const std::string& filePath)
+    {
+        // Keeps whatever format the file is in, so compressed textures stay compressed
+        bimg::ImageContainer* image = decodeImageFile(filePath);
+        if (image == nullptr) {
+            throw std::runtime_error("Failed to load texture " + filePath);
+        }
+        return image;
+    }
+
+    static bgfx::TextureHandle createTexture(const bimg::ImageContainer& image, const uint8_t firstMip, const uint32_t bytes, const uint64_t flags)
+    {
+        // bgfx takes the mips one after the other, starting with the largest one
+        const bgfx::Memory* memory = bgfx::alloc(bytes);
+        uint32_t offset = 0;
+        bimg::ImageMip first = {};
+        for (uint8_t lod = firstMip; lod < image.m_numMips; ++lod) {
+            bimg::ImageMip mip;
+            bimg::imageGetRawData(image, 0, lod, image.m_data, image.m_size, mip);
+            if (lod == firstMip) {
+                first = mip;
+            }
+            std::memcpy(memory->data + offset, mip.m_data, mip.m_size);
+            offset += mip.m_size;
+        }
+
+        bgfx::TextureHandle handle = bgfx::createTexture2D(
+            uint16_t(first.m_width),
+            uint16_t(first.m_height),
+            image.m_numMips - firstMip > 1,
+            1,
+            bgfx::TextureFormat::Enum(image.m_format),
+            flags,
+            memory);
+        bgfx::setName(handle, "Streamed Texture");
+        return handle;
+    }
+
+    void TextureStreamer::init(const TextureStreamingParams& _params)
+    {
+        params = _params;
+        stats = {};
+        loadingBytes = 0;
+        loadsInFlight = 0;
+        blitSupported = (bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_BLIT) != 0;
+        stopping = false;
+        thread = std::thread([this]() { runLoadingThread(); });
+    }
+
+    void TextureStreamer::destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            loadQueue.clear();
+        }
+        wake.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        for (const LoadedImage& load : loaded) {
+            if (load.image != nullptr) {
+                bimg::imageFree(load.image);
+            }
+        }
+        loaded.clear();
+
+        for (const Texture& texture : textures) {
+            bgfx::destroy(texture.handle);
+        }
+        textures.clear();
+        handleToTexture.clear();
+        loadingBytes = 0;
+        loadsInFlight = 0;
+        stats = {};
+    }
+
+    bgfx::TextureHandle TextureStreamer::add(const char* filePath, const uint64_t flags)
+    {
+        bimg::ImageContainer* image = loadImage(filePath);
+        if (image->m_cubeMap || image->m_depth > 1 || image->m_numLayers > 1) {
+            bimg::imageFree(image);
+            throw std::runtime_error(std::string("Only 2D textures can be streamed, not ") + filePath);
+        }
+
+        Texture texture;
+        texture.info.path = filePath;
+        texture.info.width = uint16_t(image->m_width);
+        texture.info.height = uint16_t(image->m_height);
+        texture.info.mipCount = image->m_numMips;
+        texture.flags = flags;
+        texture.format = bgfx::TextureFormat::Enum(image->m_format);
+        texture.requestFrame = UINT32_MAX;
+        texture.loadingBytes = 0;
+        texture.loading = false;
+        texture.swapUpdate = UINT32_MAX;
+
+        texture.chainBytes.resize(image->m_numMips + 1, 0);
+        for (uint8_t lod = image->m_numMips; lod-- > 0;) {
+            bimg::ImageMip mip;
+            bimg::imageGetRawData(*image, 0, lod, image->m_data, image->m_size, mip);
+            texture.chainBytes[lod] = texture.chainBytes[lod + 1] + mip.m_size;
+        }
+        texture.chainBytes.pop_back();
+
+        uint8_t tailMip = 0;
+        while (tailMip + 1 < image->m_numMips
+               && std::max(texture.info.width >> tailMip, texture.info.height >> tailMip) > params.tailSize) {
+            ++tailMip;
+        }
+        texture.info.tailMip = tailMip;
+        texture.info.residentMip = tailMip;
+        texture.info.requestedMip = tailMip;
+        texture.info.residentBytes = texture.chainBytes[tailMip];
+
+        texture.handle = createTexture(*image, tailMip, texture.info.residentBytes, flags);
+        bimg::imageFree(image);
+
+        handleToTexture[texture.handle.idx] = textures.size();
+        ++stats.textures;
+        stats.residentBytes += texture.info.residentBytes;
+        stats.fullBytes += texture.chainBytes[0];
+        textures.push_back(std::move(texture));
+        return textures.back().handle;
+    }
+
+    void TextureStreamer::request(const bgfx::TextureHandle handle, const float mip, const uint32_t frame)
+    {
+        const auto it = handleToTexture.find(handle.idx);
+        if (it == handleToTexture.end()) {
+            return;
+        }
+
+        Texture& texture = textures[it->second];
+        const float biased = std::floor(mip - params.mipBias);
+        const uint8_t requested = uint8_t(std::min(std::max(biased, 0.0f), float(texture.info.tailMip)));
+
+        if (texture.requestFrame != frame) {
+            texture.requestFrame = frame;
+            texture.info.requestedMip = requested;
+        }
+        else {
+            texture.info.requestedMip = std::min(texture.info.requestedMip, requested);
+        }
+        texture.info.lastUsedFrame = frame;
+    }
+
+    void TextureStreamer::requestForMesh(
+        const PBRMaterial& material,
+        const AABB& bounds,
+        const float uvDensity,
+        const glm::vec3& cameraPos,
+        const float projScale,
+        const uint32_t frame)
+    {
+        // The closest point of the mesh is the one that needs the most detail, and from inside its bounds
+        // everything is close enough to need the full resolution
+        const glm::vec3 closest = glm::clamp(cameraPos, bounds.min, bounds.max);
+        const float distance = glm::length(closest - cameraPos);
+        const float pixelsPerUnit = projScale / std::max(distance, 1e-4f);
+
+        const bgfx::TextureHandle handles[] = {
+            material.baseColorTexture,
+            material.metallicRoughnessTexture,
+            material.normalTexture,
+            material.emissiveTexture,
+            material.occlusionTexture,
+        };
+        for (const bgfx::TextureHandle handle : handles) {
+            const auto it = handleToTexture.find(handle.idx);
+            if (it == handleToTexture.end()) {
+                continue;
+            }
+            // Each mip halves the texels per world unit, so the one with about a texel per pixel is log2 of the
+            // ratio at mip 0
+            const StreamedTextureInfo& info = textures[it->second].info;
+            const float texelsPerUnit = uvDensity * float(std::max(info.width, info.height));
+            const float mip = texelsPerUnit > 0.0f ? std::log2(texelsPerUnit / pixelsPerUnit) : float(info.tailMip);
+            request(handle, mip, frame);
+        }
+    }
+
+    void TextureStreamer::update(const uint32_t frame, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps)
+    {
+        stats.streamedIn = 0;
+        stats.streamedOut = 0;
+        swapsThisUpdate = 0;
+        ++updateCount;
+
+        applyLoads(outSwaps);
+
+        upgrades.clear();
+        for (size_t i = 0; i < textures.size(); ++i) {
+            StreamedTextureInfo& info = textures[i].info;
+            if (textures[i].requestFrame != frame) {
+                info.requestedMip = info.tailMip;
+            }
+            if (info.requestedMip < info.residentMip && !textures[i].loading) {
+                upgrades.push_back(i);
+            }
+        }
+
+        // The budget may have shrunk since the last update
+        while (stats.residentBytes + loadingBytes > params.budgetBytes && evictOne(textures.size(), blitView, outSwaps)) {
+        }
+
+        // Biggest jumps in detail first, then the most recently used
+        std::sort(upgrades.begin(), upgrades.end(), [this](const size_t a, const size_t b) {
+            const StreamedTextureInfo& infoA = textures[a].info;
+            const StreamedTextureInfo& infoB = textures[b].info;
+            const int gainA = infoA.residentMip - infoA.requestedMip;
+            const int gainB = infoB.residentMip - infoB.requestedMip;
+            if (gainA != gainB) {
+                return gainA > gainB;
+            }
+            return infoA.lastUsedFrame > infoB.lastUsedFrame;
+        });
+
+        for (const size_t textureIdx : upgrades) {
+            if (loadsInFlight >= params.maxLoadsInFlight) {
+                break;
+            }
+
+            Texture& texture = textures[textureIdx];
+            const uint8_t wanted = texture.info.requestedMip;
+            while (stats.residentBytes + loadingBytes - texture.info.residentBytes + texture.chainBytes[wanted] > params.budgetBytes
+                   && evictOne(textureIdx, blitView, outSwaps)) {
+            }
+
+            // Settle for as much of the request as fits
+            uint8_t mip = wanted;
+            while (mip < texture.info.residentMip
+                   && stats.residentBytes + loadingBytes - texture.info.residentBytes + texture.chainBytes[mip] > params.budgetBytes) {
+                ++mip;
+            }
+            if (mip < texture.info.residentMip) {
+                queueLoad(textureIdx, mip);
+            }
+        }
+
+        stats.pending = 0;
+        stats.loading = loadsInFlight;
+        for (const Texture& texture : textures) {
+            if (texture.info.requestedMip < texture.info.residentMip) {
+                ++stats.pending;
+            }
+        }
+    }
+
+    void TextureStreamer::runLoadingThread()
+    {
+        ScopedAllocationTag tag(AllocationTag::LOADER);
+        while (true) {
+            LoadRequest request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !loadQueue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = std::move(loadQueue.front());
+                loadQueue.pop_front();
+            }
+
+            bimg::ImageContainer* image = decodeImageFile(request.path);
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back({ request.textureIdx, request.mip, image });
+        }
+    }
+
+    void TextureStreamer::queueLoad(const size_t textureIdx, const uint8_t mip)
+    {
+        Texture& texture = textures[textureIdx];
+        texture.loading = true;
+        texture.loadingBytes = texture.chainBytes[mip] - texture.info.residentBytes;
+        loadingBytes += texture.loadingBytes;
+        ++loadsInFlight;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loadQueue.push_back({ textureIdx, mip, texture.info.path });
+        }
+        wake.notify_one();
+    }
+
+    void TextureStreamer::applyLoads(std::vector<TextureSwap>& outSwaps)
+    {
+        finishedLoads.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!loaded.empty() && finishedLoads.size() < params.maxSwapsPerUpdate) {
+                finishedLoads.push_back(loaded.front());
+                loaded.pop_front();
+            }
+        }
+
+        for (const LoadedImage& load : finishedLoads) {
+            Texture& texture = textures[load.textureIdx];
+            texture.loading = false;
+            loadingBytes -= texture.loadingBytes;
+            texture.loadingBytes = 0;
+            --loadsInFlight;
+
+            if (load.image == nullptr) {
+                // It did decode when it was added, so keep the mips it has rather than failing the frame
+                continue;
+            }
+            // Textures being loaded are never evicted, so the decoded mips are still finer than what's resident
+            const bgfx::TextureHandle handle = createTexture(*load.image, load.mip, texture.chainBytes[load.mip], texture.flags);
+            bimg::imageFree(load.image);
+            if (bgfx::isValid(handle)) {
+                swapHandle(texture, handle, load.mip, outSwaps);
+            }
+        }
+    }
+
+    void TextureStreamer::dropMips(Texture& texture, const uint8_t mip, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps)
+    {
+        bgfx::TextureHandle handle = BGFX_INVALID_HANDLE;
+        if (blitSupported) {
+            // The mips we keep are already on the GPU, so copy them over instead of reading the file again
+            const uint8_t mipCount = uint8_t(texture.info.mipCount - mip);
+            handle = bgfx::createTexture2D(
+                uint16_t(std::max(texture.info.width >> mip, 1)),
+                uint16_t(std::max(texture.info.height >> mip, 1)),
+                mipCount > 1,
+                1,
+                texture.format,
+                texture.flags | BGFX_TEXTURE_BLIT_DST);
+            if (bgfx::isValid(handle)) {
+                bgfx::setName(handle, "Streamed Texture");
+                for (uint8_t lod = 0; lod < mipCount; ++lod) {
+                    bgfx::blit(blitView, handle, lod, 0, 0, 0, texture.handle, uint8_t(mip - texture.info.residentMip + lod));
+                }
+            }
+        }
+        else {
+            bimg::ImageContainer* image = loadImage(texture.info.path);
+            handle = createTexture(*image, mip, texture.chainBytes[mip], texture.flags);
+            bimg::imageFree(image);
+        }
+
+        if (bgfx::isValid(handle)) {
+            swapHandle(texture, handle, mip, outSwaps);
+        }
+    }
+
+    void TextureStreamer::swapHandle(Texture& texture, const bgfx::TextureHandle handle, const uint8_t mip, std::vector<TextureSwap>& outSwaps)
+    {
+        const size_t textureIdx = handleToTexture[texture.handle.idx];
+        handleToTexture.erase(texture.handle.idx);
+        handleToTexture[handle.idx] = textureIdx;
+        // Materials may not have seen an earlier swap to the handle we're destroying yet, so that one has to lead
+        // to the new handle as well
+        for (TextureSwap& swap : outSwaps) {
+            if (swap.to.idx == texture.handle.idx) {
+                swap.to = handle;
+            }
+        }
+        outSwaps.push_back({ texture.handle, handle });
+        // Still fine to destroy while this frame's draws and blits refer to it, bgfx only frees it once the frame
+        // is done
+        bgfx::destroy(texture.handle);
+        texture.handle = handle;
+
+        if (mip < texture.info.residentMip) {
+            ++stats.streamedIn;
+        }
+        else {
+            ++stats.streamedOut;
+        }
+        stats.residentBytes = stats.residentBytes - texture.info.residentBytes + texture.chainBytes[mip];
+        texture.info.residentMip = mip;
+        texture.info.residentBytes = texture.chainBytes[mip];
+        texture.swapUpdate = updateCount;
+        ++swapsThisUpdate;
+    }
+
+    bool TextureStreamer::evictOne(const size_t exclude, const bgfx::ViewId blitView, std::vector<TextureSwap>& outSwaps)
+    {
+        if (swapsThisUpdate >= params.maxSwapsPerUpdate) {
+            return false;
+        }
+
+        // Only mips nobody asked for this frame can go: the whole texture down to its tail if it wasn't used, the
+        // part finer than what was requested if it was. Textures being loaded keep what they have until it lands,
+        // and ones that just landed keep it at least until the next update.
+        size_t victim = textures.size();
+        for (size_t i = 0; i < textures.size(); ++i) {
+            const StreamedTextureInfo& info = textures[i].info;
+            if (i == exclude || info.requestedMip <= info.residentMip || textures[i].loading || textures[i].swapUpdate == updateCount) {
+                continue;
+            }
+            if (victim == textures.size() || info.lastUsedFrame < textures[victim].info.lastUsedFrame) {
+                victim = i;
+            }
+        }
+        if (victim == textures.size()) {
+            return false;
+        }
+
+        Texture& texture = textures[victim];
+        const uint32_t residentBytes = texture.info.residentBytes;
+        dropMips(texture, texture.info.requestedMip, blitView, outSwaps);
+        return texture.info.residentBytes != residentBytes;
+    }
+
+    float computeUvDensity(const MeshData& meshData, const glm::mat4& transform)
+    {
+        if (meshData.texcoords.empty()) {
+            return 0.0f;
+        }
+
+        float worldArea = 0.0f;
+        float uvArea = 0.0f;
+        for (size_t i = 0; i + 2 < meshData.indices.size(); i += 3) {
+            const uint16_t i0 = meshData.indices[i];
+            const uint16_t i1 = meshData.indices[i + 1];
+            const uint16_t i2 = meshData.indices[i + 2];
+
+            const glm::vec3 p0 = glm::vec3(transform * glm::vec4(meshData.positions[i0], 1.0f));
+            const glm::vec3 p1 = glm::vec3(transform * glm::vec4(meshData.positions[i1], 1.0f));
+            const glm::vec3 p2 = glm::vec3(transform * glm::vec4(meshData.positions[i2], 1.0f));
+            worldArea += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+
+            const glm::vec2 e1 = meshData.texcoords[i1] - meshData.texcoords[i0];
+            const glm::vec2 e2 = meshData.texcoords[i2] - meshData.texcoords[i0];
+            uvArea += 0.5f * std::abs(e1.x * e2.y - e1.y * e2.x);
+        }
+
+        // Areas scale with the square of lengths
+        return worldArea > 0.0f ? std::sqrt(uvArea / worldArea) : 0.0f;
+    }
+
+    void applyTextureSwaps(const std::vector<TextureSwap>& swaps, std::vector<PBRMaterial>& materials)
+    {
+        if (swaps.empty()) {
+            return;
+        }
+
+        for (PBRMaterial& material : materials) {
+            bgfx::TextureHandle* handles[] = {
+                &material.baseColorTexture,
+                &material.metallicRoughnessTexture,
+                &material.normalTexture,
+                &material.emissiveTexture,
+                &material.occlusionTexture,
+            };
+            for (bgfx::TextureHandle* handle : handles) {
+                for (const TextureSwap& swap : swaps) {
+                    if (handle->idx == swap.from.idx) {
+                        *handle = swap.to;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
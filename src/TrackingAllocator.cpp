@@ -0,0 +1,258 @@
+#include "TrackingAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <bx/uint32_t.h>
+
+namespace bae
+{
+    static thread_local AllocationTag s_currentTag = AllocationTag::BGFX;
+
+    // Block sizes, header included. Every one is a multiple of the natural alignment, so blocks carved one after the
+    // other out of a malloc'd chunk all stay aligned.
+    static constexpr uint32_t SIZE_CLASSES[TrackingAllocator::SIZE_CLASS_COUNT] = {
+        32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+    };
+    static constexpr uint8_t HEAP_CLASS = 0xff;
+    static constexpr size_t NATURAL_ALIGNMENT = 16;
+
+    // Sits right before every pointer handed out
+    struct AllocationHeader
+    {
+        uint32_t size;
+        // From the start of the malloc'd block to the pointer handed out, for over aligned heap allocations
+        uint32_t offset;
+        uint8_t sizeClass;
+        AllocationTag tag;
+        uint8_t padding[6];
+    };
+    static_assert(sizeof(AllocationHeader) == NATURAL_ALIGNMENT, "Header has to keep pointers aligned");
+
+    const char* getAllocationTagName(const AllocationTag tag)
+    {
+        switch (tag) {
+        case AllocationTag::BGFX: return "bgfx";
+        case AllocationTag::LOADER: return "Loader";
+        case AllocationTag::FRAME: return "Per-frame";
+        case AllocationTag::OTHER: return "Other";
+        default: return "";
+        }
+    }
+
+    ScopedAllocationTag::ScopedAllocationTag(const AllocationTag tag)
+        : previous(s_currentTag)
+    {
+        s_currentTag = tag;
+    }
+
+    ScopedAllocationTag::~ScopedAllocationTag()
+    {
+        s_currentTag = previous;
+    }
+
+    uint32_t AllocationFrameStats::getTotalAllocations() const
+    {
+        uint32_t total = 0;
+        for (uint32_t i = 0; i < ALLOCATION_TAG_COUNT; ++i) {
+            total += allocations[i];
+        }
+        return total;
+    }
+
+    static uint32_t getHistogramBucket(const size_t size)
+    {
+        if (size <= 16) {
+            return 0;
+        }
+        if (size > TrackingAllocator::getHistogramBucketLimit(ALLOCATION_HISTOGRAM_BUCKETS - 2)) {
+            return ALLOCATION_HISTOGRAM_BUCKETS - 1;
+        }
+        // Bits needed for size - 1, less the 4 that the first bucket covers
+        return 32 - bx::uint32_cntlz(uint32_t(size - 1)) - 4;
+    }
+
+    uint32_t TrackingAllocator::getHistogramBucketLimit(const uint32_t bucket)
+    {
+        return bucket < ALLOCATION_HISTOGRAM_BUCKETS - 1 ? 16u << bucket : UINT32_MAX;
+    }
+
+    TrackingAllocator::TrackingAllocator()
+    {
+        uint8_t sizeClass = 0;
+        for (uint32_t i = 0; i < BX_COUNTOF(sizeClassLookup); ++i) {
+            const uint32_t blockSize = (i + 1) * uint32_t(NATURAL_ALIGNMENT);
+            while (SIZE_CLASSES[sizeClass] < blockSize) {
+                ++sizeClass;
+            }
+            sizeClassLookup[i] = sizeClass;
+        }
+        for (uint32_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+            sizeClasses[i] = { SIZE_CLASSES[i], nullptr, nullptr, nullptr };
+        }
+    }
+
+    TrackingAllocator::~TrackingAllocator()
+    {
+        while (chunks != nullptr) {
+            void* next = *static_cast<void**>(chunks);
+            ::free(chunks);
+            chunks = next;
+        }
+    }
+
+    void* TrackingAllocator::allocateBlock(SizeClass& sizeClass)
+    {
+        if (sizeClass.freeList != nullptr) {
+            void* block = sizeClass.freeList;
+            sizeClass.freeList = *static_cast<void**>(block);
+            return block;
+        }
+
+        if (sizeClass.carveCursor == nullptr || sizeClass.carveCursor + sizeClass.blockSize > sizeClass.carveEnd) {
+            uint8_t* chunk = static_cast<uint8_t*>(::malloc(CHUNK_SIZE));
+            if (chunk == nullptr) {
+                return nullptr;
+            }
+            *reinterpret_cast<void**>(chunk) = chunks;
+            chunks = chunk;
+            stats.pooledBytesReserved += CHUNK_SIZE;
+            // The link takes the first natural alignment's worth of bytes
+            sizeClass.carveCursor = chunk + NATURAL_ALIGNMENT;
+            sizeClass.carveEnd = chunk + CHUNK_SIZE;
+        }
+
+        void* block = sizeClass.carveCursor;
+        sizeClass.carveCursor += sizeClass.blockSize;
+        return block;
+    }
+
+    void* TrackingAllocator::allocate(const size_t size, const size_t align, const AllocationTag tag)
+    {
+        uint8_t* block = nullptr;
+        uint32_t offset = 0;
+        uint8_t sizeClass = HEAP_CLASS;
+
+        const size_t blockSize = size + sizeof(AllocationHeader);
+        if (align <= NATURAL_ALIGNMENT && blockSize <= SIZE_CLASSES[SIZE_CLASS_COUNT - 1]) {
+            sizeClass = sizeClassLookup[(blockSize - 1) / NATURAL_ALIGNMENT];
+            block = static_cast<uint8_t*>(allocateBlock(sizeClasses[sizeClass]));
+            offset = uint32_t(sizeof(AllocationHeader));
+            ++currentFrame.pooledAllocations;
+        }
+        else {
+            // Room for the header plus enough slack to reach any alignment
+            const size_t alignment = std::max(align, NATURAL_ALIGNMENT);
+            block = static_cast<uint8_t*>(::malloc(size + sizeof(AllocationHeader) + alignment - 1));
+            if (block != nullptr) {
+                const uintptr_t start = reinterpret_cast<uintptr_t>(block) + sizeof(AllocationHeader);
+                const uintptr_t aligned = (start + alignment - 1) & ~uintptr_t(alignment - 1);
+                offset = uint32_t(aligned - reinterpret_cast<uintptr_t>(block));
+            }
+            ++currentFrame.heapAllocations;
+        }
+        if (block == nullptr) {
+            return nullptr;
+        }
+
+        uint8_t* ptr = block + offset;
+        AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr) - 1;
+        header->size = uint32_t(size);
+        header->offset = offset;
+        header->sizeClass = sizeClass;
+        header->tag = tag;
+
+        const uint32_t tagIdx = uint32_t(tag);
+        AllocationTagStats& tagStats = stats.tags[tagIdx];
+        tagStats.bytes += size;
+        tagStats.peakBytes = std::max(tagStats.peakBytes, tagStats.bytes);
+        ++tagStats.allocations;
+        ++tagStats.totalAllocations;
+        ++currentFrame.allocations[tagIdx];
+        currentFrame.bytesAllocated[tagIdx] += size;
+        ++currentFrame.histogram[tagIdx][getHistogramBucket(size)];
+        return ptr;
+    }
+
+    void TrackingAllocator::free(void* ptr)
+    {
+        AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+        const uint32_t tagIdx = uint32_t(header->tag);
+        stats.tags[tagIdx].bytes -= header->size;
+        --stats.tags[tagIdx].allocations;
+        ++currentFrame.frees[tagIdx];
+
+        uint8_t* block = static_cast<uint8_t*>(ptr) - header->offset;
+        if (header->sizeClass == HEAP_CLASS) {
+            ::free(block);
+        }
+        else {
+            SizeClass& sizeClass = sizeClasses[header->sizeClass];
+            *reinterpret_cast<void**>(block) = sizeClass.freeList;
+            sizeClass.freeList = block;
+        }
+    }
+
+    void* TrackingAllocator::realloc(void* ptr, size_t size, size_t align, const char* file, uint32_t line)
+    {
+        BX_UNUSED(file, line);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (size == 0) {
+            if (ptr != nullptr) {
+                free(ptr);
+            }
+            return nullptr;
+        }
+
+        // Reallocations keep the tag of the original allocation, whichever thread grows it
+        const AllocationTag tag = ptr != nullptr ? (static_cast<AllocationHeader*>(ptr) - 1)->tag : s_currentTag;
+        void* newPtr = allocate(size, align, tag);
+        if (ptr != nullptr && newPtr != nullptr) {
+            const uint32_t oldSize = (static_cast<AllocationHeader*>(ptr) - 1)->size;
+            memcpy(newPtr, ptr, std::min(size_t(oldSize), size));
+            free(ptr);
+        }
+        return newPtr;
+    }
+
+    void TrackingAllocator::endFrame()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        lastFrame = currentFrame;
+        currentFrame = {};
+
+        const uint32_t allocations = lastFrame.getTotalAllocations();
+        stats.quietFrames = allocations == 0 ? stats.quietFrames + 1 : 0;
+        frameHistory[frameHistoryHead] = allocations;
+        frameHistoryHead = (frameHistoryHead + 1) % ALLOCATION_FRAME_HISTORY;
+    }
+
+    TrackingAllocatorStats TrackingAllocator::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    AllocationFrameStats TrackingAllocator::getLastFrame() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lastFrame;
+    }
+
+    void TrackingAllocator::getFrameHistory(float* outAllocations) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t i = 0; i < ALLOCATION_FRAME_HISTORY; ++i) {
+            outAllocations[i] = float(frameHistory[(frameHistoryHead + i) % ALLOCATION_FRAME_HISTORY]);
+        }
+    }
+
+    TrackingAllocator* getTrackingAllocator()
+    {
+        static TrackingAllocator allocator;
+        return &allocator;
+    }
+}
@@ -0,0 +1,368 @@
+#include "VirtualPageTable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace bae
+{
+    // Out of line definitions, since std::vector::assign takes them by reference
+    constexpr uint32_t VirtualPage::MAX_PAGES_PER_SIDE;
+    constexpr uint32_t VirtualPage::MAX_MIPS;
+    constexpr uint8_t VirtualPage::NO_TEXTURE;
+    constexpr uint16_t PhysicalSlot::INVALID;
+
+    static bool isPowerOfTwo(const uint32_t value)
+    {
+        return value != 0 && (value & (value - 1)) == 0;
+    }
+
+    uint32_t VirtualPage::pack() const
+    {
+        const uint32_t r = x & 0xffu;
+        const uint32_t g = y & 0xffu;
+        const uint32_t b = ((x >> 8) & 0x3u) | (((y >> 8) & 0x3u) << 2) | (uint32_t(mip) << 4);
+        return r | (g << 8) | (b << 16) | (uint32_t(texture) << 24);
+    }
+
+    VirtualPage VirtualPage::unpack(const uint32_t packed)
+    {
+        const uint32_t b = (packed >> 16) & 0xffu;
+        VirtualPage page;
+        page.x = uint16_t((packed & 0xffu) | ((b & 0x3u) << 8));
+        page.y = uint16_t(((packed >> 8) & 0xffu) | (((b >> 2) & 0x3u) << 8));
+        page.mip = uint8_t(b >> 4);
+        page.texture = uint8_t(packed >> 24);
+        return page;
+    }
+
+    void VirtualPageTable::init(const VirtualPageTableParams& _params)
+    {
+        // Slot positions have to fit the 8 bit channels of the indirection tables
+        if (_params.cacheWidth == 0 || _params.cacheHeight == 0 || _params.cacheWidth > 256 || _params.cacheHeight > 256) {
+            throw std::runtime_error("Virtual texture caches need between 1 and 256 pages per side");
+        }
+        if (_params.pageSize == 0) {
+            throw std::runtime_error("Virtual texture pages can't be empty");
+        }
+
+        params = _params;
+        stats = {};
+        textures.clear();
+        requested.clear();
+        misses.clear();
+
+        const uint32_t slotCount = uint32_t(params.cacheWidth) * params.cacheHeight;
+        slots.assign(slotCount, Slot{ VirtualPage{}, 0, PhysicalSlot::INVALID, PhysicalSlot::INVALID, false });
+        freeSlots.clear();
+        for (uint32_t i = slotCount; i > 0; --i) {
+            freeSlots.push_back(uint16_t(i - 1));
+        }
+        lruHead = PhysicalSlot::INVALID;
+        lruTail = PhysicalSlot::INVALID;
+    }
+
+    uint8_t VirtualPageTable::addTexture(const uint32_t width, const uint32_t height)
+    {
+        if (textures.size() >= VirtualPage::NO_TEXTURE) {
+            throw std::runtime_error("Too many virtual textures");
+        }
+        if (width % params.pageSize != 0 || height % params.pageSize != 0) {
+            throw std::runtime_error("Virtual texture sizes need to be a multiple of the page size");
+        }
+        const uint32_t pagesX = width / params.pageSize;
+        const uint32_t pagesY = height / params.pageSize;
+        if (!isPowerOfTwo(pagesX) || !isPowerOfTwo(pagesY) || pagesX > VirtualPage::MAX_PAGES_PER_SIDE || pagesY > VirtualPage::MAX_PAGES_PER_SIDE) {
+            throw std::runtime_error("Virtual textures need a power of two number of pages per side, up to 1024");
+        }
+
+        // Mips keep halving until the whole texture fits in a single page
+        Texture texture;
+        texture.dirty = true;
+        uint32_t mipPagesX = pagesX;
+        uint32_t mipPagesY = pagesY;
+        while (true) {
+            Mip mip;
+            mip.pagesX = uint16_t(mipPagesX);
+            mip.pagesY = uint16_t(mipPagesY);
+            mip.slots.assign(mipPagesX * mipPagesY, PhysicalSlot::INVALID);
+            texture.mips.push_back(std::move(mip));
+            if (mipPagesX == 1 && mipPagesY == 1) {
+                break;
+            }
+            mipPagesX = std::max(1u, mipPagesX / 2);
+            mipPagesY = std::max(1u, mipPagesY / 2);
+        }
+
+        textures.push_back(std::move(texture));
+        return uint8_t(textures.size() - 1);
+    }
+
+    void VirtualPageTable::request(const VirtualPage& page)
+    {
+        ++stats.requests;
+        requested.push_back(page.pack());
+    }
+
+    void VirtualPageTable::request(const uint32_t* packedPages, const size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if ((packedPages[i] >> 24) != VirtualPage::NO_TEXTURE) {
+                ++stats.requests;
+                requested.push_back(packedPages[i]);
+            }
+        }
+    }
+
+    void VirtualPageTable::requestArea(const uint8_t texture, const float uvMin[2], const float uvMax[2], const float screenWidth, const float screenHeight)
+    {
+        const Texture& tex = textures[texture];
+        const float u0 = std::min(std::max(uvMin[0], 0.0f), 1.0f);
+        const float v0 = std::min(std::max(uvMin[1], 0.0f), 1.0f);
+        const float u1 = std::min(std::max(uvMax[0], 0.0f), 1.0f);
+        const float v1 = std::min(std::max(uvMax[1], 0.0f), 1.0f);
+
+        // Mip where a texel covers about a pixel
+        const float texelsX = (u1 - u0) * float(tex.mips[0].pagesX) * params.pageSize;
+        const float texelsY = (v1 - v0) * float(tex.mips[0].pagesY) * params.pageSize;
+        const float ratio = std::max(texelsX / std::max(screenWidth, 1.0f), texelsY / std::max(screenHeight, 1.0f));
+        const int maxMip = int(tex.mips.size()) - 1;
+        const int mipIdx = ratio > 1.0f ? std::min(int(std::floor(std::log2(ratio))), maxMip) : 0;
+        const Mip& mip = tex.mips[mipIdx];
+
+        const uint16_t x0 = uint16_t(std::min(int(u0 * mip.pagesX), mip.pagesX - 1));
+        const uint16_t y0 = uint16_t(std::min(int(v0 * mip.pagesY), mip.pagesY - 1));
+        const uint16_t x1 = uint16_t(std::min(int(std::ceil(u1 * mip.pagesX)) - 1, mip.pagesX - 1));
+        const uint16_t y1 = uint16_t(std::min(int(std::ceil(v1 * mip.pagesY)) - 1, mip.pagesY - 1));
+
+        VirtualPage page;
+        page.texture = texture;
+        page.mip = uint8_t(mipIdx);
+        for (page.y = y0; page.y <= y1; ++page.y) {
+            for (page.x = x0; page.x <= x1; ++page.x) {
+                request(page);
+            }
+        }
+    }
+
+    uint16_t& VirtualPageTable::getSlotIndex(const VirtualPage& page)
+    {
+        Mip& mip = textures[page.texture].mips[page.mip];
+        return mip.slots[page.y * mip.pagesX + page.x];
+    }
+
+    uint16_t VirtualPageTable::getSlotIndex(const VirtualPage& page) const
+    {
+        const Mip& mip = textures[page.texture].mips[page.mip];
+        return mip.slots[page.y * mip.pagesX + page.x];
+    }
+
+    void VirtualPageTable::unlink(const uint16_t slotIdx)
+    {
+        Slot& slot = slots[slotIdx];
+        if (slot.prev != PhysicalSlot::INVALID) {
+            slots[slot.prev].next = slot.next;
+        }
+        else {
+            lruHead = slot.next;
+        }
+        if (slot.next != PhysicalSlot::INVALID) {
+            slots[slot.next].prev = slot.prev;
+        }
+        else {
+            lruTail = slot.prev;
+        }
+        slot.prev = PhysicalSlot::INVALID;
+        slot.next = PhysicalSlot::INVALID;
+    }
+
+    void VirtualPageTable::pushBack(const uint16_t slotIdx)
+    {
+        Slot& slot = slots[slotIdx];
+        slot.prev = lruTail;
+        slot.next = PhysicalSlot::INVALID;
+        if (lruTail != PhysicalSlot::INVALID) {
+            slots[lruTail].next = slotIdx;
+        }
+        else {
+            lruHead = slotIdx;
+        }
+        lruTail = slotIdx;
+    }
+
+    void VirtualPageTable::update(const uint32_t frame, std::vector<PageUpload>& outUploads)
+    {
+        stats.uniquePages = 0;
+        stats.hits = 0;
+        stats.misses = 0;
+        stats.uploads = 0;
+        stats.evictions = 0;
+        stats.deferred = 0;
+
+        // The coarsest page of every texture is what everything else falls back to, so keep asking for it
+        // until it's in
+        for (size_t i = 0; i < textures.size(); ++i) {
+            VirtualPage page;
+            page.texture = uint8_t(i);
+            page.mip = uint8_t(textures[i].mips.size() - 1);
+            if (getSlotIndex(page) == PhysicalSlot::INVALID) {
+                requested.push_back(page.pack());
+            }
+        }
+
+        std::sort(requested.begin(), requested.end());
+        requested.erase(std::unique(requested.begin(), requested.end()), requested.end());
+
+        for (const uint32_t packed : requested) {
+            const VirtualPage page = VirtualPage::unpack(packed);
+            // Feedback can be stale or garbage, e.g. from a texture that has since been removed
+            if (page.texture >= textures.size() || page.mip >= textures[page.texture].mips.size()) {
+                continue;
+            }
+            const Mip& mip = textures[page.texture].mips[page.mip];
+            if (page.x >= mip.pagesX || page.y >= mip.pagesY) {
+                continue;
+            }
+
+            ++stats.uniquePages;
+            const uint16_t slotIdx = getSlotIndex(page);
+            if (slotIdx == PhysicalSlot::INVALID) {
+                misses.push_back(page);
+                continue;
+            }
+
+            ++stats.hits;
+            Slot& slot = slots[slotIdx];
+            slot.lastUsedFrame = frame;
+            if (!slot.pinned) {
+                unlink(slotIdx);
+                pushBack(slotIdx);
+            }
+        }
+        stats.misses = uint32_t(misses.size());
+
+        // Coarse pages first, they cover the most screen and give the finer ones something to fall back to
+        std::sort(misses.begin(), misses.end(), [](const VirtualPage& a, const VirtualPage& b) {
+            return a.mip != b.mip ? a.mip > b.mip : a.pack() < b.pack();
+        });
+
+        for (const VirtualPage& page : misses) {
+            if (stats.uploads >= params.maxUploadsPerUpdate) {
+                ++stats.deferred;
+                continue;
+            }
+
+            PageUpload upload;
+            upload.page = page;
+
+            uint16_t slotIdx;
+            if (!freeSlots.empty()) {
+                slotIdx = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            else {
+                // Every slot that's left was used this frame, evicting one would just make it miss next frame
+                if (lruHead == PhysicalSlot::INVALID || slots[lruHead].lastUsedFrame == frame) {
+                    ++stats.deferred;
+                    continue;
+                }
+                slotIdx = lruHead;
+                unlink(slotIdx);
+
+                upload.evicted = slots[slotIdx].page;
+                getSlotIndex(upload.evicted) = PhysicalSlot::INVALID;
+                textures[upload.evicted.texture].dirty = true;
+                ++stats.evictions;
+            }
+
+            Slot& slot = slots[slotIdx];
+            slot.page = page;
+            slot.lastUsedFrame = frame;
+            slot.pinned = page.mip + 1u == textures[page.texture].mips.size();
+            if (!slot.pinned) {
+                pushBack(slotIdx);
+            }
+            getSlotIndex(page) = slotIdx;
+            textures[page.texture].dirty = true;
+
+            upload.slot.x = uint16_t(slotIdx % params.cacheWidth);
+            upload.slot.y = uint16_t(slotIdx / params.cacheWidth);
+            outUploads.push_back(upload);
+            ++stats.uploads;
+        }
+
+        stats.residentPages = uint32_t(slots.size() - freeSlots.size());
+        requested.clear();
+        misses.clear();
+    }
+
+    bool VirtualPageTable::isResident(const VirtualPage& page) const
+    {
+        return getSlotIndex(page) != PhysicalSlot::INVALID;
+    }
+
+    IndirectionEntry VirtualPageTable::lookup(const VirtualPage& page) const
+    {
+        const Texture& texture = textures[page.texture];
+        uint16_t x = page.x;
+        uint16_t y = page.y;
+        for (size_t mipIdx = page.mip; mipIdx < texture.mips.size(); ++mipIdx) {
+            const Mip& mip = texture.mips[mipIdx];
+            const uint16_t slotIdx = mip.slots[y * mip.pagesX + x];
+            if (slotIdx != PhysicalSlot::INVALID) {
+                IndirectionEntry entry;
+                entry.x = uint8_t(slotIdx % params.cacheWidth);
+                entry.y = uint8_t(slotIdx / params.cacheWidth);
+                entry.mip = uint8_t(mipIdx);
+                entry.valid = 0xff;
+                return entry;
+            }
+            // Mips with a single row or column of pages stop halving along that side
+            x = std::min<uint16_t>(x / 2, uint16_t(std::max(1, mip.pagesX / 2) - 1));
+            y = std::min<uint16_t>(y / 2, uint16_t(std::max(1, mip.pagesY / 2) - 1));
+        }
+        return IndirectionEntry{};
+    }
+
+    void VirtualPageTable::writeIndirection(const uint8_t texture, const uint8_t mip, IndirectionEntry* outEntries) const
+    {
+        const Mip& level = textures[texture].mips[mip];
+        VirtualPage page;
+        page.texture = texture;
+        page.mip = mip;
+        for (page.y = 0; page.y < level.pagesY; ++page.y) {
+            for (page.x = 0; page.x < level.pagesX; ++page.x) {
+                outEntries[page.y * level.pagesX + page.x] = lookup(page);
+            }
+        }
+    }
+
+    bool VirtualPageTable::takeDirty(const uint8_t texture)
+    {
+        const bool dirty = textures[texture].dirty;
+        textures[texture].dirty = false;
+        return dirty;
+    }
+
+    void extractPage(
+        const uint32_t* mipTexels,
+        const uint32_t mipWidth,
+        const uint32_t mipHeight,
+        const uint16_t pageX,
+        const uint16_t pageY,
+        const uint16_t pageSize,
+        const uint16_t border,
+        uint32_t* outTexels)
+    {
+        const int paddedSize = pageSize + 2 * border;
+        const int originX = int(pageX) * pageSize - border;
+        const int originY = int(pageY) * pageSize - border;
+        for (int y = 0; y < paddedSize; ++y) {
+            const int srcY = std::min(std::max(originY + y, 0), int(mipHeight) - 1);
+            for (int x = 0; x < paddedSize; ++x) {
+                const int srcX = std::min(std::max(originX + x, 0), int(mipWidth) - 1);
+                outTexels[y * paddedSize + x] = mipTexels[srcY * mipWidth + srcX];
+            }
+        }
+    }
+}
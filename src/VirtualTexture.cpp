@@ -0,0 +1,117 @@
+#include "VirtualTexture.h"
+
+#include <stdexcept>
+
+#include "FrameArena.h"
+
+namespace bae
+{
+    // Indirection entries are uploaded as they are, one RGBA8 texel each
+    static_assert(sizeof(IndirectionEntry) == 4, "IndirectionEntry has to match an RGBA8 texel");
+
+    void VirtualTexture::init(const VirtualPageTable& _table, const bgfx::TextureFormat::Enum format)
+    {
+        destroy();
+        table = &_table;
+
+        const VirtualPageTableParams& params = table->getParams();
+        paddedPageSize = params.pageSize + 2 * params.pageBorder;
+        const uint32_t cacheWidth = uint32_t(params.cacheWidth) * paddedPageSize;
+        const uint32_t cacheHeight = uint32_t(params.cacheHeight) * paddedPageSize;
+        if (cacheWidth > bgfx::getCaps()->limits.maxTextureSize || cacheHeight > bgfx::getCaps()->limits.maxTextureSize) {
+            throw std::runtime_error("Virtual texture cache is larger than the max texture size");
+        }
+
+        // Pages carry their own borders, so the cache can be filtered without any care for its slots, but it has no
+        // mips of its own: every page is a mip level of some virtual texture already
+        cache = bgfx::createTexture2D(uint16_t(cacheWidth), uint16_t(cacheHeight), false, 1, format, BGFX_SAMPLER_UVW_CLAMP);
+        bgfx::setName(cache, "Virtual Texture Cache");
+
+        // Page table mips halve just like texture mips do, so each one maps onto a mip of the indirection texture
+        for (uint8_t i = 0; i < table->getTextureCount(); ++i) {
+            const bgfx::TextureHandle indirection = bgfx::createTexture2D(
+                table->getPagesX(i, 0),
+                table->getPagesY(i, 0),
+                table->getMipCount(i) > 1,
+                1,
+                bgfx::TextureFormat::RGBA8,
+                BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+            bgfx::setName(indirection, "Virtual Texture Indirection");
+            indirections.push_back(indirection);
+        }
+    }
+
+    void VirtualTexture::destroy()
+    {
+        if (bgfx::isValid(cache)) {
+            bgfx::destroy(cache);
+            cache = BGFX_INVALID_HANDLE;
+        }
+        for (const bgfx::TextureHandle indirection : indirections) {
+            bgfx::destroy(indirection);
+        }
+        indirections.clear();
+        table = nullptr;
+    }
+
+    void VirtualTexture::uploadPage(const PageUpload& upload, const bgfx::Memory* texels)
+    {
+        bgfx::updateTexture2D(
+            cache,
+            0,
+            0,
+            upload.slot.x * paddedPageSize,
+            upload.slot.y * paddedPageSize,
+            paddedPageSize,
+            paddedPageSize,
+            texels);
+    }
+
+    void VirtualTexture::updateIndirection(VirtualPageTable& _table)
+    {
+        for (uint8_t i = 0; i < _table.getTextureCount() && i < indirections.size(); ++i) {
+            if (!_table.takeDirty(i)) {
+                continue;
+            }
+            for (uint8_t mip = 0; mip < _table.getMipCount(i); ++mip) {
+                const uint16_t pagesX = _table.getPagesX(i, mip);
+                const uint16_t pagesY = _table.getPagesY(i, mip);
+                // Written straight into frame memory that bgfx reads from, instead of copying it over
+                const uint32_t entryCount = uint32_t(pagesX) * pagesY;
+                IndirectionEntry* entries = getFrameArena().allocate<IndirectionEntry>(entryCount);
+                _table.writeIndirection(i, mip, entries);
+                bgfx::updateTexture2D(
+                    indirections[i],
+                    0,
+                    mip,
+                    0,
+                    0,
+                    pagesX,
+                    pagesY,
+                    bgfx::makeRef(entries, entryCount * uint32_t(sizeof(IndirectionEntry))));
+            }
+        }
+    }
+
+    glm::vec4 VirtualTexture::getParams(const uint8_t texture) const
+    {
+        const VirtualPageTableParams& params = table->getParams();
+        return glm::vec4{
+            float(table->getPagesX(texture, 0)),
+            float(table->getPagesY(texture, 0)),
+            float(params.pageSize),
+            float(params.pageBorder),
+        };
+    }
+
+    glm::vec4 VirtualTexture::getInfo(const uint8_t texture) const
+    {
+        const VirtualPageTableParams& params = table->getParams();
+        return glm::vec4{
+            float(params.cacheWidth * paddedPageSize),
+            float(params.cacheHeight * paddedPageSize),
+            float(table->getMipCount(texture) - 1),
+            float(texture),
+        };
+    }
+}
@@ -0,0 +1,134 @@
+#include "VisibilityBuffer.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace bae
+{
+    // Vertex and triangle indices are stored in floats
+    static constexpr size_t MAX_EXACT_FLOAT_INDEX = size_t(1) << 24;
+
+    uint32_t packVisibilityId(const uint32_t drawId, const uint32_t triangleId)
+    {
+        return ((drawId + 1) << VISIBILITY_TRIANGLE_BITS) | (triangleId & (VISIBILITY_MAX_TRIANGLES - 1));
+    }
+
+    bool unpackVisibilityId(const uint32_t packed, uint32_t& drawId, uint32_t& triangleId)
+    {
+        if (packed == 0) {
+            return false;
+        }
+        drawId = (packed >> VISIBILITY_TRIANGLE_BITS) - 1;
+        triangleId = packed & (VISIBILITY_MAX_TRIANGLES - 1);
+        return true;
+    }
+
+    static bool isSameMaterial(const PBRMaterial& a, const PBRMaterial& b)
+    {
+        return a.baseColorFactor == b.baseColorFactor
+            && a.emissiveFactor == b.emissiveFactor
+            && a.alphaCutoff == b.alphaCutoff
+            && a.metallicFactor == b.metallicFactor
+            && a.roughnessFactor == b.roughnessFactor
+            && a.baseColorTexture.idx == b.baseColorTexture.idx
+            && a.metallicRoughnessTexture.idx == b.metallicRoughnessTexture.idx
+            && a.normalTexture.idx == b.normalTexture.idx
+            && a.emissiveTexture.idx == b.emissiveTexture.idx
+            && a.occlusionTexture.idx == b.occlusionTexture.idx;
+    }
+
+    static uint32_t findOrAddMaterial(std::vector<PBRMaterial>& materials, const PBRMaterial& material)
+    {
+        for (size_t i = 0; i < materials.size(); ++i) {
+            if (isSameMaterial(materials[i], material)) {
+                return uint32_t(i);
+            }
+        }
+        materials.push_back(material);
+        return uint32_t(materials.size() - 1);
+    }
+
+    uint32_t appendMeshGroup(VisibilityScene& scene, const MeshGroup& meshGroup)
+    {
+        if (meshGroup.meshData.size() != meshGroup.meshes.size()) {
+            throw std::runtime_error("Visibility scenes need mesh data, load the model with keepMeshData.");
+        }
+
+        const uint32_t firstDrawId = uint32_t(scene.draws.size());
+        if (firstDrawId + meshGroup.meshes.size() > VISIBILITY_MAX_DRAWS) {
+            throw std::runtime_error("Too many draws for the visibility buffer, max is " + std::to_string(VISIBILITY_MAX_DRAWS));
+        }
+
+        for (size_t i = 0; i < meshGroup.meshData.size(); ++i) {
+            const MeshData& meshData = meshGroup.meshData[i];
+            const glm::mat4& transform = meshGroup.transforms[i];
+            const glm::mat3 normalTransform{ glm::transpose(glm::inverse(transform)) };
+            const glm::mat3 tangentTransform{ transform };
+
+            const size_t baseVertex = scene.positions.size();
+            const size_t numVertices = meshData.positions.size();
+            const size_t numTriangles = meshData.indices.size() / 3;
+            if (baseVertex + numVertices > MAX_EXACT_FLOAT_INDEX) {
+                throw std::runtime_error("Too many vertices for the visibility scene");
+            }
+            if (numTriangles > VISIBILITY_MAX_TRIANGLES) {
+                throw std::runtime_error("Too many triangles in a single mesh for the visibility buffer");
+            }
+
+            for (size_t v = 0; v < numVertices; ++v) {
+                const glm::vec2& texcoord = meshData.texcoords[v];
+                const glm::vec4& tangent = meshData.tangents[v];
+                glm::vec3 position{ transform * glm::vec4{ meshData.positions[v], 1.0f } };
+                glm::vec3 normal = glm::normalize(normalTransform * meshData.normals[v]);
+                glm::vec3 worldTangent = glm::normalize(tangentTransform * glm::vec3{ tangent });
+                scene.positions.emplace_back(position, texcoord.x);
+                scene.normals.emplace_back(normal, texcoord.y);
+                scene.tangents.emplace_back(worldTangent, tangent.w);
+            }
+
+            const size_t firstTriangle = scene.triangles.size();
+            for (size_t t = 0; t < numTriangles; ++t) {
+                scene.triangles.emplace_back(
+                    float(baseVertex + meshData.indices[3 * t + 0]),
+                    float(baseVertex + meshData.indices[3 * t + 1]),
+                    float(baseVertex + meshData.indices[3 * t + 2]),
+                    0.0f);
+            }
+
+            uint32_t materialIdx = findOrAddMaterial(scene.materials, meshGroup.materials[i]);
+            if (materialIdx >= VISIBILITY_MAX_MATERIALS) {
+                throw std::runtime_error("Too many materials for the visibility buffer, max is " + std::to_string(VISIBILITY_MAX_MATERIALS));
+            }
+            scene.draws.emplace_back(float(firstTriangle), float(numTriangles), float(materialIdx), 0.0f);
+        }
+
+        return firstDrawId;
+    }
+
+    void releaseGeometry(VisibilityScene& scene)
+    {
+        std::vector<glm::vec4>().swap(scene.positions);
+        std::vector<glm::vec4>().swap(scene.normals);
+        std::vector<glm::vec4>().swap(scene.tangents);
+        std::vector<glm::vec4>().swap(scene.triangles);
+    }
+
+    glm::vec3 computeBarycentrics(
+        const glm::vec3& rayOrigin,
+        const glm::vec3& rayDirection,
+        const glm::vec3& p0,
+        const glm::vec3& p1,
+        const glm::vec3& p2)
+    {
+        // Moller-Trumbore, without rejecting hits outside the triangle
+        glm::vec3 edge1 = p1 - p0;
+        glm::vec3 edge2 = p2 - p0;
+        glm::vec3 pvec = glm::cross(rayDirection, edge2);
+        float invDet = 1.0f / glm::dot(edge1, pvec);
+        glm::vec3 tvec = rayOrigin - p0;
+        float u = glm::dot(tvec, pvec) * invDet;
+        glm::vec3 qvec = glm::cross(tvec, edge1);
+        float v = glm::dot(rayDirection, qvec) * invDet;
+        return glm::vec3{ 1.0f - u - v, u, v };
+    }
+}
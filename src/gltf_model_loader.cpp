@@ -1,5 +1,6 @@
 #include "gltf_model_loading.h"
 
+#include <functional>
 #include <stdexcept>
 #include <iostream>
 #include <glm/glm.hpp>
@@ -9,7 +10,11 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include "bgfx_utils.h"
+#include "GltfModelSource.h"
 #include "PhysicallyBasedScene.h"
+#include "TextureArrays.h"
+#include "TextureCache.h"
+#include "TextureStreaming.h"
 #include "tangent_calc.h"
 
 // Define these only in *one* .cc file.
@@ -35,42 +40,6 @@ namespace bae
         return true;
     };
 
-    struct GltfToBgfxAttributeMaps
-    {
-        std::unordered_map<std::string, bgfx::Attrib::Enum> attributes;
-        std::unordered_map<int, uint8_t> sizes;
-        std::unordered_map<int, bgfx::AttribType::Enum> componentType;
-    };
-
-    const GltfToBgfxAttributeMaps GLTF_TO_BGFX_ATTRIBUTE_MAPS{
-        {
-            {"POSITION", bgfx::Attrib::Position},
-            {"NORMAL", bgfx::Attrib::Normal},
-            {"TANGENT", bgfx::Attrib::Tangent},
-            {"TEXCOORD_0", bgfx::Attrib::TexCoord0},
-        },
-        {
-            {TINYGLTF_TYPE_SCALAR, 1},
-            {TINYGLTF_TYPE_VEC2, 2},
-            {TINYGLTF_TYPE_VEC3, 3},
-            {TINYGLTF_TYPE_VEC4, 4},
-        },
-        {
-            {TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE, bgfx::AttribType::Uint8},
-            {TINYGLTF_PARAMETER_TYPE_FLOAT, bgfx::AttribType::Float},
-            // Cannot handle TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT or any of the others
-        },
-    };
-
-    enum struct TransparencyMode
-    {
-        OPAQUE_,
-        MASKED,
-        BLENDED,
-    };
-
-    typedef std::vector<std::pair<PBRMaterial, TransparencyMode>> MaterialsList;
-
     // Returns a transformation matrix for a given GLTF node
     // Order of operations (right to left) in glTF: parentTransform * (T * R * S)
     glm::mat4 processTransform(const tinygltf::Node& node, const glm::mat4& parentTransform)
@@ -102,101 +71,66 @@ namespace bae
         return parentTransform * localTransform;
     }
 
-    // Given a GLTF primitive, return a mesh
-    // TODO: Targets and weights
-    Mesh processPrimitive(tinygltf::Model& gltf_model, const tinygltf::Primitive& primitive)
+    // The streams every mesh gets, attributes are all floats by the time they're uploaded
+    static const bgfx::VertexDecl* getVertexDecls()
     {
-        Mesh mesh{};
-        VertexData vertData{};
-
-        // Get indices
+        static bgfx::VertexDecl decls[4];
+        static bool initialized = false;
+        if (!initialized)
         {
-            const tinygltf::Accessor& indexAccessor = gltf_model.accessors[primitive.indices];
-            if (indexAccessor.type != TINYGLTF_TYPE_SCALAR || indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT)
-            {
-                throw std::runtime_error("Don't know how to handle non uint16_t indices");
-            }
-            vertData.numFaces = indexAccessor.count / 3u;
-
-            const tinygltf::BufferView& bufferView = gltf_model.bufferViews[indexAccessor.bufferView];
-            const tinygltf::Buffer& buffer = gltf_model.buffers[bufferView.buffer];
-            const bgfx::Memory* indexMemory = bgfx::copy(&buffer.data.at(0) + bufferView.byteOffset, bufferView.byteLength);
-            mesh.indexHandle = bgfx::createIndexBuffer(indexMemory);
-            vertData.p_indices = (uint16_t*)(buffer.data.data() + bufferView.byteOffset);
+            decls[0].begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).end();
+            decls[1].begin().add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float).end();
+            decls[2].begin().add(bgfx::Attrib::Tangent, 4, bgfx::AttribType::Float).end();
+            decls[3].begin().add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+            initialized = true;
         }
+        return decls;
+    }
 
-        const std::string ATTRIBUTE_NAMES[] = {
-            "POSITION",
-            "NORMAL",
-            "TANGENT",
-            "TEXCOORD_0" };
-
-        bgfx::VertexDecl decls[BX_COUNTOF(ATTRIBUTE_NAMES)];
+    Mesh createMesh(const MeshData& data, GeometryPool* geometryPool)
+    {
+        const uint32_t numVertices = uint32_t(data.positions.size());
+        const uint32_t numIndices = uint32_t(data.indices.size());
 
-        for (size_t i = 0; i < BX_COUNTOF(ATTRIBUTE_NAMES); ++i)
+        Mesh mesh{};
+        if (geometryPool != nullptr)
         {
-            const std::string& attrName = ATTRIBUTE_NAMES[i];
-
-            if (primitive.attributes.count(attrName) == 0)
+            mesh.geometry = geometryPool->allocate(
+                data.positions.data(),
+                data.normals.data(),
+                data.tangents.data(),
+                data.texcoords.data(),
+                numVertices,
+                data.indices.data(),
+                numIndices);
+            if (mesh.geometry.isValid())
             {
-                if (attrName != "TANGENT")
-                {
-                    throw std::runtime_error("Cannot handle meshes without " + attrName + " attribute");
-                }
-                else
-                {
-                    // Skip tangents for now, we can calculate later
-                    continue;
-                }
-            }
-
-            int accessorIndex = primitive.attributes.at(attrName);
-            const tinygltf::Accessor& accessor{ gltf_model.accessors[accessorIndex] };
-
-            // Copy Associated Memory
-            const tinygltf::BufferView& bufferView{ gltf_model.bufferViews[accessor.bufferView] };
-            tinygltf::Buffer& buffer{ gltf_model.buffers[bufferView.buffer] };
-
-            if (attrName == "POSITION")
-            {
-                vertData.numVertices = bufferView.byteLength / sizeof(glm::vec3);
-
+                mesh.pool = geometryPool;
             }
-
-            vertData.data[i] = &(buffer.data.at(bufferView.byteOffset));
-            vertData.byteLengths[i] = bufferView.byteLength;
-
-            // Define vertex specification/declaration for bgfx
-            decls[i].begin().add(
-                GLTF_TO_BGFX_ATTRIBUTE_MAPS.attributes.at(attrName),
-                GLTF_TO_BGFX_ATTRIBUTE_MAPS.sizes.at(accessor.type),
-                GLTF_TO_BGFX_ATTRIBUTE_MAPS.componentType.at(accessor.componentType),
-                accessor.normalized)
-                .end();
+            return mesh;
         }
 
-        // If our tangents are missing, calculate them
-        std::vector<glm::vec4> tangentData{};
-        if (vertData.data[2] == nullptr)
-        {
-            tangentData.resize(vertData.numVertices);
-            vertData.byteLengths[2] = vertData.numVertices * sizeof(glm::vec4);
-            vertData.data[2] = (unsigned char*)tangentData.data();
-            MikktSpace::calcTangents(vertData);
-
-            decls[2].begin().add(bgfx::Attrib::Tangent, 4, bgfx::AttribType::Float, false).end();
-        }
+        const bgfx::VertexDecl* decls = getVertexDecls();
+        mesh.indexHandle = bgfx::createIndexBuffer(bgfx::copy(data.indices.data(), numIndices * sizeof(uint16_t)));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.positions.data(), numVertices * sizeof(glm::vec3)), decls[0]));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.normals.data(), numVertices * sizeof(glm::vec3)), decls[1]));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.tangents.data(), numVertices * sizeof(glm::vec4)), decls[2]));
+        mesh.addVertexHandle(bgfx::createVertexBuffer(bgfx::copy(data.texcoords.data(), numVertices * sizeof(glm::vec2)), decls[3]));
+        return mesh;
+    }
 
-        for (size_t i = 0; i < BX_COUNTOF(ATTRIBUTE_NAMES); ++i)
+    void addMesh(Model& model, const Mesh& mesh, const PBRMaterial& material, const TransparencyMode mode, GltfSourceMesh& sourceMesh, const bool keepMeshData)
+    {
+        MeshGroup& meshGroup = getMeshGroup(model, mode);
+        meshGroup.meshes.push_back(mesh);
+        meshGroup.materials.push_back(material);
+        meshGroup.transforms.push_back(sourceMesh.transform);
+        meshGroup.boundingBoxes.push_back(sourceMesh.boundingBox);
+        if (keepMeshData)
         {
-            mesh.addVertexHandle(
-                bgfx::createVertexBuffer(
-                    bgfx::copy(vertData.data[i], vertData.byteLengths[i]),
-                    decls[i]));
+            meshGroup.meshData.push_back(std::move(sourceMesh.data));
         }
-
-        // Create the buffer and store the handles in our geometry object
-        return mesh;
+        model.boundingBox = { glm::min(model.boundingBox.min, sourceMesh.boundingBox.min), glm::max(model.boundingBox.max, sourceMesh.boundingBox.max) };
     }
 
     AABB getBoundingBox(tinygltf::Model& gltf_model, const tinygltf::Primitive& primitive)
@@ -220,12 +154,16 @@ namespace bae
         return boundingBox;
     }
 
-    void loadModelNode(Model& output_model, tinygltf::Model& gltf_model, const tinygltf::Node& node, glm::mat4 parentTransform, const MaterialsList& materials_list)
+    // Calls visit for every primitive with a material under node, along with its world transform
+    void forEachPrimitive(
+        const tinygltf::Model& gltf_model,
+        const tinygltf::Node& node,
+        const glm::mat4& parentTransform,
+        const std::function<void(const tinygltf::Primitive&, const glm::mat4&)>& visit)
     {
         // Process the transform
         glm::mat4 transform = processTransform(node, parentTransform);
 
-        // Process the mesh (resulting in a Mesh, Material, RenderState and Transform?)
         if (node.mesh != -1)
         {
             const tinygltf::Mesh& mesh = gltf_model.meshes[node.mesh];
@@ -234,31 +172,7 @@ namespace bae
             {
                 if (primitive.material != -1)
                 {
-                    Mesh newMesh = processPrimitive(gltf_model, primitive);
-                    AABB boundingBox = getBoundingBox(gltf_model, primitive);
-                    boundingBox.min = glm::vec3{ transform * glm::vec4{ boundingBox.min, 1.0f } };
-                    boundingBox.max = glm::vec3{ transform * glm::vec4{ boundingBox.max, 1.0f } };
-                    const std::pair<PBRMaterial, TransparencyMode>& materialModePair = materials_list[primitive.material];
-
-                    output_model.boundingBox = { glm::min(output_model.boundingBox.min, boundingBox.min), glm::max(output_model.boundingBox.max, boundingBox.max) };
-                    MeshGroup* meshGroup = nullptr;
-                    if (materialModePair.second == TransparencyMode::BLENDED)
-                    {
-                        meshGroup = &output_model.transparentMeshes;
-                    }
-                    else if (materialModePair.second == TransparencyMode::MASKED)
-                    {
-                        meshGroup = &output_model.maskedMeshes;
-                    }
-                    else
-                    {
-                        meshGroup = &output_model.opaqueMeshes;
-                    }
-
-                    meshGroup->meshes.push_back(newMesh);
-                    meshGroup->materials.push_back(materialModePair.first);
-                    meshGroup->transforms.push_back(transform);
-                    meshGroup->boundingBoxes.push_back(boundingBox);
+                    visit(primitive, transform);
                 }
             }
         }
@@ -266,14 +180,57 @@ namespace bae
         for (int child_idx : node.children)
         {
             // Process the children (using the Transform) recursively
-            loadModelNode(output_model, gltf_model, gltf_model.nodes[child_idx], transform, materials_list);
+            forEachPrimitive(gltf_model, gltf_model.nodes[child_idx], transform, visit);
         }
     }
 
-    Model loadGltfModel(const std::string& assetPath, const std::string& fileName)
+    AABB getTransformedBoundingBox(tinygltf::Model& gltf_model, const tinygltf::Primitive& primitive, const glm::mat4& transform)
     {
-        Model output_model{};
+        AABB boundingBox = getBoundingBox(gltf_model, primitive);
+        boundingBox.min = glm::vec3{ transform * glm::vec4{ boundingBox.min, 1.0f } };
+        boundingBox.max = glm::vec3{ transform * glm::vec4{ boundingBox.max, 1.0f } };
+        return boundingBox;
+    }
+
+    MeshGroup& getMeshGroup(Model& model, const TransparencyMode mode)
+    {
+        if (mode == TransparencyMode::BLENDED)
+        {
+            return model.transparentMeshes;
+        }
+        else if (mode == TransparencyMode::MASKED)
+        {
+            return model.maskedMeshes;
+        }
+        return model.opaqueMeshes;
+    }
+
+    bgfx::TextureHandle& getTextureSlot(PBRMaterial& material, const uint8_t slot)
+    {
+        bgfx::TextureHandle* slots[] = {
+            &material.baseColorTexture,
+            &material.metallicRoughnessTexture,
+            &material.normalTexture,
+            &material.emissiveTexture,
+            &material.occlusionTexture,
+        };
+        return *slots[slot];
+    }
+
+    uint16_t& getTextureLayerSlot(PBRMaterial& material, const uint8_t slot)
+    {
+        uint16_t* slots[] = {
+            &material.baseColorLayer,
+            &material.metallicRoughnessLayer,
+            &material.normalLayer,
+            &material.emissiveLayer,
+            &material.occlusionLayer,
+        };
+        return *slots[slot];
+    }
 
+    tinygltf::Model loadGltfFile(const std::string& assetPath, const std::string& fileName)
+    {
         tinygltf::TinyGLTF loader;
         loader.SetImageLoader(loadImageDataCallback, nullptr);
         std::string err, warn;
@@ -295,187 +252,361 @@ namespace bae
             throw std::runtime_error("Failed to load GLTF Model");
         }
 
-        const tinygltf::Scene& scene = gltf_model.scenes[gltf_model.defaultScene];
-
-        // Load in dummy files to use for materials that do not have texture present
-        // Allows us to treat all our materials the same way
-        std::string dummyFiles[] = {
-            "textures/dummy_white.dds",
-            "textures/dummy_metallicRoughness.dds",
-            "textures/dummy_normal_map.dds",
-        };
-        const size_t DUMMY_TEXTURE_COUNT = BX_COUNTOF(dummyFiles);
+        return gltf_model;
+    }
 
-        // The plus 3 is due to our dummy textures
-        output_model.textures.reserve(gltf_model.textures.size() + DUMMY_TEXTURE_COUNT);
-        for (const auto& dummyFile : dummyFiles)
+    uint64_t getSamplerFlags(const tinygltf::Model& gltf_model, const tinygltf::Texture& texture)
+    {
+        // Ignore the sampling options for filter -- always use mag: LINEAR and min: LINEAR_MIPMAP_LINEAR
+        uint64_t flags = BGFX_TEXTURE_NONE | BGFX_SAMPLER_MIN_ANISOTROPIC;
+
+        /*
+            For future generations: if you're familiar with the OpenGL/WebGL sampler options, the way that
+            BGFX structures this mapping is to map [SAMPLER_MIN, has_mips + SAMPLER_MIP] to a 2D matrix of
+            all the different possibilities. So if you want LINEAR_MIPMAP_LINEAR, this is equivalent to
+            BGFX_SAMPLER_MIN_ANISOTROPIC. Meanwhile, if you want NEAREST_MIPMAP_NEAREST, you'd use
+            BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MIP_POINT. Whenever you want LINEAR, you don't need a
+            flag UNLESS it's to access the LINEAR_MIPMAP_* flags...
+            */
+
+        if (texture.sampler != -1)
         {
-            bgfx::TextureHandle handle = loadTexture(dummyFile.c_str());
-            output_model.textures.push_back(handle);
+            const tinygltf::Sampler& sampler = gltf_model.samplers[texture.sampler];
+
+            switch (sampler.wrapS)
+            {
+            case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+                flags |= BGFX_SAMPLER_U_CLAMP;
+            case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+                flags |= BGFX_SAMPLER_U_MIRROR;
+            default:
+                // Default is repeat
+                break;
+            }
+            switch (sampler.wrapT)
+            {
+            case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+                flags |= BGFX_SAMPLER_V_CLAMP;
+            case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+                flags |= BGFX_SAMPLER_V_MIRROR;
+            default:
+                // Default is repeat
+                break;
+            }
         }
-        // TEXTURES
-        for (const tinygltf::Texture& texture : gltf_model.textures)
-        {
-            const std::string& uri = assetPath + gltf_model.images[texture.source].uri;
 
-            // Ignore the sampling options for filter -- always use mag: LINEAR and min: LINEAR_MIPMAP_LINEAR
-            uint64_t flags = BGFX_TEXTURE_NONE | BGFX_SAMPLER_MIN_ANISOTROPIC;
+        return flags;
+    }
 
-            /*
-                For future generations: if you're familiar with the OpenGL/WebGL sampler options, the way that
-                BGFX structures this mapping is to map [SAMPLER_MIN, has_mips + SAMPLER_MIP] to a 2D matrix of
-                all the different possibilities. So if you want LINEAR_MIPMAP_LINEAR, this is equivalent to
-                BGFX_SAMPLER_MIN_ANISOTROPIC. Meanwhile, if you want NEAREST_MIPMAP_NEAREST, you'd use
-                BGFX_SAMPLER_MIN_POINT | BGFX_SAMPLER_MIP_POINT. Whenever you want LINEAR, you don't need a
-                flag UNLESS it's to access the LINEAR_MIPMAP_* flags...
-                */
+    // Reads a material's factors and which textures it uses, leaving the texture handles to the caller
+    GltfSourceMaterial readMaterial(const tinygltf::Material& material)
+    {
+        // NOTE: We do not respect texCoord values other than the default 0... sorry!
+        // Set default values
+        GltfSourceMaterial sourceMaterial{};
+        PBRMaterial& materialData = sourceMaterial.material;
+        materialData.baseColorFactor = { 1.0f, 1.0f, 1.0f, 1.0f };
+        materialData.emissiveFactor = { 0.0f, 0.0f, 0.0f, 1.0f };
+        materialData.alphaCutoff = 0.5f;
+        materialData.metallicFactor = 1.0f;
+        materialData.roughnessFactor = 1.0f;
+
+        auto valuesEnd = material.values.end();
+        auto p_keyValue = material.values.find("baseColorTexture");
+        if (p_keyValue != valuesEnd)
+        {
+            sourceMaterial.textures[0] = p_keyValue->second.TextureIndex();
+        };
 
-            if (texture.sampler != -1)
-            {
-                const tinygltf::Sampler& sampler = gltf_model.samplers[texture.sampler];
+        p_keyValue = material.values.find("baseColorFactor");
+        if (p_keyValue != valuesEnd)
+        {
+            const auto& data = p_keyValue->second.ColorFactor();
+            materialData.baseColorFactor = glm::vec4{
+                static_cast<float>(data[0]),
+                static_cast<float>(data[1]),
+                static_cast<float>(data[2]),
+                static_cast<float>(data[3]),
+            };
+        }
 
-                switch (sampler.wrapS)
-                {
-                case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
-                    flags |= BGFX_SAMPLER_U_CLAMP;
-                case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
-                    flags |= BGFX_SAMPLER_U_MIRROR;
-                default:
-                    // Default is repeat
-                    break;
-                }
-                switch (sampler.wrapT)
-                {
-                case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
-                    flags |= BGFX_SAMPLER_V_CLAMP;
-                case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
-                    flags |= BGFX_SAMPLER_V_MIRROR;
-                default:
-                    // Default is repeat
-                    break;
-                }
-            }
+        p_keyValue = material.values.find("metallicRoughnessTexture");
+        if (p_keyValue != valuesEnd)
+        {
+            sourceMaterial.textures[1] = p_keyValue->second.TextureIndex();
+        }
 
-            bgfx::TextureHandle handle = loadTexture(uri.c_str(), flags);
-            output_model.textures.push_back(handle);
+        p_keyValue = material.values.find("metallicFactor");
+        if (p_keyValue != valuesEnd)
+        {
+            materialData.metallicFactor = static_cast<float>(p_keyValue->second.Factor());
         }
 
-        MaterialsList materials_list;
-        materials_list.reserve(gltf_model.materials.size());
+        // Additional Factors
 
-        // MATERIALS
-        for (const tinygltf::Material& material : gltf_model.materials)
+        valuesEnd = material.additionalValues.end();
+        p_keyValue = material.additionalValues.find("normalTexture");
+        if (p_keyValue != valuesEnd)
         {
-            // NOTE: We do not respect texCoord values other than the default 0... sorry!
-            // Set default values
-            PBRMaterial materialData{
-                {1.0f, 1.0f, 1.0f, 1.0f}, // baseColorFactor
-                {0.0f, 0.0f, 0.0f, 1.0f}, // emissiveFactor
-                0.5f,                     // alphaCutoff
-                1.0f,                     // metallicFactor
-                1.0f,                     // roughnessFactor
-                output_model.textures[0], // baseColorTexture as dummy_white
-                output_model.textures[1], // metallicRoughnessTexture as dummy_metallicRoughness;
-                output_model.textures[2], // normalTexture as dummy_normal_map;
-                output_model.textures[0], // emissiveTexture as dummy_white;
-                output_model.textures[0], // occlusionTexture as dummy_white;
-            };
-            TransparencyMode transparency_mode = TransparencyMode::OPAQUE_;
+            sourceMaterial.textures[2] = p_keyValue->second.TextureIndex();
+        }
 
-            auto valuesEnd = material.values.end();
-            auto p_keyValue = material.values.find("baseColorTexture");
-            if (p_keyValue != valuesEnd)
-            {
-                materialData.baseColorTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
-            };
+        p_keyValue = material.additionalValues.find("emissiveTexture");
+        if (p_keyValue != valuesEnd)
+        {
+            sourceMaterial.textures[3] = p_keyValue->second.TextureIndex();
 
-            p_keyValue = material.values.find("baseColorFactor");
-            if (p_keyValue != valuesEnd)
+            if (material.additionalValues.find("emissiveFactor") != valuesEnd)
             {
-                const auto& data = p_keyValue->second.ColorFactor();
-                materialData.baseColorFactor = glm::vec4{
+                const auto& data = material.additionalValues.at("emissiveFactor").ColorFactor();
+                materialData.emissiveFactor = glm::vec4(
                     static_cast<float>(data[0]),
                     static_cast<float>(data[1]),
                     static_cast<float>(data[2]),
-                    static_cast<float>(data[3]),
-                };
+                    1.0f);
             }
+        };
 
-            p_keyValue = material.values.find("metallicRoughnessTexture");
-            if (p_keyValue != valuesEnd)
-            {
-                materialData.metallicRoughnessTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
-            }
+        p_keyValue = material.additionalValues.find("occlusionTexture");
+        if (p_keyValue != valuesEnd)
+        {
+            sourceMaterial.textures[4] = p_keyValue->second.TextureIndex();
+        }
+
+        p_keyValue = material.additionalValues.find("metallicRoughnessTexture");
+        if (p_keyValue != valuesEnd)
+        {
+            sourceMaterial.textures[1] = p_keyValue->second.TextureIndex();
+        }
 
-            p_keyValue = material.values.find("metallicFactor");
-            if (p_keyValue != valuesEnd)
+        p_keyValue = material.additionalValues.find("alphaMode");
+        if (p_keyValue != valuesEnd)
+        {
+            if (p_keyValue->second.string_value == "BLEND")
             {
-                materialData.metallicFactor = static_cast<float>(p_keyValue->second.Factor());
+                sourceMaterial.mode = TransparencyMode::BLENDED;
             }
-
-            // Additional Factors
-
-            valuesEnd = material.additionalValues.end();
-            p_keyValue = material.additionalValues.find("normalTexture");
-            if (p_keyValue != valuesEnd)
+            else if (p_keyValue->second.string_value == "MASK")
             {
-                materialData.normalTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
+                sourceMaterial.mode = TransparencyMode::MASKED;
             }
+        }
 
-            p_keyValue = material.additionalValues.find("emissiveTexture");
-            if (p_keyValue != valuesEnd)
-            {
-                materialData.emissiveTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
+        p_keyValue = material.additionalValues.find("alphaCutoff");
+        if (p_keyValue != valuesEnd)
+        {
+            materialData.alphaCutoff = static_cast<float>(p_keyValue->second.Factor());
+        }
 
-                if (material.additionalValues.find("emissiveFactor") != valuesEnd)
-                {
-                    const auto& data = material.additionalValues.at("emissiveFactor").ColorFactor();
-                    materialData.emissiveFactor = glm::vec4(
-                        static_cast<float>(data[0]),
-                        static_cast<float>(data[1]),
-                        static_cast<float>(data[2]),
-                        1.0f);
-                }
-            };
+        return sourceMaterial;
+    }
+
+    // Reads a primitive's indices and float attributes, generating tangents where they're missing
+    void readPrimitive(tinygltf::Model& gltf_model, const tinygltf::Primitive& primitive, MeshData& meshData)
+    {
+        const tinygltf::Accessor& indexAccessor = gltf_model.accessors[primitive.indices];
+        if (indexAccessor.type != TINYGLTF_TYPE_SCALAR || indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT)
+        {
+            throw std::runtime_error("Don't know how to handle non uint16_t indices");
+        }
+        const tinygltf::BufferView& indexView = gltf_model.bufferViews[indexAccessor.bufferView];
+        const uint16_t* indices = reinterpret_cast<const uint16_t*>(gltf_model.buffers[indexView.buffer].data.data() + indexView.byteOffset);
+        meshData.indices.assign(indices, indices + indexAccessor.count / 3u * 3u);
 
-            p_keyValue = material.additionalValues.find("occlusionTexture");
-            if (p_keyValue != valuesEnd)
+        // Returns the attribute's data, or nullptr for a missing one
+        const auto getAttribute = [&](const std::string& attrName) -> const unsigned char* {
+            if (primitive.attributes.count(attrName) == 0)
             {
-                materialData.occlusionTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
+                return nullptr;
             }
+            const tinygltf::Accessor& accessor{ gltf_model.accessors[primitive.attributes.at(attrName)] };
+            if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+            {
+                throw std::runtime_error("Can only read float " + attrName + " attributes");
+            }
+            const tinygltf::BufferView& bufferView{ gltf_model.bufferViews[accessor.bufferView] };
+            return gltf_model.buffers[bufferView.buffer].data.data() + bufferView.byteOffset;
+        };
 
-            p_keyValue = material.additionalValues.find("metallicRoughnessTexture");
-            if (p_keyValue != valuesEnd)
+        const std::string REQUIRED_ATTRIBUTES[] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+        for (const std::string& attrName : REQUIRED_ATTRIBUTES)
+        {
+            if (getAttribute(attrName) == nullptr)
             {
-                materialData.metallicRoughnessTexture = output_model.textures[p_keyValue->second.TextureIndex() + DUMMY_TEXTURE_COUNT];
+                throw std::runtime_error("Cannot handle meshes without " + attrName + " attribute");
             }
+        }
+
+        const tinygltf::Accessor& positionAccessor = gltf_model.accessors[primitive.attributes.at("POSITION")];
+        const size_t numVertices = gltf_model.bufferViews[positionAccessor.bufferView].byteLength / sizeof(glm::vec3);
+        const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(getAttribute("POSITION"));
+        const glm::vec3* normals = reinterpret_cast<const glm::vec3*>(getAttribute("NORMAL"));
+        const glm::vec2* texcoords = reinterpret_cast<const glm::vec2*>(getAttribute("TEXCOORD_0"));
+        meshData.positions.assign(positions, positions + numVertices);
+        meshData.normals.assign(normals, normals + numVertices);
+        meshData.texcoords.assign(texcoords, texcoords + numVertices);
+
+        const glm::vec4* tangents = reinterpret_cast<const glm::vec4*>(getAttribute("TANGENT"));
+        if (tangents != nullptr)
+        {
+            meshData.tangents.assign(tangents, tangents + numVertices);
+            return;
+        }
+
+        // If our tangents are missing, calculate them
+        meshData.tangents.resize(numVertices);
+        VertexData vertData{};
+        vertData.p_indices = meshData.indices.data();
+        vertData.data[0] = reinterpret_cast<unsigned char*>(meshData.positions.data());
+        vertData.data[1] = reinterpret_cast<unsigned char*>(meshData.normals.data());
+        vertData.data[2] = reinterpret_cast<unsigned char*>(meshData.tangents.data());
+        vertData.data[3] = reinterpret_cast<unsigned char*>(meshData.texcoords.data());
+        vertData.byteLengths[0] = numVertices * sizeof(glm::vec3);
+        vertData.byteLengths[1] = numVertices * sizeof(glm::vec3);
+        vertData.byteLengths[2] = numVertices * sizeof(glm::vec4);
+        vertData.byteLengths[3] = numVertices * sizeof(glm::vec2);
+        vertData.numFaces = meshData.indices.size() / 3;
+        vertData.numVertices = numVertices;
+        MikktSpace::calcTangents(vertData);
+    }
+
+    void parseGltfModel(
+        const std::string& assetPath,
+        const std::string& fileName,
+        const std::function<void(GltfSource&&)>& onLayout,
+        const std::function<void(GltfSourceMesh&&)>& onMesh)
+    {
+        tinygltf::Model gltf_model = loadGltfFile(assetPath, fileName);
+        const tinygltf::Scene& scene = gltf_model.scenes[gltf_model.defaultScene];
+
+        GltfSource source;
+        source.textures.reserve(gltf_model.textures.size());
+        for (const tinygltf::Texture& texture : gltf_model.textures)
+        {
+            source.textures.push_back({ assetPath + gltf_model.images[texture.source].uri, getSamplerFlags(gltf_model, texture) });
+        }
+        source.materials.reserve(gltf_model.materials.size());
+        for (const tinygltf::Material& material : gltf_model.materials)
+        {
+            source.materials.push_back(readMaterial(material));
+        }
+        onLayout(std::move(source));
+
+        for (const int node_idx : scene.nodes)
+        {
+            forEachPrimitive(gltf_model, gltf_model.nodes[node_idx], glm::identity<glm::mat4>(),
+                [&](const tinygltf::Primitive& primitive, const glm::mat4& transform) {
+                    GltfSourceMesh sourceMesh;
+                    readPrimitive(gltf_model, primitive, sourceMesh.data);
+                    sourceMesh.boundingBox = getTransformedBoundingBox(gltf_model, primitive, transform);
+                    sourceMesh.transform = transform;
+                    sourceMesh.material = uint32_t(primitive.material);
+                    onMesh(std::move(sourceMesh));
+                });
+        }
+    }
+
+    Model loadGltfModel(
+        const std::string& assetPath,
+        const std::string& fileName,
+        const bool keepMeshData,
+        GeometryPool* geometryPool,
+        TextureArrays* textureArrays,
+        TextureStreamer* textureStreamer)
+    {
+        if (textureArrays != nullptr && textureStreamer != nullptr)
+        {
+            throw std::runtime_error("Texture arrays can't be streamed");
+        }
+        // Plain textures instead, callers check TextureArrays::isSupported to pick shaders that sample those
+        if (textureArrays != nullptr && !TextureArrays::isSupported())
+        {
+            textureArrays = nullptr;
+        }
 
-            p_keyValue = material.additionalValues.find("alphaMode");
-            if (p_keyValue != valuesEnd)
+        Model output_model{};
+        // Load in dummy files to use for materials that do not have texture present
+        // Allows us to treat all our materials the same way
+        const size_t DUMMY_TEXTURE_COUNT = BX_COUNTOF(GLTF_DUMMY_TEXTURE_FILES);
+        // When packing into texture arrays, this is the array and layer of each texture instead
+        std::vector<TextureLayer> textureLayers;
+        std::vector<GltfSourceMaterial> sourceMaterials;
+        std::vector<PBRMaterial> materials;
+
+        parseGltfModel(assetPath, fileName,
+            [&](GltfSource&& source)
             {
-                if (p_keyValue->second.string_value == "BLEND")
+                output_model.textures.reserve(source.textures.size() + DUMMY_TEXTURE_COUNT);
+                for (const char* dummyFile : GLTF_DUMMY_TEXTURE_FILES)
                 {
-                    transparency_mode = TransparencyMode::BLENDED;
+                    if (textureArrays != nullptr)
+                    {
+                        textureLayers.push_back(textureArrays->add(dummyFile, BGFX_TEXTURE_NONE | BGFX_SAMPLER_NONE));
+                        continue;
+                    }
+                    // Every model uses the same dummies, so they're only ever loaded once
+                    output_model.textures.push_back(getTextureCache().acquire(dummyFile));
                 }
-                else if (p_keyValue->second.string_value == "MASK")
+                for (const GltfSourceTexture& texture : source.textures)
                 {
-                    transparency_mode = TransparencyMode::MASKED;
+                    if (textureArrays != nullptr)
+                    {
+                        textureLayers.push_back(textureArrays->add(texture.path.c_str(), texture.flags));
+                        continue;
+                    }
+                    if (textureStreamer != nullptr)
+                    {
+                        output_model.textures.push_back(textureStreamer->add(texture.path.c_str(), texture.flags));
+                        continue;
+                    }
+                    output_model.textures.push_back(getTextureCache().acquire(texture.path, texture.flags));
+                }
+
+                if (textureArrays != nullptr)
+                {
+                    // Materials reference the array each texture ended up in, along with its layer
+                    textureArrays->build();
+                    for (const TextureLayer& textureLayer : textureLayers)
+                    {
+                        output_model.textures.push_back(textureArrays->getTexture(textureLayer.array));
+                    }
                 }
-            }
 
-            p_keyValue = material.additionalValues.find("alphaCutoff");
-            if (p_keyValue != valuesEnd)
+                sourceMaterials = std::move(source.materials);
+                materials.reserve(sourceMaterials.size());
+                for (const GltfSourceMaterial& sourceMaterial : sourceMaterials)
+                {
+                    PBRMaterial material = sourceMaterial.material;
+                    for (uint8_t slot = 0; slot < BX_COUNTOF(sourceMaterial.textures); ++slot)
+                    {
+                        const size_t textureIdx = sourceMaterial.textures[slot] >= 0
+                            ? size_t(sourceMaterial.textures[slot]) + DUMMY_TEXTURE_COUNT
+                            : GLTF_DUMMY_TEXTURE_FOR_SLOT[slot];
+                        getTextureSlot(material, slot) = output_model.textures[textureIdx];
+                        getTextureLayerSlot(material, slot) = textureLayers.empty() ? 0 : textureLayers[textureIdx].layer;
+                    }
+                    materials.push_back(material);
+                }
+            },
+            [&](GltfSourceMesh&& sourceMesh)
             {
-                materialData.alphaCutoff = static_cast<float>(p_keyValue->second.Factor());
-            }
+                const Mesh mesh = createMesh(sourceMesh.data, geometryPool);
+                if (geometryPool != nullptr && !mesh.geometry.isValid())
+                {
+                    throw std::runtime_error("Geometry pool has no room left for this mesh");
+                }
+                addMesh(output_model, mesh, materials[sourceMesh.material], sourceMaterials[sourceMesh.material].mode, sourceMesh, keepMeshData);
+            });
 
-            materials_list.emplace_back(materialData, transparency_mode);
+        // The arrays belong to textureArrays, so they shouldn't be destroyed along with the model
+        if (textureArrays != nullptr)
+        {
+            output_model.textures.clear();
         }
-
-        // For each node in the scene
-        for (const int node_idx : scene.nodes)
+        // Same for streamed textures, only the dummies belong to the model
+        if (textureStreamer != nullptr)
         {
-            loadModelNode(output_model, gltf_model, gltf_model.nodes[node_idx], glm::identity<glm::mat4>(), materials_list);
+            output_model.textures.resize(DUMMY_TEXTURE_COUNT);
         }
 
         return output_model;
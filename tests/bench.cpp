@@ -0,0 +1,51 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace bae
+{
+    namespace bench
+    {
+        static Benchmark* s_first = nullptr;
+        static Benchmark* s_last = nullptr;
+
+        BenchmarkRegistrar::BenchmarkRegistrar(Benchmark& benchmark)
+        {
+            if (s_last != nullptr) {
+                s_last->next = &benchmark;
+            }
+            else {
+                s_first = &benchmark;
+            }
+            s_last = &benchmark;
+        }
+
+        void report(const char* label, const double nsPerIteration, const uint64_t itemsPerIteration)
+        {
+            if (itemsPerIteration > 1) {
+                const double itemsPerSecond = double(itemsPerIteration) * 1e9 / nsPerIteration;
+                printf("  %-56s %12.2f ns %10.2f M items/s\n", label, nsPerIteration, itemsPerSecond * 1e-6);
+            }
+            else {
+                printf("  %-56s %12.2f ns\n", label, nsPerIteration);
+            }
+        }
+    }
+}
+
+// Usage: bae-bench [filter], where only the benchmarks with filter in their name are run
+int main(int argc, const char* argv[])
+{
+    using namespace bae::bench;
+
+    const char* filter = argc > 1 ? argv[1] : "";
+    for (Benchmark* benchmark = s_first; benchmark != nullptr; benchmark = benchmark->next) {
+        if (strstr(benchmark->name, filter) == nullptr) {
+            continue;
+        }
+        printf("%s\n", benchmark->name);
+        benchmark->function();
+    }
+    return 0;
+}
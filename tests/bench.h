@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Microbenchmarks for the CPU side of bae, next to the tests and registered the same way. The runner in bench.cpp
+// runs every one whose name contains its first argument, and each reports as many measurements as it likes.
+//
+//   BENCHMARK("Handle lookups")
+//   {
+//       bae::bench::run("HandlePool::get", [&]() { ... });
+//   }
+//
+// Build in release, a debug build mostly measures how well the compiler inlines nothing.
+namespace bae
+{
+    namespace bench
+    {
+        struct Benchmark
+        {
+            const char* name;
+            void (*function)();
+            Benchmark* next;
+        };
+
+        struct BenchmarkRegistrar
+        {
+            BenchmarkRegistrar(Benchmark& benchmark);
+        };
+
+        // Prints one result line, ns per iteration, plus items per second when an iteration handles itemsPerIteration
+        void report(const char* label, const double nsPerIteration, const uint64_t itemsPerIteration);
+
+        // Keeps the compiler from dropping work whose result isn't otherwise used
+        template<typename T>
+        inline void doNotOptimize(const T& value)
+        {
+            const volatile uint8_t* bytes = reinterpret_cast<const volatile uint8_t*>(&value);
+            (void)bytes[0];
+        }
+
+        // Calls function in batches sized to take a few milliseconds each and reports the fastest batch, which is
+        // the one the least disturbed by the rest of the system.
+        template<typename Function>
+        inline double run(const char* label, Function&& function, const uint64_t itemsPerIteration = 1)
+        {
+            using Clock = std::chrono::high_resolution_clock;
+            constexpr double MIN_BATCH_NS = 5e6;
+            constexpr uint32_t BATCH_COUNT = 7;
+
+            uint64_t iterations = 1;
+            double best = 0.0;
+            for (uint32_t batch = 0; batch < BATCH_COUNT;) {
+                const Clock::time_point start = Clock::now();
+                for (uint64_t i = 0; i < iterations; ++i) {
+                    function();
+                }
+                const double elapsed = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+                // Grow the batch until it's long enough to time, those first short ones don't count
+                if (elapsed < MIN_BATCH_NS && iterations < (1ull << 40)) {
+                    iterations *= 2;
+                    continue;
+                }
+                const double nsPerIteration = elapsed / double(iterations);
+                best = batch == 0 ? nsPerIteration : (nsPerIteration < best ? nsPerIteration : best);
+                ++batch;
+            }
+
+            report(label, best, itemsPerIteration);
+            return best;
+        }
+    }
+}
+
+#define BAE_BENCH_CONCAT_(a, b) a##b
+#define BAE_BENCH_CONCAT(a, b) BAE_BENCH_CONCAT_(a, b)
+
+#define BAE_BENCHMARK_(name, function)                                                              \
+    static void function();                                                                         \
+    static bae::bench::Benchmark BAE_BENCH_CONCAT(function, _benchmark) = { name, function, nullptr }; \
+    static bae::bench::BenchmarkRegistrar BAE_BENCH_CONCAT(function, _registrar)(BAE_BENCH_CONCAT(function, _benchmark)); \
+    static void function()
+
+#define BENCHMARK(name) BAE_BENCHMARK_(name, BAE_BENCH_CONCAT(benchmark, __LINE__))
@@ -0,0 +1,142 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "DrawInstancing.h"
+#include "FrameArena.h"
+
+namespace
+{
+    // The FlightHelmet's meshes, on a 64x64 grid
+    constexpr uint32_t MESH_COUNT = 20;
+    constexpr uint32_t GRID_SIZE = 64;
+    constexpr uint32_t DRAW_COUNT = MESH_COUNT * GRID_SIZE * GRID_SIZE;
+    const uint64_t STATE_OPAQUE = BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS;
+
+    // Laid out like the instancer's own draws, so the sorts move as much memory as it does
+    struct SortDraw
+    {
+        uint32_t mesh;
+        uint32_t material;
+        uint64_t state;
+        uint32_t blendRun;
+        uint32_t order;
+        glm::mat4 transform;
+    };
+
+    bool isLess(const SortDraw& a, const SortDraw& b)
+    {
+        return std::make_tuple(a.blendRun, a.mesh, a.material, a.state) < std::make_tuple(b.blendRun, b.mesh, b.material, b.state);
+    }
+
+    // std::stable_sort without its temporary buffer: merges through scratch memory from the arena instead, and
+    // gives it back before returning
+    template<class Iterator, class Compare>
+    void arenaStableSort(Iterator first, Iterator last, Compare compare, bae::FrameArena& arena)
+    {
+        using T = typename std::iterator_traits<Iterator>::value_type;
+        const size_t count = size_t(std::distance(first, last));
+        if (count < 2) {
+            return;
+        }
+
+        // Insertion sort short runs, then merge runs of doubling width back and forth between data and scratch
+        constexpr size_t RUN_LENGTH = 16;
+        T* data = &*first;
+        for (size_t start = 0; start < count; start += RUN_LENGTH) {
+            const size_t end = std::min(start + RUN_LENGTH, count);
+            for (size_t i = start + 1; i < end; ++i) {
+                const T value = data[i];
+                size_t j = i;
+                for (; j > start && compare(value, data[j - 1]); --j) {
+                    data[j] = data[j - 1];
+                }
+                data[j] = value;
+            }
+        }
+        if (count <= RUN_LENGTH) {
+            return;
+        }
+
+        const bae::FrameArena::Marker marker = arena.getMarker();
+        T* from = data;
+        T* to = arena.allocate<T>(count);
+        for (size_t width = RUN_LENGTH; width < count; width *= 2) {
+            for (size_t start = 0; start < count; start += 2 * width) {
+                const size_t middle = std::min(start + width, count);
+                const size_t end = std::min(start + 2 * width, count);
+                std::merge(from + start, from + middle, from + middle, from + end, to + start, compare);
+            }
+            std::swap(from, to);
+        }
+        if (from != data) {
+            std::copy(from, from + count, data);
+        }
+        arena.rewind(marker);
+    }
+}
+
+BENCHMARK("Draw instancing")
+{
+    std::vector<bae::Mesh> meshes(MESH_COUNT);
+    for (uint32_t i = 0; i < MESH_COUNT; ++i) {
+        meshes[i].indexHandle.idx = uint16_t(i);
+        meshes[i].vertexHandles[0].idx = uint16_t(i);
+    }
+    std::vector<glm::mat4> transforms;
+    for (uint32_t y = 0; y < GRID_SIZE; ++y) {
+        for (uint32_t x = 0; x < GRID_SIZE; ++x) {
+            transforms.push_back(glm::translate(glm::mat4{ 1.0f }, glm::vec3{ float(x), 0.0f, float(y) }));
+        }
+    }
+
+    bae::DrawInstancer instancer;
+    bae::bench::run("DrawInstancer begin + add + end, 64x64 helmets", [&]() {
+        instancer.begin();
+        for (const glm::mat4& transform : transforms) {
+            for (uint32_t i = 0; i < MESH_COUNT; ++i) {
+                instancer.add(meshes[i], i, STATE_OPAQUE, transform);
+            }
+        }
+        instancer.end();
+        bae::bench::doNotOptimize(instancer.getBatchCount());
+    }, DRAW_COUNT);
+
+    // The sort on its own, over draws in the order a scene walk adds them, every way we could do it
+    std::vector<SortDraw> unsorted;
+    for (uint32_t i = 0; i < DRAW_COUNT; ++i) {
+        unsorted.push_back({ i % MESH_COUNT, i % MESH_COUNT, STATE_OPAQUE, 0, i, transforms[i / MESH_COUNT] });
+    }
+    std::vector<SortDraw> draws;
+    bae::FrameArena arena;
+    arena.init(bae::FrameArenaParams{});
+    bae::bench::run("std::stable_sort", [&]() {
+        draws = unsorted;
+        std::stable_sort(draws.begin(), draws.end(), isLess);
+        bae::bench::doNotOptimize(draws[0]);
+    }, DRAW_COUNT);
+    bae::bench::run("Merge sort through arena scratch memory", [&]() {
+        draws = unsorted;
+        arenaStableSort(draws.begin(), draws.end(), isLess, arena);
+        arena.endFrame();
+        bae::bench::doNotOptimize(draws[0]);
+    }, DRAW_COUNT);
+    bae::bench::run("std::sort, ties broken on order", [&]() {
+        draws = unsorted;
+        std::sort(draws.begin(), draws.end(), [](const SortDraw& a, const SortDraw& b) {
+            return std::make_tuple(a.blendRun, a.mesh, a.material, a.state, a.order) < std::make_tuple(b.blendRun, b.mesh, b.material, b.state, b.order);
+        });
+        bae::bench::doNotOptimize(draws[0]);
+    }, DRAW_COUNT);
+    bae::bench::run("Copy only", [&]() {
+        draws = unsorted;
+        bae::bench::doNotOptimize(draws[0]);
+    }, DRAW_COUNT);
+    arena.destroy();
+}
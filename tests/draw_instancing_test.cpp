@@ -0,0 +1,105 @@
+#include "test.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "DrawInstancing.h"
+
+namespace
+{
+    const uint64_t STATE_OPAQUE = BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_Z | BGFX_STATE_DEPTH_TEST_LESS;
+    const uint64_t STATE_BLENDED = BGFX_STATE_WRITE_RGB | BGFX_STATE_DEPTH_TEST_LESS | BGFX_STATE_BLEND_ALPHA;
+
+    bae::Mesh makeMesh(const uint16_t idx)
+    {
+        bae::Mesh mesh;
+        mesh.indexHandle.idx = idx;
+        mesh.vertexHandles[0].idx = idx;
+        return mesh;
+    }
+
+    glm::mat4 atDepth(const float depth)
+    {
+        return glm::translate(glm::mat4{ 1.0f }, glm::vec3{ 0.0f, 0.0f, depth });
+    }
+}
+
+TEST_CASE("Opaque draws of the same mesh, material and state are batched")
+{
+    const bae::Mesh meshA = makeMesh(1);
+    const bae::Mesh meshB = makeMesh(2);
+    // A copy of a mesh still batches with the original
+    const bae::Mesh meshACopy = meshA;
+
+    bae::DrawInstancer instancer;
+    instancer.begin();
+    instancer.add(meshA, 0, STATE_OPAQUE, atDepth(1.0f));
+    instancer.add(meshB, 0, STATE_OPAQUE, atDepth(2.0f));
+    instancer.add(meshACopy, 0, STATE_OPAQUE, atDepth(3.0f));
+    instancer.add(meshA, 1, STATE_OPAQUE, atDepth(4.0f));
+    instancer.add(meshB, 0, STATE_OPAQUE, atDepth(5.0f));
+    instancer.end();
+
+    REQUIRE(instancer.getBatchCount() == 3);
+    // In the order of each batch's first draw, with draws in the order they were added
+    const bae::InstanceBatch& first = instancer.getBatch(0);
+    CHECK(first.mesh == &meshA && first.material == 0 && first.count == 2);
+    CHECK(instancer.getTransform(first.firstDraw)[3].z == 1.0f);
+    CHECK(instancer.getTransform(first.firstDraw + 1)[3].z == 3.0f);
+    const bae::InstanceBatch& second = instancer.getBatch(1);
+    CHECK(second.mesh == &meshB && second.count == 2);
+    CHECK(instancer.getTransform(second.firstDraw + 1)[3].z == 5.0f);
+    CHECK(instancer.getBatch(2).material == 1);
+    CHECK(instancer.getStats().draws == 5);
+    CHECK(instancer.getStats().batches == 3);
+}
+
+TEST_CASE("Blended draws keep the order they were added in")
+{
+    const bae::Mesh glass = makeMesh(1);
+    const bae::Mesh smoke = makeMesh(2);
+
+    // Back to front: glass, smoke, glass. Merging the two glass draws would draw the far one over the smoke.
+    bae::DrawInstancer instancer;
+    instancer.begin();
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(30.0f));
+    instancer.add(smoke, 1, STATE_BLENDED, atDepth(20.0f));
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(10.0f));
+    instancer.end();
+
+    REQUIRE(instancer.getBatchCount() == 3);
+    const float expectedDepths[] = { 30.0f, 20.0f, 10.0f };
+    for (size_t i = 0; i < instancer.getBatchCount(); ++i) {
+        const bae::InstanceBatch& batch = instancer.getBatch(i);
+        CHECK(batch.count == 1);
+        CHECK(instancer.getTransform(batch.firstDraw)[3].z == expectedDepths[i]);
+    }
+}
+
+TEST_CASE("Consecutive identical blended draws are still batched")
+{
+    const bae::Mesh opaque = makeMesh(1);
+    const bae::Mesh glass = makeMesh(2);
+
+    bae::DrawInstancer instancer;
+    instancer.begin();
+    instancer.add(opaque, 0, STATE_OPAQUE, atDepth(1.0f));
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(40.0f));
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(30.0f));
+    instancer.add(glass, 0, STATE_OPAQUE, atDepth(2.0f));
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(20.0f));
+    instancer.add(glass, 0, STATE_BLENDED, atDepth(10.0f));
+    instancer.add(opaque, 0, STATE_OPAQUE, atDepth(3.0f));
+    instancer.end();
+
+    // Opaque draws still merge across the blended ones, blended ones only with their neighbours
+    REQUIRE(instancer.getBatchCount() == 4);
+    CHECK(instancer.getBatch(0).mesh == &opaque);
+    CHECK(instancer.getBatch(0).count == 2);
+    CHECK(instancer.getBatch(1).state == STATE_BLENDED);
+    CHECK(instancer.getBatch(1).count == 2);
+    CHECK(instancer.getTransform(instancer.getBatch(1).firstDraw)[3].z == 40.0f);
+    CHECK(instancer.getBatch(2).state == STATE_OPAQUE);
+    CHECK(instancer.getBatch(3).state == STATE_BLENDED);
+    CHECK(instancer.getBatch(3).count == 2);
+    CHECK(instancer.getTransform(instancer.getBatch(3).firstDraw)[3].z == 20.0f);
+}
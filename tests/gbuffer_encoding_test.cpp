@@ -0,0 +1,135 @@
+#include "test.h"
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "GBufferEncoding.h"
+
+// Evenly spread directions over the whole sphere, both hemispheres of the octahedron included
+static glm::vec3 getSphereDirection(const uint32_t idx, const uint32_t count)
+{
+    const float goldenAngle = 2.39996323f;
+    const float z = 1.0f - 2.0f * (float(idx) + 0.5f) / float(count);
+    const float radius = std::sqrt(1.0f - z * z);
+    const float phi = goldenAngle * float(idx);
+    return glm::vec3{ radius * std::cos(phi), radius * std::sin(phi), z };
+}
+
+static float getAngleDegrees(const glm::vec3& a, const glm::vec3& b)
+{
+    return glm::degrees(std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f)));
+}
+
+static float getMaxNormalError(const uint32_t bits)
+{
+    constexpr uint32_t DIRECTION_COUNT = 100000;
+    float maxError = 0.0f;
+    for (uint32_t i = 0; i < DIRECTION_COUNT; ++i) {
+        const glm::vec3 normal = getSphereDirection(i, DIRECTION_COUNT);
+        const glm::vec2 encoded = bae::quantizeUnorm(bae::encodeNormalOctahedron(normal), bits);
+        maxError = std::max(maxError, getAngleDegrees(normal, bae::decodeNormalOctahedron(encoded)));
+    }
+    return maxError;
+}
+
+TEST_CASE("Octahedral normals round trip exactly without quantization")
+{
+    const glm::vec3 axes[] = {
+        { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+        { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+    };
+    for (const glm::vec3& axis : axes) {
+        const glm::vec2 encoded = bae::encodeNormalOctahedron(axis);
+        CHECK(encoded.x >= 0.0f && encoded.x <= 1.0f);
+        CHECK(encoded.y >= 0.0f && encoded.y <= 1.0f);
+        CHECK(getAngleDegrees(axis, bae::decodeNormalOctahedron(encoded)) < 1e-3f);
+    }
+
+    constexpr uint32_t DIRECTION_COUNT = 10000;
+    for (uint32_t i = 0; i < DIRECTION_COUNT; ++i) {
+        const glm::vec3 normal = getSphereDirection(i, DIRECTION_COUNT);
+        const glm::vec3 decoded = bae::decodeNormalOctahedron(bae::encodeNormalOctahedron(normal));
+        CHECK(getAngleDegrees(normal, decoded) < 0.05f);
+        CHECK_CLOSE(glm::length(decoded), 1.0f, 1e-5f);
+    }
+}
+
+TEST_CASE("Octahedral normals stay within the precision of each compact layout")
+{
+    // RGBA16 normals, what COMPACT_16 stores. Indistinguishable from the float round trip above.
+    CHECK(getMaxNormalError(16) < 0.05f);
+    // RGBA8 normals, what COMPACT_8 stores. Visible on smooth surfaces, but within the usual bounds for 8 bits.
+    CHECK(getMaxNormalError(8) < 1.0f);
+}
+
+TEST_CASE("Roughness and metalness round trip through UNORM targets")
+{
+    const uint32_t bitDepths[] = { 8, 16 };
+    for (const uint32_t bits : bitDepths) {
+        const float step = 1.0f / float((1u << bits) - 1u);
+        for (uint32_t i = 0; i <= 1000; ++i) {
+            const float value = float(i) / 1000.0f;
+            const float quantized = bae::quantizeUnorm(value, bits);
+            CHECK(std::abs(quantized - value) <= 0.5f * step + 1e-6f);
+            // Quantizing what a target stores gives back the same value
+            CHECK(bae::quantizeUnorm(quantized, bits) == quantized);
+        }
+
+        // Fully rough and fully metallic have to survive exactly
+        CHECK(bae::quantizeUnorm(0.0f, bits) == 0.0f);
+        CHECK(bae::quantizeUnorm(1.0f, bits) == 1.0f);
+        // Factors above 1 get clamped, like the render target would
+        CHECK(bae::quantizeUnorm(1.5f, bits) == 1.0f);
+        CHECK(bae::quantizeUnorm(-0.5f, bits) == 0.0f);
+
+        const glm::vec2 roughnessMetal = bae::quantizeUnorm(glm::vec2{ 0.3f, 0.8f }, bits);
+        CHECK_CLOSE(roughnessMetal.x, 0.3f, 0.5f * step + 1e-6f);
+        CHECK_CLOSE(roughnessMetal.y, 0.8f, 0.5f * step + 1e-6f);
+    }
+}
+
+static void checkPositionReconstruction(const glm::mat4& proj, const bool glslConventions)
+{
+    const glm::mat4 view = glm::lookAt(glm::vec3{ 3.0f, 2.0f, -5.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f });
+    const glm::mat4 viewProj = proj * view;
+    const glm::mat4 invViewProj = glm::inverse(viewProj);
+
+    const glm::vec3 positions[] = {
+        { 0.0f, 1.0f, 0.0f },
+        { 1.5f, 0.5f, 2.0f },
+        { -2.0f, 3.0f, 10.0f },
+        { 0.5f, -1.0f, -3.0f },
+        { 20.0f, 5.0f, 80.0f },
+    };
+    for (const glm::vec3& position : positions) {
+        // What the rasterizer writes for this position, then what the light pass samples it with
+        const glm::vec4 clip = viewProj * glm::vec4{ position, 1.0f };
+        const glm::vec3 ndc = glm::vec3{ clip } / clip.w;
+        glm::vec2 texcoord = glm::vec2{ ndc } * 0.5f + 0.5f;
+        float depth = ndc.z;
+        if (glslConventions) {
+            depth = depth * 0.5f + 0.5f;
+        }
+        else {
+            texcoord.y = 1.0f - texcoord.y;
+        }
+        REQUIRE(depth >= 0.0f && depth <= 1.0f);
+
+        const glm::vec3 reconstructed = bae::reconstructWorldPosition(texcoord, depth, invViewProj, glslConventions);
+        // Float depth loses precision with distance, so compare relative to how far the point is from the camera
+        const float distance = glm::length(glm::vec3{ view * glm::vec4{ position, 1.0f } });
+        CHECK(glm::length(reconstructed - position) <= 1e-3f * distance);
+    }
+}
+
+TEST_CASE("World positions are reconstructed from hardware depth")
+{
+    const float aspectRatio = 16.0f / 9.0f;
+    // D3D and Metal: depth in [0, 1], texcoords with a top left origin
+    checkPositionReconstruction(glm::perspectiveRH_ZO(glm::radians(60.0f), aspectRatio, 0.1f, 1000.0f), false);
+    // OpenGL: depth in [-1, 1], texcoords with a bottom left origin
+    checkPositionReconstruction(glm::perspectiveRH_NO(glm::radians(60.0f), aspectRatio, 0.1f, 1000.0f), true);
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+#include "HandlePool.h"
+#include "ResourceList.h"
+
+// What the pool replaces: examples looked their programs up by name in a ResourceList, on every submit
+BENCHMARK("Handle pool lookups")
+{
+    constexpr uint32_t RESOURCE_COUNT = 1024;
+
+    ResourceList<bgfx::ProgramHandle> list;
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    std::vector<std::string> names;
+    std::vector<bae::PoolHandle> handles;
+    for (uint32_t i = 0; i < RESOURCE_COUNT; ++i) {
+        bgfx::ProgramHandle program;
+        program.idx = uint16_t(i);
+        names.push_back("Program " + std::to_string(i));
+        list.add(names.back(), program);
+        handles.push_back(pool.add(program, names.back().c_str()));
+    }
+
+    // Shuffled, so neither gets to walk its storage in order
+    std::vector<uint32_t> order(RESOURCE_COUNT);
+    for (uint32_t i = 0; i < RESOURCE_COUNT; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937{ 42 });
+
+    uint32_t next = 0;
+    uint32_t sum = 0;
+    bae::bench::run("ResourceList::get, by name", [&]() {
+        sum += list.get(names[order[next++ & (RESOURCE_COUNT - 1)]]).idx;
+    });
+    bae::bench::run("HandlePool::get, by handle", [&]() {
+        sum += pool.get(handles[order[next++ & (RESOURCE_COUNT - 1)]]).idx;
+    });
+    bae::bench::run("HandlePool::tryGet, by handle", [&]() {
+        sum += pool.tryGet(handles[order[next++ & (RESOURCE_COUNT - 1)]])->idx;
+    });
+    bae::bench::run("HandlePool::find, by name", [&]() {
+        sum += pool.find(names[order[next++ & (RESOURCE_COUNT - 1)]]).index();
+    });
+    bae::bench::doNotOptimize(sum);
+
+    // Churn: a resource released and a new one added every frame, like a framebuffer recreated on resize
+    uint32_t frame = 0;
+    bae::bench::run("HandlePool release + update + add", [&]() {
+        const uint32_t slot = order[frame & (RESOURCE_COUNT - 1)];
+        pool.release(handles[slot], frame);
+        pool.update(frame);
+        bgfx::ProgramHandle program;
+        program.idx = uint16_t(slot);
+        handles[slot] = pool.add(program);
+        ++frame;
+    });
+    pool.destroy();
+}
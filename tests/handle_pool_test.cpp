@@ -0,0 +1,133 @@
+#include "test.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "HandlePool.h"
+
+namespace
+{
+    bgfx::ProgramHandle makeProgram(const uint16_t idx)
+    {
+        bgfx::ProgramHandle program;
+        program.idx = idx;
+        return program;
+    }
+}
+
+TEST_CASE("Released handles go stale straight away")
+{
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    const bae::PoolHandle first = pool.add(makeProgram(1));
+    const bae::PoolHandle second = pool.add(makeProgram(2));
+    CHECK(first != second);
+    CHECK(pool.get(second).idx == 2);
+
+    pool.release(first, 0);
+    CHECK(!pool.isValid(first));
+    CHECK(pool.tryGet(first) == nullptr);
+    bool threw = false;
+    try {
+        pool.get(first);
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(pool.isValid(second));
+    CHECK(pool.getAliveCount() == 1);
+
+    // Releasing twice is harmless
+    pool.release(first, 0);
+    CHECK(pool.getPendingCount() == 1);
+    CHECK(!bae::PoolHandle{}.isValid());
+    pool.destroy();
+}
+
+TEST_CASE("Slots are reused once the destroy latency has passed")
+{
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    const bae::PoolHandle first = pool.add(makeProgram(1));
+    pool.release(first, 10);
+
+    // Still in flight, so the slot can't be handed out again
+    pool.update(11);
+    CHECK(pool.getPendingCount() == 1);
+    const bae::PoolHandle second = pool.add(makeProgram(2));
+    CHECK(second.index() != first.index());
+
+    pool.update(12);
+    CHECK(pool.getPendingCount() == 0);
+    const bae::PoolHandle third = pool.add(makeProgram(3));
+    CHECK(third.index() == first.index());
+    CHECK(third.generation() == first.generation() + 1);
+    CHECK(!pool.isValid(first));
+    CHECK(pool.get(third).idx == 3);
+    pool.destroy();
+}
+
+TEST_CASE("Slots retire instead of wrapping their generation")
+{
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    pool.setDestroyLatency(0);
+
+    // Every generation of one slot, each released and recycled straight away
+    std::vector<bae::PoolHandle> handles;
+    for (uint32_t frame = 0; frame <= bae::PoolHandle::GENERATION_MASK; ++frame) {
+        const bae::PoolHandle handle = pool.add(makeProgram(uint16_t(frame)));
+        REQUIRE(handle.index() == 0);
+        CHECK(handle.generation() == frame);
+        handles.push_back(handle);
+        pool.release(handle, frame);
+        pool.update(frame);
+    }
+    CHECK(pool.getRetiredCount() == 1);
+
+    // The next resource gets a fresh slot, and none of the old handles match anything
+    const bae::PoolHandle fresh = pool.add(makeProgram(1));
+    CHECK(fresh.index() == 1);
+    CHECK(fresh.generation() == 0);
+    uint32_t validCount = 0;
+    for (const bae::PoolHandle handle : handles) {
+        validCount += pool.isValid(handle) ? 1 : 0;
+    }
+    CHECK(validCount == 0);
+    pool.destroy();
+}
+
+TEST_CASE("Named resources can be found by name")
+{
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    const bae::PoolHandle skybox = pool.add(makeProgram(1), "Skybox");
+    pool.add(makeProgram(2));
+    CHECK(pool.find("Skybox") == skybox);
+    CHECK(std::string(pool.getName(skybox)) == "Skybox");
+    CHECK(!pool.find("Not Added").isValid());
+
+    pool.release(skybox, 0);
+    CHECK(!pool.find("Skybox").isValid());
+    pool.destroy();
+}
+
+TEST_CASE("Names are unique among alive resources")
+{
+    bae::HandlePool<bgfx::ProgramHandle> pool;
+    const bae::PoolHandle first = pool.add(makeProgram(1), "HDR");
+    bool threw = false;
+    try {
+        pool.add(makeProgram(2), "HDR");
+    }
+    catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(pool.getAliveCount() == 1);
+    CHECK(pool.find("HDR") == first);
+
+    // Releasing frees the name, and the stale handle can no longer touch the new resource
+    pool.release(first, 0);
+    const bae::PoolHandle second = pool.add(makeProgram(3), "HDR");
+    pool.release(first, 0);
+    CHECK(pool.find("HDR") == second);
+    pool.destroy();
+}
@@ -0,0 +1,133 @@
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+
+namespace
+{
+    // Enough arithmetic per item that a job of a hundred items is a few microseconds, as a culling or skinning job
+    // might be
+    float work(const uint32_t item)
+    {
+        float value = float(item);
+        for (int i = 0; i < 64; ++i) {
+            value = std::sqrt(value * 1.0001f + 1.0f);
+        }
+        return value;
+    }
+
+    struct FanOut
+    {
+        float* results;
+    };
+
+    void runFanOutJob(const void* data, const uint32_t begin, const uint32_t end)
+    {
+        float* results = static_cast<const FanOut*>(data)->results;
+        for (uint32_t i = begin; i < end; ++i) {
+            results[i] = work(i);
+        }
+    }
+
+    void runEmptyJob(const void*, const uint32_t, const uint32_t)
+    {
+    }
+}
+
+// Every case next to the same work done serially. Speedups need cores, on a single core machine this only measures
+// the overhead of going through the job system.
+static void runJobSystemBenchmarks(const uint32_t workerCount)
+{
+    bae::JobSystemParams params;
+    params.workerCount = workerCount;
+    bae::JobSystem jobs;
+    jobs.init(params);
+    printf("  %u threads on %u cores\n", jobs.getThreadCount(), std::thread::hardware_concurrency());
+
+    // Fan-out: a thousand independent jobs queued at once, then a single wait
+    constexpr uint32_t FAN_OUT_JOBS = 1000;
+    constexpr uint32_t FAN_OUT_ITEMS = 100;
+    std::vector<float> results(FAN_OUT_JOBS * FAN_OUT_ITEMS);
+    const FanOut fanOut = { results.data() };
+    std::vector<bae::Job> fanOutJobs(FAN_OUT_JOBS);
+    for (uint32_t i = 0; i < FAN_OUT_JOBS; ++i) {
+        fanOutJobs[i] = { &runFanOutJob, &fanOut, i * FAN_OUT_ITEMS, (i + 1) * FAN_OUT_ITEMS };
+    }
+    bae::bench::run("Fan-out, 1000 jobs of 100 items, serial", [&]() {
+        runFanOutJob(&fanOut, 0, FAN_OUT_JOBS * FAN_OUT_ITEMS);
+        bae::bench::doNotOptimize(results[0]);
+    }, FAN_OUT_JOBS * FAN_OUT_ITEMS);
+    bae::bench::run("Fan-out, 1000 jobs of 100 items", [&]() {
+        bae::JobCounter counter;
+        jobs.run(fanOutJobs.data(), FAN_OUT_JOBS, counter);
+        jobs.wait(counter);
+        bae::bench::doNotOptimize(results[0]);
+    }, FAN_OUT_JOBS * FAN_OUT_ITEMS);
+
+    // What a job costs on its own
+    std::vector<bae::Job> emptyJobs(FAN_OUT_JOBS);
+    for (bae::Job& job : emptyJobs) {
+        job.function = &runEmptyJob;
+    }
+    bae::bench::run("Fan-out, 1000 empty jobs", [&]() {
+        bae::JobCounter counter;
+        jobs.run(emptyJobs.data(), FAN_OUT_JOBS, counter);
+        jobs.wait(counter);
+    }, FAN_OUT_JOBS);
+
+    // Fork-join: small parallel loops back to back, like the stages of a frame
+    constexpr uint32_t FORK_JOIN_ITEMS = 4096;
+    constexpr uint32_t FORK_JOIN_GRAIN = 256;
+    bae::bench::run("Fork-join, 4096 items with grain 256, serial", [&]() {
+        for (uint32_t i = 0; i < FORK_JOIN_ITEMS; ++i) {
+            results[i] = work(i);
+        }
+        bae::bench::doNotOptimize(results[0]);
+    }, FORK_JOIN_ITEMS);
+    bae::bench::run("Fork-join, 4096 items with grain 256", [&]() {
+        jobs.parallelFor(FORK_JOIN_ITEMS, FORK_JOIN_GRAIN, [&](const uint32_t begin, const uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                results[i] = work(i);
+            }
+        });
+        bae::bench::doNotOptimize(results[0]);
+    }, FORK_JOIN_ITEMS);
+
+    // Nested: every outer item runs a parallel loop of its own from within a job
+    constexpr uint32_t NESTED_OUTER = 64;
+    constexpr uint32_t NESTED_INNER = 1024;
+    std::vector<float> nestedResults(NESTED_OUTER * NESTED_INNER);
+    bae::bench::run("Nested, 64 x 1024 items, serial", [&]() {
+        for (uint32_t i = 0; i < NESTED_OUTER * NESTED_INNER; ++i) {
+            nestedResults[i] = work(i);
+        }
+        bae::bench::doNotOptimize(nestedResults[0]);
+    }, NESTED_OUTER * NESTED_INNER);
+    bae::bench::run("Nested, 64 x 1024 items", [&]() {
+        jobs.parallelFor(NESTED_OUTER, 1, [&](const uint32_t outerBegin, const uint32_t outerEnd) {
+            for (uint32_t outer = outerBegin; outer < outerEnd; ++outer) {
+                jobs.parallelFor(NESTED_INNER, 128, [&](const uint32_t begin, const uint32_t end) {
+                    for (uint32_t i = outer * NESTED_INNER + begin; i < outer * NESTED_INNER + end; ++i) {
+                        nestedResults[i] = work(i);
+                    }
+                });
+            }
+        });
+        bae::bench::doNotOptimize(nestedResults[0]);
+    }, NESTED_OUTER * NESTED_INNER);
+
+    jobs.destroy();
+}
+
+BENCHMARK("Job system")
+{
+    // One worker per core but one, then more workers than that wherever there are fewer than four cores
+    runJobSystemBenchmarks(0);
+    if (std::thread::hardware_concurrency() < 4) {
+        runJobSystemBenchmarks(4);
+    }
+}
@@ -0,0 +1,202 @@
+#include "test.h"
+
+#include <atomic>
+#include <vector>
+
+#include "JobSystem.h"
+
+// Meant to be run under ThreadSanitizer too (genie --with-tsan), which is what catches jobs whose writes aren't
+// visible once their counter has been waited on. Jobs never CHECK themselves, the runner isn't thread safe, they
+// leave their results for the test to check after waiting.
+namespace
+{
+    constexpr uint32_t WORKER_COUNT = 4;
+
+    bae::JobSystemParams makeParams(const uint32_t queueCapacity)
+    {
+        bae::JobSystemParams params;
+        params.workerCount = WORKER_COUNT;
+        params.queueCapacity = queueCapacity;
+        return params;
+    }
+
+    struct Histogram
+    {
+        std::vector<std::atomic<uint32_t>> visits;
+
+        explicit Histogram(const uint32_t count) : visits(count) {}
+
+        void visit(const uint32_t begin, const uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i) {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        uint32_t countOtherThanOnce() const
+        {
+            uint32_t count = 0;
+            for (const std::atomic<uint32_t>& visit : visits) {
+                count += visit.load() != 1 ? 1 : 0;
+            }
+            return count;
+        }
+    };
+
+    // Values written by one set of jobs and summed by another, which waits for them on their counter
+    struct Pipeline
+    {
+        bae::JobSystem* jobs;
+        bae::JobCounter* produced;
+        uint32_t* values;
+        uint32_t valueCount;
+        uint32_t* sums;
+    };
+
+    void produceValues(const void* data, const uint32_t begin, const uint32_t end)
+    {
+        const Pipeline& pipeline = *static_cast<const Pipeline*>(data);
+        for (uint32_t i = begin; i < end; ++i) {
+            pipeline.values[i] = i;
+        }
+    }
+
+    void sumValues(const void* data, const uint32_t begin, const uint32_t end)
+    {
+        const Pipeline& pipeline = *static_cast<const Pipeline*>(data);
+        pipeline.jobs->wait(*pipeline.produced);
+        for (uint32_t i = begin; i < end; ++i) {
+            pipeline.sums[i] = 0;
+            for (uint32_t value = 0; value < pipeline.valueCount; ++value) {
+                pipeline.sums[i] += pipeline.values[value] * (i + 1);
+            }
+        }
+    }
+}
+
+TEST_CASE("Parallel for visits every index exactly once")
+{
+    bae::JobSystem jobs;
+    jobs.init(makeParams(4096));
+    REQUIRE(jobs.getThreadCount() == WORKER_COUNT + 1);
+
+    // Counts that do and don't divide by the grain, and ones below it that run inline
+    const uint32_t counts[] = { 0, 1, 97, 1000, 4096 };
+    for (const uint32_t count : counts) {
+        for (uint32_t grain = 1; grain <= 97; grain += 8) {
+            Histogram histogram(count);
+            jobs.parallelFor(count, grain, [&](const uint32_t begin, const uint32_t end) {
+                histogram.visit(begin, end);
+            });
+            CHECK(histogram.countOtherThanOnce() == 0);
+        }
+    }
+    jobs.destroy();
+}
+
+TEST_CASE("Plain writes from jobs are visible after waiting")
+{
+    bae::JobSystem jobs;
+    jobs.init(makeParams(4096));
+
+    // Non-atomic on purpose, the counter is all that orders the jobs' writes before our reads
+    constexpr uint32_t COUNT = 10000;
+    std::vector<uint32_t> squares(COUNT, 0);
+    for (int round = 0; round < 8; ++round) {
+        jobs.parallelFor(COUNT, 64, [&](const uint32_t begin, const uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                squares[i] = i * i + uint32_t(round);
+            }
+        });
+        uint32_t wrong = 0;
+        for (uint32_t i = 0; i < COUNT; ++i) {
+            wrong += squares[i] != i * i + uint32_t(round) ? 1 : 0;
+        }
+        CHECK(wrong == 0);
+    }
+    jobs.destroy();
+}
+
+TEST_CASE("Nested parallel for runs to completion")
+{
+    bae::JobSystem jobs;
+    jobs.init(makeParams(4096));
+
+    constexpr uint32_t OUTER = 64;
+    constexpr uint32_t INNER = 2048;
+    Histogram histogram(OUTER * INNER);
+    jobs.parallelFor(OUTER, 1, [&](const uint32_t outerBegin, const uint32_t outerEnd) {
+        for (uint32_t outer = outerBegin; outer < outerEnd; ++outer) {
+            jobs.parallelFor(INNER, 128, [&](const uint32_t begin, const uint32_t end) {
+                histogram.visit(outer * INNER + begin, outer * INNER + end);
+            });
+        }
+    });
+    CHECK(histogram.countOtherThanOnce() == 0);
+    jobs.destroy();
+}
+
+TEST_CASE("Jobs that don't fit the queue run inline")
+{
+    bae::JobSystem jobs;
+    jobs.init(makeParams(4));
+
+    Histogram histogram(4096);
+    jobs.parallelFor(4096, 1, [&](const uint32_t begin, const uint32_t end) {
+        histogram.visit(begin, end);
+    });
+    CHECK(histogram.countOtherThanOnce() == 0);
+    const bae::JobSystemStats stats = jobs.getStats();
+    CHECK(stats.jobsRun == 4096);
+    CHECK(stats.jobsRunInline > 0);
+    jobs.destroy();
+}
+
+// Dependencies are counters: a job that needs others' results waits on their counter, running queued jobs meanwhile
+TEST_CASE("Jobs can wait on counters of jobs run elsewhere")
+{
+    bae::JobSystem jobs;
+    jobs.init(makeParams(4096));
+
+    constexpr uint32_t VALUE_COUNT = 256;
+    constexpr uint32_t SUM_COUNT = 4;
+    uint32_t values[VALUE_COUNT] = {};
+    uint32_t sums[SUM_COUNT] = {};
+    bae::JobCounter produced;
+    const Pipeline pipeline = { &jobs, &produced, values, VALUE_COUNT, sums };
+
+    bae::Job producers[16];
+    for (uint32_t i = 0; i < 16; ++i) {
+        producers[i] = { &produceValues, &pipeline, i * 16, (i + 1) * 16 };
+    }
+    bae::Job consumers[SUM_COUNT];
+    for (uint32_t i = 0; i < SUM_COUNT; ++i) {
+        consumers[i] = { &sumValues, &pipeline, i, i + 1 };
+    }
+
+    // Queues are popped newest first, so the consumers are likely to start before the producers are done
+    bae::JobCounter consumed;
+    jobs.run(producers, 16, produced);
+    jobs.run(consumers, SUM_COUNT, consumed);
+    jobs.wait(consumed);
+
+    for (uint32_t i = 0; i < SUM_COUNT; ++i) {
+        CHECK(sums[i] == (VALUE_COUNT - 1) * VALUE_COUNT / 2 * (i + 1));
+    }
+    CHECK(produced.isDone());
+    jobs.destroy();
+}
+
+TEST_CASE("Job systems can be restarted")
+{
+    bae::JobSystem jobs;
+    for (int i = 0; i < 4; ++i) {
+        jobs.init(makeParams(64));
+        Histogram histogram(1000);
+        jobs.parallelFor(1000, 10, [&](const uint32_t begin, const uint32_t end) {
+            histogram.visit(begin, end);
+        });
+        CHECK(histogram.countOtherThanOnce() == 0);
+    }
+    jobs.destroy();
+}
@@ -0,0 +1,349 @@
+#include "test.h"
+
+#include <vector>
+
+#include "PointShadows.h"
+
+namespace
+{
+    // CPU copy of getPointShadowFaceCoords in 02-forward-rendering/fs_pbr.sc, which has to match getFaceBasis
+    glm::vec3 getPointShadowFaceCoords(const glm::vec3& dir, uint32_t& face)
+    {
+        const glm::vec3 absDir = glm::abs(dir);
+        if (absDir.x >= absDir.y && absDir.x >= absDir.z) {
+            face = dir.x > 0.0f ? 0u : 1u;
+            return dir.x > 0.0f ? glm::vec3{ -dir.z, dir.y, dir.x } : glm::vec3{ dir.z, dir.y, -dir.x };
+        }
+        if (absDir.y >= absDir.z) {
+            face = dir.y > 0.0f ? 2u : 3u;
+            return dir.y > 0.0f ? glm::vec3{ dir.x, -dir.z, dir.y } : glm::vec3{ dir.x, dir.z, -dir.y };
+        }
+        face = dir.z > 0.0f ? 4u : 5u;
+        return dir.z > 0.0f ? dir : glm::vec3{ -dir.x, dir.y, -dir.z };
+    }
+
+    // Camera sits inside every light, so each one covers the whole viewport and its ideal face size is half the
+    // viewport's side. Lights are ordered by intensity alone.
+    bae::LightLODView getViewForFaceSize(const float idealFaceSize)
+    {
+        bae::LightLODView view;
+        view.viewportWidth = 2.0f * idealFaceSize;
+        view.viewportHeight = 2.0f * idealFaceSize;
+        return view;
+    }
+
+    struct PointShadowScene
+    {
+        std::vector<glm::vec4> positionRadius;
+        std::vector<glm::vec4> colorIntensity;
+        std::vector<bae::AABB> casterBounds;
+
+        void addLight(const float intensity)
+        {
+            positionRadius.push_back(glm::vec4{ 0.0f, 0.0f, 0.0f, 10.0f });
+            colorIntensity.push_back(glm::vec4{ 1.0f, 1.0f, 1.0f, intensity });
+        }
+
+        void update(bae::PointShadowAtlas& shadows, const bae::LightLODView& view) const
+        {
+            shadows.update(
+                positionRadius.data(),
+                colorIntensity.data(),
+                uint32_t(positionRadius.size()),
+                view,
+                casterBounds.data(),
+                uint32_t(casterBounds.size()));
+        }
+    };
+
+    const bae::PointShadowLight* findLight(const bae::PointShadowAtlas& shadows, const uint32_t lightIdx)
+    {
+        for (const bae::PointShadowLight& slot : shadows.getSlots()) {
+            if (slot.lightIdx == lightIdx) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    bool regionsOverlap(const bae::ShadowAtlasRegion& a, const bae::ShadowAtlasRegion& b)
+    {
+        return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+    }
+}
+
+TEST_CASE("Point shadow faces have orthonormal, left handed bases along each axis")
+{
+    for (uint32_t face = 0; face < bae::POINT_SHADOW_FACES; ++face) {
+        glm::vec3 right, up, forward;
+        bae::PointShadowAtlas::getFaceBasis(face, right, up, forward);
+
+        glm::vec3 axis{ 0.0f };
+        axis[face / 2] = face % 2 == 0 ? 1.0f : -1.0f;
+        CHECK(forward == axis);
+        CHECK_CLOSE(glm::dot(right, up), 0.0f, 1e-6f);
+        CHECK_CLOSE(glm::dot(right, forward), 0.0f, 1e-6f);
+        CHECK_CLOSE(glm::dot(up, forward), 0.0f, 1e-6f);
+        CHECK_CLOSE(glm::length(right), 1.0f, 1e-6f);
+        CHECK_CLOSE(glm::length(up), 1.0f, 1e-6f);
+        CHECK_CLOSE(glm::dot(glm::cross(up, forward), right), 1.0f, 1e-6f);
+    }
+}
+
+TEST_CASE("Point shadow face views match the shader's cube face coordinates")
+{
+    for (int homogeneousDepth = 0; homogeneousDepth < 2; ++homogeneousDepth) {
+        bae::PointShadowParams params;
+        bae::PointShadowAtlas shadows;
+        shadows.init(1024, 1024, params, homogeneousDepth != 0);
+
+        PointShadowScene scene;
+        scene.addLight(1.0f);
+        scene.positionRadius[0] = glm::vec4{ 3.0f, -2.0f, 5.0f, 10.0f };
+        bae::LightLODView view = getViewForFaceSize(100.0f);
+        view.cameraPos = glm::vec3{ scene.positionRadius[0] };
+        scene.update(shadows, view);
+        REQUIRE(shadows.getShadowedSlots().size() == 1);
+
+        const uint32_t slot = shadows.getShadowedSlots()[0];
+        const glm::mat4 proj = shadows.getFaceProjection(slot);
+        const glm::vec3 lightPos{ scene.positionRadius[0] };
+
+        // Spread over the whole sphere, including directions right on the edges between faces
+        for (int x = -4; x <= 4; ++x) {
+            for (int y = -4; y <= 4; ++y) {
+                for (int z = -4; z <= 4; ++z) {
+                    const glm::vec3 dir = glm::vec3{ float(x), float(y), float(z) } * 0.5f;
+                    if (dir == glm::vec3{ 0.0f }) {
+                        continue;
+                    }
+
+                    uint32_t face = 0;
+                    const glm::vec3 faceCoords = getPointShadowFaceCoords(dir, face);
+                    const glm::vec4 viewPos = shadows.getFaceView(slot, face) * glm::vec4{ lightPos + dir, 1.0f };
+                    CHECK_CLOSE(viewPos.x, faceCoords.x, 1e-4f);
+                    CHECK_CLOSE(viewPos.y, faceCoords.y, 1e-4f);
+                    CHECK_CLOSE(viewPos.z, faceCoords.z, 1e-4f);
+
+                    // Lands inside the face's projection, and the shader gets back its distance along the axis
+                    const glm::vec4 clip = proj * viewPos;
+                    CHECK(std::abs(clip.x / clip.w) <= 1.0f + 1e-5f);
+                    CHECK(std::abs(clip.y / clip.w) <= 1.0f + 1e-5f);
+                    const float ndcDepth = clip.z / clip.w;
+                    CHECK_CLOSE(proj[3][2] / (ndcDepth - proj[2][2]), faceCoords.z, 1e-3f);
+
+                    // And the face we sample from is one that draws casters there
+                    const bae::AABB box = { lightPos + dir - 0.01f, lightPos + dir + 0.01f };
+                    CHECK(bae::PointShadowAtlas::faceOverlapsBox(scene.positionRadius[0], face, box));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Point shadow faces only see boxes on their side of the light")
+{
+    const glm::vec4 positionRadius{ 0.0f, 0.0f, 0.0f, 5.0f };
+    const bae::AABB inFrontOfX = { { 2.0f, -0.5f, -0.5f }, { 3.0f, 0.5f, 0.5f } };
+    const bae::AABB outOfRange = { { 6.0f, -0.5f, -0.5f }, { 7.0f, 0.5f, 0.5f } };
+    const bae::AABB aroundLight = { { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+    for (uint32_t face = 0; face < bae::POINT_SHADOW_FACES; ++face) {
+        CHECK(bae::PointShadowAtlas::faceOverlapsBox(positionRadius, face, inFrontOfX) == (face == 0));
+        CHECK(!bae::PointShadowAtlas::faceOverlapsBox(positionRadius, face, outOfRange));
+        CHECK(bae::PointShadowAtlas::faceOverlapsBox(positionRadius, face, aroundLight));
+    }
+}
+
+TEST_CASE("Point shadow faces get disjoint atlas regions, sized by screen coverage")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 4;
+    params.maxFaceUpdates = 4 * bae::POINT_SHADOW_FACES;
+    bae::PointShadowAtlas shadows;
+    shadows.init(2048, 1024, params, false);
+
+    PointShadowScene scene;
+    for (uint32_t i = 0; i < 4; ++i) {
+        scene.addLight(float(i + 1));
+    }
+    // Ideal size of 200 texels rounds up to 256
+    scene.update(shadows, getViewForFaceSize(200.0f));
+
+    CHECK(shadows.getStats().shadowedLights == 4);
+    CHECK(shadows.getStats().renderedFaces == 4 * bae::POINT_SHADOW_FACES);
+    CHECK(shadows.getFaceUpdates().size() == 4 * bae::POINT_SHADOW_FACES);
+    CHECK(shadows.getAtlas().getAllocatedTexels() == 4u * bae::POINT_SHADOW_FACES * 256u * 256u);
+
+    std::vector<bae::ShadowAtlasRegion> regions;
+    for (const bae::PointShadowLight& slot : shadows.getSlots()) {
+        CHECK(slot.faceSize == 256);
+        CHECK(slot.isReady());
+        for (const bae::PointShadowFace& face : slot.faces) {
+            CHECK(face.region.size == 256);
+            CHECK(face.region.x + face.region.size <= 2048 && face.region.y + face.region.size <= 1024);
+            for (const bae::ShadowAtlasRegion& other : regions) {
+                CHECK(!regionsOverlap(face.region, other));
+            }
+            regions.push_back(face.region);
+        }
+    }
+
+    // Most important light first
+    const std::vector<uint32_t>& shadowed = shadows.getShadowedSlots();
+    REQUIRE(shadowed.size() == 4);
+    CHECK(shadows.getSlots()[shadowed[0]].lightIdx == 3);
+    CHECK(shadows.getSlots()[shadowed[3]].lightIdx == 0);
+
+    // Nothing moved, so nothing is redrawn
+    scene.update(shadows, getViewForFaceSize(200.0f));
+    CHECK(shadows.getFaceUpdates().empty());
+    CHECK(shadows.getStats().cachedFaces == 4 * bae::POINT_SHADOW_FACES);
+}
+
+TEST_CASE("Point shadows fall back to smaller faces when the atlas is full")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 2;
+    params.maxFaceUpdates = 2 * bae::POINT_SHADOW_FACES;
+    bae::PointShadowAtlas shadows;
+    // Room for 8 faces of 256, so the second light only fits at 128
+    shadows.init(512, 1024, params, false);
+
+    PointShadowScene scene;
+    scene.addLight(2.0f);
+    scene.addLight(1.0f);
+    scene.update(shadows, getViewForFaceSize(200.0f));
+
+    REQUIRE(findLight(shadows, 0) != nullptr);
+    REQUIRE(findLight(shadows, 1) != nullptr);
+    CHECK(findLight(shadows, 0)->faceSize == 256);
+    CHECK(findLight(shadows, 1)->faceSize == 128);
+    CHECK(shadows.getStats().allocationFailures == 0);
+
+    // The smaller light doesn't keep trying, and redrawing, at the size that didn't fit
+    scene.update(shadows, getViewForFaceSize(200.0f));
+    CHECK(findLight(shadows, 1)->faceSize == 128);
+    CHECK(shadows.getFaceUpdates().empty());
+}
+
+TEST_CASE("Point shadows evict the least important lights over budget")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 2;
+    params.maxFaceUpdates = 3 * bae::POINT_SHADOW_FACES;
+    bae::PointShadowAtlas shadows;
+    shadows.init(1024, 1024, params, false);
+
+    PointShadowScene scene;
+    scene.addLight(3.0f);
+    scene.addLight(2.0f);
+    scene.addLight(1.0f);
+    const bae::LightLODView view = getViewForFaceSize(100.0f);
+    scene.update(shadows, view);
+
+    CHECK(shadows.getStats().shadowedLights == 2);
+    CHECK(shadows.getStats().skippedLights == 1);
+    CHECK(findLight(shadows, 2) == nullptr);
+    const uint32_t allocatedTexels = shadows.getAtlas().getAllocatedTexels();
+    CHECK(allocatedTexels == 2u * bae::POINT_SHADOW_FACES * 128u * 128u);
+
+    // The last light becomes the brightest, so the dimmest of the others gives up its faces
+    scene.colorIntensity[2].w = 4.0f;
+    scene.update(shadows, view);
+    CHECK(findLight(shadows, 1) == nullptr);
+    REQUIRE(findLight(shadows, 2) != nullptr);
+    CHECK(findLight(shadows, 2)->isReady());
+    CHECK(shadows.getAtlas().getAllocatedTexels() == allocatedTexels);
+    // Only the new light is drawn, the one that kept its slot keeps its faces
+    CHECK(shadows.getFaceUpdates().size() == bae::POINT_SHADOW_FACES);
+    for (const bae::PointShadowFaceUpdate& faceUpdate : shadows.getFaceUpdates()) {
+        CHECK(shadows.getSlots()[faceUpdate.slot].lightIdx == 2);
+    }
+}
+
+TEST_CASE("Point shadows grow straight away but only shrink well below their size")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 1;
+    bae::PointShadowAtlas shadows;
+    shadows.init(2048, 2048, params, false);
+
+    PointShadowScene scene;
+    scene.addLight(1.0f);
+    scene.update(shadows, getViewForFaceSize(200.0f));
+    REQUIRE(findLight(shadows, 0) != nullptr);
+    CHECK(findLight(shadows, 0)->faceSize == 256);
+
+    // Wants 128, which isn't below half of 256, so the faces stay where they are and aren't redrawn
+    scene.update(shadows, getViewForFaceSize(100.0f));
+    CHECK(findLight(shadows, 0)->faceSize == 256);
+    CHECK(shadows.getFaceUpdates().empty());
+
+    // Wants 64, which is
+    scene.update(shadows, getViewForFaceSize(50.0f));
+    CHECK(findLight(shadows, 0)->faceSize == 64);
+    CHECK(shadows.getFaceUpdates().size() == bae::POINT_SHADOW_FACES);
+    CHECK(shadows.getAtlas().getAllocatedTexels() == bae::POINT_SHADOW_FACES * 64u * 64u);
+
+    // Back up to 128 immediately
+    scene.update(shadows, getViewForFaceSize(100.0f));
+    CHECK(findLight(shadows, 0)->faceSize == 128);
+    CHECK(shadows.getFaceUpdates().size() == bae::POINT_SHADOW_FACES);
+
+    // And clamped to the largest face we allow
+    scene.update(shadows, getViewForFaceSize(4000.0f));
+    CHECK(findLight(shadows, 0)->faceSize == params.maxFaceSize);
+}
+
+TEST_CASE("Point shadows defer whole lights past the face update budget")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 2;
+    params.maxFaceUpdates = bae::POINT_SHADOW_FACES;
+    bae::PointShadowAtlas shadows;
+    shadows.init(1024, 1024, params, false);
+
+    PointShadowScene scene;
+    scene.addLight(2.0f);
+    scene.addLight(1.0f);
+    const bae::LightLODView view = getViewForFaceSize(100.0f);
+    scene.update(shadows, view);
+    CHECK(shadows.getStats().renderedFaces == bae::POINT_SHADOW_FACES);
+    CHECK(shadows.getStats().deferredFaces == bae::POINT_SHADOW_FACES);
+    CHECK(shadows.getShadowedSlots().size() == 1);
+
+    scene.update(shadows, view);
+    CHECK(shadows.getStats().deferredFaces == 0);
+    CHECK(shadows.getShadowedSlots().size() == 2);
+}
+
+TEST_CASE("Moving a caster only redraws the faces that see it")
+{
+    bae::PointShadowParams params;
+    params.maxShadowedLights = 1;
+    bae::PointShadowAtlas shadows;
+    shadows.init(1024, 1024, params, false);
+
+    PointShadowScene scene;
+    scene.addLight(1.0f);
+    scene.casterBounds.push_back(bae::AABB{ { 2.0f, -0.5f, -0.5f }, { 3.0f, 0.5f, 0.5f } });
+    scene.casterBounds.push_back(bae::AABB{ { -0.5f, -0.5f, 20.0f }, { 0.5f, 0.5f, 21.0f } });
+    const bae::LightLODView view = getViewForFaceSize(100.0f);
+    scene.update(shadows, view);
+    REQUIRE(shadows.getFaceUpdates().size() == bae::POINT_SHADOW_FACES);
+    for (const bae::PointShadowFaceUpdate& faceUpdate : shadows.getFaceUpdates()) {
+        // Only the +X face draws the first caster, and nothing draws the one out of range
+        CHECK(faceUpdate.casterCount == (faceUpdate.face == 0 ? 1u : 0u));
+    }
+
+    scene.casterBounds[0].min.y += 0.25f;
+    scene.casterBounds[0].max.y += 0.25f;
+    scene.update(shadows, view);
+    REQUIRE(shadows.getFaceUpdates().size() == 1);
+    CHECK(shadows.getFaceUpdates()[0].face == 0);
+
+    // Moving the light redraws every face
+    scene.positionRadius[0].x += 1.0f;
+    scene.update(shadows, view);
+    CHECK(shadows.getFaceUpdates().size() == bae::POINT_SHADOW_FACES);
+}
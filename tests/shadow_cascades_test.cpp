@@ -0,0 +1,182 @@
+#include "test.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "ShadowCascades.h"
+
+namespace
+{
+    constexpr float NEAR_PLANE = 0.1f;
+    constexpr float FAR_PLANE = 100.0f;
+    constexpr uint16_t CASCADE_SIZE = 1024;
+
+    struct CascadeView
+    {
+        glm::vec3 eye;
+        glm::vec3 target;
+        glm::vec3 lightDirection;
+        // The view space depths actually in use, like the depth reduction would give us
+        float nearDepth;
+        float farDepth;
+    };
+
+    // Roughly Sponza's bounds, and views through it from the ground, from above and looking at it from outside
+    const bae::AABB SCENE_BOUNDS = { { -20.0f, -1.0f, -12.0f }, { 20.0f, 16.0f, 12.0f } };
+    const CascadeView CASCADE_VIEWS[] = {
+        { { -15.0f, 2.0f, 0.0f }, { 15.0f, 2.0f, 0.0f }, { 1.0f, -3.0f, 1.0f }, NEAR_PLANE, 40.0f },
+        { { 0.0f, 14.0f, -10.0f }, { 0.0f, 0.0f, 5.0f }, { 0.2f, -1.0f, 0.4f }, 1.0f, 30.0f },
+        { { 30.0f, 8.0f, 30.0f }, { 0.0f, 2.0f, 0.0f }, { -1.0f, -1.0f, 0.0f }, 20.0f, FAR_PLANE },
+        // Light straight down, where we have to pick a different up vector
+        { { 5.0f, 3.0f, 2.0f }, { -5.0f, 1.0f, -2.0f }, { 0.0f, -1.0f, 0.0f }, NEAR_PLANE, FAR_PLANE },
+    };
+    const bae::CascadeSplitScheme SPLIT_SCHEMES[] = {
+        bae::CascadeSplitScheme::LOGARITHMIC,
+        bae::CascadeSplitScheme::UNIFORM,
+        bae::CascadeSplitScheme::PRACTICAL,
+    };
+
+    // Splits and fits cascades the same way the shadow mapping example does, and checks they cover the view
+    bae::CascadeCoverage checkConfiguration(
+        const CascadeView& view,
+        const uint32_t numCascades,
+        const bae::CascadeSplitScheme scheme,
+        const bool stabilize,
+        const bool homogeneousDepth)
+    {
+        const glm::mat4 proj = homogeneousDepth
+            ? glm::perspectiveRH_NO(glm::radians(60.0f), 16.0f / 9.0f, NEAR_PLANE, FAR_PLANE)
+            : glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, NEAR_PLANE, FAR_PLANE);
+        const glm::mat4 invViewProj = glm::inverse(proj * glm::lookAt(view.eye, view.target, glm::vec3{ 0.0f, 1.0f, 0.0f }));
+        const float clipNear = homogeneousDepth ? -1.0f : 0.0f;
+
+        const glm::vec3 lightDirection = glm::normalize(view.lightDirection);
+        const glm::vec3 up = std::abs(lightDirection.y) != 1.0f ? glm::vec3{ 0.0f, 1.0f, 0.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
+        const glm::mat4 lightRotation = glm::lookAt(glm::vec3{ 0.0f }, lightDirection, up);
+
+        glm::vec2 splits[bae::MAX_SHADOW_CASCADES];
+        glm::mat4 lightViewProjs[bae::MAX_SHADOW_CASCADES];
+        bae::computeCascadeSplits(view.nearDepth, view.farDepth, numCascades, scheme, 0.75f, splits);
+        for (uint32_t cascadeIdx = 0; cascadeIdx < numCascades; ++cascadeIdx) {
+            bae::CascadeFit fit;
+            bae::getFrustumSliceCorners(invViewProj, clipNear, NEAR_PLANE, FAR_PLANE, splits[cascadeIdx], fit.corners);
+            bae::fitCascade(fit, lightRotation, lightDirection, up, SCENE_BOUNDS, stabilize);
+            if (stabilize) {
+                bae::snapCascadeToTexels(fit, CASCADE_SIZE);
+            }
+            lightViewProjs[cascadeIdx] = bae::getCascadeProjection(fit, homogeneousDepth) * fit.lightView;
+        }
+
+        return bae::validateCascadeCoverage(
+            invViewProj, clipNear, NEAR_PLANE, FAR_PLANE, view.nearDepth, view.farDepth, splits, lightViewProjs, numCascades, &SCENE_BOUNDS);
+    }
+}
+
+TEST_CASE("Cascade splits are contiguous and span the depth range")
+{
+    for (const bae::CascadeSplitScheme scheme : SPLIT_SCHEMES) {
+        for (uint32_t numCascades = 1; numCascades <= bae::MAX_SHADOW_CASCADES; ++numCascades) {
+            glm::vec2 splits[bae::MAX_SHADOW_CASCADES];
+            bae::computeCascadeSplits(0.5f, 80.0f, numCascades, scheme, 0.75f, splits);
+            CHECK(splits[0].x == 0.5f);
+            CHECK(splits[numCascades - 1].y == 80.0f);
+            for (uint32_t i = 0; i < numCascades; ++i) {
+                CHECK(splits[i].y > splits[i].x);
+                if (i > 0) {
+                    CHECK(splits[i].x == splits[i - 1].y);
+                }
+            }
+        }
+    }
+
+    // Logarithmic splits keep the same far to near ratio, uniform ones the same length
+    glm::vec2 splits[4];
+    bae::computeCascadeSplits(1.0f, 10000.0f, 4, bae::CascadeSplitScheme::LOGARITHMIC, 0.0f, splits);
+    for (const glm::vec2& split : splits) {
+        CHECK_CLOSE(split.y / split.x, 10.0f, 1e-3f);
+    }
+    bae::computeCascadeSplits(1.0f, 101.0f, 4, bae::CascadeSplitScheme::UNIFORM, 0.0f, splits);
+    for (const glm::vec2& split : splits) {
+        CHECK_CLOSE(split.y - split.x, 25.0f, 1e-4f);
+    }
+}
+
+TEST_CASE("Cascade projections map near and far light space depths to the clip range")
+{
+    bae::CascadeFit fit;
+    fit.min = glm::vec3{ -4.0f, -2.0f, -30.0f };
+    fit.max = glm::vec3{ 6.0f, 8.0f, -5.0f };
+
+    const float clipNears[] = { 0.0f, -1.0f };
+    for (int homogeneousDepth = 0; homogeneousDepth < 2; ++homogeneousDepth) {
+        const glm::mat4 projection = bae::getCascadeProjection(fit, homogeneousDepth != 0);
+        const glm::vec4 nearCorner = projection * glm::vec4{ fit.min.x, fit.min.y, fit.max.z, 1.0f };
+        const glm::vec4 farCorner = projection * glm::vec4{ fit.max.x, fit.max.y, fit.min.z, 1.0f };
+        CHECK_CLOSE(nearCorner.x, -1.0f, 1e-5f);
+        CHECK_CLOSE(nearCorner.y, -1.0f, 1e-5f);
+        CHECK_CLOSE(nearCorner.z, clipNears[homogeneousDepth], 1e-5f);
+        CHECK_CLOSE(farCorner.x, 1.0f, 1e-5f);
+        CHECK_CLOSE(farCorner.y, 1.0f, 1e-5f);
+        CHECK_CLOSE(farCorner.z, 1.0f, 1e-5f);
+    }
+}
+
+TEST_CASE("Stabilized cascades snap to whole texels without changing size")
+{
+    bae::CascadeFit fit;
+    fit.min = glm::vec3{ -3.3f, 1.7f, -20.0f };
+    fit.max = glm::vec3{ 4.7f, 9.7f, -1.0f };
+    bae::snapCascadeToTexels(fit, 512);
+
+    const float texelSize = 8.0f / 512.0f;
+    CHECK_CLOSE(fit.max.x - fit.min.x, 8.0f, 1e-5f);
+    CHECK_CLOSE(fit.max.y - fit.min.y, 8.0f, 1e-5f);
+    CHECK_CLOSE(fit.min.x / texelSize, std::round(fit.min.x / texelSize), 1e-3f);
+    CHECK_CLOSE(fit.min.y / texelSize, std::round(fit.min.y / texelSize), 1e-3f);
+    CHECK(fit.min.z == -20.0f && fit.max.z == -1.0f);
+}
+
+// Every cascade count, split scheme and fit mode, for both clip space depth conventions
+TEST_CASE("Cascades cover the view frustum in every configuration")
+{
+    uint32_t configurations = 0;
+    for (const CascadeView& view : CASCADE_VIEWS) {
+        for (uint32_t numCascades = 1; numCascades <= bae::MAX_SHADOW_CASCADES; ++numCascades) {
+            for (const bae::CascadeSplitScheme scheme : SPLIT_SCHEMES) {
+                for (int stabilize = 0; stabilize < 2; ++stabilize) {
+                    for (int homogeneousDepth = 0; homogeneousDepth < 2; ++homogeneousDepth) {
+                        const bae::CascadeCoverage coverage = checkConfiguration(view, numCascades, scheme, stabilize != 0, homogeneousDepth != 0);
+                        CHECK(coverage.contiguous);
+                        CHECK(coverage.uncoveredCascades == 0);
+                        ++configurations;
+                    }
+                }
+            }
+        }
+    }
+    CHECK(configurations == 4 * 8 * 3 * 2 * 2);
+}
+
+TEST_CASE("Cascade coverage catches gaps and uncovered slices")
+{
+    const CascadeView& view = CASCADE_VIEWS[0];
+    const glm::mat4 invViewProj = glm::inverse(
+        glm::perspectiveRH_ZO(glm::radians(60.0f), 16.0f / 9.0f, NEAR_PLANE, FAR_PLANE) * glm::lookAt(view.eye, view.target, glm::vec3{ 0.0f, 1.0f, 0.0f }));
+
+    glm::vec2 splits[2] = { { NEAR_PLANE, 10.0f }, { 12.0f, 40.0f } };
+    // A projection that covers everything, and one that only covers a sliver around the origin
+    const glm::mat4 everything = glm::orthoLH_ZO(-1000.0f, 1000.0f, -1000.0f, 1000.0f, 1000.0f, -1000.0f);
+    const glm::mat4 sliver = glm::orthoLH_ZO(-0.1f, 0.1f, -0.1f, 0.1f, 1000.0f, -1000.0f);
+
+    glm::mat4 lightViewProjs[2] = { everything, everything };
+    bae::CascadeCoverage coverage = bae::validateCascadeCoverage(invViewProj, 0.0f, NEAR_PLANE, FAR_PLANE, NEAR_PLANE, 40.0f, splits, lightViewProjs, 2);
+    CHECK(!coverage.contiguous);
+    CHECK(coverage.uncoveredCascades == 0);
+
+    splits[1].x = 10.0f;
+    lightViewProjs[1] = sliver;
+    coverage = bae::validateCascadeCoverage(invViewProj, 0.0f, NEAR_PLANE, FAR_PLANE, NEAR_PLANE, 40.0f, splits, lightViewProjs, 2);
+    CHECK(coverage.contiguous);
+    CHECK(coverage.uncoveredCascades == 2);
+    CHECK(!coverage.isValid());
+}
@@ -0,0 +1,59 @@
+#include "test.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace bae
+{
+    namespace test
+    {
+        static TestCase* s_first = nullptr;
+        static TestCase* s_last = nullptr;
+        static uint32_t s_failures = 0;
+
+        TestRegistrar::TestRegistrar(TestCase& testCase)
+        {
+            // Appended, so tests within a file run in the order they're written
+            if (s_last != nullptr) {
+                s_last->next = &testCase;
+            }
+            else {
+                s_first = &testCase;
+            }
+            s_last = &testCase;
+        }
+
+        bool fail(const char* file, const int line, const char* expression)
+        {
+            fprintf(stderr, "%s(%d): failed: %s\n", file, line, expression);
+            ++s_failures;
+            return false;
+        }
+    }
+}
+
+// Usage: bae-test [filter], where only the test cases with filter in their name are run
+int main(int argc, const char* argv[])
+{
+    using namespace bae::test;
+
+    const char* filter = argc > 1 ? argv[1] : "";
+    uint32_t testCount = 0;
+    uint32_t failedCount = 0;
+    for (TestCase* testCase = s_first; testCase != nullptr; testCase = testCase->next) {
+        if (strstr(testCase->name, filter) == nullptr) {
+            continue;
+        }
+
+        const uint32_t failuresBefore = s_failures;
+        testCase->function();
+        ++testCount;
+        if (s_failures != failuresBefore) {
+            fprintf(stderr, "FAILED: %s\n", testCase->name);
+            ++failedCount;
+        }
+    }
+
+    printf("%u of %u test cases passed\n", testCount - failedCount, testCount);
+    return failedCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+// Just enough of a test runner to check bae's CPU side logic without a GPU or a window. Tests register
+// themselves with TEST_CASE, and the runner in test.cpp runs every one whose name contains its first argument.
+//
+//   TEST_CASE("Octahedral normals round trip")
+//   {
+//       REQUIRE(...);   // stops the test case on failure
+//       CHECK(...);     // carries on
+//   }
+namespace bae
+{
+    namespace test
+    {
+        struct TestCase
+        {
+            const char* name;
+            void (*function)();
+            TestCase* next;
+        };
+
+        struct TestRegistrar
+        {
+            TestRegistrar(TestCase& testCase);
+        };
+
+        // Returns false, so the macros below can be used as conditions
+        bool fail(const char* file, const int line, const char* expression);
+
+        inline bool isClose(const double a, const double b, const double epsilon)
+        {
+            return std::abs(a - b) <= epsilon;
+        }
+    }
+}
+
+#define BAE_TEST_CONCAT_(a, b) a##b
+#define BAE_TEST_CONCAT(a, b) BAE_TEST_CONCAT_(a, b)
+
+#define BAE_TEST_CASE_(name, function)                                                      \
+    static void function();                                                                 \
+    static bae::test::TestCase BAE_TEST_CONCAT(function, _case) = { name, function, nullptr }; \
+    static bae::test::TestRegistrar BAE_TEST_CONCAT(function, _registrar)(BAE_TEST_CONCAT(function, _case)); \
+    static void function()
+
+#define TEST_CASE(name) BAE_TEST_CASE_(name, BAE_TEST_CONCAT(testCase, __LINE__))
+
+#define CHECK(expression) ((expression) || bae::test::fail(__FILE__, __LINE__, #expression))
+#define REQUIRE(expression)                                          \
+    do {                                                             \
+        if (!(expression)) {                                         \
+            bae::test::fail(__FILE__, __LINE__, #expression);        \
+            return;                                                  \
+        }                                                            \
+    } while (false)
+
+#define CHECK_CLOSE(a, b, epsilon) CHECK(bae::test::isClose(double(a), double(b), double(epsilon)))
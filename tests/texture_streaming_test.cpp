@@ -0,0 +1,125 @@
+#include "test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <bgfx/bgfx.h>
+
+#include "TextureStreaming.h"
+
+namespace
+{
+    constexpr const char* TEXTURE_PATH = "texture_streaming_test.dds";
+
+    // Uncompressed BGRA8 DDS with a full mip chain, the simplest file the streamer's decoder reads
+    void writeMippedDds(const char* path, const uint32_t size, const uint32_t mipCount)
+    {
+        uint32_t header[32] = {};
+        header[0] = 0x20534444;                 // "DDS "
+        header[1] = 124;
+        header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;   // caps, height, width, pixel format, mip count
+        header[3] = size;
+        header[4] = size;
+        header[7] = mipCount;
+        header[19] = 32;
+        header[20] = 0x40 | 0x1;                // RGB with alpha
+        header[22] = 32;
+        header[23] = 0x00ff0000;
+        header[24] = 0x0000ff00;
+        header[25] = 0x000000ff;
+        header[26] = 0xff000000;
+        header[27] = 0x1000 | 0x8 | 0x400000;   // texture, complex, mipmap
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (uint32_t mip = 0; mip < mipCount; ++mip) {
+            const uint32_t side = std::max(size >> mip, 1u);
+            const std::vector<uint32_t> texels(side * side, 0xff000000u | (mip * 0x404040u));
+            file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(uint32_t));
+        }
+    }
+
+    bae::TextureStreamingParams makeParams()
+    {
+        bae::TextureStreamingParams params;
+        params.tailSize = 4;
+        params.maxSwapsPerUpdate = 4;
+        params.maxLoadsInFlight = 4;
+        return params;
+    }
+}
+
+// The budget shrinks while a texture's finer mips are being decoded, and the texture isn't visible anymore by the
+// time they land, so it's the first thing to evict. It must not be recreated twice in one update, and whatever
+// swaps a material missed, it has to end up on the texture's live handle.
+TEST_CASE("Textures streamed in are not evicted in the same update, and swaps lead to the live handle")
+{
+    writeMippedDds(TEXTURE_PATH, 16, 5);
+    bgfx::Init init;
+    init.type = bgfx::RendererType::Noop;
+    REQUIRE(bgfx::init(init));
+
+    bae::TextureStreamingParams params = makeParams();
+    bae::TextureStreamer streamer;
+    streamer.init(params);
+    const bgfx::TextureHandle original = streamer.add(TEXTURE_PATH, BGFX_TEXTURE_NONE | BGFX_SAMPLER_NONE);
+    REQUIRE(bgfx::isValid(original));
+    REQUIRE(streamer.getInfo(0).tailMip == 2);
+    const uint32_t tailBytes = streamer.getInfo(0).residentBytes;
+
+    // One copy of the material gets each update's swaps, the other only sees them all at the end, from the one
+    // list every update appended to
+    std::vector<bae::PBRMaterial> everyUpdate(1);
+    std::vector<bae::PBRMaterial> atTheEnd(1);
+    everyUpdate[0].baseColorTexture = original;
+    atTheEnd[0].baseColorTexture = original;
+    std::vector<bae::TextureSwap> swaps;
+    std::vector<bae::TextureSwap> newSwaps;
+
+    uint32_t frame = 0;
+    streamer.request(original, 0.0f, frame);
+    streamer.update(frame, 0, swaps);
+    REQUIRE(streamer.getStats().loading == 1);
+
+    params.budgetBytes = tailBytes;
+    streamer.setParams(params);
+
+    bool streamedIn = false;
+    bool streamedOut = false;
+    for (uint32_t attempt = 0; attempt < 2000 && !streamedOut; ++attempt) {
+        const size_t firstNewSwap = swaps.size();
+        streamer.update(++frame, 0, swaps);
+        newSwaps.assign(swaps.begin() + firstNewSwap, swaps.end());
+        bae::applyTextureSwaps(newSwaps, everyUpdate);
+        CHECK(everyUpdate[0].baseColorTexture.idx == streamer.getHandle(0).idx);
+
+        const bae::TextureStreamingStats& stats = streamer.getStats();
+        if (stats.streamedIn > 0) {
+            streamedIn = true;
+            CHECK(streamer.getInfo(0).residentMip == 0);
+            CHECK(stats.streamedOut == 0);
+        }
+        else if (stats.streamedOut > 0) {
+            streamedOut = true;
+        }
+        bgfx::frame();
+        if (!streamedIn) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    CHECK(streamedIn);
+    CHECK(streamedOut);
+    CHECK(streamer.getInfo(0).residentMip == 2);
+    CHECK(streamer.getStats().residentBytes == tailBytes);
+
+    bae::applyTextureSwaps(swaps, atTheEnd);
+    CHECK(atTheEnd[0].baseColorTexture.idx == streamer.getHandle(0).idx);
+
+    streamer.destroy();
+    bgfx::shutdown();
+    std::remove(TEXTURE_PATH);
+}
@@ -0,0 +1,83 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "VirtualPageTable.h"
+
+namespace
+{
+    constexpr uint32_t FEEDBACK_WIDTH = 160;
+    constexpr uint32_t FEEDBACK_HEIGHT = 90;
+    constexpr uint32_t TEXTURE_COUNT = 4;
+
+    // A feedback buffer like a floor seen in perspective gives: each quarter of the screen samples its own texture,
+    // fine mips at the bottom of the screen, coarser ones towards the horizon, and sky at the top.
+    std::vector<uint32_t> makeFeedback(const bae::VirtualPageTable& table, const uint32_t frame)
+    {
+        std::vector<uint32_t> feedback(FEEDBACK_WIDTH * FEEDBACK_HEIGHT, 0xffffffffu);
+        for (uint32_t y = FEEDBACK_HEIGHT / 3; y < FEEDBACK_HEIGHT; ++y) {
+            const float distance = float(FEEDBACK_HEIGHT) / float(y - FEEDBACK_HEIGHT / 3 + 1);
+            for (uint32_t x = 0; x < FEEDBACK_WIDTH; ++x) {
+                bae::VirtualPage page;
+                page.texture = uint8_t(x * TEXTURE_COUNT / FEEDBACK_WIDTH);
+                const uint32_t mipCount = table.getMipCount(page.texture);
+                page.mip = uint8_t(std::min(uint32_t(distance), mipCount - 1));
+                // The camera drifts sideways a little every frame
+                const float u = float((x + frame) % FEEDBACK_WIDTH) / float(FEEDBACK_WIDTH);
+                const float v = float(y) / float(FEEDBACK_HEIGHT);
+                page.x = uint16_t(u * table.getPagesX(page.texture, page.mip));
+                page.y = uint16_t(v * table.getPagesY(page.texture, page.mip));
+                feedback[y * FEEDBACK_WIDTH + x] = page.pack();
+            }
+        }
+        return feedback;
+    }
+}
+
+BENCHMARK("Virtual page table")
+{
+    bae::VirtualPageTableParams params;
+    params.maxUploadsPerUpdate = 64;
+    bae::VirtualPageTable table;
+    table.init(params);
+    for (uint32_t i = 0; i < TEXTURE_COUNT; ++i) {
+        table.addTexture(8192, 8192);
+    }
+
+    const uint32_t frameCount = 64;
+    std::vector<std::vector<uint32_t>> feedbacks;
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        feedbacks.push_back(makeFeedback(table, frame));
+    }
+
+    // Warm the cache up so the measured frames are mostly hits, like a camera that's settled
+    std::vector<bae::PageUpload> uploads;
+    uint32_t frame = 0;
+    for (; frame < 4 * frameCount; ++frame) {
+        const std::vector<uint32_t>& feedback = feedbacks[frame % frameCount];
+        table.request(feedback.data(), feedback.size());
+        table.update(frame, uploads);
+    }
+
+    bae::bench::run("request + update, 160x90 feedback", [&]() {
+        const std::vector<uint32_t>& feedback = feedbacks[frame % frameCount];
+        uploads.clear();
+        table.request(feedback.data(), feedback.size());
+        table.update(frame++, uploads);
+        bae::bench::doNotOptimize(uploads.size());
+    }, FEEDBACK_WIDTH * FEEDBACK_HEIGHT);
+
+    std::vector<bae::IndirectionEntry> entries(table.getPagesX(0, 0) * table.getPagesY(0, 0));
+    bae::bench::run("writeIndirection, 64x64 pages", [&]() {
+        table.writeIndirection(0, 0, entries.data());
+        bae::bench::doNotOptimize(entries[0]);
+    }, entries.size());
+
+    bae::VirtualPage page;
+    page.texture = 1;
+    bae::bench::run("VirtualPage pack + unpack", [&]() {
+        page = bae::VirtualPage::unpack(page.pack() + 1);
+        bae::bench::doNotOptimize(page);
+    });
+}
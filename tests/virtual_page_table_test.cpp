@@ -0,0 +1,282 @@
+#include "test.h"
+
+#include <vector>
+
+#include "VirtualPageTable.h"
+
+namespace
+{
+    bae::VirtualPage makePage(const uint8_t texture, const uint8_t mip, const uint16_t x, const uint16_t y)
+    {
+        bae::VirtualPage page;
+        page.texture = texture;
+        page.mip = mip;
+        page.x = x;
+        page.y = y;
+        return page;
+    }
+
+    bool isSamePage(const bae::VirtualPage& a, const bae::VirtualPage& b)
+    {
+        return a.texture == b.texture && a.mip == b.mip && a.x == b.x && a.y == b.y;
+    }
+
+    bae::VirtualPageTableParams makeParams(const uint16_t cacheWidth, const uint16_t cacheHeight, const uint32_t maxUploadsPerUpdate)
+    {
+        bae::VirtualPageTableParams params;
+        params.pageSize = 16;
+        params.pageBorder = 1;
+        params.cacheWidth = cacheWidth;
+        params.cacheHeight = cacheHeight;
+        params.maxUploadsPerUpdate = maxUploadsPerUpdate;
+        return params;
+    }
+}
+
+TEST_CASE("Virtual pages round trip through the feedback encoding")
+{
+    const uint16_t coordinates[] = { 0, 1, 255, 256, 511, 768, 1023 };
+    for (uint8_t mip = 0; mip < bae::VirtualPage::MAX_MIPS; ++mip) {
+        for (const uint16_t x : coordinates) {
+            for (const uint16_t y : coordinates) {
+                const bae::VirtualPage page = makePage(uint8_t(mip * 7), mip, x, y);
+                CHECK(isSamePage(bae::VirtualPage::unpack(page.pack()), page));
+            }
+        }
+    }
+
+    // What the feedback pass clears its target to, and what request skips
+    const bae::VirtualPage nothing = bae::VirtualPage::unpack(0xffffffffu);
+    CHECK(nothing.texture == bae::VirtualPage::NO_TEXTURE);
+    CHECK((bae::VirtualPage{}.pack() >> 24) == bae::VirtualPage::NO_TEXTURE);
+}
+
+TEST_CASE("Textures get mips down to a single page")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(4, 4, 16));
+    const uint8_t square = table.addTexture(128, 128);
+    const uint8_t wide = table.addTexture(256, 32);
+
+    CHECK(table.getMipCount(square) == 4);
+    CHECK(table.getPagesX(square, 3) == 1 && table.getPagesY(square, 3) == 1);
+    // Wide textures stop halving vertically once they're a single row of pages
+    CHECK(table.getMipCount(wide) == 5);
+    CHECK(table.getPagesX(wide, 1) == 8 && table.getPagesY(wide, 1) == 1);
+    CHECK(table.getPagesX(wide, 4) == 1 && table.getPagesY(wide, 4) == 1);
+}
+
+TEST_CASE("The coarsest mip is uploaded first and never evicted")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(2, 1, 16));
+    const uint8_t texture = table.addTexture(64, 64);
+    const bae::VirtualPage coarsest = makePage(texture, 2, 0, 0);
+
+    // Nothing requested, the coarsest page still comes in
+    std::vector<bae::PageUpload> uploads;
+    table.update(1, uploads);
+    REQUIRE(uploads.size() == 1);
+    CHECK(isSamePage(uploads[0].page, coarsest));
+    CHECK(table.isResident(coarsest));
+
+    // With a single slot left for everything else, finer pages keep replacing each other but never the coarsest
+    for (uint32_t frame = 2; frame < 10; ++frame) {
+        uploads.clear();
+        table.request(makePage(texture, 0, uint16_t(frame % 4), 0));
+        table.update(frame, uploads);
+        REQUIRE(uploads.size() == 1);
+        CHECK(uploads[0].evicted.texture == bae::VirtualPage::NO_TEXTURE || uploads[0].evicted.mip == 0);
+        CHECK(table.isResident(coarsest));
+    }
+    CHECK(table.getStats().residentPages == 2);
+}
+
+TEST_CASE("The least recently used page is evicted first")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(4, 1, 16));
+    const uint8_t texture = table.addTexture(64, 64);
+    std::vector<bae::PageUpload> uploads;
+    table.update(0, uploads);
+
+    // Fill the other three slots on separate frames, A oldest
+    const bae::VirtualPage pageA = makePage(texture, 0, 0, 0);
+    const bae::VirtualPage pageB = makePage(texture, 0, 1, 0);
+    const bae::VirtualPage pageC = makePage(texture, 0, 2, 0);
+    const bae::VirtualPage pages[] = { pageA, pageB, pageC };
+    uint32_t frame = 1;
+    for (const bae::VirtualPage& page : pages) {
+        table.request(page);
+        table.update(frame++, uploads);
+    }
+    CHECK(table.getStats().residentPages == 4);
+
+    // Using A again makes B the oldest
+    uploads.clear();
+    table.request(pageA);
+    table.update(frame++, uploads);
+    CHECK(uploads.empty());
+    CHECK(table.getStats().hits == 1);
+
+    uploads.clear();
+    table.request(makePage(texture, 0, 3, 0));
+    table.update(frame++, uploads);
+    REQUIRE(uploads.size() == 1);
+    CHECK(isSamePage(uploads[0].evicted, pageB));
+    CHECK(!table.isResident(pageB));
+
+    uploads.clear();
+    table.request(makePage(texture, 0, 0, 1));
+    table.update(frame++, uploads);
+    REQUIRE(uploads.size() == 1);
+    CHECK(isSamePage(uploads[0].evicted, pageC));
+    // The new page reuses the slot of the one it evicted
+    CHECK(table.isResident(pageA));
+    CHECK(table.getStats().evictions == 1);
+}
+
+TEST_CASE("Pages used this frame are not evicted")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(3, 1, 16));
+    const uint8_t texture = table.addTexture(64, 64);
+    std::vector<bae::PageUpload> uploads;
+    table.request(makePage(texture, 0, 0, 0));
+    table.request(makePage(texture, 0, 1, 0));
+    table.update(1, uploads);
+    CHECK(uploads.size() == 3);
+
+    // Both resident pages are in use, so the new one has to wait
+    uploads.clear();
+    table.request(makePage(texture, 0, 0, 0));
+    table.request(makePage(texture, 0, 1, 0));
+    table.request(makePage(texture, 0, 2, 0));
+    table.update(2, uploads);
+    CHECK(uploads.empty());
+    CHECK(table.getStats().deferred == 1);
+    CHECK(table.getStats().evictions == 0);
+}
+
+TEST_CASE("Uploads past the budget are deferred, coarse pages first")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(8, 8, 3));
+    const uint8_t texture = table.addTexture(64, 64);
+
+    // Requested in the order a feedback buffer might have them, finest first
+    table.request(makePage(texture, 0, 3, 3));
+    table.request(makePage(texture, 0, 0, 0));
+    table.request(makePage(texture, 1, 1, 1));
+    table.request(makePage(texture, 0, 2, 1));
+
+    std::vector<bae::PageUpload> uploads;
+    table.update(1, uploads);
+    REQUIRE(uploads.size() == 3);
+    CHECK(uploads[0].page.mip == 2);
+    CHECK(uploads[1].page.mip == 1);
+    CHECK(uploads[2].page.mip == 0);
+    CHECK(table.getStats().misses == 5);
+    CHECK(table.getStats().deferred == 2);
+
+    // Deferred pages aren't remembered, they come back with the next frame's feedback
+    uploads.clear();
+    table.update(2, uploads);
+    CHECK(uploads.empty());
+
+    table.request(makePage(texture, 0, 3, 3));
+    table.request(makePage(texture, 0, 0, 0));
+    table.request(makePage(texture, 0, 2, 1));
+    table.update(3, uploads);
+    CHECK(uploads.size() == 2);
+    CHECK(table.getStats().hits == 1);
+    CHECK(table.getStats().deferred == 0);
+}
+
+TEST_CASE("Lookups fall back to the closest resident ancestor")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(8, 8, 16));
+    const uint8_t texture = table.addTexture(128, 128);
+    const uint8_t wide = table.addTexture(256, 32);
+
+    // Nothing resident yet
+    CHECK(table.lookup(makePage(texture, 0, 5, 6)).valid == 0);
+
+    std::vector<bae::PageUpload> uploads;
+    table.request(makePage(texture, 1, 2, 3));
+    table.update(1, uploads);
+
+    // Under the resident mip 1 page, a mip 0 page finds it
+    const bae::IndirectionEntry direct = table.lookup(makePage(texture, 1, 2, 3));
+    const bae::IndirectionEntry child = table.lookup(makePage(texture, 0, 5, 6));
+    CHECK(direct.valid != 0 && direct.mip == 1);
+    CHECK(child.valid != 0 && child.mip == 1);
+    CHECK(child.x == direct.x && child.y == direct.y);
+
+    // Elsewhere it walks all the way to the coarsest page, skipping the missing mip 2
+    const bae::IndirectionEntry coarsest = table.lookup(makePage(texture, 3, 0, 0));
+    const bae::IndirectionEntry fallback = table.lookup(makePage(texture, 0, 0, 0));
+    CHECK(fallback.valid != 0 && fallback.mip == 3);
+    CHECK(fallback.x == coarsest.x && fallback.y == coarsest.y);
+
+    // The walk stays in bounds when a side stops halving
+    uploads.clear();
+    table.request(makePage(wide, 2, 3, 0));
+    table.update(2, uploads);
+    const bae::IndirectionEntry wideEntry = table.lookup(makePage(wide, 0, 15, 1));
+    CHECK(wideEntry.valid != 0 && wideEntry.mip == 2);
+
+    // The indirection table of a mip is the lookup of each of its pages
+    std::vector<bae::IndirectionEntry> entries(table.getPagesX(texture, 0) * table.getPagesY(texture, 0));
+    table.writeIndirection(texture, 0, entries.data());
+    CHECK(entries[6 * 8 + 5].mip == 1);
+    CHECK(entries[0].mip == 3);
+    CHECK(table.takeDirty(texture));
+    CHECK(!table.takeDirty(texture));
+}
+
+TEST_CASE("Feedback skips texels without a texture and out of range pages")
+{
+    bae::VirtualPageTable table;
+    table.init(makeParams(8, 8, 16));
+    const uint8_t texture = table.addTexture(64, 64);
+
+    const uint32_t feedback[] = {
+        0xffffffffu,
+        makePage(texture, 0, 1, 1).pack(),
+        makePage(texture, 0, 1, 1).pack(),
+        makePage(texture, 0, 9, 0).pack(),
+        makePage(texture, 5, 0, 0).pack(),
+        makePage(7, 0, 0, 0).pack(),
+    };
+    std::vector<bae::PageUpload> uploads;
+    table.request(feedback, sizeof(feedback) / sizeof(feedback[0]));
+    table.update(1, uploads);
+
+    CHECK(table.getStats().requests == 5);
+    // The page asked for twice, plus the coarsest page
+    CHECK(table.getStats().uniquePages == 2);
+    CHECK(uploads.size() == 2);
+}
+
+TEST_CASE("Extracted pages repeat edge texels into their borders")
+{
+    // 4x4 mip where each texel holds its own coordinates
+    uint32_t mip[16];
+    for (uint32_t y = 0; y < 4; ++y) {
+        for (uint32_t x = 0; x < 4; ++x) {
+            mip[y * 4 + x] = (y << 8) | x;
+        }
+    }
+
+    // Bottom right 2x2 page with a border of 1
+    uint32_t page[16];
+    bae::extractPage(mip, 4, 4, 1, 1, 2, 1, page);
+    CHECK(page[0] == ((1u << 8) | 1u));
+    CHECK(page[1 * 4 + 1] == ((2u << 8) | 2u));
+    CHECK(page[2 * 4 + 2] == ((3u << 8) | 3u));
+    // Past the image's edge
+    CHECK(page[3 * 4 + 3] == ((3u << 8) | 3u));
+    CHECK(page[1 * 4 + 3] == ((2u << 8) | 3u));
+}